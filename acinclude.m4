@@ -268,6 +268,93 @@ AC_DEFUN([OFP_CHECK_IF_PACKET],
                 [Define to 1 if net/if_packet.h is available.])
    fi])
 
+dnl Checks for AF_XDP sockets and for the BPF interfaces used to attach an
+dnl XDP program to a device (BPF_LINK_CREATE, Linux 5.9 and later).
+AC_DEFUN([OFP_CHECK_AF_XDP],
+  [AC_CACHE_CHECK([for AF_XDP support], [ofp_cv_af_xdp],
+     [AC_COMPILE_IFELSE(
+        [AC_LANG_PROGRAM([[#include <sys/socket.h>
+#include <linux/bpf.h>
+#include <linux/if_xdp.h>]],
+                         [[struct sockaddr_xdp sxdp;
+union bpf_attr attr;
+sxdp.sxdp_flags = XDP_COPY;
+attr.link_create.attach_type = BPF_XDP;
+return AF_XDP + BPF_LINK_CREATE;]])],
+        [ofp_cv_af_xdp=yes],
+        [ofp_cv_af_xdp=no])])
+   if test "$ofp_cv_af_xdp" = yes; then
+      AC_DEFINE([HAVE_AF_XDP], [1],
+                [Define to 1 if AF_XDP sockets can be used.])
+   fi])
+
+dnl Checks whether the compiler can build AVX2 code with -mavx2, for the test
+dnl of the AVX2 flow matcher.
+AC_DEFUN([OFP_CHECK_AVX2],
+  [AC_CACHE_CHECK([whether $CC accepts -mavx2], [ofp_cv_avx2],
+     [save_CFLAGS="$CFLAGS"
+      CFLAGS="$CFLAGS -mavx2"
+      AC_COMPILE_IFELSE(
+        [AC_LANG_PROGRAM([[#include <immintrin.h>]],
+                         [[__m256i x = _mm256_setzero_si256();
+return _mm256_testz_si256(x, x);]])],
+        [ofp_cv_avx2=yes],
+        [ofp_cv_avx2=no])
+      CFLAGS="$save_CFLAGS"])
+   AM_CONDITIONAL([HAVE_AVX2], [test "$ofp_cv_avx2" = yes])])
+
+dnl Checks for --disable-trace, which compiles the trace points of the
+dnl datapath out.  They are built in by default, turned off at run time.
+AC_DEFUN([OFP_CHECK_TRACE],
+  [AC_ARG_ENABLE(
+     [trace],
+     [AC_HELP_STRING([--disable-trace],
+                     [Compile out the datapath trace points])],
+     [case "${enableval}" in
+        (yes) trace=true ;;
+        (no)  trace=false ;;
+        (*) AC_MSG_ERROR([bad value ${enableval} for --enable-trace]) ;;
+      esac],
+     [trace=true])
+   if test "$trace" = true; then
+      AC_DEFINE([HAVE_TRACE], [1],
+                [Define to 1 to build the trace points in.])
+   fi])
+
+dnl Checks for --enable-nbee.  By default the NetBee packet decoder is built
+dnl in when libnbee is found; the datapath falls back to its native parser
+dnl otherwise.
+AC_DEFUN([OFP_CHECK_NBEE],
+  [AC_ARG_ENABLE(
+     [nbee],
+     [AC_HELP_STRING([--enable-nbee],
+                     [Build the NetBee packet decoder (requires libnbee)])],
+     [case "${enableval}" in
+        (yes) nbee=yes ;;
+        (no)  nbee=no ;;
+        (*) AC_MSG_ERROR([bad value ${enableval} for --enable-nbee]) ;;
+      esac],
+     [nbee=check])
+   HAVE_NBEE=no
+   if test "$nbee" != no; then
+      AC_LANG_PUSH([C++])
+      AC_CHECK_HEADER([nbee.h], [have_nbee_h=yes], [have_nbee_h=no])
+      AC_LANG_POP([C++])
+      if test "$have_nbee_h" = yes; then
+         AC_CHECK_LIB([nbee], [nbGetLastError], [HAVE_NBEE=yes])
+      fi
+      if test "$nbee" = yes && test "$HAVE_NBEE" = no; then
+         AC_MSG_ERROR([--enable-nbee specified but libnbee was not found])
+      fi
+   fi
+   AM_CONDITIONAL([HAVE_NBEE], [test "$HAVE_NBEE" = yes])
+   if test "$HAVE_NBEE" = yes; then
+      NBEE_LIBS=-lnbee
+      AC_DEFINE([HAVE_NBEE], [1],
+                [Define to 1 if the NetBee packet decoder is available.])
+   fi
+   AC_SUBST([NBEE_LIBS])])
+
 dnl Checks for dpkg-buildpackage.  If this is available then we check
 dnl that the Debian packaging is functional at "make distcheck" time.
 AC_DEFUN([OFP_CHECK_DPKG_BUILDPACKAGE],
@@ -70,8 +70,12 @@ lib_libopenflow_a_SOURCES = \
 	lib/svec.h \
 	lib/tag.c \
 	lib/tag.h \
+	lib/timer-wheel.c \
+	lib/timer-wheel.h \
 	lib/timeval.c \
 	lib/timeval.h \
+	lib/trace.c \
+	lib/trace.h \
 	lib/type-props.h \
 	lib/util.c \
 	lib/util.h \
@@ -88,6 +92,8 @@ lib_libopenflow_a_SOURCES = \
 	lib/vlog-socket.h \
 	lib/vlog.c \
 	lib/vlog.h \
+	lib/xsk.c \
+	lib/xsk.h \
 	lib/xtoxll.h
 
 lib_libopenflow_a_LIBADD = oflib/ofl-actions.o \
@@ -40,6 +40,9 @@
 #define PRINTF_FORMAT(FMT, ARG1) __attribute__((__format__(printf, FMT, ARG1)))
 #define STRFTIME_FORMAT(FMT) __attribute__((__format__(__strftime__, FMT, 0)))
 #define MALLOC_LIKE __attribute__((__malloc__))
+#define CACHE_LINE_SIZE 64
+#define CACHE_ALIGNED __attribute__((__aligned__(CACHE_LINE_SIZE)))
+#define THREAD_LOCAL __thread
 #define likely(x) __builtin_expect((x),1)
 #define unlikely(x) __builtin_expect((x),0)
 
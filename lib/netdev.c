@@ -79,6 +79,10 @@
 #define HAVE_PACKET_AUXDATA
 #endif
 
+#if defined(TPACKET3_HDRLEN) && defined(PACKET_TX_RING)
+#define HAVE_PACKET_RING
+#endif
+
 /* Fix for some compile issues we were experiencing when setting up openwrt
  * with the 2.4 kernel. linux/ethtool.h seems to use kernel-style inttypes,
  * which breaks in userspace.
@@ -100,6 +104,7 @@
 #include <linux/version.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <net/ethernet.h>
 #include <net/if.h>
@@ -119,6 +124,7 @@
 #include "poll-loop.h"
 #include "socket-util.h"
 #include "svec.h"
+#include "xsk.h"
 
 /* linux/if.h defines IFF_LOWER_UP, net/if.h doesn't.
  * net/if.h defines if_nameindex(), linux/if.h doesn't.
@@ -141,12 +147,21 @@ struct netdev
     int tap_fd;    /* TAP character device, if any, otherwise the
                                  * network device. */
 
-    int netlink_fd;
+    /* Link state, as last reported by the kernel, and whether the kernel
+     * reported on the link since the last netdev_link_state(). */
+    bool link_up;
+    bool link_reported;
 
     /* one socket per queue.These are valid only for ordinary network devices*/
     int queue_fd[NETDEV_MAX_QUEUES + 1];
     uint16_t num_queues;
 
+    /* Receive sockets in the PACKET_FANOUT group set up with
+     * netdev_enable_fanout().  fanout_fd[0] is 'netdev_fd', the only one
+     * without fanout. */
+    int fanout_fd[NETDEV_MAX_FANOUT];
+    int n_fanout;
+
     /* Cached network device information. */
     int ifindex;
     uint8_t etheraddr[ETH_ADDR_LEN];
@@ -165,6 +180,40 @@ struct netdev
 
     int save_flags;    /* Initial device flags. */
     int changed_flags; /* Flags that we changed. */
+
+    /* PACKET_MMAP rings, if set up with netdev_enable_rings(). */
+    struct netdev_rx_ring *rx_ring;
+    struct netdev_tx_ring *tx_ring;
+
+    /* AF_XDP socket, if set up with netdev_enable_xdp(). */
+    struct xsk *xsk;
+};
+
+/* A TPACKET_V3 receive ring, mapped from 'netdev_fd'.  The kernel fills whole
+ * blocks of packets, which are handed back to it once consumed. */
+struct netdev_rx_ring
+{
+    uint8_t *map;           /* Mapped blocks. */
+    size_t map_size;
+    size_t block_size;
+    unsigned int n_blocks;
+    unsigned int block;     /* Block being consumed. */
+    unsigned int n_left;    /* Packets of 'block' not yet received. */
+    uint8_t *next;          /* Next packet of 'block'. */
+    bool release;           /* Hand 'block' back on the next receive. */
+};
+
+/* A TPACKET_V2 transmit ring on a socket of its own.  Frames are queued with
+ * netdev_send() and handed to the kernel in bursts by netdev_send_flush(). */
+struct netdev_tx_ring
+{
+    int fd;
+    uint8_t *map;           /* Mapped frames. */
+    size_t map_size;
+    size_t frame_size;
+    unsigned int n_frames;
+    unsigned int frame;     /* Next frame to fill. */
+    unsigned int n_pending; /* Frames filled since the last kick. */
 };
 
 /* All open network devices. */
@@ -173,11 +222,18 @@ static struct list netdev_list = LIST_INITIALIZER(&netdev_list);
 /* An AF_INET socket (used for ioctl operations). */
 static int af_inet_sock = -1;
 
+/* An rtnetlink socket subscribed to link changes of all devices, and a
+ * counter of the changes seen in open network devices. */
+static int rtnl_sock = -1;
+static unsigned int change_seq;
+
 /* This is set pretty low because we probably won't learn anything from the
  * additional log messages. */
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 20);
 
 static void init_netdev(void);
+static void open_rtnl_sock(void);
+static void free_rings(struct netdev *netdev);
 static int do_open_netdev(const char *name, int ethertype, int tap_fd,
                           struct netdev **netdev_);
 static int restore_flags(struct netdev *netdev);
@@ -778,9 +834,7 @@ do_open_netdev(const char *name, int ethertype, int tap_fd,
                struct netdev **netdev_)
 {
     int netdev_fd;
-    int netlink_fd;
     struct sockaddr_ll sll;
-    struct sockaddr_nl snl;
     struct ifreq ifr;
     unsigned int ifindex;
     uint8_t etheraddr[ETH_ADDR_LEN];
@@ -795,20 +849,6 @@ do_open_netdev(const char *name, int ethertype, int tap_fd,
     *netdev_ = NULL;
     netdev_fd = -1;
 
-    netlink_fd = socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
-
-    if (netlink_fd < 0)
-    {
-        return errno;
-    }
-
-    /* Set non-blocking mode. */
-    error = set_nonblocking(netlink_fd);
-    if (error)
-    {
-        goto error_already_set;
-    }
-
     /* Create raw socket. */
     netdev_fd = socket(PF_PACKET, SOCK_RAW,
                        htons(ethertype == NETDEV_ETH_TYPE_NONE ? 0
@@ -838,15 +878,6 @@ do_open_netdev(const char *name, int ethertype, int tap_fd,
         goto error_already_set;
     }
 
-    memset(&snl, 0, sizeof(snl));
-    snl.nl_family = AF_NETLINK;
-    snl.nl_groups = RTMGRP_LINK;
-
-    if (bind(netlink_fd, (struct sockaddr *)&snl, sizeof(snl)) < 0)
-    {
-        VLOG_ERR(LOG_MODULE, "netlink bind to %s failed: %s", name, strerror(errno));
-        goto error;
-    }
     /* Get ethernet device index. */
     strncpy(ifr.ifr_name, name, sizeof ifr.ifr_name);
     if (ioctl(netdev_fd, SIOCGIFINDEX, &ifr) < 0)
@@ -922,13 +953,17 @@ do_open_netdev(const char *name, int ethertype, int tap_fd,
     netdev->txqlen = txqlen;
     netdev->hwaddr_family = hwaddr_family;
     netdev->netdev_fd = netdev_fd;
-    netdev->netlink_fd = netlink_fd;
     netdev->tap_fd = tap_fd < 0 ? netdev_fd : tap_fd;
     netdev->queue_fd[0] = netdev->tap_fd;
+    netdev->fanout_fd[0] = netdev_fd;
+    netdev->n_fanout = 1;
     memcpy(netdev->etheraddr, etheraddr, sizeof etheraddr);
     netdev->mtu = mtu;
     netdev->in6 = in6;
     netdev->num_queues = 0;
+    netdev->rx_ring = NULL;
+    netdev->tx_ring = NULL;
+    netdev->xsk = NULL;
 
     /* Get speed, features. */
     do_ethtool(netdev);
@@ -940,9 +975,12 @@ do_open_netdev(const char *name, int ethertype, int tap_fd,
         goto error_already_set;
     }
     netdev->changed_flags = 0;
+    netdev->link_up = (netdev->save_flags & IFF_UP) != 0;
+    netdev->link_reported = false;
     fatal_signal_block();
     list_push_back(&netdev_list, &netdev->node);
     fatal_signal_unblock();
+    change_seq++;
 
     /* Success! */
     *netdev_ = netdev;
@@ -980,10 +1018,15 @@ void netdev_close(struct netdev *netdev)
         }
 
         /* Free. */
+        free_rings(netdev);
+        xsk_close(netdev->xsk);
+        change_seq++;
         free(netdev->name);
+        poll_fd_forget(netdev->netdev_fd);
         close(netdev->netdev_fd);
         if (netdev->netdev_fd != netdev->tap_fd)
         {
+            poll_fd_forget(netdev->tap_fd);
             close(netdev->tap_fd);
         }
 
@@ -991,6 +1034,11 @@ void netdev_close(struct netdev *netdev)
         {
             close(netdev->queue_fd[i]);
         }
+        for (i = 1; i < netdev->n_fanout; i++)
+        {
+            poll_fd_forget(netdev->fanout_fd[i]);
+            close(netdev->fanout_fd[i]);
+        }
         free(netdev);
     }
 }
@@ -1006,41 +1054,224 @@ pad_to_minimum_length(struct ofpbuf *buffer)
     }
 }
 
+/* Returns NETDEV_LINK_UP or NETDEV_LINK_DOWN, as the state of 'netdev', if
+ * the kernel reported on its link since the last call, as seen by
+ * netdev_run(), otherwise NETDEV_LINK_NO_CHANGE.  Every report counts, even
+ * one that leaves the link as it was, and resynchronizes the flags 'netdev'
+ * restores at close with the kernel's. */
 int netdev_link_state(struct netdev *netdev)
 {
-    int len;
-    char buff[4096];
-    struct nlmsghdr *nlm;
-    struct ifinfomsg *ifa;
     enum netdev_flags flags;
-    nlm = (struct nlmsghdr *)buff;
-    do
+
+    if (!netdev->link_reported)
+    {
+        return NETDEV_LINK_NO_CHANGE;
+    }
+    netdev->link_reported = false;
+    if (!netdev_get_flags(netdev, &flags))
+    {
+        netdev_set_flags(netdev, flags, false);
+    }
+    return netdev->link_up ? NETDEV_LINK_UP : NETDEV_LINK_DOWN;
+}
+
+/* Returns true if 'netdev' is up, as of the last netdev_run(). */
+bool netdev_is_link_up(const struct netdev *netdev)
+{
+    return netdev->link_up;
+}
+
+/* Returns the open network device with index 'ifindex', if any. */
+static struct netdev *
+netdev_from_ifindex(int ifindex)
+{
+    struct netdev *netdev;
+
+    LIST_FOR_EACH(netdev, struct netdev, node, &netdev_list)
+    {
+        if (netdev->ifindex == ifindex)
+        {
+            return netdev;
+        }
+    }
+    return NULL;
+}
+
+/* Updates 'netdev''s link state and MTU from a report of the kernel. */
+static void
+update_link(struct netdev *netdev, bool up, int mtu)
+{
+    netdev->link_up = up;
+    netdev->mtu = mtu;
+    netdev->link_reported = true;
+    change_seq++;
+}
+
+/* Reads the state of every open network device from the kernel, after
+ * link change notifications were lost. */
+static void
+refresh_links(void)
+{
+    struct netdev *netdev;
+
+    LIST_FOR_EACH(netdev, struct netdev, node, &netdev_list)
+    {
+        struct ifreq ifr;
+        int flags;
+
+        strncpy(ifr.ifr_name, netdev->name, sizeof ifr.ifr_name);
+        if (!get_flags(netdev->name, &flags)
+            && ioctl(af_inet_sock, SIOCGIFMTU, &ifr) == 0)
+        {
+            update_link(netdev, (flags & IFF_UP) != 0, ifr.ifr_mtu);
+        }
+    }
+}
+
+/* Processes the link change notifications received from the kernel since the
+ * last call, updating the link state and MTU of the open network devices. */
+void netdev_run(void)
+{
+    char buf[8192];
+    ssize_t len;
+
+    if (rtnl_sock < 0)
+    {
+        return;
+    }
+    for (;;)
     {
-        len = recv(netdev->netlink_fd, nlm, 4096, 0);
-        for (; (NLMSG_OK(nlm, len)) && (nlm->nlmsg_type != NLMSG_DONE); nlm = NLMSG_NEXT(nlm, len))
+        struct nlmsghdr *nlm = (struct nlmsghdr *)buf;
+
+        do
+        {
+            len = recv(rtnl_sock, buf, sizeof buf, 0);
+        } while (len < 0 && errno == EINTR);
+        if (len < 0)
+        {
+            if (errno == ENOBUFS)
+            {
+                /* The socket overflowed: resynchronize. */
+                refresh_links();
+                continue;
+            }
+            if (errno != EAGAIN)
+            {
+                VLOG_WARN_RL(LOG_MODULE, &rl, "error receiving link changes: %s",
+                             strerror(errno));
+            }
+            return;
+        }
+
+        for (; NLMSG_OK(nlm, len) && nlm->nlmsg_type != NLMSG_DONE;
+             nlm = NLMSG_NEXT(nlm, len))
         {
+            struct ifinfomsg *ifi = NLMSG_DATA(nlm);
+            struct netdev *netdev;
+            struct rtattr *rta;
+            int rta_len;
+            int mtu;
+
             if (nlm->nlmsg_type != RTM_NEWLINK)
+            {
                 continue;
-            ifa = (struct ifinfomsg *)NLMSG_DATA(nlm);
-            if (ifa->ifi_index == netdev->ifindex)
+            }
+            netdev = netdev_from_ifindex(ifi->ifi_index);
+            if (netdev == NULL)
             {
-                if (ifa->ifi_flags & IFF_UP)
-                {
-                    netdev_nodev_get_flags(netdev->name, &flags);
-                    netdev_set_flags(netdev, flags, false);
-                    return NETDEV_LINK_UP;
-                }
-                else
+                continue;
+            }
+
+            mtu = netdev->mtu;
+            rta_len = IFLA_PAYLOAD(nlm);
+            for (rta = IFLA_RTA(ifi); RTA_OK(rta, rta_len);
+                 rta = RTA_NEXT(rta, rta_len))
+            {
+                if (rta->rta_type == IFLA_MTU
+                    && RTA_PAYLOAD(rta) >= sizeof(uint32_t))
                 {
-                    netdev_nodev_get_flags(netdev->name, &flags);
-                    netdev_set_flags(netdev, flags, false);
-                    return NETDEV_LINK_DOWN;
+                    mtu = *(uint32_t *)RTA_DATA(rta);
                 }
             }
+            update_link(netdev, (ifi->ifi_flags & IFF_UP) != 0, mtu);
+        }
+    }
+}
+
+/* Registers with the poll loop to wake up from the next call to poll_block()
+ * when netdev_run() has link changes to process. */
+void netdev_wait(void)
+{
+    if (rtnl_sock >= 0)
+    {
+        poll_fd_wait(rtnl_sock, POLLIN);
+    }
+}
+
+/* Returns a number that changes whenever a network device is opened or closed
+ * or netdev_run() sees a report of the kernel on the link of one, so that
+ * callers only need to look at the devices again when it does. */
+unsigned int netdev_change_seq(void)
+{
+    return change_seq;
+}
+
+#if defined(HAVE_PACKET_AUXDATA) || defined(HAVE_PACKET_RING)
+/* Inserts into the packet in 'buffer' the VLAN tag with 'tci' that the kernel
+ * stripped on reception.  (Code from libpcap to reconstruct VLAN header.) */
+static void
+netdev_push_vlan(struct ofpbuf *buffer, uint16_t tci)
+{
+    struct vlan_tag *tag;
+    uint16_t eth_type;
+
+    /* VLAN tag found. Shift MAC addresses down and insert VLAN tag */
+    /* Create headroom for the VLAN tag */
+    eth_type = ntohs(*((uint16_t *)((uint8_t *)buffer->data + ETHER_ADDR_LEN * 2)));
+    ofpbuf_push_uninit(buffer, VLAN_HEADER_LEN);
+    memmove(buffer->data, (uint8_t *)buffer->data + VLAN_HEADER_LEN, ETH_ALEN * 2);
+    tag = (struct vlan_tag *)((uint8_t *)buffer->data + ETH_ALEN * 2);
+    if (eth_type == ETH_TYPE_VLAN_PBB_S ||
+        eth_type == ETH_TYPE_VLAN_PBB_B ||
+        eth_type == ETH_TYPE_VLAN)
+    {
+        tag->vlan_tp_id = htons(ETH_TYPE_VLAN_PBB_B);
+    }
+    else
+    {
+        tag->vlan_tp_id = htons(ETH_P_8021Q);
+    }
+    tag->vlan_tci = htons(tci);
+}
+#endif
+
+#ifdef HAVE_PACKET_AUXDATA
+/* Inserts into 'buffer' the VLAN tag that the kernel stripped from a packet
+ * received with 'msg', as reported in its PACKET_AUXDATA control message. */
+static void
+netdev_recv_vlan(struct ofpbuf *buffer, struct msghdr *msg)
+{
+    struct cmsghdr *cmsg;
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+    {
+        struct tpacket_auxdata *aux;
+
+        if (cmsg->cmsg_len < CMSG_LEN(sizeof(struct tpacket_auxdata)) ||
+            cmsg->cmsg_level != SOL_PACKET ||
+            cmsg->cmsg_type != PACKET_AUXDATA)
+        {
+            continue;
         }
-    } while (len < 0 && errno == EINTR);
-    return NETDEV_LINK_NO_CHANGE;
+        aux = (struct tpacket_auxdata *)CMSG_DATA(cmsg);
+        if (aux->tp_vlan_tci == 0)
+        {
+            continue;
+        }
+        netdev_push_vlan(buffer, aux->tp_vlan_tci);
+    }
 }
+#endif
 
 /* Attempts to receive a packet from 'netdev' into 'buffer', which the caller
  * must have initialized with sufficient room for the packet.  The space
@@ -1054,12 +1285,14 @@ int netdev_link_state(struct netdev *netdev)
  * positive errno value.  Returns EAGAIN immediately if no packet is ready to
  * be returned.
  */
-int netdev_recv(struct netdev *netdev, struct ofpbuf *buffer, size_t max_mtu)
+/* Receives a packet from 'netdev' on its socket 'fd', as netdev_recv(). */
+static int
+recv_packet(struct netdev *netdev, int fd, struct ofpbuf *buffer,
+            size_t max_mtu)
 {
 #ifdef HAVE_PACKET_AUXDATA
     /* Code from libpcap to reconstruct VLAN header */
     struct iovec iov;
-    struct cmsghdr *cmsg;
     struct msghdr msg;
     struct sockaddr from;
     union
@@ -1113,10 +1346,10 @@ int netdev_recv(struct netdev *netdev, struct ofpbuf *buffer, size_t max_mtu)
         {
 #ifdef HAVE_PACKET_AUXDATA
             /* Code from libpcap to reconstruct VLAN header */
-            n_bytes = recvmsg(netdev->netdev_fd, &msg, 0); // Lo he cambiado porque si no es del tipo tap no le veo sentido utilizar el tap_fd aunque sea igual que netdev_fd
+            n_bytes = recvmsg(fd, &msg, 0); // Lo he cambiado porque si no es del tipo tap no le veo sentido utilizar el tap_fd aunque sea igual que netdev_fd
                                                            // n_bytes = recvmsg(netdev->tap_fd, &msg, 0);
 #else
-            n_bytes = recvfrom(netdev->tap_fd, ofpbuf_tail(buffer),
+            n_bytes = recvfrom(fd, ofpbuf_tail(buffer),
                                (ssize_t)ofpbuf_tailroom(buffer), 0,
                                (struct sockaddr *)&sll, &sll_len);
 #endif /* ifdef HAVE_PACKET_AUXDATA  */
@@ -1135,43 +1368,8 @@ int netdev_recv(struct netdev *netdev, struct ofpbuf *buffer, size_t max_mtu)
     {
 
 #ifdef HAVE_PACKET_AUXDATA
-        /* Code from libpcap to reconstruct VLAN header */
-        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
-        {
-            struct tpacket_auxdata *aux;
-            struct vlan_tag *tag;
-            uint16_t eth_type;
-            buffer->size += n_bytes;
-
-            if (cmsg->cmsg_len < CMSG_LEN(sizeof(struct tpacket_auxdata)) ||
-                cmsg->cmsg_level != SOL_PACKET ||
-                cmsg->cmsg_type != PACKET_AUXDATA)
-            {
-                continue;
-            }
-            aux = (struct tpacket_auxdata *)CMSG_DATA(cmsg);
-            if (aux->tp_vlan_tci == 0)
-            {
-                continue;
-            }
-            /* VLAN tag found. Shift MAC addresses down and insert VLAN tag */
-            /* Create headroom for the VLAN tag */
-            eth_type = ntohs(*((uint16_t *)((uint8_t *)buffer->data + ETHER_ADDR_LEN * 2)));
-            ofpbuf_push_uninit(buffer, VLAN_HEADER_LEN);
-            memmove(buffer->data, (uint8_t *)buffer->data + VLAN_HEADER_LEN, ETH_ALEN * 2);
-            tag = (struct vlan_tag *)((uint8_t *)buffer->data + ETH_ALEN * 2);
-            if (eth_type == ETH_TYPE_VLAN_PBB_S ||
-                eth_type == ETH_TYPE_VLAN_PBB_B ||
-                eth_type == ETH_TYPE_VLAN)
-            {
-                tag->vlan_tp_id = htons(ETH_TYPE_VLAN_PBB_B);
-            }
-            else
-            {
-                tag->vlan_tp_id = htons(ETH_P_8021Q);
-            }
-            tag->vlan_tci = htons(aux->tp_vlan_tci);
-        }
+        buffer->size += n_bytes;
+        netdev_recv_vlan(buffer, &msg);
 #else
         /* we have multiple raw sockets at the same interface, so we also
          * receive what others send, and need to filter them out.
@@ -1192,92 +1390,906 @@ int netdev_recv(struct netdev *netdev, struct ofpbuf *buffer, size_t max_mtu)
     }
 }
 
-/* Registers with the poll loop to wake up from the next call to poll_block()
- * when a packet is ready to be received with netdev_recv() on 'netdev'. */
-void netdev_recv_wait(struct netdev *netdev)
-{
-    poll_fd_wait(netdev->tap_fd, POLLIN);
-}
-
-/* Discards all packets waiting to be received from 'netdev'. */
-int netdev_drain(struct netdev *netdev)
+int netdev_recv(struct netdev *netdev, struct ofpbuf *buffer, size_t max_mtu)
 {
-    if (netdev->tap_fd != netdev->netdev_fd)
-    {
-        drain_fd(netdev->tap_fd, netdev->txqlen);
-        return 0;
-    }
-    else
-    {
-        return drain_rcvbuf(netdev->netdev_fd);
-    }
+    return recv_packet(netdev, netdev->netdev_fd, buffer, max_mtu);
 }
 
-/* Sends 'buffer' on 'netdev'.  Returns 0 if successful, otherwise a positive
- * errno value.  Returns EAGAIN without blocking if the packet cannot be queued
- * immediately.  Returns EMSGSIZE if a partial packet was transmitted or if
- * the packet is too big or too small to transmit on the device.
- *
- * class_id denotes the queue to send the packet. If 0, it goes to the
- * default,best-effort queue.
- *
- * The caller retains ownership of 'buffer' in all cases.
+/* Attempts to receive up to 'n_buffers' packets from 'netdev' with a single
+ * system call, into 'buffers', each of which the caller must have initialized
+ * as for netdev_recv().  At most NETDEV_MAX_BATCH packets are received.
  *
- * The kernel maintains a packet transmission queue, so the caller is not
- * expected to do additional queuing of packets.
+ * On return, '*n_received' is the number of packets received: they are stored
+ * in buffers[0] through buffers[*n_received - 1], which may have been
+ * reordered with respect to the array the caller passed in.  Returns 0 if at
+ * least one packet was received, otherwise a positive errno value (EAGAIN if
+ * no packet is ready to be returned).
  */
-int netdev_send(struct netdev *netdev, const struct ofpbuf *buffer,
-                uint16_t class_id)
+int netdev_recv_batch(struct netdev *netdev, struct ofpbuf **buffers,
+                      size_t n_buffers, size_t max_mtu, size_t *n_received)
 {
-    ssize_t n_bytes;
+    return netdev_fanout_recv_batch(netdev, 0, buffers, n_buffers, max_mtu,
+                                    n_received);
+}
 
-    assert(class_id <= NETDEV_MAX_QUEUES);
+/* Same as netdev_recv_batch(), but receives the packets that the kernel
+ * handed to 'netdev''s receive socket 'member', which must be less than
+ * netdev_n_fanout(netdev). */
+int netdev_fanout_recv_batch(struct netdev *netdev, int member,
+                             struct ofpbuf **buffers, size_t n_buffers,
+                             size_t max_mtu, size_t *n_received)
+{
+    int fd = netdev->fanout_fd[member];
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr msgs[NETDEV_MAX_BATCH];
+    struct iovec iovs[NETDEV_MAX_BATCH];
+    struct sockaddr_ll slls[NETDEV_MAX_BATCH];
+#ifdef HAVE_PACKET_AUXDATA
+    union
+    {
+        struct cmsghdr cmsg;
+        char buf[CMSG_SPACE(sizeof(struct tpacket_auxdata))];
+    } cmsg_bufs[NETDEV_MAX_BATCH];
+#endif
+    int n_msgs;
+#endif
+    size_t i;
+    int error;
 
-    do
+    *n_received = 0;
+    if (n_buffers > NETDEV_MAX_BATCH)
     {
-        n_bytes = write(netdev->queue_fd[class_id], buffer->data, buffer->size);
-    } while (n_bytes < 0 && errno == EINTR);
-    if (n_bytes < 0)
+        n_buffers = NETDEV_MAX_BATCH;
+    }
+
+#ifdef HAVE_RECVMMSG
+    /* cannot execute recvmmsg over a tap device */
+    if (strncmp(netdev->name, "tap", 3))
     {
-        /* The Linux AF_PACKET implementation never blocks waiting for room
-         * for packets, instead returning ENOBUFS.  Translate this into EAGAIN
-         * for the caller. */
-        if (errno == ENOBUFS)
+        memset(msgs, 0, n_buffers * sizeof *msgs);
+        for (i = 0; i < n_buffers; i++)
         {
-            return EAGAIN;
+            struct msghdr *msg = &msgs[i].msg_hdr;
+
+            assert(buffers[i]->size == 0);
+            assert(ofpbuf_tailroom(buffers[i]) >= ETH_TOTAL_MIN);
+
+            iovs[i].iov_base = buffers[i]->data;
+            iovs[i].iov_len = MIN(max_mtu, ofpbuf_tailroom(buffers[i]));
+            msg->msg_name = &slls[i];
+            msg->msg_namelen = sizeof slls[i];
+            msg->msg_iov = &iovs[i];
+            msg->msg_iovlen = 1;
+#ifdef HAVE_PACKET_AUXDATA
+            msg->msg_control = &cmsg_bufs[i];
+            msg->msg_controllen = sizeof cmsg_bufs[i];
+#endif
         }
-        else if (errno != EAGAIN)
+
+        do
         {
-            VLOG_WARN_RL(LOG_MODULE, &rl, "error sending Ethernet packet on %s: %s",
-                         netdev->name, strerror(errno));
+            n_msgs = recvmmsg(fd, msgs, n_buffers, 0, NULL);
+        } while (n_msgs < 0 && errno == EINTR);
+        if (n_msgs < 0)
+        {
+            if (errno != EAGAIN)
+            {
+                VLOG_WARN_RL(LOG_MODULE, &rl, "error receiving Ethernet packets on %s: %s",
+                             netdev->name, strerror(errno));
+            }
+            return errno;
         }
-        return errno;
-    }
-    else if (n_bytes != buffer->size)
-    {
-        VLOG_WARN_RL(LOG_MODULE, &rl,
-                     "send partial Ethernet packet (%d bytes of %zu) on %s",
-                     (int)n_bytes, buffer->size, netdev->name);
-        return EMSGSIZE;
+
+        for (i = 0; i < (size_t) n_msgs; i++)
+        {
+            struct ofpbuf *buffer = buffers[i];
+
+#ifndef HAVE_PACKET_AUXDATA
+            /* Filter out what other raw sockets on the interface send, as
+             * netdev_recv() does. */
+            if (slls[i].sll_pkttype == PACKET_OUTGOING)
+            {
+                continue;
+            }
+#endif
+            buffer->size += msgs[i].msg_len;
+#ifdef HAVE_PACKET_AUXDATA
+            netdev_recv_vlan(buffer, &msgs[i].msg_hdr);
+#endif
+            pad_to_minimum_length(buffer);
+
+            /* Keep the received packets at the front of 'buffers'. */
+            buffers[i] = buffers[*n_received];
+            buffers[(*n_received)++] = buffer;
+        }
+        return *n_received ? 0 : EAGAIN;
     }
-    else
+#endif
+
+    error = 0;
+    for (i = 0; i < n_buffers; i++)
     {
-        return 0;
+        error = recv_packet(netdev, fd, buffers[i], max_mtu);
+        if (error)
+        {
+            break;
+        }
     }
+    *n_received = i;
+    return i ? 0 : error;
 }
 
-/* Registers with the poll loop to wake up from the next call to poll_block()
- * when the packet transmission queue has sufficient room to transmit a packet
- * with netdev_send().
- *
- * The kernel maintains a packet transmission queue, so the client is not
- * expected to do additional queuing of packets.  Thus, this function is
- * unlikely to ever be used.  It is included for completeness. */
-void netdev_send_wait(struct netdev *netdev)
+#ifdef HAVE_PACKET_RING
+/* Sets up a TPACKET_V3 receive ring on 'netdev''s socket. */
+static int
+setup_rx_ring(struct netdev *netdev)
 {
-    if (netdev->tap_fd == netdev->netdev_fd)
+    struct netdev_rx_ring *rx;
+    struct tpacket_req3 req;
+    int val;
+
+    val = TPACKET_V3;
+    if (setsockopt(netdev->netdev_fd, SOL_PACKET, PACKET_VERSION,
+                   &val, sizeof val) < 0)
     {
-        poll_fd_wait(netdev->tap_fd, POLLOUT);
+        return errno;
+    }
+    /* Leave room in front of every frame, so that headers can be pushed
+     * without copying the packet out of the ring. */
+    val = NETDEV_RING_HEADROOM;
+    if (setsockopt(netdev->netdev_fd, SOL_PACKET, PACKET_RESERVE,
+                   &val, sizeof val) < 0)
+    {
+        return errno;
+    }
+
+    memset(&req, 0, sizeof req);
+    req.tp_block_size = NETDEV_RING_BLOCK_SIZE;
+    req.tp_block_nr = NETDEV_RING_BLOCKS;
+    req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+    req.tp_frame_nr = req.tp_block_size / req.tp_frame_size * req.tp_block_nr;
+    req.tp_retire_blk_tov = NETDEV_RING_BLOCK_TIMEOUT;
+    if (setsockopt(netdev->netdev_fd, SOL_PACKET, PACKET_RX_RING,
+                   &req, sizeof req) < 0)
+    {
+        return errno;
+    }
+
+    rx = xcalloc(1, sizeof *rx);
+    rx->block_size = req.tp_block_size;
+    rx->n_blocks = req.tp_block_nr;
+    rx->map_size = (size_t)req.tp_block_size * req.tp_block_nr;
+    rx->map = mmap(NULL, rx->map_size,
+                   PROT_READ | PROT_WRITE, MAP_SHARED, netdev->netdev_fd, 0);
+    if (rx->map == MAP_FAILED)
+    {
+        int error = errno;
+        free(rx);
+        return error;
+    }
+    netdev->rx_ring = rx;
+    return 0;
+}
+
+/* Sets up a TPACKET_V2 transmit ring, with frames large enough for a packet
+ * of 'netdev''s MTU, on a write-only socket bound to 'netdev'. */
+static int
+setup_tx_ring(struct netdev *netdev)
+{
+    struct netdev_tx_ring *tx;
+    struct tpacket_req req;
+    struct sockaddr_ll sll;
+    size_t frame_size;
+    int error;
+    int fd;
+    int val;
+
+    fd = socket(PF_PACKET, SOCK_RAW, htons(0)); /* this is a write-only sock */
+    if (fd < 0)
+    {
+        return errno;
+    }
+    val = TPACKET_V2;
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &val, sizeof val) < 0)
+    {
+        goto error;
+    }
+    memset(&sll, 0, sizeof sll);
+    sll.sll_family = AF_PACKET;
+    sll.sll_ifindex = netdev->ifindex;
+    if (bind(fd, (struct sockaddr *)&sll, sizeof sll) < 0)
+    {
+        goto error;
+    }
+
+    frame_size = TPACKET_ALIGNMENT << 7;
+    while (frame_size < TPACKET2_HDRLEN + VLAN_ETH_HEADER_LEN + netdev->mtu)
+    {
+        frame_size <<= 1;
+    }
+    memset(&req, 0, sizeof req);
+    req.tp_block_size = MAX(frame_size, NETDEV_RING_BLOCK_SIZE);
+    req.tp_block_nr = NETDEV_RING_BLOCKS;
+    req.tp_frame_size = frame_size;
+    req.tp_frame_nr = req.tp_block_size / frame_size * req.tp_block_nr;
+    if (setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof req) < 0)
+    {
+        goto error;
+    }
+
+    tx = xcalloc(1, sizeof *tx);
+    tx->fd = fd;
+    tx->frame_size = frame_size;
+    tx->n_frames = req.tp_frame_nr;
+    tx->map_size = (size_t)req.tp_block_size * req.tp_block_nr;
+    tx->map = mmap(NULL, tx->map_size,
+                   PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (tx->map == MAP_FAILED)
+    {
+        error = errno;
+        free(tx);
+        close(fd);
+        return error;
+    }
+    netdev->tx_ring = tx;
+    return 0;
+
+error:
+    error = errno;
+    close(fd);
+    return error;
+}
+#endif /* HAVE_PACKET_RING */
+
+/* Switches 'netdev' from socket reads and writes to PACKET_MMAP rings shared
+ * with the kernel: a TPACKET_V3 ring for reception, to be read with
+ * netdev_recv_ring(), and a TPACKET_V2 ring for transmission on the default
+ * queue, which netdev_send() fills and netdev_send_flush() hands over.
+ *
+ * Returns 0 if successful, otherwise a positive errno value, in which case
+ * 'netdev' keeps working as before. */
+int netdev_enable_rings(struct netdev *netdev)
+{
+#ifdef HAVE_PACKET_RING
+    int error;
+
+    if (netdev->rx_ring || netdev->xsk || netdev->n_fanout > 1)
+    {
+        return netdev->rx_ring ? 0 : EBUSY;
+    }
+    if (netdev->tap_fd != netdev->netdev_fd)
+    {
+        return EOPNOTSUPP;
+    }
+
+    /* A socket cannot drop its receive ring once set up, so start with the
+     * transmit ring, which lives on a socket of its own. */
+    error = setup_tx_ring(netdev);
+    if (!error)
+    {
+        error = setup_rx_ring(netdev);
+        if (error)
+        {
+            free_rings(netdev);
+        }
+    }
+    if (error)
+    {
+        VLOG_WARN(LOG_MODULE, "failed to set up packet rings on %s: %s",
+                  netdev->name, strerror(error));
+    }
+    return error;
+#else
+    VLOG_WARN(LOG_MODULE, "packet rings are not supported on %s", netdev->name);
+    return EOPNOTSUPP;
+#endif
+}
+
+/* Switches 'netdev' to AF_XDP sockets bound to each of its receive queues, in
+ * copy mode, whose receive and transmit rings share a UMEM with the AF_XDP
+ * sockets of the other netdevs (see xsk.h).  Afterwards packets are received
+ * with netdev_recv_ring() and netdev_send() queues packets for the default
+ * queue on the transmit ring of the first socket until netdev_send_flush().
+ *
+ * Returns 0 if successful, otherwise a positive errno value, in which case
+ * 'netdev' keeps working as before. */
+int netdev_enable_xdp(struct netdev *netdev)
+{
+    if (netdev->xsk || netdev->rx_ring || netdev->n_fanout > 1)
+    {
+        return netdev->xsk ? 0 : EBUSY;
+    }
+    if (netdev->tap_fd != netdev->netdev_fd)
+    {
+        return EOPNOTSUPP;
+    }
+    return xsk_open(netdev->name, netdev->ifindex, NETDEV_RING_HEADROOM,
+                    &netdev->xsk);
+}
+
+#ifdef PACKET_FANOUT
+/* Opens in '*fdp' another receive socket for 'netdev', bound like its
+ * 'netdev_fd' to 'sll', and adds it to the PACKET_FANOUT group 'fanout'. */
+static int
+open_fanout_socket(struct netdev *netdev, const struct sockaddr_ll *sll,
+                   uint32_t fanout, int *fdp)
+{
+    int fd;
+    int error;
+#ifdef HAVE_PACKET_AUXDATA
+    int val;
+#endif
+
+    fd = socket(PF_PACKET, SOCK_RAW, sll->sll_protocol);
+    if (fd < 0)
+    {
+        return errno;
+    }
+#ifdef HAVE_PACKET_AUXDATA
+    val = 1;
+    if (setsockopt(fd, SOL_PACKET, PACKET_AUXDATA, &val, sizeof val) == -1
+        && errno != ENOPROTOOPT)
+    {
+        VLOG_ERR(LOG_MODULE, "setsockopt(PACKET_AUXDATA) on %s failed: %s",
+                 netdev->name, strerror(errno));
+    }
+#endif
+    error = set_nonblocking(fd);
+    if (error)
+    {
+        goto error_already_set;
+    }
+    if (bind(fd, (const struct sockaddr *)sll, sizeof *sll) < 0)
+    {
+        goto error;
+    }
+    /* As in do_open_netdev(), drop what the socket received from other
+     * devices before it was bound. */
+    error = drain_rcvbuf(fd);
+    if (error)
+    {
+        goto error_already_set;
+    }
+    if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof fanout) < 0)
+    {
+        goto error;
+    }
+    *fdp = fd;
+    return 0;
+
+error:
+    error = errno;
+error_already_set:
+    close(fd);
+    return error;
+}
+#endif
+
+/* Spreads the packets received on 'netdev' over 'n_members' sockets (at most
+ * NETDEV_MAX_FANOUT), joined in a PACKET_FANOUT_HASH group: packets of the
+ * same flow always land on the same socket, and thus keep their order.  The
+ * packets of each socket are received with netdev_fanout_recv_batch().  Only
+ * devices that receive through sockets, with neither receive rings nor
+ * AF_XDP, can be set up this way.
+ *
+ * Returns 0 if successful, otherwise a positive errno value, in which case
+ * 'netdev' keeps receiving on a single socket. */
+int netdev_enable_fanout(struct netdev *netdev, int n_members)
+{
+#ifdef PACKET_FANOUT
+    struct sockaddr_ll sll;
+    socklen_t sll_len;
+    uint32_t fanout;
+    int error;
+
+    if (netdev->n_fanout > 1 || netdev_has_rx_ring(netdev))
+    {
+        return EBUSY;
+    }
+    if (netdev->tap_fd != netdev->netdev_fd)
+    {
+        return EOPNOTSUPP;
+    }
+    if (n_members > NETDEV_MAX_FANOUT)
+    {
+        n_members = NETDEV_MAX_FANOUT;
+    }
+    if (n_members < 2)
+    {
+        return 0;
+    }
+
+    /* Every member must be bound like 'netdev_fd'.  The group is named after
+     * the device, which keeps the groups of different devices apart. */
+    sll_len = sizeof sll;
+    if (getsockname(netdev->netdev_fd, (struct sockaddr *)&sll, &sll_len) < 0)
+    {
+        error = errno;
+        goto exit;
+    }
+    fanout = (netdev->ifindex & 0xffff)
+             | (PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16;
+    if (setsockopt(netdev->netdev_fd, SOL_PACKET, PACKET_FANOUT,
+                   &fanout, sizeof fanout) < 0)
+    {
+        error = errno;
+        goto exit;
+    }
+
+    error = 0;
+    while (netdev->n_fanout < n_members)
+    {
+        error = open_fanout_socket(netdev, &sll, fanout,
+                                   &netdev->fanout_fd[netdev->n_fanout]);
+        if (error)
+        {
+            break;
+        }
+        netdev->n_fanout++;
+    }
+    if (error)
+    {
+        /* 'netdev_fd' cannot leave the group, but as its only member it
+         * receives everything, as before. */
+        while (netdev->n_fanout > 1)
+        {
+            close(netdev->fanout_fd[--netdev->n_fanout]);
+        }
+    }
+
+exit:
+    if (error)
+    {
+        VLOG_WARN(LOG_MODULE, "failed to set up packet fanout on %s: %s",
+                  netdev->name, strerror(error));
+    }
+    return error;
+#else
+    VLOG_WARN(LOG_MODULE, "packet fanout is not supported on %s",
+              netdev->name);
+    return EOPNOTSUPP;
+#endif
+}
+
+/* Returns the number of receive sockets of 'netdev', which is 1 unless
+ * netdev_enable_fanout() set up more. */
+int netdev_n_fanout(const struct netdev *netdev)
+{
+    return netdev->n_fanout;
+}
+
+/* Unmaps the rings of 'netdev', if any. */
+static void
+free_rings(struct netdev *netdev)
+{
+#ifdef HAVE_PACKET_RING
+    if (netdev->rx_ring)
+    {
+        struct netdev_rx_ring *rx = netdev->rx_ring;
+
+        munmap(rx->map, rx->map_size);
+        free(rx);
+        netdev->rx_ring = NULL;
+    }
+    if (netdev->tx_ring)
+    {
+        struct netdev_tx_ring *tx = netdev->tx_ring;
+
+        munmap(tx->map, tx->map_size);
+        close(tx->fd);
+        free(tx);
+        netdev->tx_ring = NULL;
+    }
+#else
+    assert(!netdev->rx_ring && !netdev->tx_ring);
+#endif
+}
+
+/* Returns true if packets from 'netdev' must be received with
+ * netdev_recv_ring(). */
+bool netdev_has_rx_ring(const struct netdev *netdev)
+{
+    return netdev->rx_ring != NULL || netdev->xsk != NULL;
+}
+
+/* Returns true if netdev_send() queues the packets for 'netdev''s queue
+ * 'class_id' on a transmit ring, until netdev_send_flush(), instead of
+ * sending each of them with a system call. */
+bool netdev_has_tx_ring(const struct netdev *netdev, uint16_t class_id)
+{
+    return class_id == 0 && (netdev->tx_ring != NULL || netdev->xsk != NULL);
+}
+
+/* Attempts to receive up to 'n_buffers' packets from 'netdev''s receive ring,
+ * which must have been set up with netdev_enable_rings() or
+ * netdev_enable_xdp().
+ *
+ * buffers[0] through buffers[n_buffers - 1] must point to ofpbuf headers
+ * supplied by the caller.  On return, '*n_received' is the number of packets
+ * received, for which buffers[0] through buffers[*n_received - 1] have been
+ * initialized; the others are left untouched.  The packets' data are not
+ * copied: they stay in the ring, with NETDEV_RING_HEADROOM bytes of headroom,
+ * until the next call to this function on 'netdev', so a packet that must be
+ * kept longer must be copied out with ofpbuf_own_data() first.  Returns 0 if
+ * at least one packet was received, otherwise a positive errno value (EAGAIN
+ * if no packet is ready to be returned).
+ */
+int netdev_recv_ring(struct netdev *netdev, struct ofpbuf **buffers,
+                     size_t n_buffers, size_t *n_received)
+{
+#ifdef HAVE_PACKET_RING
+    struct netdev_rx_ring *rx = netdev->rx_ring;
+    struct tpacket_block_desc *block;
+#endif
+
+    if (netdev->xsk)
+    {
+        int error = xsk_recv(netdev->xsk, buffers, n_buffers, n_received);
+        size_t i;
+
+        for (i = 0; i < *n_received; i++)
+        {
+            pad_to_minimum_length(buffers[i]);
+        }
+        return error;
+    }
+
+#ifdef HAVE_PACKET_RING
+    *n_received = 0;
+    block = (struct tpacket_block_desc *)(rx->map + rx->block * rx->block_size);
+    if (rx->release)
+    {
+        /* All of the block's packets were processed since the last call. */
+        __sync_synchronize();
+        block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        rx->block = (rx->block + 1) % rx->n_blocks;
+        rx->release = false;
+        block = (struct tpacket_block_desc *)(rx->map + rx->block * rx->block_size);
+    }
+
+    if (rx->n_left == 0)
+    {
+        if (!(block->hdr.bh1.block_status & TP_STATUS_USER))
+        {
+            return EAGAIN;
+        }
+        __sync_synchronize();
+        rx->n_left = block->hdr.bh1.num_pkts;
+        rx->next = (uint8_t *)block + block->hdr.bh1.offset_to_first_pkt;
+    }
+
+    while (*n_received < n_buffers && rx->n_left > 0)
+    {
+        struct tpacket3_hdr *hdr = (struct tpacket3_hdr *)rx->next;
+        const struct sockaddr_ll *sll;
+        struct ofpbuf *buffer;
+
+        rx->next += hdr->tp_next_offset;
+        rx->n_left--;
+
+        /* we have multiple raw sockets at the same interface, so we also
+         * receive what others send, and need to filter them out. */
+        sll = (const struct sockaddr_ll *)((uint8_t *)hdr +
+                                           TPACKET_ALIGN(sizeof *hdr));
+        if (sll->sll_pkttype == PACKET_OUTGOING)
+        {
+            continue;
+        }
+
+        buffer = buffers[*n_received];
+        ofpbuf_use_foreign(buffer, (uint8_t *)hdr + hdr->tp_mac - NETDEV_RING_HEADROOM,
+                           NETDEV_RING_HEADROOM + hdr->tp_snaplen);
+        ofpbuf_reserve(buffer, NETDEV_RING_HEADROOM);
+        ofpbuf_put_uninit(buffer, hdr->tp_snaplen);
+        if (hdr->hv1.tp_vlan_tci != 0 || hdr->tp_status & TP_STATUS_VLAN_VALID)
+        {
+            netdev_push_vlan(buffer, hdr->hv1.tp_vlan_tci);
+        }
+        pad_to_minimum_length(buffer);
+        (*n_received)++;
+    }
+    if (rx->n_left == 0)
+    {
+        rx->release = true;
+    }
+    return *n_received ? 0 : EAGAIN;
+#else
+    *n_received = 0;
+    return EOPNOTSUPP;
+#endif
+}
+
+/* Registers with the poll loop to wake up from the next call to poll_block()
+ * when a packet is ready to be received with netdev_recv() on 'netdev'. */
+void netdev_recv_wait(struct netdev *netdev)
+{
+    if (netdev->xsk)
+    {
+        xsk_recv_wait(netdev->xsk);
+    }
+    else
+    {
+        poll_fd_wait(netdev->tap_fd, POLLIN);
+    }
+}
+
+/* Registers with the poll loop to wake up from the next call to poll_block()
+ * when a packet is ready to be received with netdev_fanout_recv_batch() on
+ * 'netdev''s receive socket 'member'. */
+void netdev_fanout_recv_wait(struct netdev *netdev, int member)
+{
+    if (member == 0)
+    {
+        netdev_recv_wait(netdev);
+    }
+    else
+    {
+        poll_fd_wait(netdev->fanout_fd[member], POLLIN);
+    }
+}
+
+/* Discards all packets waiting to be received from 'netdev'. */
+int netdev_drain(struct netdev *netdev)
+{
+    if (netdev->tap_fd != netdev->netdev_fd)
+    {
+        drain_fd(netdev->tap_fd, netdev->txqlen);
+        return 0;
+    }
+    else
+    {
+        int i;
+
+        for (i = 1; i < netdev->n_fanout; i++)
+        {
+            drain_rcvbuf(netdev->fanout_fd[i]);
+        }
+        return drain_rcvbuf(netdev->netdev_fd);
+    }
+}
+
+#ifdef HAVE_PACKET_RING
+/* Hands the frames queued on 'tx' over to the kernel for transmission. */
+static void
+kick_tx_ring(struct netdev *netdev, struct netdev_tx_ring *tx)
+{
+    tx->n_pending = 0;
+    if (send(tx->fd, NULL, 0, MSG_DONTWAIT) < 0
+        && errno != EAGAIN && errno != ENOBUFS)
+    {
+        VLOG_WARN_RL(LOG_MODULE, &rl, "error sending Ethernet packets on %s: %s",
+                     netdev->name, strerror(errno));
+    }
+}
+
+/* Queues a copy of 'buffer' on 'netdev''s transmit ring. */
+static int
+send_ring(struct netdev *netdev, const struct ofpbuf *buffer)
+{
+    struct netdev_tx_ring *tx = netdev->tx_ring;
+    struct tpacket2_hdr *hdr;
+
+    if (buffer->size > tx->frame_size - (TPACKET2_HDRLEN - sizeof(struct sockaddr_ll)))
+    {
+        VLOG_WARN_RL(LOG_MODULE, &rl, "packet of %zu bytes too big for the "
+                     "transmit ring of %s", buffer->size, netdev->name);
+        return EMSGSIZE;
+    }
+
+    hdr = (struct tpacket2_hdr *)(tx->map + tx->frame * tx->frame_size);
+    if (hdr->tp_status != TP_STATUS_AVAILABLE)
+    {
+        /* The ring is full of frames the kernel has not sent yet. */
+        if (tx->n_pending)
+        {
+            kick_tx_ring(netdev, tx);
+        }
+        return EAGAIN;
+    }
+
+    memcpy((uint8_t *)hdr + TPACKET2_HDRLEN - sizeof(struct sockaddr_ll),
+           buffer->data, buffer->size);
+    hdr->tp_len = buffer->size;
+    __sync_synchronize();
+    hdr->tp_status = TP_STATUS_SEND_REQUEST;
+    tx->frame = (tx->frame + 1) % tx->n_frames;
+
+    if (++tx->n_pending >= tx->n_frames / 2)
+    {
+        kick_tx_ring(netdev, tx);
+    }
+    return 0;
+}
+#endif
+
+/* Sends 'buffer' on 'netdev'.  Returns 0 if successful, otherwise a positive
+ * errno value.  Returns EAGAIN without blocking if the packet cannot be queued
+ * immediately.  Returns EMSGSIZE if a partial packet was transmitted or if
+ * the packet is too big or too small to transmit on the device.
+ *
+ * class_id denotes the queue to send the packet. If 0, it goes to the
+ * default,best-effort queue.
+ *
+ * The caller retains ownership of 'buffer' in all cases.
+ *
+ * The kernel maintains a packet transmission queue, so the caller is not
+ * expected to do additional queuing of packets.
+ */
+int netdev_send(struct netdev *netdev, const struct ofpbuf *buffer,
+                uint16_t class_id)
+{
+    ssize_t n_bytes;
+
+    assert(class_id <= NETDEV_MAX_QUEUES);
+
+    if (class_id == 0 && netdev->xsk)
+    {
+        return xsk_send(netdev->xsk, buffer->data, buffer->size, false);
+    }
+#ifdef HAVE_PACKET_RING
+    if (class_id == 0 && netdev->tx_ring)
+    {
+        return send_ring(netdev, buffer);
+    }
+#endif
+
+    do
+    {
+        n_bytes = write(netdev->queue_fd[class_id], buffer->data, buffer->size);
+    } while (n_bytes < 0 && errno == EINTR);
+    if (n_bytes < 0)
+    {
+        /* The Linux AF_PACKET implementation never blocks waiting for room
+         * for packets, instead returning ENOBUFS.  Translate this into EAGAIN
+         * for the caller. */
+        if (errno == ENOBUFS)
+        {
+            return EAGAIN;
+        }
+        else if (errno != EAGAIN)
+        {
+            VLOG_WARN_RL(LOG_MODULE, &rl, "error sending Ethernet packet on %s: %s",
+                         netdev->name, strerror(errno));
+        }
+        return errno;
+    }
+    else if (n_bytes != buffer->size)
+    {
+        VLOG_WARN_RL(LOG_MODULE, &rl,
+                     "send partial Ethernet packet (%d bytes of %zu) on %s",
+                     (int)n_bytes, buffer->size, netdev->name);
+        return EMSGSIZE;
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+/* Sends 'buffer' on 'netdev', as netdev_send() does, for a caller that
+ * neither reads nor modifies the data of 'buffer' afterwards: a packet
+ * received with netdev_recv_ring() from an AF_XDP socket is then sent to
+ * another one from the frame it was received in, without a copy. */
+int netdev_send_in_place(struct netdev *netdev, const struct ofpbuf *buffer,
+                         uint16_t class_id)
+{
+    if (class_id == 0 && netdev->xsk)
+    {
+        return xsk_send(netdev->xsk, buffer->data, buffer->size, true);
+    }
+    return netdev_send(netdev, buffer, class_id);
+}
+
+/* Sends the 'n_buffers' packets in 'buffers', in order, on 'netdev''s queue
+ * 'class_id', as netdev_send() would, but with as few system calls as the
+ * system allows: a single sendmmsg() for up to NETDEV_MAX_BATCH packets.
+ *
+ * Stops at the first packet that cannot be sent.  '*n_sent' is set to the
+ * number of packets sent before it.  Returns 0 if all the packets were sent,
+ * otherwise the positive errno value netdev_send() would have returned for the
+ * packet buffers[*n_sent]. */
+int netdev_send_batch(struct netdev *netdev, struct ofpbuf **buffers,
+                      size_t n_buffers, uint16_t class_id, size_t *n_sent)
+{
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[NETDEV_MAX_BATCH];
+    struct iovec iovs[NETDEV_MAX_BATCH];
+#endif
+    size_t i;
+    int error;
+
+    assert(class_id <= NETDEV_MAX_QUEUES);
+
+    *n_sent = 0;
+#ifdef HAVE_SENDMMSG
+    /* cannot execute sendmmsg over a tap device */
+    if (!netdev_has_tx_ring(netdev, class_id) && n_buffers > 1
+        && (class_id != 0 || netdev->tap_fd == netdev->netdev_fd))
+    {
+        if (n_buffers > NETDEV_MAX_BATCH)
+        {
+            n_buffers = NETDEV_MAX_BATCH;
+        }
+        memset(msgs, 0, n_buffers * sizeof *msgs);
+        for (i = 0; i < n_buffers; i++)
+        {
+            iovs[i].iov_base = buffers[i]->data;
+            iovs[i].iov_len = buffers[i]->size;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        while (*n_sent < n_buffers)
+        {
+            int n_msgs = sendmmsg(netdev->queue_fd[class_id], &msgs[*n_sent],
+                                  n_buffers - *n_sent, 0);
+            if (n_msgs < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                /* As in netdev_send(). */
+                if (errno == ENOBUFS)
+                {
+                    return EAGAIN;
+                }
+                else if (errno != EAGAIN)
+                {
+                    VLOG_WARN_RL(LOG_MODULE, &rl, "error sending Ethernet packets on %s: %s",
+                                 netdev->name, strerror(errno));
+                }
+                return errno;
+            }
+            *n_sent += n_msgs;
+        }
+        return 0;
+    }
+#endif
+
+    for (i = 0; i < n_buffers; i++)
+    {
+        error = netdev_send(netdev, buffers[i], class_id);
+        if (error)
+        {
+            return error;
+        }
+        (*n_sent)++;
+    }
+    return 0;
+}
+
+/* Transmits the packets that netdev_send() queued on the transmit ring of
+ * 'netdev' since the last call, with a single system call.  Does nothing if
+ * 'netdev' has no transmit ring. */
+void netdev_send_flush(struct netdev *netdev)
+{
+    if (netdev->xsk)
+    {
+        xsk_flush(netdev->xsk);
+    }
+#ifdef HAVE_PACKET_RING
+    if (netdev->tx_ring && netdev->tx_ring->n_pending)
+    {
+        kick_tx_ring(netdev, netdev->tx_ring);
+    }
+#else
+    assert(!netdev->tx_ring);
+#endif
+}
+
+/* Registers with the poll loop to wake up from the next call to poll_block()
+ * when the packet transmission queue has sufficient room to transmit a packet
+ * with netdev_send().
+ *
+ * The kernel maintains a packet transmission queue, so the client is not
+ * expected to do additional queuing of packets.  Thus, this function is
+ * unlikely to ever be used.  It is included for completeness. */
+void netdev_send_wait(struct netdev *netdev)
+{
+    if (netdev->tap_fd == netdev->netdev_fd)
+    {
+        poll_fd_wait(netdev->tap_fd, POLLOUT);
     }
     else
     {
@@ -1826,6 +2838,40 @@ init_netdev(void)
         {
             ofp_fatal(errno, "socket(AF_INET)");
         }
+        open_rtnl_sock();
+    }
+}
+
+/* Opens 'rtnl_sock'.  On failure, link changes go unnoticed. */
+static void
+open_rtnl_sock(void)
+{
+    struct sockaddr_nl snl;
+    int error;
+
+    rtnl_sock = socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if (rtnl_sock < 0)
+    {
+        VLOG_ERR(LOG_MODULE, "socket(NETLINK_ROUTE) failed: %s", strerror(errno));
+        return;
+    }
+
+    error = set_nonblocking(rtnl_sock);
+    if (!error)
+    {
+        memset(&snl, 0, sizeof snl);
+        snl.nl_family = AF_NETLINK;
+        snl.nl_groups = RTMGRP_LINK;
+        if (bind(rtnl_sock, (struct sockaddr *)&snl, sizeof snl) < 0)
+        {
+            error = errno;
+        }
+    }
+    if (error)
+    {
+        VLOG_ERR(LOG_MODULE, "netlink bind failed: %s", strerror(error));
+        close(rtnl_sock);
+        rtnl_sock = -1;
     }
 }
 
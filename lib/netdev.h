@@ -80,6 +80,20 @@ enum netdev_link_state
 
 #define NETDEV_MAX_QUEUES 8
 
+/* Maximum number of packets received by a single netdev_recv_batch(). */
+#define NETDEV_MAX_BATCH 64
+
+/* Maximum number of receive sockets of a netdev (see
+ * netdev_enable_fanout()). */
+#define NETDEV_MAX_FANOUT 64
+
+/* PACKET_MMAP ring geometry (see netdev_enable_rings()).  Every received
+ * packet has NETDEV_RING_HEADROOM bytes of headroom in the ring. */
+#define NETDEV_RING_BLOCK_SIZE (1 << 16)
+#define NETDEV_RING_BLOCKS 64
+#define NETDEV_RING_BLOCK_TIMEOUT 10 /* ms before a partial block is returned */
+#define NETDEV_RING_HEADROOM 128
+
 struct netdev;
 
 int netdev_open(const char *name, int ethertype, struct netdev **);
@@ -87,10 +101,33 @@ int netdev_open_tap(const char *name, struct netdev **);
 void netdev_close(struct netdev *);
 
 int netdev_recv(struct netdev *, struct ofpbuf *, size_t);
+int netdev_recv_batch(struct netdev *, struct ofpbuf **, size_t n_buffers,
+                      size_t max_mtu, size_t *n_received);
+int netdev_enable_fanout(struct netdev *, int n_members);
+int netdev_n_fanout(const struct netdev *);
+int netdev_fanout_recv_batch(struct netdev *, int member,
+                             struct ofpbuf **, size_t n_buffers,
+                             size_t max_mtu, size_t *n_received);
+void netdev_fanout_recv_wait(struct netdev *, int member);
+int netdev_enable_rings(struct netdev *);
+int netdev_enable_xdp(struct netdev *);
+bool netdev_has_rx_ring(const struct netdev *);
+bool netdev_has_tx_ring(const struct netdev *, uint16_t class_id);
+int netdev_recv_ring(struct netdev *, struct ofpbuf **, size_t n_buffers,
+                     size_t *n_received);
 void netdev_recv_wait(struct netdev *);
 int netdev_link_state(struct netdev *netdev);
+bool netdev_is_link_up(const struct netdev *);
+void netdev_run(void);
+void netdev_wait(void);
+unsigned int netdev_change_seq(void);
 int netdev_drain(struct netdev *);
 int netdev_send(struct netdev *, const struct ofpbuf *, uint16_t class_id);
+int netdev_send_in_place(struct netdev *, const struct ofpbuf *,
+                         uint16_t class_id);
+int netdev_send_batch(struct netdev *, struct ofpbuf **, size_t n_buffers,
+                      uint16_t class_id, size_t *n_sent);
+void netdev_send_flush(struct netdev *);
 void netdev_send_wait(struct netdev *);
 int netdev_set_etheraddr(struct netdev *, const uint8_t mac[6]);
 const uint8_t *netdev_get_etheraddr(const struct netdev *);
@@ -38,6 +38,8 @@
 #include "dynamic-string.h"
 #include "util.h"
 
+static void ofpbuf_resize_tailroom__(struct ofpbuf *, size_t new_tailroom);
+
 /* Initializes 'b' as an empty ofpbuf that contains the 'allocated' bytes of
  * memory starting at 'base'.
  *
@@ -50,12 +52,26 @@ ofpbuf_use(struct ofpbuf *b, void *base, size_t allocated)
 {
     b->base = b->data = base;
     b->allocated = allocated;
+    b->source = OFPBUF_MALLOC;
+    b->ref_cnt = NULL;
     b->size = 0;
     b->l2 = b->l3 = b->l4 = b->l7 = NULL;
     b->next = NULL;
     b->private_p = NULL;
 }
 
+/* Initializes 'b' as an empty ofpbuf that contains the 'allocated' bytes of
+ * memory starting at 'base', which 'b' does not own: it is never freed, and
+ * the data are copied into malloc()'d memory if 'b' needs to be expanded.
+ * The caller must make sure 'base' stays valid as long as 'b' uses it (see
+ * ofpbuf_own_data()). */
+void
+ofpbuf_use_foreign(struct ofpbuf *b, void *base, size_t allocated)
+{
+    ofpbuf_use(b, base, allocated);
+    b->source = OFPBUF_FOREIGN;
+}
+
 /* Initializes 'b' as an empty ofpbuf with an initial capacity of 'size'
  * bytes. */
 void
@@ -68,8 +84,12 @@ ofpbuf_init(struct ofpbuf *b, size_t size)
 void
 ofpbuf_uninit(struct ofpbuf *b)
 {
-    if (b) {
+    if (b && b->source == OFPBUF_MALLOC) {
         free(b->base);
+    } else if (b && b->source == OFPBUF_SHARED
+               && __atomic_sub_fetch(b->ref_cnt, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(b->base);
+        free(b->ref_cnt);
     }
 }
 
@@ -125,6 +145,67 @@ ofpbuf_clone_data(const void *data, size_t size)
     return b;
 }
 
+/* Initializes 'share' as an ofpbuf that shares the memory of 'b', and thus
+ * its data, headroom and tailroom, instead of copying them.  The memory is
+ * freed along with the last ofpbuf that uses it.  Any of the ofpbufs must be
+ * made private with ofpbuf_unshare() before its data are modified in place;
+ * the ones that grow get a copy of the data anyway.
+ *
+ * The data of 'b' are first copied into malloc()'d memory if 'b' was set up
+ * with ofpbuf_use_foreign(). */
+void
+ofpbuf_use_shared(struct ofpbuf *share, struct ofpbuf *b)
+{
+    ofpbuf_own_data(b);
+    if (b->source == OFPBUF_MALLOC) {
+        b->ref_cnt = xmalloc(sizeof *b->ref_cnt);
+        *b->ref_cnt = 1;
+        b->source = OFPBUF_SHARED;
+    }
+    __atomic_add_fetch(b->ref_cnt, 1, __ATOMIC_RELAXED);
+
+    *share = *b;
+    share->next = NULL;
+    share->private_p = NULL;
+}
+
+/* Creates and returns a new ofpbuf that shares the memory of 'b', as
+ * ofpbuf_use_shared() does. */
+struct ofpbuf *
+ofpbuf_share(struct ofpbuf *b)
+{
+    struct ofpbuf *share = xmalloc(sizeof *share);
+
+    ofpbuf_use_shared(share, b);
+    return share;
+}
+
+/* Returns true if 'b' shares its memory with other ofpbufs. */
+bool
+ofpbuf_is_shared(const struct ofpbuf *b)
+{
+    return (b->source == OFPBUF_SHARED
+            && __atomic_load_n(b->ref_cnt, __ATOMIC_ACQUIRE) > 1);
+}
+
+/* Makes sure that no other ofpbuf shares the memory of 'b', copying its data
+ * (along with its headroom and tailroom) into malloc()'d memory of its own if
+ * needed.  The data and header pointers may change. */
+void
+ofpbuf_unshare(struct ofpbuf *b)
+{
+    if (b->source != OFPBUF_SHARED) {
+        return;
+    }
+    if (ofpbuf_is_shared(b)) {
+        ofpbuf_resize_tailroom__(b, ofpbuf_tailroom(b));
+    } else {
+        free(b->ref_cnt);
+        b->ref_cnt = NULL;
+        b->source = OFPBUF_MALLOC;
+    }
+}
+
 /* Frees memory that 'b' points to, as well as 'b' itself. */
 void
 ofpbuf_delete(struct ofpbuf *b) 
@@ -181,8 +262,33 @@ ofpbuf_rebase__(struct ofpbuf *b, void *new_base)
 static void
 ofpbuf_resize_tailroom__(struct ofpbuf *b, size_t new_tailroom)
 {
-    b->allocated = ofpbuf_headroom(b) + b->size + new_tailroom;
-    ofpbuf_rebase__(b, xrealloc(b->base, b->allocated));
+    size_t used = ofpbuf_headroom(b) + b->size;
+    void *new_base;
+
+    b->allocated = used + new_tailroom;
+    if (b->source == OFPBUF_MALLOC) {
+        new_base = xrealloc(b->base, b->allocated);
+    } else {
+        /* Foreign or shared memory is copied, and released. */
+        new_base = xmalloc(b->allocated);
+        memcpy(new_base, b->base, used);
+        ofpbuf_uninit(b);
+        b->source = OFPBUF_MALLOC;
+        b->ref_cnt = NULL;
+    }
+    ofpbuf_rebase__(b, new_base);
+}
+
+/* Makes sure that 'b' owns the memory its data is in, copying the data (along
+ * with its headroom and tailroom) into malloc()'d memory if 'b' was set up
+ * with ofpbuf_use_foreign().  The data and header pointers may change.
+ * Memory shared with ofpbuf_share() counts as owned. */
+void
+ofpbuf_own_data(struct ofpbuf *b)
+{
+    if (b->source == OFPBUF_FOREIGN) {
+        ofpbuf_resize_tailroom__(b, ofpbuf_tailroom(b));
+    }
 }
 
 /* Ensures that 'b' has room for at least 'size' bytes at its tail end,
@@ -34,14 +34,27 @@
 #ifndef OFPBUF_H
 #define OFPBUF_H 1
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+/* Where an ofpbuf's memory came from. */
+enum ofpbuf_source {
+    OFPBUF_MALLOC,              /* Obtained via malloc(). */
+    OFPBUF_FOREIGN,             /* Owned by someone else, e.g. a packet ring;
+                                   copied into malloc()'d memory on demand. */
+    OFPBUF_SHARED               /* Obtained via malloc(), and shared with the
+                                   ofpbufs made by ofpbuf_share(); copied
+                                   before it is modified. */
+};
+
 /* Buffer for holding arbitrary data.  An ofpbuf is automatically reallocated
  * as necessary if it grows too large for the available memory. */
 struct ofpbuf {
     void *base;                 /* First byte of area malloc()'d area. */
     size_t allocated;           /* Number of bytes allocated. */
+    enum ofpbuf_source source;  /* Source of memory allocated as 'base'. */
+    unsigned int *ref_cnt;      /* References to 'base', if shared. */
 
     uint8_t conn_id;            /* Connection ID. Application-defined value to 
                                    associate a connection to the buffer. */
@@ -59,6 +72,9 @@ struct ofpbuf {
 };
 
 void ofpbuf_use(struct ofpbuf *, void *, size_t);
+void ofpbuf_use_foreign(struct ofpbuf *, void *, size_t);
+void ofpbuf_use_shared(struct ofpbuf *share, struct ofpbuf *);
+void ofpbuf_own_data(struct ofpbuf *);
 
 void ofpbuf_init(struct ofpbuf *, size_t);
 void ofpbuf_uninit(struct ofpbuf *);
@@ -70,6 +86,9 @@ struct ofpbuf *ofpbuf_clone(const struct ofpbuf *);
 struct ofpbuf *ofpbuf_clone_with_headroom(const struct ofpbuf *,
                                           size_t headroom);
 struct ofpbuf *ofpbuf_clone_data(const void *, size_t);
+struct ofpbuf *ofpbuf_share(struct ofpbuf *);
+bool ofpbuf_is_shared(const struct ofpbuf *);
+void ofpbuf_unshare(struct ofpbuf *);
 void ofpbuf_delete(struct ofpbuf *);
 
 void *ofpbuf_at(const struct ofpbuf *, size_t offset, size_t size);
@@ -33,12 +33,22 @@
 
 #include <config.h>
 #include "poll-loop.h"
+
+/* Defining POLL_LOOP_NO_EPOLL builds the poll() backend alone, for
+ * tests/bench-poll-loop-poll. */
+#if defined(HAVE_EPOLL_CREATE1) && !defined(POLL_LOOP_NO_EPOLL)
+#define USE_EPOLL 1
+#endif
+
 #include <assert.h>
 #include <errno.h>
 #include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
 #include "backtrace.h"
 #include "dynamic-string.h"
 #include "list.h"
@@ -58,27 +68,30 @@ struct poll_waiter {
     struct backtrace *backtrace; /* Optionally, event that created waiter. */
 
     /* Set only when poll_block() is called. */
-    struct pollfd *pollfd;      /* Pointer to element of the pollfds array
-                                   (null if added from a callback). */
+    short int revents;          /* Events that occurred on 'fd' (zero if
+                                   added from a callback). */
 };
 
-/* All active poll waiters. */
-static struct list waiters = LIST_INITIALIZER(&waiters);
+/* Each thread has a poll loop of its own, so all of the state below is
+ * per-thread. */
+
+/* All active poll waiters (initialized on first use). */
+static THREAD_LOCAL struct list waiters;
 
 /* Number of elements in the waiters list. */
-static size_t n_waiters;
+static THREAD_LOCAL size_t n_waiters;
 
 /* Max time to wait in next call to poll_block(), in milliseconds, or -1 to
  * wait forever. */
-static int timeout = -1;
+static THREAD_LOCAL int timeout = -1;
 
 /* Backtrace of 'timeout''s registration, if debugging is enabled. */
-static struct backtrace timeout_backtrace;
+static THREAD_LOCAL struct backtrace timeout_backtrace;
 
 /* Callback currently running, to allow verifying that poll_cancel() is not
  * being called on a running callback. */
 #ifndef NDEBUG
-static struct poll_waiter *running_cb;
+static THREAD_LOCAL struct poll_waiter *running_cb;
 #endif
 
 static struct poll_waiter *new_waiter(int fd, short int events);
@@ -145,24 +158,19 @@ log_wakeup(const struct backtrace *backtrace, const char *format, ...)
     ds_destroy(&ds);
 }
 
-/* Blocks until one or more of the events registered with poll_fd_wait()
- * occurs, or until the minimum duration registered with poll_timer_wait()
- * elapses, or not at all if poll_immediate_wake() has been called.
- *
- * Also executes any autonomous subroutines registered with poll_fd_callback(),
- * if their file descriptors have become ready. */
-void
-poll_block(void)
+/* Waits with poll() for the events that 'waiters' wait for, and stores the
+ * events that occurred in their 'revents' members.  Returns the number of
+ * file descriptors with events, 0 on timeout, or a negative errno value. */
+static int
+wait_poll(void)
 {
-    static struct pollfd *pollfds;
-    static size_t max_pollfds;
+    static THREAD_LOCAL struct pollfd *pollfds;
+    static THREAD_LOCAL size_t max_pollfds;
 
     struct poll_waiter *pw;
-    struct list *node;
     int n_pollfds;
     int retval;
 
-    assert(!running_cb);
     if (max_pollfds < n_waiters) {
         max_pollfds = n_waiters;
         pollfds = xrealloc(pollfds, max_pollfds * sizeof *pollfds);
@@ -170,7 +178,6 @@ poll_block(void)
 
     n_pollfds = 0;
     LIST_FOR_EACH (pw, struct poll_waiter, node, &waiters) {
-        pw->pollfd = &pollfds[n_pollfds];
         pollfds[n_pollfds].fd = pw->fd;
         pollfds[n_pollfds].events = pw->events;
         pollfds[n_pollfds].revents = 0;
@@ -178,6 +185,290 @@ poll_block(void)
     }
 
     retval = time_poll(pollfds, n_pollfds, timeout);
+
+    n_pollfds = 0;
+    LIST_FOR_EACH (pw, struct poll_waiter, node, &waiters) {
+        pw->revents = retval > 0 ? pollfds[n_pollfds].revents : 0;
+        n_pollfds++;
+    }
+    return retval;
+}
+
+#ifdef USE_EPOLL
+/* epoll backend.
+ *
+ * Waiters only last until the next poll_block(), but most of them wait on
+ * the same file descriptors every time, so file descriptors stay registered
+ * with 'epoll_fd' across calls and only changes cost a system call.  A file
+ * descriptor is unregistered when a poll_block() goes by without a waiter
+ * for it, or when poll_fd_forget() is called for it. */
+
+BUILD_ASSERT_DECL(EPOLLIN == POLLIN && EPOLLPRI == POLLPRI
+                  && EPOLLOUT == POLLOUT && EPOLLERR == POLLERR
+                  && EPOLLHUP == POLLHUP);
+
+/* The registration of a file descriptor with 'epoll_fd'. */
+struct epoll_reg {
+    bool registered;            /* Registered with 'epoll_fd'? */
+    short int events;           /* Events registered with 'epoll_fd'. */
+    size_t idx;                 /* Index in 'reg_fds', if registered. */
+
+    /* Set only when poll_block() is called. */
+    unsigned int serial;        /* Last poll_block() that waited on it. */
+    short int wanted;           /* Events wanted by that poll_block(). */
+    short int revents;          /* Events that occurred. */
+};
+
+/* The epoll instance, or -1 if not created yet, or if epoll_create1() failed
+ * (in which case 'epoll_failed' is set and poll() is used instead). */
+static THREAD_LOCAL int epoll_fd = -1;
+static THREAD_LOCAL bool epoll_failed;
+
+/* Registrations, indexed by file descriptor. */
+static THREAD_LOCAL struct epoll_reg *regs;
+static THREAD_LOCAL int n_regs;
+
+/* The registered file descriptors. */
+static THREAD_LOCAL int *reg_fds;
+static THREAD_LOCAL size_t n_reg_fds, allocated_reg_fds;
+
+/* Incremented by every poll_fd_forget(), and the value this thread last
+ * acted on.  A file descriptor forgotten by another thread may be registered
+ * with this thread's epoll instance too, so when they differ all of the
+ * registrations are dropped and redone. */
+static unsigned int forget_seq;
+static THREAD_LOCAL unsigned int seen_forget_seq;
+
+static struct epoll_reg *
+get_reg(int fd)
+{
+    if (fd >= n_regs) {
+        int n = MAX(fd + 1, n_regs * 2);
+
+        regs = xrealloc(regs, n * sizeof *regs);
+        memset(&regs[n_regs], 0, (n - n_regs) * sizeof *regs);
+        n_regs = n;
+    }
+    return &regs[fd];
+}
+
+static void
+unregister_fd(int fd)
+{
+    struct epoll_reg *reg = &regs[fd];
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    reg->registered = false;
+    reg->events = 0;
+    reg_fds[reg->idx] = reg_fds[--n_reg_fds];
+    regs[reg_fds[reg->idx]].idx = reg->idx;
+}
+
+/* Registers 'fd' with 'epoll_fd' for the events in 'reg->wanted'.  Returns 0
+ * if successful, otherwise a positive errno value. */
+static int
+register_fd(int fd, struct epoll_reg *reg)
+{
+    struct epoll_event event;
+    int op;
+
+    memset(&event, 0, sizeof event);
+    event.events = reg->wanted;
+    event.data.fd = fd;
+
+    /* The kernel drops registrations of closed files by itself, and a new
+     * file may have been given the number of a registered one. */
+    op = reg->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(epoll_fd, op, fd, &event) < 0) {
+        if (errno != (op == EPOLL_CTL_MOD ? ENOENT : EEXIST)) {
+            return errno;
+        }
+        op = op == EPOLL_CTL_MOD ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+        if (epoll_ctl(epoll_fd, op, fd, &event) < 0) {
+            return errno;
+        }
+    }
+
+    if (!reg->registered) {
+        if (n_reg_fds >= allocated_reg_fds) {
+            allocated_reg_fds = MAX(16, allocated_reg_fds * 2);
+            reg_fds = xrealloc(reg_fds, allocated_reg_fds * sizeof *reg_fds);
+        }
+        reg->registered = true;
+        reg->idx = n_reg_fds;
+        reg_fds[n_reg_fds++] = fd;
+    }
+    reg->events = reg->wanted;
+    return 0;
+}
+
+/* Like wait_poll(), but with 'epoll_fd'.  Falls back to wait_poll() if epoll
+ * cannot be used. */
+static int
+wait_epoll(void)
+{
+    static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+    static THREAD_LOCAL struct epoll_event *events;
+    static THREAD_LOCAL size_t max_events;
+    static THREAD_LOCAL unsigned int serial;
+
+    struct poll_waiter *pw;
+    struct pollfd pollfd;
+    int n_ready;
+    int retval;
+    size_t i;
+
+    if (epoll_fd < 0) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) {
+            VLOG_WARN(LOG_MODULE, "epoll_create1 failed (%s), using poll",
+                      strerror(errno));
+            epoll_failed = true;
+            return wait_poll();
+        }
+    }
+
+    if (seen_forget_seq != __atomic_load_n(&forget_seq, __ATOMIC_ACQUIRE)) {
+        seen_forget_seq = __atomic_load_n(&forget_seq, __ATOMIC_ACQUIRE);
+        while (n_reg_fds > 0) {
+            unregister_fd(reg_fds[0]);
+        }
+    }
+
+    /* Gather the events wanted on each file descriptor. */
+    serial++;
+    LIST_FOR_EACH (pw, struct poll_waiter, node, &waiters) {
+        struct epoll_reg *reg = get_reg(pw->fd);
+        if (reg->serial != serial) {
+            reg->serial = serial;
+            reg->wanted = 0;
+            reg->revents = 0;
+        }
+        reg->wanted |= pw->events;
+    }
+
+    /* Drop the file descriptors that nothing waits on anymore. */
+    for (i = 0; i < n_reg_fds; ) {
+        int fd = reg_fds[i];
+        if (regs[fd].serial != serial) {
+            unregister_fd(fd);
+        } else {
+            i++;
+        }
+    }
+
+    /* Register the new and changed ones.  poll() reports file descriptors
+     * that epoll cannot watch (such as regular files) as always ready, and
+     * invalid ones as POLLNVAL, so do the same here. */
+    n_ready = 0;
+    LIST_FOR_EACH (pw, struct poll_waiter, node, &waiters) {
+        struct epoll_reg *reg = &regs[pw->fd];
+        int error;
+
+        if ((reg->registered && reg->events == reg->wanted) || reg->revents) {
+            continue;
+        }
+        error = register_fd(pw->fd, reg);
+        if (error == EPERM) {
+            reg->revents = reg->wanted & (POLLIN | POLLOUT);
+            n_ready++;
+        } else if (error == EBADF) {
+            reg->revents = POLLNVAL;
+            n_ready++;
+        } else if (error) {
+            VLOG_ERR_RL(LOG_MODULE, &rl, "epoll_ctl on fd %d: %s",
+                        pw->fd, strerror(error));
+            return wait_poll();
+        }
+    }
+
+    /* The epoll instance is readable while any of its file descriptors is
+     * ready, so time_poll() can do the waiting. */
+    pollfd.fd = epoll_fd;
+    pollfd.events = POLLIN;
+    pollfd.revents = 0;
+    retval = time_poll(&pollfd, 1, n_ready ? 0 : timeout);
+    if (retval > 0) {
+        int n;
+
+        if (max_events < n_reg_fds) {
+            max_events = n_reg_fds;
+            events = xrealloc(events, max_events * sizeof *events);
+        }
+        n = max_events ? epoll_wait(epoll_fd, events, max_events, 0) : 0;
+        for (i = 0; n > 0 && i < (size_t) n; i++) {
+            regs[events[i].data.fd].revents |= events[i].events;
+        }
+        n_ready += MAX(n, 0);
+    } else if (retval < 0) {
+        return retval;
+    }
+
+    LIST_FOR_EACH (pw, struct poll_waiter, node, &waiters) {
+        pw->revents = regs[pw->fd].revents & (pw->events | POLLERR | POLLHUP
+                                              | POLLNVAL);
+    }
+    return n_ready;
+}
+
+/* Uses epoll unless it failed. */
+static int
+wait_events(void)
+{
+    return epoll_failed ? wait_poll() : wait_epoll();
+}
+
+/* Tells the poll loop that 'fd' is about to be closed, so that a file that
+ * later gets the same file descriptor is not mistaken for it.  Should be
+ * called before closing any file descriptor that may have been waited on. */
+void
+poll_fd_forget(int fd)
+{
+    unsigned int seq;
+
+    if (fd >= 0 && fd < n_regs && regs[fd].registered) {
+        unregister_fd(fd);
+    }
+
+    /* Other threads need to drop their registrations of 'fd' too, but this
+     * one does not unless another thread forgot something meanwhile. */
+    seq = __atomic_add_fetch(&forget_seq, 1, __ATOMIC_RELEASE);
+    if (seq == seen_forget_seq + 1) {
+        seen_forget_seq = seq;
+    }
+}
+#else  /* !USE_EPOLL */
+static int
+wait_events(void)
+{
+    return wait_poll();
+}
+
+void
+poll_fd_forget(int fd UNUSED)
+{
+}
+#endif /* !USE_EPOLL */
+
+/* Blocks until one or more of the events registered with poll_fd_wait()
+ * occurs, or until the minimum duration registered with poll_timer_wait()
+ * elapses, or not at all if poll_immediate_wake() has been called.
+ *
+ * Also executes any autonomous subroutines registered with poll_fd_callback(),
+ * if their file descriptors have become ready. */
+void
+poll_block(void)
+{
+    struct poll_waiter *pw;
+    struct list *node;
+    int retval;
+
+    assert(!running_cb);
+    if (!waiters.next) {
+        list_init(&waiters);
+    }
+
+    retval = wait_events();
     if (retval < 0) {
         static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
         VLOG_ERR_RL(LOG_MODULE, &rl, "poll: %s", strerror(-retval));
@@ -187,7 +478,7 @@ poll_block(void)
 
     for (node = waiters.next; node != &waiters; ) {
         pw = CONTAINER_OF(node, struct poll_waiter, node);
-        if (!pw->pollfd || !pw->pollfd->revents) {
+        if (!pw->revents) {
             if (pw->function) {
                 node = node->next;
                 continue;
@@ -195,11 +486,11 @@ poll_block(void)
         } else {
             if (VLOG_IS_DBG_ENABLED(LOG_MODULE)) {
                 log_wakeup(pw->backtrace, "%s%s%s%s%s on fd %d",
-                           pw->pollfd->revents & POLLIN ? "[POLLIN]" : "",
-                           pw->pollfd->revents & POLLOUT ? "[POLLOUT]" : "",
-                           pw->pollfd->revents & POLLERR ? "[POLLERR]" : "",
-                           pw->pollfd->revents & POLLHUP ? "[POLLHUP]" : "",
-                           pw->pollfd->revents & POLLNVAL ? "[POLLNVAL]" : "",
+                           pw->revents & POLLIN ? "[POLLIN]" : "",
+                           pw->revents & POLLOUT ? "[POLLOUT]" : "",
+                           pw->revents & POLLERR ? "[POLLERR]" : "",
+                           pw->revents & POLLHUP ? "[POLLHUP]" : "",
+                           pw->revents & POLLNVAL ? "[POLLNVAL]" : "",
                            pw->fd);
             }
 
@@ -207,7 +498,7 @@ poll_block(void)
 #ifndef NDEBUG
                 running_cb = pw;
 #endif
-                pw->function(pw->fd, pw->pollfd->revents, pw->aux);
+                pw->function(pw->fd, pw->revents, pw->aux);
 #ifndef NDEBUG
                 running_cb = NULL;
 #endif
@@ -221,14 +512,6 @@ poll_block(void)
     timeout_backtrace.n_frames = 0;
 }
 
-/* Registers 'function' to be called with argument 'aux' by poll_block() when
- * 'fd' becomes ready for one of the events in 'events', which should be POLLIN
- * or POLLOUT or POLLIN | POLLOUT.
- *
- * The callback registration persists until the event actually occurs.  At that
- * point, it is automatically de-registered.  The callback function must
- * re-register the event by calling poll_fd_callback() again within the
- * callback, if it wants to be called back again later. */
 struct poll_waiter *
 poll_fd_callback(int fd, short int events, poll_fd_func *function, void *aux)
 {
@@ -274,6 +557,9 @@ new_waiter(int fd, short int events)
         waiter->backtrace = xmalloc(sizeof *waiter->backtrace);
         backtrace_capture(waiter->backtrace);
     }
+    if (!waiters.next) {
+        list_init(&waiters);
+    }
     list_push_back(&waiters, &waiter->node);
     n_waiters++;
     return waiter;
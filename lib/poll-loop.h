@@ -31,7 +31,7 @@
  * derivatives without specific, written prior permission.
  */
 
-/* High-level wrapper around the "poll" system call.
+/* High-level wrapper around the "poll" system call (or, on Linux, "epoll").
  *
  * Intended usage is for the program's main loop to go about its business
  * servicing whatever events it needs to.  Then, when it runs out of immediate
@@ -44,7 +44,10 @@
  * There is also some support for autonomous subroutines that are executed by
  * poll_block() when a file descriptor becomes ready.  To prevent these
  * routines from starving if events are continuously ready, the application
- * should bound the amount of work it does between poll_block() calls. */
+ * should bound the amount of work it does between poll_block() calls.
+ *
+ * Every thread has a separate set of events: poll_block() only waits for the
+ * events registered by the thread that calls it. */
 
 #ifndef POLL_LOOP_H
 #define POLL_LOOP_H 1
@@ -69,4 +72,7 @@ struct poll_waiter *poll_fd_callback(int fd, short int events,
 /* Cancel a file descriptor callback or event. */
 void poll_cancel(struct poll_waiter *);
 
+/* Must be called before closing a file descriptor that was waited on. */
+void poll_fd_forget(int fd);
+
 #endif /* poll-loop.h */
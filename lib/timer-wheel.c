@@ -0,0 +1,227 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <config.h>
+#include "timer-wheel.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+#define TIMER_WHEEL_MASK   (TIMER_WHEEL_SLOTS - 1)
+
+/* Timers further away than this are placed at the end of the range and
+ * moved again when the wheel gets there. */
+#define TIMER_WHEEL_RANGE  (1LL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+static inline int
+timer_wheel_index(int level, long long int when)
+{
+    return (when >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+}
+
+static struct list *
+timer_wheel_slot(struct timer_wheel *wheel, int level, long long int when)
+{
+    return &wheel->slots[level * TIMER_WHEEL_SLOTS
+                         + timer_wheel_index(level, when)];
+}
+
+/* Puts 'timer' into the slot for 'when', which is not before the current
+ * time of the wheel. */
+static void
+timer_wheel_place(struct timer_wheel *wheel, struct wheel_timer *timer,
+                  long long int when)
+{
+    long long int delta;
+    int level;
+
+    if (when - wheel->now >= TIMER_WHEEL_RANGE) {
+        when = wheel->now + TIMER_WHEEL_RANGE - 1;
+    }
+    delta = when - wheel->now;
+    for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++) {
+        if (delta < 1LL << (TIMER_WHEEL_BITS * (level + 1))) {
+            break;
+        }
+    }
+    list_push_back(timer_wheel_slot(wheel, level, when), &timer->node);
+    wheel->occupied[level] |= UINT64_C(1) << timer_wheel_index(level, when);
+}
+
+/* Moves the timers of a slot down to the lower levels, or to the expired
+ * list if they are due. */
+static void
+timer_wheel_cascade(struct timer_wheel *wheel, int level)
+{
+    struct list *slot = timer_wheel_slot(wheel, level, wheel->now);
+
+    /* Cancelling a timer leaves its slot's bit set, which is harmless. */
+    wheel->occupied[level] &= ~(UINT64_C(1)
+                                << timer_wheel_index(level, wheel->now));
+    while (!list_is_empty(slot)) {
+        struct wheel_timer *timer = CONTAINER_OF(list_pop_front(slot),
+                                                 struct wheel_timer, node);
+        if (timer->expires <= wheel->now) {
+            list_push_back(&wheel->expired, &timer->node);
+            wheel->n_timers--;
+        } else {
+            timer_wheel_place(wheel, timer, timer->expires);
+        }
+    }
+}
+
+/* Returns the next time after the current one at which the wheel reaches a
+ * slot that may hold timers. */
+static long long int
+timer_wheel_next(const struct timer_wheel *wheel)
+{
+    long long int next = LLONG_MAX;
+    int level;
+
+    for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        uint64_t bits = wheel->occupied[level];
+        long long int base = wheel->now >> (TIMER_WHEEL_BITS * level);
+        int start, dist;
+
+        if (bits == 0) {
+            continue;
+        }
+        /* Rotate the bitmap so that bit 0 is the slot after the current. */
+        start = (base + 1) & TIMER_WHEEL_MASK;
+        if (start != 0) {
+            bits = (bits >> start) | (bits << (TIMER_WHEEL_SLOTS - start));
+        }
+        dist = __builtin_ctzll(bits) + 1;
+        if ((base + dist) << (TIMER_WHEEL_BITS * level) < next) {
+            next = (base + dist) << (TIMER_WHEEL_BITS * level);
+        }
+    }
+    return next;
+}
+
+/* Advances the wheel to 'now', moving the timers due to the expired list. */
+static void
+timer_wheel_advance(struct timer_wheel *wheel, long long int now)
+{
+    while (wheel->now < now) {
+        long long int next;
+        int level;
+
+        next = wheel->n_timers > 0 ? timer_wheel_next(wheel) : LLONG_MAX;
+        if (next > now) {
+            wheel->now = now;
+            break;
+        }
+
+        wheel->now = next;
+        for (level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+            if (!(wheel->now & ((1LL << (TIMER_WHEEL_BITS * level)) - 1))) {
+                timer_wheel_cascade(wheel, level);
+            }
+        }
+        timer_wheel_cascade(wheel, 0);
+    }
+}
+
+/* Initializes 'wheel' as empty, with its current time set to 'now'. */
+void
+timer_wheel_init(struct timer_wheel *wheel, long long int now)
+{
+    wheel->now = now;
+    wheel->n_timers = 0;
+    wheel->slots = NULL;
+    memset(wheel->occupied, 0, sizeof wheel->occupied);
+    list_init(&wheel->expired);
+}
+
+/* Frees the slots of 'wheel'. The timers in it are not touched. */
+void
+timer_wheel_destroy(struct timer_wheel *wheel)
+{
+    free(wheel->slots);
+    wheel->slots = NULL;
+}
+
+/* Adds 'timer' to 'wheel', to be due at 'expires'. A timer that is already
+ * due is returned by the next timer_wheel_expire(). 'timer' must not be
+ * scheduled. */
+void
+timer_wheel_add(struct timer_wheel *wheel, struct wheel_timer *timer,
+                long long int expires)
+{
+    if (wheel->slots == NULL) {
+        size_t i;
+
+        wheel->slots = xmalloc(sizeof *wheel->slots
+                               * TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS);
+        for (i = 0; i < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS; i++) {
+            list_init(&wheel->slots[i]);
+        }
+    }
+
+    timer->expires = expires;
+    if (expires <= wheel->now) {
+        list_push_back(&wheel->expired, &timer->node);
+    } else {
+        timer_wheel_place(wheel, timer, expires);
+        wheel->n_timers++;
+    }
+}
+
+/* Removes 'timer' from 'wheel', if it is scheduled. */
+void
+timer_wheel_cancel(struct timer_wheel *wheel, struct wheel_timer *timer)
+{
+    if (wheel_timer_is_scheduled(timer)) {
+        list_remove(&timer->node);
+        list_init(&timer->node);
+        if (timer->expires > wheel->now) {
+            wheel->n_timers--;
+        }
+    }
+}
+
+/* Advances 'wheel' to 'now', and removes and returns a timer that is due,
+ * or returns NULL if none is. */
+struct wheel_timer *
+timer_wheel_expire(struct timer_wheel *wheel, long long int now)
+{
+    struct wheel_timer *timer;
+
+    timer_wheel_advance(wheel, now);
+    if (list_is_empty(&wheel->expired)) {
+        return NULL;
+    }
+    timer = CONTAINER_OF(list_pop_front(&wheel->expired),
+                         struct wheel_timer, node);
+    list_init(&timer->node);
+    return timer;
+}
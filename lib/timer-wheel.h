@@ -0,0 +1,96 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H 1
+
+/* Hierarchical timer wheel.
+ *
+ * Timers are kept in TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS lists
+ * each. Level 0 has one slot per tick; each further level has slots
+ * TIMER_WHEEL_SLOTS times as wide. A timer goes to the lowest level whose
+ * range covers it, and is moved down a level whenever the wheel reaches its
+ * slot, so adding and cancelling a timer take constant time, and advancing
+ * the wheel only touches the timers that are due and those being moved down.
+ * A bitmap of the non-empty slots of each level lets it skip empty slots.
+ *
+ * Times are in arbitrary ticks, e.g. the milliseconds of time_msec(). The
+ * slots are only allocated when the first timer is added. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "list.h"
+
+#define TIMER_WHEEL_BITS   6        /* one bit per slot in a uint64_t. */
+#define TIMER_WHEEL_SLOTS  (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 6
+
+struct wheel_timer {
+    struct list    node;        /* element in a slot of the wheel. */
+    long long int  expires;     /* time the timer is due at. */
+};
+
+struct timer_wheel {
+    long long int  now;         /* time the wheel has been advanced to. */
+    size_t         n_timers;    /* timers in the slots. */
+    struct list   *slots;       /* TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS
+                                   lists, or NULL. */
+    uint64_t       occupied[TIMER_WHEEL_LEVELS]; /* slots that may be
+                                   non-empty. */
+    struct list    expired;     /* timers due, not yet returned. A timer is
+                                   here if and only if it expires at or
+                                   before 'now'. */
+};
+
+void timer_wheel_init(struct timer_wheel *, long long int now);
+void timer_wheel_destroy(struct timer_wheel *);
+
+void timer_wheel_add(struct timer_wheel *, struct wheel_timer *,
+                     long long int expires);
+void timer_wheel_cancel(struct timer_wheel *, struct wheel_timer *);
+struct wheel_timer *timer_wheel_expire(struct timer_wheel *,
+                                       long long int now);
+
+/* Initializes 'timer' as not scheduled. */
+static inline void
+wheel_timer_init(struct wheel_timer *timer)
+{
+    list_init(&timer->node);
+}
+
+/* Returns true if 'timer' is in a wheel. */
+static inline bool
+wheel_timer_is_scheduled(const struct wheel_timer *timer)
+{
+    return !list_is_empty(&timer->node);
+}
+
+#endif /* timer-wheel.h */
@@ -39,17 +39,23 @@
 #include <signal.h>
 #include <string.h>
 #include <sys/time.h>
+#include "compiler.h"
 #include "fatal-signal.h"
 #include "util.h"
 
 /* Initialized? */
 static bool inited;
 
-/* Has a timer tick occurred? */
-static volatile sig_atomic_t tick;
+/* Number of timer ticks so far.  SIGALRM may be delivered to any thread, so
+ * the handler only bumps this counter and each thread refreshes its own copy
+ * of the time when it sees the counter move.  Starts at 1 so that a thread
+ * that has not refreshed yet always does. */
+static unsigned int tick = 1;
 
-/* The current time, as of the last refresh. */
-static struct timeval now;
+/* The current time, as of this thread's last refresh, and the value of 'tick'
+ * at that refresh. */
+static THREAD_LOCAL struct timeval now;
+static THREAD_LOCAL unsigned int now_tick;
 
 /* Time at which to die with SIGALRM (if not TIME_MIN). */
 static time_t deadline = TIME_MIN;
@@ -72,8 +78,7 @@ time_init(void)
     }
 
     inited = true;
-    gettimeofday(&now, NULL);
-    tick = false;
+    time_refresh();
 
     /* Set up signal handler. */
     memset(&sa, 0, sizeof sa);
@@ -99,8 +104,8 @@ time_init(void)
 void
 time_refresh(void)
 {
+    now_tick = __atomic_load_n(&tick, __ATOMIC_RELAXED);
     gettimeofday(&now, NULL);
-    tick = false;
 }
 
 /* Returns the current time, in seconds. */
@@ -194,7 +199,7 @@ time_add(time_t a, time_t b)
 static void
 sigalrm_handler(int sig_nr)
 {
-    tick = true;
+    __atomic_add_fetch(&tick, 1, __ATOMIC_RELAXED);
     if (deadline != TIME_MIN && time(0) > deadline) {
         fatal_signal_handler(sig_nr);
     }
@@ -204,7 +209,7 @@ static void
 refresh_if_ticked(void)
 {
     assert(inited);
-    if (tick) {
+    if (__atomic_load_n(&tick, __ATOMIC_RELAXED) != now_tick) {
         time_refresh();
     }
 }
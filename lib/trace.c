@@ -0,0 +1,169 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <config.h>
+#include "trace.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dynamic-string.h"
+#include "timeval.h"
+#include "util.h"
+
+/* Number of records in the ring, a power of 2. */
+#define TRACE_RING_SIZE 4096
+
+/* Maximum number of records returned by trace_dump(), so that the dump fits
+ * in the reply of a vlog socket. */
+#define TRACE_DUMP_MAX 512
+
+struct trace_record {
+    uint64_t seq;               /* 1 + number of records before this one, or
+                                   0 while the record is being written. */
+    const struct trace_point *point;
+    long long int when;         /* time_msec() when recorded. */
+    uint64_t args[TRACE_MAX_ARGS];
+};
+
+bool trace_modules[VLM_N_MODULES];
+
+static struct trace_record ring[TRACE_RING_SIZE];
+static uint64_t n_records;
+
+/* Records an event at trace point 'point'.  Called by the TRACE macro; may be
+ * called by any thread. */
+void
+trace_record(const struct trace_point *point,
+             const uint64_t args[TRACE_MAX_ARGS])
+{
+    uint64_t seq = __atomic_fetch_add(&n_records, 1, __ATOMIC_RELAXED);
+    struct trace_record *r = &ring[seq & (TRACE_RING_SIZE - 1)];
+
+    /* The reader of a record checks that its sequence number did not change
+     * while it read it, like a seqlock. */
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    r->point = point;
+    r->when = time_msec();
+    memcpy(r->args, args, sizeof r->args);
+    __atomic_store_n(&r->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Turns the trace points of 'module' on or off, or those of all modules if
+ * 'module' is VLM_ANY_MODULE. */
+void
+trace_set(enum vlog_module module, bool on)
+{
+    if (module == VLM_ANY_MODULE) {
+        for (module = 0; module < VLM_N_MODULES; module++) {
+            trace_modules[module] = on;
+        }
+    } else {
+        assert(module < VLM_N_MODULES);
+        trace_modules[module] = on;
+    }
+}
+
+/* Turns trace points on or off as specified by 's', of the form
+ * "MODULE[:on|:off]", where MODULE may be "ANY".  Returns NULL if successful,
+ * otherwise an error message that the caller must free(). */
+char *
+trace_set_from_string(const char *s_)
+{
+    char *s = xstrdup(s_);
+    char *state = strchr(s, ':');
+    enum vlog_module module;
+    char *msg = NULL;
+    bool on = true;
+
+    if (state != NULL) {
+        *state++ = '\0';
+        if (!strcmp(state, "off")) {
+            on = false;
+        } else if (strcmp(state, "on")) {
+            msg = xasprintf("unknown trace state \"%s\"", state);
+        }
+    }
+    if (msg == NULL) {
+        if (!strcmp(s, "ANY")) {
+            module = VLM_ANY_MODULE;
+        } else {
+            module = vlog_get_module_val(s);
+            if (module >= VLM_N_MODULES) {
+                msg = xasprintf("unknown module \"%s\"", s);
+            }
+        }
+        if (msg == NULL) {
+            trace_set(module, on);
+        }
+    }
+    free(s);
+    return msg;
+}
+
+/* Formats the latest records of the ring, oldest first, one per line.  The
+ * caller must free() the returned string. */
+char *
+trace_dump(void)
+{
+    struct ds s = DS_EMPTY_INITIALIZER;
+    uint64_t end = __atomic_load_n(&n_records, __ATOMIC_ACQUIRE);
+    uint64_t seq = end > TRACE_DUMP_MAX ? end - TRACE_DUMP_MAX : 0;
+
+    for (; seq < end; seq++) {
+        struct trace_record *r = &ring[seq & (TRACE_RING_SIZE - 1)];
+        struct trace_record copy;
+        char when[16];
+        struct tm tm;
+        time_t secs;
+
+        if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != seq + 1) {
+            continue;           /* overwritten, or being written. */
+        }
+        copy = *r;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) != seq + 1) {
+            continue;
+        }
+
+        secs = copy.when / 1000;
+        localtime_r(&secs, &tm);
+        strftime(when, sizeof when, "%H:%M:%S", &tm);
+        ds_put_format(&s, "%s.%03lld|%s|%s|", when, copy.when % 1000,
+                      vlog_get_module_name(copy.point->module),
+                      copy.point->name);
+        ds_put_format(&s, copy.point->format, copy.args[0], copy.args[1],
+                      copy.args[2], copy.args[3]);
+        ds_put_char(&s, '\n');
+    }
+    return ds_cstr(&s);
+}
@@ -0,0 +1,94 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H 1
+
+/* Trace points.
+ *
+ * A trace point records an event of the packet path, along with a few integer
+ * arguments, in a ring of binary records shared by all threads.  Recording
+ * takes neither a lock nor any formatting: the records are formatted only when
+ * the ring is dumped, with "vlogconf --dump-trace".
+ *
+ * Trace points belong to a vlog module, and are turned on and off by module
+ * ("vlogconf --trace"); they are all off at startup, and then cost a test of
+ * a flag.  Configuring with --disable-trace compiles them out. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "vlog.h"
+
+/* Maximum number of arguments of a trace point. */
+#define TRACE_MAX_ARGS 4
+
+struct trace_point {
+    enum vlog_module module;
+    const char *name;
+    const char *format;         /* printf() format for the arguments, all of
+                                   them uint64_t. */
+};
+
+/* Records an event at a trace point named NAME, of vlog module MODULE, with
+ * up to TRACE_MAX_ARGS integer arguments formatted with FORMAT, e.g.:
+ *
+ *     TRACE(VLM_pipeline, "table_miss", "table %"PRIu64, table_id);
+ *
+ * The arguments are only evaluated if the trace point is on. */
+#ifdef HAVE_TRACE
+#define TRACE(MODULE, NAME, FORMAT, ...)                                \
+    do {                                                                \
+        if (trace_modules[MODULE]) {                                    \
+            static const struct trace_point trace_point__ =             \
+                { MODULE, NAME, FORMAT };                               \
+            trace_record(&trace_point__,                                \
+                         (const uint64_t[TRACE_MAX_ARGS]) { __VA_ARGS__ }); \
+        }                                                               \
+    } while (0)
+#else
+#define TRACE(MODULE, NAME, FORMAT, ...)                                \
+    do {                                                                \
+        if (0) {                                                        \
+            trace_record(NULL,                                          \
+                         (const uint64_t[TRACE_MAX_ARGS]) { __VA_ARGS__ }); \
+        }                                                               \
+    } while (0)
+#endif
+
+extern bool trace_modules[VLM_N_MODULES];
+
+void trace_record(const struct trace_point *,
+                  const uint64_t args[TRACE_MAX_ARGS]);
+
+void trace_set(enum vlog_module, bool on);
+char *trace_set_from_string(const char *);
+char *trace_dump(void);
+
+#endif /* trace.h */
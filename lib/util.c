@@ -67,6 +67,18 @@ xmalloc(size_t size)
     return p;
 }
 
+/* Allocates 'size' bytes aligned to 'align', a power of two multiple of
+ * sizeof(void *).  The memory is released with free(). */
+void *
+xmalloc_aligned(size_t align, size_t size)
+{
+    void *p;
+    if (posix_memalign(&p, align, size ? size : 1) != 0) {
+        out_of_memory();
+    }
+    return p;
+}
+
 void *
 xrealloc(void *p, size_t size) 
 {
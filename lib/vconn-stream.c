@@ -98,6 +98,7 @@ stream_close(struct vconn *vconn)
     poll_cancel(s->tx_waiter);
     stream_clear_txbuf(s);
     ofpbuf_delete(s->rxbuf);
+    poll_fd_forget(s->fd);
     close(s->fd);
     free(s);
 }
@@ -347,6 +348,7 @@ static void
 pstream_close(struct pvconn *pvconn)
 {
     struct pstream_pvconn *ps = pstream_pvconn_cast(pvconn);
+    poll_fd_forget(ps->fd);
     close(ps->fd);
     free(ps);
 }
@@ -49,6 +49,7 @@
 #include "poll-loop.h"
 #include "socket-util.h"
 #include "timeval.h"
+#include "trace.h"
 #include "util.h"
 
 #ifndef SCM_CREDENTIALS
@@ -67,6 +68,10 @@ struct vlog_server {
 
 static void poll_server(int fd, short int events, void *server_);
 
+/* Callback answering "stats" requests, if any. */
+static char *(*stats_cb)(void *aux);
+static void *stats_aux;
+
 /* Start listening for connections from clients and processing their
  * requests.  'path' may be:
  *
@@ -125,6 +130,7 @@ vlog_server_close(struct vlog_server *server)
 {
     if (server) {
         poll_cancel(server->waiter);
+        poll_fd_forget(server->fd);
         close(server->fd);
         unlink(server->path);
         fatal_signal_remove_file_to_unlink(server->path);
@@ -236,6 +242,15 @@ recv_with_creds(const struct vlog_server *server,
 #endif /* !SCM_CREDENTIALS */
 }
 
+/* Makes servers answer "stats" requests with the string returned by
+ * 'stats(aux)', which must be allocated with malloc(). */
+void
+vlog_server_set_stats(char *(*stats)(void *aux), void *aux)
+{
+    stats_cb = stats;
+    stats_aux = aux;
+}
+
 /* Processes incoming requests for 'server'. */
 static void
 poll_server(int fd UNUSED, short int events UNUSED, void *server_)
@@ -265,6 +280,13 @@ poll_server(int fd UNUSED, short int events UNUSED, void *server_)
             reply = msg ? msg : xstrdup("ack");
         } else if (!strcmp(cmd_buf, "list")) {
             reply = vlog_get_levels();
+        } else if (!strncmp(cmd_buf, "trace ", 6)) {
+            char *msg = trace_set_from_string(cmd_buf + 6);
+            reply = msg ? msg : xstrdup("ack");
+        } else if (!strcmp(cmd_buf, "dump-trace")) {
+            reply = trace_dump();
+        } else if (!strcmp(cmd_buf, "stats") && stats_cb) {
+            reply = stats_cb(stats_aux);
         } else if (!strcmp(cmd_buf, "reopen")) {
             int error = vlog_reopen_log_file();
             reply = (error
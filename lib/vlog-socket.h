@@ -38,6 +38,7 @@
 struct vlog_server;
 int vlog_server_listen(const char *path, struct vlog_server **);
 void vlog_server_close(struct vlog_server *);
+void vlog_server_set_stats(char *(*stats)(void *aux), void *aux);
 
 /* Client for Vlog control connection. */
 struct vlog_client;
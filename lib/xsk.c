@@ -0,0 +1,859 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <config.h>
+#include "xsk.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "list.h"
+#include "ofpbuf.h"
+#include "poll-loop.h"
+#include "util.h"
+
+#define LOG_MODULE VLM_xsk
+#include "vlog.h"
+
+#ifdef HAVE_AF_XDP
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+/* Entries of the XSKMAP used by the XDP program, one per device queue. */
+#define XSK_MAX_QUEUES 64
+
+/* One of the rings shared with the kernel.  Descriptors between 'consumer'
+ * and 'producer' belong to the consuming side. */
+struct xsk_ring {
+    uint32_t *producer;
+    uint32_t *consumer;
+    void *descs;
+    void *map;
+    size_t map_size;
+};
+
+/* A frame of a UMEM.  Each frame belongs to one queue: it is in the queue's
+ * fill, receive, transmit or completion ring, held since the queue's last
+ * receive, or free for sending. */
+struct xsk_frame {
+    struct xsk_queue *queue;    /* NULL if no queue has the frame. */
+    int held;                   /* Index in 'queue->held', or -1. */
+};
+
+/* A UMEM: memory shared with the kernel, split in XSK_FRAME_SIZE frames,
+ * which the queues that use it receive packets into and send them from. */
+struct xsk_umem {
+    uint8_t *area;
+    size_t n_frames;
+    struct xsk_frame *frames;
+    struct list queues;         /* Queues whose sockets use the UMEM.  It is
+                                 * registered with the first one's. */
+
+    /* Frames not handed to a queue. */
+    uint64_t *spare;
+    size_t n_spare;
+};
+
+/* The socket of one receive queue, with XSK_N_FRAMES frames of a UMEM. */
+struct xsk_queue {
+    int fd;
+    struct xsk_umem *umem;
+    struct list umem_node;      /* In 'umem->queues'. */
+    struct xsk_ring fill;       /* Frames for the kernel to receive into. */
+    struct xsk_ring comp;       /* Frames the kernel finished sending. */
+    struct xsk_ring rx;
+    struct xsk_ring tx;
+    uint32_t tx_pending;        /* Frames queued on 'tx' since last kick. */
+
+    /* Frames available for sending. */
+    uint64_t free[XSK_N_FRAMES];
+    size_t n_free;
+
+    /* Frames handed out by the last xsk_recv(), to give back to the kernel
+     * on the next one. */
+    uint64_t held[XSK_RING_SIZE];
+    size_t n_held;
+};
+
+struct xsk {
+    char *name;
+    int map_fd;                 /* XSKMAP, with the socket of each queue at
+                                 * the queue's index. */
+    int link_fd;                /* Attachment of the XDP program. */
+
+    struct xsk_queue *queues;   /* One per receive queue.  Packets are sent
+                                 * on the first. */
+    size_t n_queues;
+    size_t next_rx;             /* Queue xsk_recv() starts with. */
+};
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 20);
+
+/* The UMEM of all the xsks, or NULL if none is open. */
+static struct xsk_umem *shared_umem;
+
+static inline uint32_t
+ring_load(const uint32_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void
+ring_store(uint32_t *p, uint32_t value)
+{
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t *
+ring_addr(struct xsk_ring *ring, uint32_t idx)
+{
+    return &((uint64_t *) ring->descs)[idx & (XSK_RING_SIZE - 1)];
+}
+
+static inline struct xdp_desc *
+ring_desc(struct xsk_ring *ring, uint32_t idx)
+{
+    return &((struct xdp_desc *) ring->descs)[idx & (XSK_RING_SIZE - 1)];
+}
+
+static int
+sys_bpf(enum bpf_cmd cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof *attr);
+}
+
+static void
+set_insn(struct bpf_insn *insn, uint8_t code, uint8_t dst, uint8_t src,
+         int16_t off, int32_t imm)
+{
+    memset(insn, 0, sizeof *insn);
+    insn->code = code;
+    insn->dst_reg = dst;
+    insn->src_reg = src;
+    insn->off = off;
+    insn->imm = imm;
+}
+
+/* Loads an XDP program that redirects every packet to the socket in XSKMAP
+ * 'map_fd' for its receive queue, or passes it on to the kernel's stack if
+ * there is none, and attaches it to 'ifindex'.  Returns the link's file
+ * descriptor, which detaches the program when closed, or a negative errno
+ * value. */
+static int
+attach_xdp_prog(int ifindex, int map_fd)
+{
+    static char license[] = "Dual BSD/GPL";
+    struct bpf_insn insns[6];
+    union bpf_attr attr;
+    int prog_fd, link_fd;
+
+    /* r2 = ctx->rx_queue_index; r1 = map; r3 = XDP_PASS;
+     * return bpf_redirect_map(r1, r2, r3); */
+    set_insn(&insns[0], BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1,
+             offsetof(struct xdp_md, rx_queue_index), 0);
+    set_insn(&insns[1], BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1,
+             BPF_PSEUDO_MAP_FD, 0, map_fd);
+    set_insn(&insns[2], 0, 0, 0, 0, 0);
+    set_insn(&insns[3], BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0,
+             XDP_PASS);
+    set_insn(&insns[4], BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map);
+    set_insn(&insns[5], BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+    memset(&attr, 0, sizeof attr);
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.expected_attach_type = BPF_XDP;
+    attr.insns = (uintptr_t) insns;
+    attr.insn_cnt = ARRAY_SIZE(insns);
+    attr.license = (uintptr_t) license;
+    prog_fd = sys_bpf(BPF_PROG_LOAD, &attr);
+    if (prog_fd < 0) {
+        return -errno;
+    }
+
+    /* Prefer the driver's XDP support, and fall back to generic XDP. */
+    memset(&attr, 0, sizeof attr);
+    attr.link_create.prog_fd = prog_fd;
+    attr.link_create.target_ifindex = ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    link_fd = sys_bpf(BPF_LINK_CREATE, &attr);
+    if (link_fd < 0) {
+        attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+        link_fd = sys_bpf(BPF_LINK_CREATE, &attr);
+    }
+    if (link_fd < 0) {
+        link_fd = -errno;
+    }
+    close(prog_fd);
+    return link_fd;
+}
+
+/* Sets the size of ring 'optname' of 'fd'. */
+static int
+setup_ring(int fd, int optname)
+{
+    unsigned int size = XSK_RING_SIZE;
+
+    if (setsockopt(fd, SOL_XDP, optname, &size, sizeof size) < 0) {
+        return errno;
+    }
+    return 0;
+}
+
+/* Maps 'ring', of 'desc_size' byte descriptors, at 'off' of 'fd''s page
+ * 'pgoff'. */
+static int
+map_ring(int fd, const struct xdp_ring_offset *off, size_t desc_size,
+         off_t pgoff, struct xsk_ring *ring)
+{
+    uint8_t *map;
+
+    ring->map_size = off->desc + XSK_RING_SIZE * desc_size;
+    map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if (map == MAP_FAILED) {
+        ring->map = NULL;
+        return errno;
+    }
+    ring->map = map;
+    ring->producer = (uint32_t *) (map + off->producer);
+    ring->consumer = (uint32_t *) (map + off->consumer);
+    ring->descs = map + off->desc;
+    return 0;
+}
+
+static void
+unmap_ring(struct xsk_ring *ring)
+{
+    if (ring->map) {
+        munmap(ring->map, ring->map_size);
+    }
+}
+
+/* Returns the number of receive queues of network device 'name', as listed
+ * in sysfs, or 1 if they cannot be counted. */
+static size_t
+count_rx_queues(const char *name)
+{
+    char path[128];
+    struct dirent *de;
+    size_t n = 0;
+    DIR *dir;
+
+    snprintf(path, sizeof path, "/sys/class/net/%s/queues", name);
+    dir = opendir(path);
+    if (!dir) {
+        return 1;
+    }
+    while ((de = readdir(dir)) != NULL) {
+        if (!strncmp(de->d_name, "rx-", 3)) {
+            n++;
+        }
+    }
+    closedir(dir);
+    return MAX(n, 1);
+}
+
+/* Returns a new UMEM of 'n_frames' frames, or NULL if it cannot be
+ * allocated. */
+static struct xsk_umem *
+umem_create(size_t n_frames)
+{
+    struct xsk_umem *umem;
+    size_t i;
+
+    umem = xcalloc(1, sizeof *umem);
+    umem->area = mmap(NULL, n_frames * XSK_FRAME_SIZE,
+                      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+    if (umem->area == MAP_FAILED) {
+        free(umem);
+        return NULL;
+    }
+    umem->n_frames = n_frames;
+    umem->frames = xmalloc(n_frames * sizeof *umem->frames);
+    umem->spare = xmalloc(n_frames * sizeof *umem->spare);
+    list_init(&umem->queues);
+    for (i = 0; i < n_frames; i++) {
+        umem->frames[i].queue = NULL;
+        umem->frames[i].held = -1;
+        umem->spare[umem->n_spare++] = (uint64_t) (n_frames - 1 - i)
+                                       * XSK_FRAME_SIZE;
+    }
+    return umem;
+}
+
+static void
+umem_destroy(struct xsk_umem *umem)
+{
+    if (umem == shared_umem) {
+        shared_umem = NULL;
+    }
+    munmap(umem->area, umem->n_frames * XSK_FRAME_SIZE);
+    free(umem->frames);
+    free(umem->spare);
+    free(umem);
+}
+
+/* Returns the frame of the UMEM at 'addr'. */
+static inline struct xsk_frame *
+umem_frame(struct xsk_umem *umem, uint64_t addr)
+{
+    return &umem->frames[addr / XSK_FRAME_SIZE];
+}
+
+/* Opens the AF_XDP socket of 'queue', for queue 'queue_id' of the device with
+ * index 'ifindex', with XSK_N_FRAMES frames of 'umem', and adds it to
+ * 'map_fd'.  The socket shares 'umem' with the sockets already using it, and
+ * registers it otherwise.  Returns 0 if successful, otherwise a positive
+ * errno value, after which the caller closes 'queue'. */
+static int
+queue_open(struct xsk_queue *queue, struct xsk_umem *umem, int ifindex,
+           uint32_t queue_id, size_t headroom, int map_fd)
+{
+    struct xdp_mmap_offsets off;
+    struct sockaddr_xdp sxdp;
+    union bpf_attr attr;
+    socklen_t optlen;
+    uint32_t prod;
+    int error;
+    size_t i;
+
+    queue->umem = umem;
+    queue->fd = socket(AF_XDP, SOCK_RAW, 0);
+    if (queue->fd < 0) {
+        return errno;
+    }
+
+    memset(&sxdp, 0, sizeof sxdp);
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = ifindex;
+    sxdp.sxdp_queue_id = queue_id;
+    if (list_is_empty(&umem->queues)) {
+        struct xdp_umem_reg reg;
+
+        memset(&reg, 0, sizeof reg);
+        reg.addr = (uintptr_t) umem->area;
+        reg.len = (uint64_t) umem->n_frames * XSK_FRAME_SIZE;
+        reg.chunk_size = XSK_FRAME_SIZE;
+        reg.headroom = headroom;
+        if (setsockopt(queue->fd, SOL_XDP, XDP_UMEM_REG, &reg,
+                       sizeof reg) < 0) {
+            return errno;
+        }
+        sxdp.sxdp_flags = XDP_COPY;
+    } else {
+        struct xsk_queue *first = CONTAINER_OF(list_front(&umem->queues),
+                                               struct xsk_queue, umem_node);
+
+        /* The socket still has fill and completion rings of its own, which
+         * takes Linux 5.10 or later if it is on another device or queue. */
+        sxdp.sxdp_flags = XDP_SHARED_UMEM;
+        sxdp.sxdp_shared_umem_fd = first->fd;
+    }
+
+    error = setup_ring(queue->fd, XDP_UMEM_FILL_RING);
+    if (!error) {
+        error = setup_ring(queue->fd, XDP_UMEM_COMPLETION_RING);
+    }
+    if (!error) {
+        error = setup_ring(queue->fd, XDP_RX_RING);
+    }
+    if (!error) {
+        error = setup_ring(queue->fd, XDP_TX_RING);
+    }
+    if (error) {
+        return error;
+    }
+
+    optlen = sizeof off;
+    if (getsockopt(queue->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) {
+        return errno;
+    }
+    error = map_ring(queue->fd, &off.fr, sizeof(uint64_t),
+                     XDP_UMEM_PGOFF_FILL_RING, &queue->fill);
+    if (!error) {
+        error = map_ring(queue->fd, &off.cr, sizeof(uint64_t),
+                         XDP_UMEM_PGOFF_COMPLETION_RING, &queue->comp);
+    }
+    if (!error) {
+        error = map_ring(queue->fd, &off.rx, sizeof(struct xdp_desc),
+                         XDP_PGOFF_RX_RING, &queue->rx);
+    }
+    if (!error) {
+        error = map_ring(queue->fd, &off.tx, sizeof(struct xdp_desc),
+                         XDP_PGOFF_TX_RING, &queue->tx);
+    }
+    if (error) {
+        return error;
+    }
+
+    /* Take XSK_N_FRAMES frames of the UMEM, give the first XSK_RING_SIZE to
+     * the kernel for reception, and keep the others for sending. */
+    if (umem->n_spare < XSK_N_FRAMES) {
+        return ENOBUFS;
+    }
+    prod = *queue->fill.producer;
+    for (i = 0; i < XSK_N_FRAMES; i++) {
+        uint64_t addr = umem->spare[--umem->n_spare];
+
+        umem_frame(umem, addr)->queue = queue;
+        if (i < XSK_RING_SIZE) {
+            *ring_addr(&queue->fill, prod + i) = addr;
+        } else {
+            queue->free[queue->n_free++] = addr;
+        }
+    }
+    ring_store(queue->fill.producer, prod + XSK_RING_SIZE);
+
+    if (bind(queue->fd, (struct sockaddr *) &sxdp, sizeof sxdp) < 0) {
+        return errno;
+    }
+    list_push_back(&umem->queues, &queue->umem_node);
+
+    memset(&attr, 0, sizeof attr);
+    attr.map_fd = map_fd;
+    attr.key = (uintptr_t) &queue_id;
+    attr.value = (uintptr_t) &queue->fd;
+    if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        return errno;
+    }
+    return 0;
+}
+
+/* Closes 'queue', and gives its frames back to its UMEM, which is destroyed
+ * along with the last queue that uses it. */
+static void
+queue_close(struct xsk_queue *queue)
+{
+    struct xsk_umem *umem = queue->umem;
+
+    unmap_ring(&queue->fill);
+    unmap_ring(&queue->comp);
+    unmap_ring(&queue->rx);
+    unmap_ring(&queue->tx);
+    if (queue->fd >= 0) {
+        poll_fd_forget(queue->fd);
+        close(queue->fd);
+    }
+    if (umem) {
+        size_t i;
+
+        for (i = 0; i < umem->n_frames; i++) {
+            if (umem->frames[i].queue == queue) {
+                umem->frames[i].queue = NULL;
+                umem->frames[i].held = -1;
+                umem->spare[umem->n_spare++] = (uint64_t) i * XSK_FRAME_SIZE;
+            }
+        }
+        if (queue->umem_node.next) {
+            list_remove(&queue->umem_node);
+        }
+        if (list_is_empty(&umem->queues)) {
+            umem_destroy(umem);
+        }
+    }
+    memset(queue, 0, sizeof *queue);
+    queue->fd = -1;
+}
+
+/* Opens the AF_XDP socket of 'queue' on the UMEM the xsks share, or on a UMEM
+ * of its own if the shared one has no frames left or the kernel cannot share
+ * it with another device.  Returns 0 if successful, otherwise a positive
+ * errno value, after which the caller closes 'queue'. */
+static int
+queue_open_shared(struct xsk_queue *queue, int ifindex, uint32_t queue_id,
+                  size_t headroom, int map_fd)
+{
+    struct xsk_umem *umem;
+    int error;
+
+    if (!shared_umem) {
+        shared_umem = umem_create(XSK_UMEM_FRAMES);
+    }
+    if (shared_umem) {
+        bool first = list_is_empty(&shared_umem->queues);
+
+        error = queue_open(queue, shared_umem, ifindex, queue_id, headroom,
+                           map_fd);
+        if (!error || first) {
+            return error;
+        }
+        VLOG_INFO(LOG_MODULE, "queue %"PRIu32" of device %d does not share "
+                  "the UMEM of the other AF_XDP sockets: %s",
+                  queue_id, ifindex, strerror(error));
+        queue_close(queue);
+    }
+
+    umem = umem_create(XSK_N_FRAMES);
+    if (!umem) {
+        return ENOMEM;
+    }
+    return queue_open(queue, umem, ifindex, queue_id, headroom, map_fd);
+}
+
+/* Opens an AF_XDP socket for each receive queue of network device 'name',
+ * with index 'ifindex', leaving at least 'headroom' bytes in front of every
+ * received packet.  Returns 0 and stores the sockets in '*xskp' if
+ * successful, otherwise a positive errno value. */
+int
+xsk_open(const char *name, int ifindex, size_t headroom, struct xsk **xskp)
+{
+    union bpf_attr attr;
+    struct xsk *xsk;
+    int error;
+    size_t i;
+
+    *xskp = NULL;
+    xsk = xcalloc(1, sizeof *xsk);
+    xsk->map_fd = xsk->link_fd = -1;
+    xsk->n_queues = count_rx_queues(name);
+    if (xsk->n_queues > XSK_MAX_QUEUES) {
+        error = EOPNOTSUPP;
+        xsk->n_queues = 0;
+        goto error;
+    }
+    xsk->queues = xcalloc(xsk->n_queues, sizeof *xsk->queues);
+    for (i = 0; i < xsk->n_queues; i++) {
+        xsk->queues[i].fd = -1;
+    }
+
+    memset(&attr, 0, sizeof attr);
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = XSK_MAX_QUEUES;
+    xsk->map_fd = sys_bpf(BPF_MAP_CREATE, &attr);
+    if (xsk->map_fd < 0) {
+        error = errno;
+        goto error;
+    }
+
+    for (i = 0; i < xsk->n_queues; i++) {
+        error = queue_open_shared(&xsk->queues[i], ifindex, i, headroom,
+                                  xsk->map_fd);
+        if (error) {
+            goto error;
+        }
+    }
+    xsk->link_fd = attach_xdp_prog(ifindex, xsk->map_fd);
+    if (xsk->link_fd < 0) {
+        error = -xsk->link_fd;
+        goto error;
+    }
+
+    xsk->name = xstrdup(name);
+    *xskp = xsk;
+    return 0;
+
+error:
+    VLOG_WARN(LOG_MODULE, "failed to open AF_XDP socket on %s: %s",
+              name, strerror(error));
+    xsk_close(xsk);
+    return error;
+}
+
+/* Closes 'xsk', which detaches its XDP program from the device. */
+void
+xsk_close(struct xsk *xsk)
+{
+    if (xsk) {
+        size_t i;
+
+        if (xsk->link_fd >= 0) {
+            close(xsk->link_fd);
+        }
+        for (i = 0; i < xsk->n_queues; i++) {
+            queue_close(&xsk->queues[i]);
+        }
+        if (xsk->map_fd >= 0) {
+            close(xsk->map_fd);
+        }
+        free(xsk->queues);
+        free(xsk->name);
+        free(xsk);
+    }
+}
+
+/* Registers with the poll loop to wake up when 'xsk' has packets to
+ * receive, on any queue. */
+void
+xsk_recv_wait(struct xsk *xsk)
+{
+    size_t i;
+
+    for (i = 0; i < xsk->n_queues; i++) {
+        poll_fd_wait(xsk->queues[i].fd, POLLIN);
+    }
+}
+
+/* Gives the frames handed out by the last queue_recv() back to the kernel:
+ * the fill ring always has room for them, as it holds at most XSK_RING_SIZE
+ * frames. */
+static void
+queue_refill(struct xsk_queue *queue)
+{
+    uint32_t prod;
+    size_t i;
+
+    if (queue->n_held) {
+        prod = *queue->fill.producer;
+        for (i = 0; i < queue->n_held; i++) {
+            *ring_addr(&queue->fill, prod + i) = queue->held[i];
+            umem_frame(queue->umem, queue->held[i])->held = -1;
+        }
+        ring_store(queue->fill.producer, prod + queue->n_held);
+        queue->n_held = 0;
+    }
+}
+
+/* Receives up to 'n_buffers' packets from 'queue', and returns how many. */
+static size_t
+queue_recv(struct xsk_queue *queue, struct ofpbuf **buffers, size_t n_buffers)
+{
+    uint32_t prod, cons, n, i;
+
+    cons = *queue->rx.consumer;
+    prod = ring_load(queue->rx.producer);
+    n = MIN(prod - cons, n_buffers);
+    for (i = 0; i < n; i++) {
+        const struct xdp_desc *desc = ring_desc(&queue->rx, cons + i);
+        uint64_t frame = desc->addr & ~(uint64_t) (XSK_FRAME_SIZE - 1);
+        struct ofpbuf *buffer = buffers[i];
+
+        ofpbuf_use_foreign(buffer, queue->umem->area + frame,
+                           XSK_FRAME_SIZE);
+        ofpbuf_reserve(buffer, desc->addr - frame);
+        ofpbuf_put_uninit(buffer, desc->len);
+        umem_frame(queue->umem, frame)->held = queue->n_held;
+        queue->held[queue->n_held++] = frame;
+    }
+    ring_store(queue->rx.consumer, cons + n);
+    return n;
+}
+
+/* Receives up to 'n_buffers' packets from the queues of 'xsk' into the caller
+ * supplied ofpbuf headers buffers[0] through buffers[*n_received - 1], whose
+ * data stay in the UMEM until the next call.  The queue served first changes
+ * from call to call, so a busy queue does not starve the others.  Returns 0
+ * if at least one packet was received, otherwise EAGAIN. */
+int
+xsk_recv(struct xsk *xsk, struct ofpbuf **buffers, size_t n_buffers,
+         size_t *n_received)
+{
+    size_t n = 0;
+    size_t i;
+
+    for (i = 0; i < xsk->n_queues; i++) {
+        queue_refill(&xsk->queues[i]);
+    }
+    for (i = 0; i < xsk->n_queues && n < n_buffers; i++) {
+        struct xsk_queue *queue;
+
+        queue = &xsk->queues[(xsk->next_rx + i) % xsk->n_queues];
+        n += queue_recv(queue, buffers + n, n_buffers - n);
+    }
+    xsk->next_rx = (xsk->next_rx + 1) % xsk->n_queues;
+
+    *n_received = n;
+    return n ? 0 : EAGAIN;
+}
+
+/* Takes back the frames the kernel has finished sending. */
+static void
+queue_complete(struct xsk_queue *queue)
+{
+    uint32_t prod, cons;
+
+    cons = *queue->comp.consumer;
+    prod = ring_load(queue->comp.producer);
+    for (; cons != prod; cons++) {
+        /* Packets sent in place start past the frame's beginning. */
+        queue->free[queue->n_free++] = (*ring_addr(&queue->comp, cons)
+                                        & ~(uint64_t) (XSK_FRAME_SIZE - 1));
+    }
+    ring_store(queue->comp.consumer, cons);
+}
+
+/* Hands the frames queued on the transmit ring over to the kernel. */
+void
+xsk_flush(struct xsk *xsk)
+{
+    struct xsk_queue *queue = &xsk->queues[0];
+
+    if (queue->tx_pending) {
+        queue->tx_pending = 0;
+        if (sendto(queue->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0
+            && errno != EAGAIN && errno != EBUSY && errno != ENOBUFS) {
+            VLOG_WARN_RL(LOG_MODULE, &rl, "error sending packets on %s: %s",
+                         xsk->name, strerror(errno));
+        }
+    }
+    queue_complete(queue);
+}
+
+/* If the 'size' bytes at 'data' are in a frame of the UMEM of 'queue' that
+ * the queue that received them still holds, hands the frame over to 'queue'
+ * in exchange for 'spare', one of its free frames, and returns true, with
+ * the packet's address in '*addr'.  Otherwise returns false. */
+static bool
+queue_take_frame(struct xsk_queue *queue, const void *data, size_t size,
+                 uint64_t spare, uint64_t *addr)
+{
+    struct xsk_umem *umem = queue->umem;
+    const uint8_t *p = data;
+    struct xsk_frame *frame;
+    struct xsk_queue *rx;
+    uint64_t offset;
+
+    if (p < umem->area || p >= umem->area + umem->n_frames * XSK_FRAME_SIZE) {
+        return false;
+    }
+    offset = p - umem->area;
+    frame = umem_frame(umem, offset);
+    if (frame->held < 0 || offset % XSK_FRAME_SIZE + size > XSK_FRAME_SIZE) {
+        return false;
+    }
+
+    /* The receiving queue gives 'spare' to the kernel instead. */
+    rx = frame->queue;
+    rx->held[frame->held] = spare;
+    umem_frame(umem, spare)->queue = rx;
+    umem_frame(umem, spare)->held = frame->held;
+    frame->queue = queue;
+    frame->held = -1;
+    *addr = offset;
+    return true;
+}
+
+/* Queues the 'size' bytes at 'data' for transmission on 'xsk'.  The packet is
+ * sent by the next xsk_flush(), or earlier if the ring fills up.
+ *
+ * If 'in_place' is true, the caller neither reads nor modifies the data
+ * afterwards, and a packet received on an xsk, which all share a UMEM, is
+ * sent from the frame it was received in.  Otherwise, or if the packet is
+ * not in that UMEM, it is copied into a free frame.
+ *
+ * Returns 0 if successful, EAGAIN if the transmit ring is full or EMSGSIZE if
+ * the packet does not fit in a frame. */
+int
+xsk_send(struct xsk *xsk, const void *data, size_t size, bool in_place)
+{
+    struct xsk_queue *queue = &xsk->queues[0];
+    struct xdp_desc *desc;
+    uint64_t addr;
+    uint32_t prod;
+
+    if (size > XSK_FRAME_SIZE) {
+        return EMSGSIZE;
+    }
+    if (!queue->n_free) {
+        xsk_flush(xsk);
+        if (!queue->n_free) {
+            return EAGAIN;
+        }
+    }
+
+    /* The transmit ring cannot overflow: it has room for as many frames as
+     * the kernel can have yet to complete. */
+    addr = queue->free[--queue->n_free];
+    if (!in_place || !queue_take_frame(queue, data, size, addr, &addr)) {
+        memcpy(queue->umem->area + addr, data, size);
+    }
+    prod = *queue->tx.producer;
+    desc = ring_desc(&queue->tx, prod);
+    desc->addr = addr;
+    desc->len = size;
+    desc->options = 0;
+    ring_store(queue->tx.producer, prod + 1);
+
+    if (++queue->tx_pending >= XSK_RING_SIZE / 2) {
+        xsk_flush(xsk);
+    }
+    return 0;
+}
+
+#else  /* !HAVE_AF_XDP */
+
+int
+xsk_open(const char *name, int ifindex UNUSED, size_t headroom UNUSED,
+         struct xsk **xskp)
+{
+    VLOG_WARN(LOG_MODULE, "cannot open AF_XDP socket on %s: not supported",
+              name);
+    *xskp = NULL;
+    return EOPNOTSUPP;
+}
+
+void
+xsk_close(struct xsk *xsk)
+{
+    assert(!xsk);
+}
+
+void
+xsk_recv_wait(struct xsk *xsk UNUSED)
+{
+    NOT_REACHED();
+}
+
+int
+xsk_recv(struct xsk *xsk UNUSED, struct ofpbuf **buffers UNUSED,
+         size_t n_buffers UNUSED, size_t *n_received UNUSED)
+{
+    NOT_REACHED();
+}
+
+int
+xsk_send(struct xsk *xsk UNUSED, const void *data UNUSED,
+         size_t size UNUSED, bool in_place UNUSED)
+{
+    NOT_REACHED();
+}
+
+void
+xsk_flush(struct xsk *xsk UNUSED)
+{
+    NOT_REACHED();
+}
+
+#endif /* !HAVE_AF_XDP */
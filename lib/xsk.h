@@ -0,0 +1,72 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef XSK_H
+#define XSK_H 1
+
+/* AF_XDP sockets.
+ *
+ * An xsk receives the packets of every receive queue of a network device,
+ * with one socket per queue, to which a small XDP program redirects them
+ * before they reach the kernel's stack.  It sends packets straight to the
+ * device's driver, on the socket of the first queue.  The sockets of all the
+ * xsks share one UMEM, a memory area shared with the kernel and split in
+ * XSK_FRAME_SIZE frames, so received packets are processed where the kernel
+ * put them, and forwarded from there to another xsk without being copied in
+ * user space.  Each
+ * socket takes XSK_N_FRAMES frames of the XSK_UMEM_FRAMES; a socket that
+ * cannot share the UMEM, because it is full or the kernel is older than
+ * Linux 5.10, gets a UMEM of its own, and packets are copied to and from it.
+ *
+ * Sockets are bound in copy mode, which every driver supports, including
+ * veth.  xsk_open() fails with EOPNOTSUPP if the system was built without
+ * AF_XDP support, or the device has more than 64 receive queues. */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define XSK_FRAME_SIZE  4096
+#define XSK_N_FRAMES    2048    /* of the UMEM for each socket. */
+#define XSK_RING_SIZE   1024    /* descriptors in each of the four rings. */
+#define XSK_UMEM_FRAMES (8 * XSK_N_FRAMES)
+
+struct ofpbuf;
+struct xsk;
+
+int xsk_open(const char *name, int ifindex, size_t headroom, struct xsk **);
+void xsk_close(struct xsk *);
+void xsk_recv_wait(struct xsk *);
+
+int xsk_recv(struct xsk *, struct ofpbuf **buffers, size_t n_buffers,
+             size_t *n_received);
+int xsk_send(struct xsk *, const void *data, size_t size, bool in_place);
+void xsk_flush(struct xsk *);
+
+#endif /* xsk.h */
@@ -1,4 +1,5 @@
 # Process this file with automake to produce Makefile.in
+if HAVE_NBEE
 noinst_LIBRARIES += nbee_link/libnbee_link.a
 #lib_LTLIBRARIES += nbee_link/libnbeelink.la
 #lib_LTLIBRARIES = libnbeelink.la
@@ -9,6 +10,7 @@ noinst_LIBRARIES += nbee_link/libnbee_link.a
 
 nbee_link_libnbee_link_a_SOURCES = nbee_link/nbee_link.cpp \
 			nbee_link/nbee_link.h
+endif
 
 MAINTAINERCLEANFILES = Makefile.in aclocal.m4 config.guess config.sub config.h.in configure depcomp install-sh missing ltmain.sh *~ *.tar.*
 
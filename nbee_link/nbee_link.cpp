@@ -6,7 +6,6 @@
  */
 
 #include <iostream>
-#include <map>
 #include <string.h>
 #include <sys/stat.h>
 #include <errno.h>
@@ -21,8 +20,7 @@
 #include "oflib/ofl-utils.h"
 #include "lib/hash.h"
 #include "lib/fatal-signal.h"
-
-map<uint16_t,uint16_t> ext_hdr_orders;
+#include "udatapath/packet_parse.h"
 
 nbPacketDecoder *Decoder;
 nbPacketDecoderVars* PacketDecoderVars;
@@ -133,82 +131,22 @@ int nblink_check_for_entry_on_hmap(struct hmap * pktout ,uint32_t  header, struc
 }
 
 /*
-* Function used to extract an Extension Header flag from the NetBee field structure.
+* Function used to get the Extension Header flag of a NetBee block, or 0 if it is none.
 */
-int nblink_extract_exthdr_fields(struct ofpbuf * pktin, struct ofl_match * pktout, uint16_t type, _nbPDMLField * field, int *destination_num)
+static uint16_t nblink_exthdr_flag(const char * name)
 {
-    struct ofl_match_tlv *iter;
-    uint16_t *ext_hdrs;
-
-
-    if (type == OFPIEH_DEST){
-        (*destination_num)++;
-    }
-
-    HMAP_FOR_EACH_WITH_HASH(iter, struct ofl_match_tlv, hmap_node, hash_int(OXM_OF_IPV6_EXTHDR, 0), &pktout->match_fields)
-    {
-        /*First check if is duplicated*/
-        ext_hdrs = (uint16_t*) iter->value;
-        *ext_hdrs = *ext_hdrs;
-        if(!(*ext_hdrs & OFPIEH_UNREP)){
-            if (type != OFPIEH_DEST && *ext_hdrs & type){
-                *ext_hdrs ^=  OFPIEH_UNREP;
-                return 0;
-            }
-            /*DOH can appear twice */
-            if(*ext_hdrs & type && *destination_num > 2){
-                *ext_hdrs ^=  OFPIEH_UNREP;
-                return 0;
-            }
-        }
-
-        /*Check sequence*/
-        if(!(*ext_hdrs & OFPIEH_UNSEQ)){
-            uint16_t next_type;
-            char *pEnd;
-            uint16_t next_header = strtol(field->FirstChild->Value, &pEnd,16);
-            /*Set OFPIEH_NONEXT */
-            if (next_header == IPV6_NO_NEXT_HEADER)
-                *ext_hdrs ^=  OFPIEH_NONEXT;
-
-            /*DOH Should have a routing header or the upper layer as the next header
-              if not, set the UNSEQ bit                                            */
-            if(type == OFPIEH_DEST){
-                if ( next_header == IPV6_TYPE_HBH
-                    || next_header == IPV6_TYPE_FH || next_header == IPV6_TYPE_AH ||
-                    next_header == IPV6_TYPE_ESP ){
-                    *ext_hdrs ^=  OFPIEH_DEST;
-                    *ext_hdrs ^=  OFPIEH_UNSEQ;
-                    *ext_hdrs = htons(*ext_hdrs);
-                    return 0;
-                }
-            }
-            map<uint16_t,uint16_t>::iterator it;
-            it = ext_hdr_orders.find(type);
-            if(next_header == IPV6_TYPE_HBH)
-                next_type = HBH;
-            else if(next_header == IPV6_TYPE_DOH){
-                next_type = DESTINATION;
-            }
-            else if (next_header == IPV6_TYPE_RH)
-                next_type = ROUTING;
-            else if (next_header == IPV6_TYPE_FH)
-                next_type = FRAGMENT;
-            else if (next_header == IPV6_TYPE_AH)
-                next_type = AUTHENTICATION;
-            else if (next_header == IPV6_TYPE_ESP)
-                next_type = ESP;
-            else next_type = 0xffff;
-            if(!(it->second & next_type))
-                /*Set the not in order preferred bit */
-                *ext_hdrs ^=  OFPIEH_UNSEQ;
-        }
-
-        /* Set the extension header flag*/
-        *ext_hdrs ^=  type;
-        *ext_hdrs = *ext_hdrs;
-    }
-
+    if (strcmp(name, "HBH") == 0)
+        return OFPIEH_HOP;
+    if (strcmp(name, "DOH") == 0)
+        return OFPIEH_DEST;
+    if (strcmp(name, "RH") == 0)
+        return OFPIEH_ROUTER;
+    if (strcmp(name, "FH") == 0)
+        return OFPIEH_FRAG;
+    if (strcmp(name, "AH") == 0)
+        return OFPIEH_AUTH;
+    if (strcmp(name, "ESP") == 0)
+        return OFPIEH_ESP;
     return 0;
 }
 
@@ -261,7 +199,7 @@ int nblink_extract_proto_fields(struct ofpbuf * pktin, _nbPDMLField * field, str
             else {
                 uint32_t field_value;
                 sscanf(field->Value, "%x", &field_value);
-                m_value = field_value & IPV6_ECN_MASK;               
+                m_value = (field_value >> IPV6_ECN_SHIFT) & IPV6_ECN_MASK;
                 ofl_structs_match_put8(pktout, header, m_value);
             }
         }
@@ -288,9 +226,9 @@ int nblink_extract_proto_fields(struct ofpbuf * pktin, _nbPDMLField * field, str
             uint8_t pbb_isid[3];
             sscanf(field->Value, "%x", &m_value);
             m_value = (m_value & PBB_ISID_MASK);
-            pbb_isid[0] = (m_value >> 24) & 0xff;
-            pbb_isid[1] = (m_value >> 16) & 0xff;
-            pbb_isid[2] = m_value & 0xff;                                
+            pbb_isid[0] = (m_value >> 16) & 0xff;
+            pbb_isid[1] = (m_value >> 8) & 0xff;
+            pbb_isid[2] = m_value & 0xff;
             ofl_structs_match_put_pbb_isid(pktout, header, pbb_isid);        
         }
         else if (header == OXM_OF_IPV6_FLABEL){
@@ -396,13 +334,6 @@ extern "C" int nblink_packet_parse(struct ofpbuf * pktin,  struct ofl_match * pk
 
     _nbPDMLPacket * curr_packet;
 
-    ext_hdr_orders.insert( pair<uint16_t,uint16_t>(OFPIEH_HOP,HBH_ALLOWED));
-    ext_hdr_orders.insert( pair<uint16_t,uint16_t>(OFPIEH_DEST,DESTINATION_ALLOWED));
-    ext_hdr_orders.insert( pair<uint16_t,uint16_t>(OFPIEH_ROUTER,ROUTING_ALLOWED));
-    ext_hdr_orders.insert( pair<uint16_t,uint16_t>(OFPIEH_FRAG,FRAG_ALLOWED));
-    ext_hdr_orders.insert( pair<uint16_t,uint16_t>(OFPIEH_AUTH,AUTH_ALLOWED));
-    ext_hdr_orders.insert( pair<uint16_t,uint16_t>(OFPIEH_ESP,ESP_ALLOWED));
-
     /* Decode packet */
     if (Decoder->DecodePacket(LinkLayerType, PacketCounter, pkhdr, (const unsigned char*) (pktin->data)) == nbFAILURE)
     {
@@ -416,7 +347,6 @@ extern "C" int nblink_packet_parse(struct ofpbuf * pktin,  struct ofl_match * pk
     _nbPDMLProto * proto;
     _nbPDMLField * field;
 
-    int destination_num = 0;
     proto = curr_packet->FirstProto;
     bool proto_done = true;
     while (proto!= NULL)
@@ -518,6 +448,7 @@ extern "C" int nblink_packet_parse(struct ofpbuf * pktin,  struct ofl_match * pk
             {
 
                 _nbPDMLField * ip_proto = NULL;
+                struct ipv6_exthdr_walk exthdr = {0, 0, 0};
                 uint8_t i;
                 pkt_proto->ipv6 = (struct ipv6_header *) ((uint8_t*) pktin->data + proto->Position);
                 PDMLReader->GetPDMLField(proto->Name, (char*) "ipv6 dscp", proto->FirstField, &field);
@@ -526,71 +457,33 @@ extern "C" int nblink_packet_parse(struct ofpbuf * pktin,  struct ofl_match * pk
                 nblink_extract_proto_fields(pktin, field, pktout, OXM_OF_IP_ECN);
                 PDMLReader->GetPDMLField(proto->Name, (char*) "flabel", proto->FirstField, &field);                
                 nblink_extract_proto_fields(pktin, field, pktout, OXM_OF_IPV6_FLABEL);
-                /*Initialize extension header OXM */
-                struct ofl_match_tlv * EH_field;
-                uint16_t bit_field = OFPIEH_NONEXT;
-                EH_field = (struct ofl_match_tlv *) malloc(sizeof(struct ofl_match_tlv));
-                EH_field->value = (uint8_t*) malloc(OXM_LENGTH(OXM_OF_IPV6_EXTHDR));
-                EH_field->header = OXM_OF_IPV6_EXTHDR;
-                /*Set everything to zero */
-                memset(EH_field->value,0x0, sizeof(uint16_t));
-
-                char *pEnd;
-                uint16_t next_header = strtol(field->Value, &pEnd,16);
-                /*Set OFPIEH_NONEXT */
-                if (next_header == IPV6_NO_NEXT_HEADER)
-                {
-                    uint16_t *ext_hdrs;
-
-                    ext_hdrs = (uint16_t*) EH_field->value;
-                    *ext_hdrs ^=  OFPIEH_NONEXT;
-                    *ext_hdrs = *ext_hdrs;
-                }
-
-                hmap_insert_fast(&pktout->match_fields, &EH_field->hmap_node,
-                            hash_int(EH_field->header, 0));
-                pktout->header.length += 6;
-
                 PDMLReader->GetPDMLField(proto->Name, (char*) "src", proto->FirstField, &field);
                 nblink_extract_proto_fields(pktin, field, pktout, OXM_OF_IPV6_SRC);
                 PDMLReader->GetPDMLField(proto->Name, (char*) "dst", proto->FirstField, &field);
                 nblink_extract_proto_fields(pktin, field, pktout, OXM_OF_IPV6_DST);
 
 
-                PDMLReader->GetPDMLField(proto->Name, (char*) "nexthdr", proto->FirstField, &ip_proto);                
-                if (PDMLReader->GetPDMLField(proto->Name, (char*) "HBH", proto->FirstField, &field) == nbSUCCESS){                    
-                    nblink_extract_exthdr_fields(pktin, pktout, OFPIEH_HOP, field, &destination_num);                    
-                        ip_proto = field->FirstChild;                    
-                }
-                if(PDMLReader->GetPDMLField(proto->Name, (char*) "FH", proto->FirstField, &field) == nbSUCCESS){
-                    nblink_extract_exthdr_fields(pktin, pktout, OFPIEH_FRAG, field, &destination_num);
-                    if(!field->NextField)
-                        ip_proto = field->FirstChild;
-                }
-                if(PDMLReader->GetPDMLField(proto->Name, (char*) "AH",proto->FirstField, &field) == nbSUCCESS){
-                    nblink_extract_exthdr_fields(pktin, pktout, OFPIEH_AUTH, field, &destination_num);
-                    if(!field->NextField)
-                        ip_proto = field->FirstChild;
-                }
-                if(PDMLReader->GetPDMLField(proto->Name, (char*) "DOH", proto->FirstField, &field) == nbSUCCESS){                   
-                    nblink_extract_exthdr_fields(pktin, pktout, OFPIEH_DEST, field, &destination_num);
-                    if(!field->NextField)
-                        ip_proto = field->FirstChild;
-                }
-                if(PDMLReader->GetPDMLField(proto->Name, (char*) "RH", proto->FirstField, &field) == nbSUCCESS){
-                    nblink_extract_exthdr_fields(pktin, pktout, OFPIEH_ROUTER, field, &destination_num);
-                    if(!field->NextField)
+                PDMLReader->GetPDMLField(proto->Name, (char*) "nexthdr", proto->FirstField, &ip_proto);
+                /* Walk the extension headers in the order of the packet */
+                for (field = proto->FirstField; field != NULL; field = field->NextField)
+                {
+                    uint16_t flag = nblink_exthdr_flag(field->Name);
+
+                    if (flag == 0)
+                        continue;
+                    packet_parse_ipv6_exthdr(&exthdr, flag);
+                    /* An ESP header has no next header in clear */
+                    if (flag != OFPIEH_ESP)
                         ip_proto = field->FirstChild;
                 }
-                if(PDMLReader->GetPDMLField(proto->Name, (char*) "ESP", proto->FirstField, &field) == nbSUCCESS){                    
-                    nblink_extract_exthdr_fields(pktin, pktout, OFPIEH_ESP, field, &destination_num);
-                    if(!field->NextField)
-                        ip_proto = field->FirstChild;
-                } 
                 if (ip_proto){
+                    char *pEnd;
+                    uint8_t next_header = strtol(ip_proto->Value, &pEnd, 16);
 
+                    ofl_structs_match_put16(pktout, OXM_OF_IPV6_EXTHDR,
+                                            packet_parse_ipv6_exthdr_done(&exthdr, next_header));
                     nblink_extract_proto_fields(pktin, ip_proto, pktout, OXM_OF_IP_PROTO);
-                }                 
+                }
             }
             if (protocol_Name.compare("tcp") == 0 && pkt_proto->tcp == NULL)
             {
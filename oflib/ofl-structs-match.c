@@ -236,7 +236,7 @@ void ofl_structs_match_amaru_level(struct ofl_match *match, uint32_t header, uin
 
     m->header = header;
     m->value = malloc(len);
-    memcpy(m->value, &value, len);
+    memcpy(m->value, value, len);
     hmap_insert(&match->match_fields, &m->hmap_node, hash_int(header, 0));
     match->header.length += len + 4;
 }
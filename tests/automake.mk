@@ -0,0 +1,140 @@
+# The flow matcher is checked against packet_match() with each of its
+# implementations.
+TESTS += \
+	tests/test-flow-matcher \
+	tests/test-flow-matcher-scalar
+noinst_PROGRAMS += \
+	tests/test-flow-matcher \
+	tests/test-flow-matcher-scalar
+
+test_flow_matcher_sources = \
+	tests/test-flow-matcher.c \
+	udatapath/match_std.c \
+	udatapath/packet_key.c
+test_flow_matcher_ldadd = \
+	oflib/liboflib.a lib/libopenflow.a $(FAULT_LIBS) $(SSL_LIBS)
+
+tests_test_flow_matcher_SOURCES = $(test_flow_matcher_sources)
+tests_test_flow_matcher_LDADD = $(test_flow_matcher_ldadd)
+tests_test_flow_matcher_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
+
+tests_test_flow_matcher_scalar_SOURCES = $(test_flow_matcher_sources)
+tests_test_flow_matcher_scalar_LDADD = $(test_flow_matcher_ldadd)
+tests_test_flow_matcher_scalar_CPPFLAGS = \
+	$(tests_test_flow_matcher_CPPFLAGS) -U__SSE2__ -U__AVX2__
+
+if HAVE_AVX2
+TESTS += tests/test-flow-matcher-avx2
+noinst_PROGRAMS += tests/test-flow-matcher-avx2
+
+tests_test_flow_matcher_avx2_SOURCES = $(test_flow_matcher_sources)
+tests_test_flow_matcher_avx2_LDADD = $(test_flow_matcher_ldadd)
+tests_test_flow_matcher_avx2_CPPFLAGS = $(tests_test_flow_matcher_CPPFLAGS)
+tests_test_flow_matcher_avx2_CFLAGS = $(AM_CFLAGS) -mavx2
+endif
+
+# The parsers are checked against each other on fixed frames; NetBee, when it
+# is built in, against the native parser.
+TESTS += tests/test-packet-parse
+noinst_PROGRAMS += tests/test-packet-parse
+
+tests_test_packet_parse_SOURCES = \
+	tests/test-packet-parse.c \
+	udatapath/packet_key.c \
+	udatapath/packet_parse.c
+nodist_tests_test_packet_parse_SOURCES = udatapath/packet_parse_netpdl.c
+nodist_EXTRA_tests_test_packet_parse_SOURCES = dummy.cxx
+tests_test_packet_parse_LDADD = $(udatapath_nbee_libs) \
+	oflib/liboflib.a lib/libopenflow.a $(FAULT_LIBS) $(SSL_LIBS)
+tests_test_packet_parse_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
+
+# The datapath sources, but for the main program.
+test_udatapath_sources = \
+	udatapath/action_set.c \
+	udatapath/amaru_log.c \
+	udatapath/crc32.c \
+	udatapath/datapath.c \
+	udatapath/dp_actions.c \
+	udatapath/dp_buffers.c \
+	udatapath/dp_control.c \
+	udatapath/dp_exp.c \
+	udatapath/dp_pool.c \
+	udatapath/dp_ports.c \
+	udatapath/dp_workers.c \
+	udatapath/flow_cache.c \
+	udatapath/flow_classifier.c \
+	udatapath/flow_table.c \
+	udatapath/flow_entry.c \
+	udatapath/group_table.c \
+	udatapath/group_entry.c \
+	udatapath/match_std.c \
+	udatapath/meter_entry.c \
+	udatapath/meter_table.c \
+	udatapath/packet.c \
+	udatapath/packet_handle_std.c \
+	udatapath/packet_key.c \
+	udatapath/packet_parse.c \
+	udatapath/pipeline.c
+test_udatapath_ldadd = $(udatapath_nbee_libs) lib/libopenflow.a \
+	oflib/liboflib.a oflib-exp/liboflib_exp.a $(SSL_LIBS) $(FAULT_LIBS)
+
+# The pipeline is checked for the flow entries packets hit, with the flow
+# cache in front of the tables.
+TESTS += tests/test-pipeline
+noinst_PROGRAMS += tests/test-pipeline
+
+tests_test_pipeline_SOURCES = tests/test-pipeline.c $(test_udatapath_sources)
+nodist_tests_test_pipeline_SOURCES = udatapath/packet_parse_netpdl.c
+nodist_EXTRA_tests_test_pipeline_SOURCES = dummy.cxx
+tests_test_pipeline_LDADD = $(test_udatapath_ldadd)
+tests_test_pipeline_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
+
+# The action set is checked against a model of the execution order.
+TESTS += tests/test-action-set
+noinst_PROGRAMS += tests/test-action-set
+
+tests_test_action_set_SOURCES = \
+	tests/test-action-set.c $(test_udatapath_sources)
+nodist_tests_test_action_set_SOURCES = udatapath/packet_parse_netpdl.c
+nodist_EXTRA_tests_test_action_set_SOURCES = dummy.cxx
+tests_test_action_set_LDADD = $(test_udatapath_ldadd)
+tests_test_action_set_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
+
+# Packets are checked not to allocate memory once the pools are warm.
+TESTS += tests/test-packet-alloc
+noinst_PROGRAMS += tests/test-packet-alloc
+
+tests_test_packet_alloc_SOURCES = \
+	tests/test-packet-alloc.c $(test_udatapath_sources)
+nodist_tests_test_packet_alloc_SOURCES = udatapath/packet_parse_netpdl.c
+nodist_EXTRA_tests_test_packet_alloc_SOURCES = dummy.cxx
+tests_test_packet_alloc_LDADD = $(test_udatapath_ldadd)
+tests_test_packet_alloc_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
+
+# The AMAC table is checked against the list it used to be.
+TESTS += tests/test-amac-table
+noinst_PROGRAMS += tests/test-amac-table
+
+tests_test_amac_table_SOURCES = \
+	tests/test-amac-table.c $(test_udatapath_sources)
+nodist_tests_test_amac_table_SOURCES = udatapath/packet_parse_netpdl.c
+nodist_EXTRA_tests_test_amac_table_SOURCES = dummy.cxx
+tests_test_amac_table_LDADD = $(test_udatapath_ldadd)
+tests_test_amac_table_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
+
+# Benchmarks, run by hand.
+noinst_PROGRAMS += tests/bench-netdev-recv
+
+tests_bench_netdev_recv_SOURCES = tests/bench-netdev-recv.c
+tests_bench_netdev_recv_LDADD = lib/libopenflow.a $(FAULT_LIBS) $(SSL_LIBS)
+
+noinst_PROGRAMS += \
+	tests/bench-poll-loop \
+	tests/bench-poll-loop-poll
+
+tests_bench_poll_loop_SOURCES = tests/bench-poll-loop.c
+tests_bench_poll_loop_LDADD = lib/libopenflow.a $(FAULT_LIBS) $(SSL_LIBS)
+
+tests_bench_poll_loop_poll_SOURCES = tests/bench-poll-loop.c lib/poll-loop.c
+tests_bench_poll_loop_poll_LDADD = lib/libopenflow.a $(FAULT_LIBS) $(SSL_LIBS)
+tests_bench_poll_loop_poll_CPPFLAGS = $(AM_CPPFLAGS) -DPOLL_LOOP_NO_EPOLL
@@ -0,0 +1,239 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Measures how fast netdev_recv() and netdev_recv_batch() take packets off a
+ * network device, usually one end of a veth pair.  In every round, a burst
+ * of minimum size frames is sent from the other end, and the time it takes
+ * to receive them all is measured, so that the rates depend neither on the
+ * sender nor on how the kernel schedules wakeups.
+ *
+ * Usage: bench-netdev-recv PORT PEER [SECONDS]
+ *
+ * Needs the privileges to open raw sockets. */
+
+#include <config.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <net/if.h>
+#include <netpacket/packet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "netdev.h"
+#include "ofpbuf.h"
+#include "packets.h"
+#include "timeval.h"
+#include "util.h"
+#include "vlog.h"
+
+/* Frames sent in a round.  They must all fit in the receive buffer of the
+ * socket of the device. */
+#define ROUND_SIZE 128
+
+/* Room for a received frame. */
+#define BUFFER_SIZE 2048
+
+/* Returns the time of 'clock', in seconds. */
+static double
+now(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Opens a raw socket on 'peer'. */
+static int
+open_peer(const char *peer)
+{
+    struct sockaddr_ll sll;
+    int fd;
+
+    fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (fd < 0) {
+        ofp_fatal(errno, "could not create raw socket");
+    }
+    memset(&sll, 0, sizeof sll);
+    sll.sll_family = AF_PACKET;
+    sll.sll_ifindex = if_nametoindex(peer);
+    if (sll.sll_ifindex == 0) {
+        ofp_fatal(errno, "%s", peer);
+    }
+    if (bind(fd, (struct sockaddr *) &sll, sizeof sll) < 0) {
+        ofp_fatal(errno, "could not bind to %s", peer);
+    }
+    return fd;
+}
+
+/* Sends ROUND_SIZE copies of 'frame' on 'fd'. */
+static void
+send_round(int fd, uint8_t *frame, size_t size)
+{
+    struct mmsghdr msgs[ROUND_SIZE];
+    struct iovec iov;
+    size_t n_sent;
+    int i;
+
+    iov.iov_base = frame;
+    iov.iov_len = size;
+    memset(msgs, 0, sizeof msgs);
+    for (i = 0; i < ROUND_SIZE; i++) {
+        msgs[i].msg_hdr.msg_iov = &iov;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    for (n_sent = 0; n_sent < ROUND_SIZE; ) {
+        int n = sendmmsg(fd, msgs, ROUND_SIZE - n_sent, 0);
+
+        if (n > 0) {
+            n_sent += n;
+        } else if (errno != ENOBUFS && errno != EAGAIN && errno != EINTR) {
+            ofp_fatal(errno, "sendmmsg failed");
+        }
+    }
+}
+
+/* Receives on 'netdev', 'burst' packets at a time with netdev_recv_batch(),
+ * or one at a time with netdev_recv() if 'burst' is 0, until no packet is
+ * left.  Returns the number of packets received. */
+static size_t
+drain(struct netdev *netdev, struct ofpbuf **buffers, size_t burst)
+{
+    size_t n_received = 0;
+
+    for (;;) {
+        size_t i, n;
+        int error;
+
+        for (i = 0; i < MAX(burst, 1); i++) {
+            ofpbuf_clear(buffers[i]);
+        }
+        if (burst == 0) {
+            error = netdev_recv(netdev, buffers[0], BUFFER_SIZE);
+            n = !error;
+        } else {
+            error = netdev_recv_batch(netdev, buffers, burst, BUFFER_SIZE,
+                                      &n);
+        }
+        if (error == EAGAIN) {
+            return n_received;
+        } else if (error) {
+            ofp_fatal(error, "receive failed");
+        }
+        n_received += n;
+    }
+}
+
+/* Runs rounds for 'seconds', receiving with drain(), and prints the rate. */
+static void
+run(struct netdev *netdev, int peer_fd, size_t burst, double seconds)
+{
+    struct ofpbuf *buffers[NETDEV_MAX_BATCH];
+    uint8_t frame[ETH_TOTAL_MIN];
+    struct eth_header *eth = (struct eth_header *) frame;
+    uint64_t n_sent = 0, n_received = 0;
+    double end, busy = 0;
+    size_t i;
+
+    memset(frame, 0, sizeof frame);
+    memcpy(eth->eth_dst, netdev_get_etheraddr(netdev), ETH_ADDR_LEN);
+    eth->eth_src[0] = 0x02;
+    eth->eth_src[5] = 0x01;
+    eth->eth_type = htons(0x88b5);  /* local experimental ethertype. */
+
+    for (i = 0; i < NETDEV_MAX_BATCH; i++) {
+        buffers[i] = ofpbuf_new(BUFFER_SIZE);
+    }
+    netdev_drain(netdev);
+
+    end = now(CLOCK_MONOTONIC) + seconds;
+    while (now(CLOCK_MONOTONIC) < end) {
+        double start;
+
+        send_round(peer_fd, frame, sizeof frame);
+        n_sent += ROUND_SIZE;
+        start = now(CLOCK_MONOTONIC);
+        n_received += drain(netdev, buffers, burst);
+        busy += now(CLOCK_MONOTONIC) - start;
+    }
+
+    for (i = 0; i < NETDEV_MAX_BATCH; i++) {
+        ofpbuf_delete(buffers[i]);
+    }
+
+    if (burst == 0) {
+        printf("netdev_recv():           ");
+    } else {
+        printf("netdev_recv_batch(), %2zu: ", burst);
+    }
+    printf("%9.0f packets/s, %5.0f ns/packet, %"PRIu64" of %"PRIu64
+           " packets lost\n", n_received / busy, busy * 1e9 / n_received,
+           n_sent - n_received, n_sent);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const size_t bursts[] = { 0, 8, 32, NETDEV_MAX_BATCH };
+    struct netdev *netdev;
+    double seconds;
+    size_t i;
+    int peer_fd;
+    int error;
+
+    set_program_name(argv[0]);
+    time_init();
+    vlog_init();
+
+    if (argc != 3 && argc != 4) {
+        ofp_fatal(0, "usage: %s PORT PEER [SECONDS]", program_name);
+    }
+    seconds = argc > 3 ? atof(argv[3]) : 2;
+
+    error = netdev_open(argv[1], NETDEV_ETH_TYPE_ANY, &netdev);
+    if (error) {
+        ofp_fatal(error, "could not open %s", argv[1]);
+    }
+    error = netdev_turn_flags_on(netdev, NETDEV_UP, false);
+    if (error) {
+        ofp_fatal(error, "could not bring %s up", argv[1]);
+    }
+    peer_fd = open_peer(argv[2]);
+
+    for (i = 0; i < ARRAY_SIZE(bursts); i++) {
+        run(netdev, peer_fd, bursts[i], seconds);
+    }
+    close(peer_fd);
+    netdev_close(netdev);
+    return 0;
+}
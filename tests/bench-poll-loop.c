@@ -0,0 +1,141 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Measures the cost of a poll_block() wakeup against the number of file
+ * descriptors waited on.  Every iteration registers the read ends of N pipes
+ * with poll_fd_wait(), makes one of them readable, and calls poll_block().
+ *
+ * Usage: bench-poll-loop [SECONDS]
+ *
+ * bench-poll-loop uses the epoll backend of the poll loop, where available,
+ * and bench-poll-loop-poll the poll() one. */
+
+#include <config.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include "poll-loop.h"
+#include "socket-util.h"
+#include "timeval.h"
+#include "util.h"
+#include "vlog.h"
+
+/* Returns the monotonic time, in seconds. */
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Waits on 'n' pipes for 'seconds' and prints the time per wakeup. */
+static void
+run(int n, double seconds)
+{
+    int (*fds)[2] = xmalloc(n * sizeof *fds);
+    unsigned long long int n_wakeups = 0;
+    double start, elapsed;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (pipe(fds[i]) || set_nonblocking(fds[i][0])) {
+            ofp_fatal(errno, "could not create pipe");
+        }
+    }
+
+    start = now();
+    do {
+        int ready = n_wakeups % n;
+        char c = 0;
+
+        if (write(fds[ready][1], &c, 1) != 1) {
+            ofp_fatal(errno, "write failed");
+        }
+        for (i = 0; i < n; i++) {
+            poll_fd_wait(fds[i][0], POLLIN);
+        }
+        poll_block();
+        if (read(fds[ready][0], &c, 1) != 1) {
+            ofp_fatal(errno, "read failed");
+        }
+        n_wakeups++;
+    } while ((elapsed = now() - start) < seconds);
+
+    for (i = 0; i < n; i++) {
+        poll_fd_forget(fds[i][0]);
+        close(fds[i][0]);
+        close(fds[i][1]);
+    }
+    free(fds);
+
+    printf("%5d fds: %8.0f ns/wakeup\n", n, elapsed * 1e9 / n_wakeups);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const int counts[] = { 1, 16, 64, 256, 1024, 4096 };
+    double seconds;
+    struct rlimit rlim;
+    size_t i;
+
+    set_program_name(argv[0]);
+    time_init();
+    vlog_init();
+
+    if (argc > 2) {
+        ofp_fatal(0, "usage: %s [SECONDS]", program_name);
+    }
+    seconds = argc > 1 ? atof(argv[1]) : 1;
+
+#if defined(HAVE_EPOLL_CREATE1) && !defined(POLL_LOOP_NO_EPOLL)
+    printf("epoll backend\n");
+#else
+    printf("poll() backend\n");
+#endif
+
+    if (getrlimit(RLIMIT_NOFILE, &rlim)) {
+        ofp_fatal(errno, "getrlimit failed");
+    }
+    for (i = 0; i < ARRAY_SIZE(counts); i++) {
+        if (2 * counts[i] + 16 > rlim.rlim_cur) {
+            printf("%5d fds: skipped, over the open file limit\n", counts[i]);
+            continue;
+        }
+        run(counts[i], seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,259 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Checks the action set against a model of the order the specification
+ * gives: actions are executed by rank, actions of the same rank in the order
+ * they were first written, and an action replaces the one of the same type,
+ * or for set-field actions, the one setting the same field, in its place.
+ * The set is written randomized sequences of actions and printed in
+ * execution order. */
+
+#include <config.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "action_set.h"
+#include "oflib/ofl-actions.h"
+#include "oflib/ofl-structs.h"
+#include "oflib/oxm-match.h"
+#include "openflow/openflow.h"
+#include "packets.h"
+#include "random.h"
+#include "util.h"
+
+#define N_ROUNDS 20000
+
+/* Writes per round, at most. */
+#define MAX_WRITES 16
+
+/* Actions written to the sets, two of each type. */
+static struct ofl_action_header *actions[64];
+static size_t n_actions;
+
+/* The ranks of the action types in the execution order. */
+static int
+rank(const struct ofl_action_header *act)
+{
+    switch (act->type) {
+    case OFPAT_COPY_TTL_IN:  return 10;
+    case OFPAT_POP_VLAN:
+    case OFPAT_POP_PBB:
+    case OFPAT_POP_MPLS:     return 20;
+    case OFPAT_PUSH_VLAN:
+    case OFPAT_PUSH_PBB:
+    case OFPAT_PUSH_MPLS:    return 30;
+    case OFPAT_COPY_TTL_OUT: return 40;
+    case OFPAT_DEC_MPLS_TTL:
+    case OFPAT_DEC_NW_TTL:   return 50;
+    case OFPAT_SET_MPLS_TTL:
+    case OFPAT_SET_NW_TTL:
+    case OFPAT_SET_FIELD:    return 60;
+    case OFPAT_SET_QUEUE:    return 70;
+    case OFPAT_EXPERIMENTER: return 75;
+    case OFPAT_GROUP:        return 80;
+    case OFPAT_OUTPUT:       return 90;
+    default:                 abort();
+    }
+}
+
+static bool
+same_slot(const struct ofl_action_header *a, const struct ofl_action_header *b)
+{
+    return (a->type == b->type
+            && (a->type != OFPAT_SET_FIELD
+                || (((struct ofl_action_set_field *) a)->field->header
+                    == ((struct ofl_action_set_field *) b)->field->header)));
+}
+
+/* The model: the actions of a set, in execution order. */
+struct model {
+    struct ofl_action_header *acts[MAX_WRITES];
+    size_t n;
+};
+
+static void
+model_write(struct model *m, struct ofl_action_header *act)
+{
+    size_t i;
+
+    for (i = 0; i < m->n; i++) {
+        if (same_slot(m->acts[i], act)) {
+            m->acts[i] = act;
+            return;
+        }
+        if (rank(act) < rank(m->acts[i])) {
+            break;
+        }
+    }
+    memmove(&m->acts[i + 1], &m->acts[i], (m->n - i) * sizeof *m->acts);
+    m->acts[i] = act;
+    m->n++;
+}
+
+static char *
+model_to_string(const struct model *m)
+{
+    char *str;
+    size_t str_size, i;
+    FILE *stream = open_memstream(&str, &str_size);
+
+    fprintf(stream, "[");
+    for (i = 0; i < m->n; i++) {
+        if (i > 0) {
+            fprintf(stream, ", ");
+        }
+        ofl_action_print(stream, m->acts[i], NULL);
+    }
+    fprintf(stream, "]");
+    fclose(stream);
+    return str;
+}
+
+static void
+add(void *act_, uint16_t type)
+{
+    struct ofl_action_header *act = act_;
+
+    act->type = type;
+    act->len = 0;
+    actions[n_actions++] = act;
+}
+
+static void
+add_set_field(uint32_t header, uint8_t value)
+{
+    struct ofl_action_set_field *act = xmalloc(sizeof *act);
+
+    act->field = xmalloc(sizeof *act->field);
+    act->field->header = header;
+    act->field->value = xmalloc(1);
+    act->field->value[0] = value;
+    add(act, OFPAT_SET_FIELD);
+}
+
+static void
+init_actions(void)
+{
+    static const uint16_t plain[] = {
+        OFPAT_COPY_TTL_IN, OFPAT_POP_VLAN, OFPAT_POP_PBB, OFPAT_COPY_TTL_OUT,
+        OFPAT_DEC_MPLS_TTL, OFPAT_DEC_NW_TTL
+    };
+    static const uint16_t pushes[] = {
+        OFPAT_PUSH_VLAN, OFPAT_PUSH_PBB, OFPAT_PUSH_MPLS
+    };
+    size_t i;
+    int v;
+
+    for (v = 1; v <= 2; v++) {
+        for (i = 0; i < ARRAY_SIZE(plain); i++) {
+            add(xmalloc(sizeof(struct ofl_action_header)), plain[i]);
+        }
+        for (i = 0; i < ARRAY_SIZE(pushes); i++) {
+            struct ofl_action_push *act = xmalloc(sizeof *act);
+
+            act->ethertype = (pushes[i] == OFPAT_PUSH_MPLS
+                              ? ETH_TYPE_MPLS : ETH_TYPE_VLAN) + v - 1;
+            add(act, pushes[i]);
+        }
+        {
+            struct ofl_action_pop_mpls *pop = xmalloc(sizeof *pop);
+            struct ofl_action_mpls_ttl *mpls_ttl = xmalloc(sizeof *mpls_ttl);
+            struct ofl_action_set_nw_ttl *nw_ttl = xmalloc(sizeof *nw_ttl);
+            struct ofl_action_set_queue *queue = xmalloc(sizeof *queue);
+            struct ofl_action_group *group = xmalloc(sizeof *group);
+            struct ofl_action_output *output = xmalloc(sizeof *output);
+
+            pop->ethertype = ETH_TYPE_IP + v - 1;
+            add(pop, OFPAT_POP_MPLS);
+            mpls_ttl->mpls_ttl = v;
+            add(mpls_ttl, OFPAT_SET_MPLS_TTL);
+            nw_ttl->nw_ttl = v;
+            add(nw_ttl, OFPAT_SET_NW_TTL);
+            queue->queue_id = v;
+            add(queue, OFPAT_SET_QUEUE);
+            group->group_id = v;
+            add(group, OFPAT_GROUP);
+            output->port = v;
+            output->max_len = 0;
+            add(output, OFPAT_OUTPUT);
+        }
+        add_set_field(OXM_OF_IP_DSCP, v);
+        add_set_field(OXM_OF_IP_ECN, v);
+        add_set_field(OXM_OF_VLAN_PCP, v);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int seed = argc > 1 ? atoi(argv[1]) : 1;
+    struct ofl_action_header *writes[MAX_WRITES];
+    struct action_set *set;
+    struct model model;
+    int round;
+
+    printf("checking the action set, seed %u\n", seed);
+    random_init();
+    srand(seed);
+    init_actions();
+    set = action_set_create(NULL);
+
+    for (round = 0; round < N_ROUNDS; round++) {
+        size_t n_writes = 1 + random_range(MAX_WRITES);
+        size_t i, n;
+        char *got, *expected;
+
+        action_set_clear_actions(set);
+        model.n = 0;
+        for (i = 0; i < n_writes; i++) {
+            writes[i] = actions[random_range(n_actions)];
+            model_write(&model, writes[i]);
+        }
+
+        /* The actions are written by instructions of one or more
+         * actions. */
+        for (i = 0; i < n_writes; i += n) {
+            n = 1 + random_range(n_writes - i);
+            action_set_write_actions(set, n, &writes[i]);
+        }
+
+        got = action_set_to_string(set);
+        expected = model_to_string(&model);
+        if (strcmp(got, expected)) {
+            fprintf(stderr, "round %d: the action set is %s, "
+                    "expected %s\n", round, got, expected);
+            return EXIT_FAILURE;
+        }
+        free(got);
+        free(expected);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,302 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Checks the AMAC table against the list it used to be, which every
+ * operation walked in full: validation, learning, port down and up, and
+ * removal of the AMACs of a port.  Each round applies a randomized sequence
+ * of operations to both and compares validation results, the order of the
+ * AMACs, their per-port counts and their state.  AMACs are drawn from a few
+ * byte values so that their validation prefixes often collide. */
+
+#include <config.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "datapath.h"
+#include "dp_ports.h"
+#include "hmap.h"
+#include "list.h"
+#include "random.h"
+#include "timeval.h"
+
+#define N_ROUNDS 2000
+
+/* Operations per round, at most. */
+#define MAX_OPS 32
+
+/* Validations checked after each operation. */
+#define N_PROBES 16
+
+/* AMACs are drawn from ports 0 to N_PORTS - 1, with their first AMAC_BYTES
+ * bytes below N_VALUES and levels up to MAX_LEVEL. */
+#define N_PORTS 4
+#define AMAC_BYTES 5
+#define N_VALUES 3
+#define MAX_LEVEL 5
+
+/* The list, in order of arrival. */
+struct model_amac {
+    uint8_t AMAC[AMAC_LEN];
+    uint8_t level;
+    uint32_t port;
+    bool active;
+};
+
+struct model {
+    struct model_amac amacs[MAX_OPS];
+    int n;
+};
+
+static int
+model_count_port(const struct model *m, uint32_t port)
+{
+    int i, n = 0;
+
+    for (i = 0; i < m->n; i++) {
+        n += m->amacs[i].port == port;
+    }
+    return n;
+}
+
+/* As validate_AMAC_in_switch() did on the list. */
+static int
+model_validate(const struct model *m, const uint8_t AMAC[AMAC_LEN],
+               uint32_t port)
+{
+    int i;
+
+    if (m->n >= max_dir_switch && max_dir_switch != 0) {
+        return 0;
+    } else if (model_count_port(m, port) >= max_dir_port
+               && max_dir_port != 0) {
+        return 0;
+    }
+    for (i = 0; i < m->n; i++) {
+        const struct model_amac *a = &m->amacs[i];
+        int len = (max_len_dir == 0 ? a->level
+                   : max_len_dir < a->level ? max_len_dir : a->level);
+
+        if (!memcmp(a->AMAC, AMAC, len)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void
+model_add(struct model *m, const uint8_t AMAC[AMAC_LEN], uint8_t level,
+          uint32_t port)
+{
+    struct model_amac *a = &m->amacs[m->n++];
+
+    memcpy(a->AMAC, AMAC, AMAC_LEN);
+    a->level = level;
+    a->port = port;
+    a->active = true;
+}
+
+static void
+model_set_active(struct model *m, uint32_t port, bool active)
+{
+    int i;
+
+    for (i = 0; i < m->n; i++) {
+        if (m->amacs[i].port == port) {
+            m->amacs[i].active = active;
+        }
+    }
+}
+
+static void
+model_remove(struct model *m, uint32_t port)
+{
+    int i, n = 0;
+
+    for (i = 0; i < m->n; i++) {
+        if (m->amacs[i].port != port) {
+            m->amacs[n++] = m->amacs[i];
+        }
+    }
+    m->n = n;
+}
+
+static void
+random_amac(uint8_t AMAC[AMAC_LEN])
+{
+    int i;
+
+    memset(AMAC, 0, AMAC_LEN);
+    for (i = 0; i < AMAC_BYTES; i++) {
+        AMAC[i] = random_range(N_VALUES);
+    }
+}
+
+/* Compares the table with the model, and returns false if they differ. */
+static bool
+check(struct table_AMACS *table, const struct model *m, int round, int op)
+{
+    struct reg_AMAC *r;
+    uint32_t port;
+    int i;
+
+    if (table->num_element != m->n) {
+        fprintf(stderr, "round %d, op %d: the table has %d AMACs, "
+                "expected %d\n", round, op, table->num_element, m->n);
+        return false;
+    }
+
+    i = 0;
+    LIST_FOR_EACH(r, struct reg_AMAC, node, &table->amacs) {
+        const struct model_amac *a = &m->amacs[i++];
+
+        if (memcmp(r->AMAC, a->AMAC, AMAC_LEN) || r->level != a->level
+            || r->port_in != a->port || r->active != a->active) {
+            fprintf(stderr, "round %d, op %d: AMAC %d differs\n",
+                    round, op, i - 1);
+            return false;
+        }
+    }
+
+    for (port = 0; port < N_PORTS; port++) {
+        int got = number_AMAC_assigned_port(table, port);
+        int expected = model_count_port(m, port);
+
+        if (got != expected) {
+            fprintf(stderr, "round %d, op %d: port %u has %d AMACs, "
+                    "expected %d\n", round, op, port, got, expected);
+            return false;
+        }
+    }
+
+    for (i = 0; i < N_PROBES; i++) {
+        uint8_t AMAC[AMAC_LEN];
+        int got, expected;
+
+        random_amac(AMAC);
+        port = random_range(N_PORTS);
+        got = validate_AMAC_in_switch(table, AMAC, port);
+        expected = model_validate(m, AMAC, port);
+        if (!!got != expected) {
+            fprintf(stderr, "round %d, op %d: validation on port %u "
+                    "gave %d, expected %d\n", round, op, port, got, expected);
+            return false;
+        }
+    }
+    return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int seed = argc > 1 ? atoi(argv[1]) : 1;
+    int round;
+
+    printf("checking the AMAC table, seed %u\n", seed);
+    time_init();
+    random_init();
+    srand(seed);
+
+    for (round = 0; round < N_ROUNDS; round++) {
+        struct table_AMACS table;
+        struct model m;
+        int n_ops = 1 + random_range(MAX_OPS);
+        int op;
+        uint32_t port;
+
+        AMAC_table_new(&table);
+        m.n = 0;
+
+        for (op = 0; op < n_ops; op++) {
+            uint8_t AMAC[AMAC_LEN];
+            uint8_t level = random_range(MAX_LEVEL + 1);
+
+            random_amac(AMAC);
+            port = random_range(N_PORTS);
+            switch (random_range(6)) {
+            case 0:
+            case 1:
+                /* Learned from an AMARU packet, as the pipeline does. */
+                if (validate_AMAC_in_switch(&table, AMAC, port)) {
+                    table_AMACS_add_AMAC(&table, AMAC, level, port, 0);
+                }
+                if (model_validate(&m, AMAC, port)) {
+                    model_add(&m, AMAC, level, port);
+                }
+                break;
+            case 2:
+                /* Added unchecked, as the initial AMAC is. */
+                table_AMACS_add_AMAC(&table, AMAC, level, port, 0);
+                model_add(&m, AMAC, level, port);
+                break;
+            case 3:
+                disable_invalid_amacs_UAH(&table, port);
+                model_set_active(&m, port, false);
+                break;
+            case 4:
+                enable_valid_amacs_UAH(&table, port);
+                model_set_active(&m, port, true);
+                break;
+            case 5:
+                remove_invalid_amacs_UAH(&table, port);
+                model_remove(&m, port);
+                break;
+            }
+            if (!check(&table, &m, round, op)) {
+                return EXIT_FAILURE;
+            }
+        }
+
+        /* Removing the AMACs of every port leaves the table, trie included,
+         * empty.  The port records stay. */
+        for (port = 0; port < N_PORTS; port++) {
+            remove_invalid_amacs_UAH(&table, port);
+        }
+        if (table.num_element || !list_is_empty(&table.amacs)
+            || hmap_count(&table.trie)
+            || table.root.n_amacs || table.root.n_children) {
+            fprintf(stderr, "round %d: the emptied table is not empty\n",
+                    round);
+            return EXIT_FAILURE;
+        }
+        {
+            struct amac_port *p, *next;
+
+            HMAP_FOR_EACH_SAFE(p, next, struct amac_port, hmap_node,
+                               &table.ports) {
+                hmap_remove(&table.ports, &p->hmap_node);
+                free(p);
+            }
+        }
+        hmap_destroy(&table.ports);
+        hmap_destroy(&table.trie);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,245 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Checks the compiled flow matcher against packet_match() on randomized
+ * matches and packet keys.  The program is built once for each
+ * implementation of flow_matcher_match(): AVX2, SSE2 and 64-bit words. */
+
+#include <config.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "hmap.h"
+#include "match_std.h"
+#include "oflib/ofl-structs.h"
+#include "openflow/openflow.h"
+#include "packet_key.h"
+#include "random.h"
+#include "util.h"
+
+#define N_ROUNDS 200000
+
+/* Fields of the matches, at most this many. */
+#define MAX_FIELDS 6
+
+/* Fields the matcher compiles; the others always take the fallback. */
+static int fields[PACKET_KEY_N_FIELDS];
+static size_t n_fields;
+
+static void
+init_fields(void)
+{
+    int f;
+
+    for (f = 0; f < PACKET_KEY_N_FIELDS; f++) {
+        uint32_t header = packet_key_header(f);
+
+        if (packet_key_fields[f].len != 0 && header != OXM_OF_IPV6_EXTHDR
+            && header != OXM_OF_AMARU_LEVEL && header != OXM_OF_AMARU_AMAC) {
+            fields[n_fields++] = f;
+        }
+    }
+}
+
+/* Adds field 'f' to 'match'.  'mask' is NULL for an exact match. */
+static void
+match_put(struct ofl_match *match, int f, const uint8_t *value,
+          const uint8_t *mask)
+{
+    struct ofl_match_tlv *tlv = xmalloc(sizeof *tlv);
+    size_t len = packet_key_fields[f].len;
+
+    tlv->header = (mask != NULL
+                   ? OXM_HEADER_W(OFPXMC_OPENFLOW_BASIC, f, len)
+                   : OXM_HEADER(OFPXMC_OPENFLOW_BASIC, f, len));
+    tlv->value = xmalloc(mask != NULL ? 2 * len : len);
+    memcpy(tlv->value, value, len);
+    if (mask != NULL) {
+        memcpy(tlv->value + len, mask, len);
+    }
+    hmap_insert(&match->match_fields, &tlv->hmap_node,
+                hash_int(tlv->header, 0));
+    match->header.length += OXM_LENGTH(tlv->header) + 4;
+}
+
+static void
+match_clear(struct ofl_match *match)
+{
+    struct ofl_match_tlv *tlv, *next;
+
+    HMAP_FOR_EACH_SAFE (tlv, next, struct ofl_match_tlv, hmap_node,
+                        &match->match_fields) {
+        hmap_remove(&match->match_fields, &tlv->hmap_node);
+        free(tlv->value);
+        free(tlv);
+    }
+    match->header.length = 0;
+}
+
+/* Returns a random VLAN ID of a match, favoring the special values. */
+static uint16_t
+random_vid(void)
+{
+    switch (random_range(4)) {
+    case 0:
+        return OFPVID_NONE;
+    case 1:
+        return OFPVID_PRESENT;
+    default:
+        return OFPVID_PRESENT | (random_uint16() & VLAN_VID_MASK);
+    }
+}
+
+/* Fills 'match' with random fields, and 'key' with a packet likely to match
+ * it: most fields of the match are copied to the key, some with a bit
+ * flipped, and the key gets a few random fields of its own. */
+static void
+random_case(struct ofl_match *match, struct packet_key *key)
+{
+    bool used[PACKET_KEY_N_FIELDS];
+    size_t n = random_range(MAX_FIELDS + 1);
+    size_t i;
+
+    memset(used, 0, sizeof used);
+    packet_key_init(key);
+
+    for (i = 0; i < n; i++) {
+        int f = fields[random_range(n_fields)];
+        size_t len = packet_key_fields[f].len;
+        uint8_t value[32], mask[32];
+        bool has_mask = random_range(2);
+        uint32_t header = packet_key_header(f);
+
+        if (used[f]) {
+            continue;
+        }
+        used[f] = true;
+
+        random_bytes(value, len);
+        random_bytes(mask, len);
+        if (header == OXM_OF_VLAN_VID) {
+            uint16_t vid = random_vid();
+
+            memcpy(value, &vid, sizeof vid);
+        }
+        match_put(match, f, value, has_mask ? mask : NULL);
+
+        if (header == OXM_OF_VLAN_VID && random_range(2)) {
+            uint16_t vid = random_uint16() & VLAN_VID_MASK;
+
+            if (random_range(4)) {
+                packet_key_put16(key, header, vid);
+            }
+        } else if (random_range(8)) {
+            if (!random_range(4)) {
+                int bit = random_range(len * 8);
+
+                value[bit / 8] ^= 1 << (bit % 8);
+            }
+            packet_key_put(key, header, value);
+        }
+    }
+
+    for (i = random_range(4); i > 0; i--) {
+        int f = fields[random_range(n_fields)];
+        uint8_t value[32];
+
+        if (!used[f]) {
+            random_bytes(value, packet_key_fields[f].len);
+            packet_key_put(key, packet_key_header(f), value);
+        }
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct ofl_match match;
+    struct flow_matcher matcher;
+    struct packet_key key;
+    unsigned int seed = argc > 1 ? atoi(argv[1]) : 1;
+    size_t n_matched = 0, n_missed = 0, n_fallback = 0;
+    int i;
+
+#if defined(__AVX2__)
+    if (!__builtin_cpu_supports("avx2")) {
+        printf("the CPU does not support AVX2, skipping\n");
+        return 77;
+    }
+    printf("checking the AVX2 matcher, seed %u\n", seed);
+#elif defined(__SSE2__)
+    printf("checking the SSE2 matcher, seed %u\n", seed);
+#else
+    printf("checking the 64-bit word matcher, seed %u\n", seed);
+#endif
+
+    random_init();
+    srand(seed);
+    init_fields();
+
+    memset(&match, 0, sizeof match);
+    match.header.type = OFPMT_OXM;
+    hmap_init(&match.match_fields);
+
+    for (i = 0; i < N_ROUNDS; i++) {
+        bool expected;
+
+        random_case(&match, &key);
+        flow_matcher_compile(&matcher, &match);
+        if (matcher.fallback) {
+            n_fallback++;
+        } else {
+            expected = packet_match(&match, &key);
+            if (flow_matcher_match(&matcher, &key) != expected) {
+                fprintf(stderr, "round %d: the matcher %s, packet_match() "
+                        "%s\n", i, expected ? "missed" : "matched",
+                        expected ? "matched" : "missed");
+                return EXIT_FAILURE;
+            }
+            if (expected) {
+                n_matched++;
+            } else {
+                n_missed++;
+            }
+        }
+        match_clear(&match);
+    }
+    hmap_destroy(&match.match_fields);
+
+    printf("%zu matched, %zu missed, %zu left to packet_match()\n",
+           n_matched, n_missed, n_fallback);
+    if (n_matched < N_ROUNDS / 10 || n_missed < N_ROUNDS / 10) {
+        fprintf(stderr, "too few matches or misses to be meaningful\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,339 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Runs packets through a group of type ALL, as they come from a port's receive
+ * ring and from a receive buffer, and makes AMARU packets, and checks that
+ * none of it goes through malloc() once the pools are warm.  Also checks that
+ * the clones of a packet in a receive ring share it in place, until one of
+ * them is modified. */
+
+#include <config.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __GLIBC__
+
+#include "datapath.h"
+#include "group_table.h"
+#include "oflib/ofl-actions.h"
+#include "oflib/ofl-messages.h"
+#include "oflib/ofl-structs.h"
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "packet.h"
+#include "pipeline.h"
+#include "timeval.h"
+#include "util.h"
+
+/* Allocations are counted on their way to the C library's allocator. */
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void *__libc_memalign(size_t, size_t);
+
+static bool counting;
+static unsigned long n_allocs;
+
+static void
+count_alloc(void)
+{
+    if (counting) {
+        __atomic_add_fetch(&n_allocs, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void *
+malloc(size_t size)
+{
+    count_alloc();
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t n, size_t size)
+{
+    count_alloc();
+    return __libc_calloc(n, size);
+}
+
+void *
+realloc(void *p, size_t size)
+{
+    count_alloc();
+    return __libc_realloc(p, size);
+}
+
+int
+posix_memalign(void **p, size_t align, size_t size)
+{
+    count_alloc();
+    *p = __libc_memalign(align, size);
+    return *p != NULL ? 0 : ENOMEM;
+}
+
+/* Ethernet, IPv4 and UDP. */
+static const uint8_t udp[] = {
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x08, 0x00,
+    0x45, 0x00, 0x00, 0x1c, 0x00, 0x01, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00,
+    0x0a, 0x00, 0x00, 0x01, 0x0a, 0x00, 0x00, 0x02,
+    0x04, 0xd2, 0x16, 0x2e, 0x00, 0x08, 0x00, 0x00
+};
+
+#define RING_HEADROOM 128
+
+/* A frame of a port's receive ring. */
+static uint8_t ring[2048];
+
+static struct datapath *dp;
+static struct remote remote;
+static const struct sender sender = { &remote, 0, 0 };
+
+static void
+fail(const char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+static struct ofl_action_header *
+action_new(enum ofp_action_type type)
+{
+    struct ofl_action_header *act = xmalloc(sizeof *act);
+
+    act->type = type;
+    act->len = sizeof(struct ofp_action_header);
+    return act;
+}
+
+static struct ofl_action_header *
+action_flood(void)
+{
+    struct ofl_action_output *act = xmalloc(sizeof *act);
+
+    act->header.type = OFPAT_OUTPUT;
+    act->header.len = sizeof(struct ofp_action_output);
+    act->port = OFPP_FLOOD;
+    act->max_len = 0;
+    return &act->header;
+}
+
+static struct ofl_action_header *
+action_group(uint32_t group_id)
+{
+    struct ofl_action_group *act = xmalloc(sizeof *act);
+
+    act->header.type = OFPAT_GROUP;
+    act->header.len = sizeof(struct ofp_action_group);
+    act->group_id = group_id;
+    return &act->header;
+}
+
+static struct ofl_bucket *
+bucket_new(size_t n_actions, struct ofl_action_header *a0,
+           struct ofl_action_header *a1)
+{
+    struct ofl_bucket *bucket = xcalloc(1, sizeof *bucket);
+
+    bucket->watch_port = OFPP_ANY;
+    bucket->watch_group = OFPG_ANY;
+    bucket->actions_num = n_actions;
+    bucket->actions = xmalloc(2 * sizeof *bucket->actions);
+    bucket->actions[0] = a0;
+    bucket->actions[1] = a1;
+    return bucket;
+}
+
+/* Adds group 1, of type ALL, whose first bucket modifies the packet, and an
+ * entry that sends all the packets to the group and floods them. */
+static void
+setup(void)
+{
+    struct ofl_msg_group_mod *group = xcalloc(1, sizeof *group);
+    struct ofl_msg_flow_mod *flow = xcalloc(1, sizeof *flow);
+    struct ofl_instruction_actions *inst = xmalloc(sizeof *inst);
+    struct ofl_match *match = xmalloc(sizeof *match);
+
+    group->header.type = OFPT_GROUP_MOD;
+    group->command = OFPGC_ADD;
+    group->type = OFPGT_ALL;
+    group->group_id = 1;
+    group->buckets_num = 3;
+    group->buckets = xmalloc(3 * sizeof *group->buckets);
+    group->buckets[0] = bucket_new(2, action_new(OFPAT_DEC_NW_TTL),
+                                   action_flood());
+    group->buckets[1] = bucket_new(1, action_flood(), NULL);
+    group->buckets[2] = bucket_new(1, action_flood(), NULL);
+    if (group_table_handle_group_mod(dp->groups, group, &sender)) {
+        fail("group_mod rejected");
+    }
+
+    inst->header.type = OFPIT_APPLY_ACTIONS;
+    inst->actions_num = 2;
+    inst->actions = xmalloc(2 * sizeof *inst->actions);
+    inst->actions[0] = action_group(1);
+    inst->actions[1] = action_flood();
+    ofl_structs_match_init(match);
+    flow->header.type = OFPT_FLOW_MOD;
+    flow->command = OFPFC_ADD;
+    flow->priority = 10;
+    flow->buffer_id = OFP_NO_BUFFER;
+    flow->out_port = OFPP_ANY;
+    flow->out_group = OFPG_ANY;
+    flow->match = &match->header;
+    flow->instructions_num = 1;
+    flow->instructions = xmalloc(sizeof *flow->instructions);
+    flow->instructions[0] = &inst->header;
+    if (pipeline_handle_flow_mod(dp->pipeline, flow, &sender)) {
+        fail("flow_mod rejected");
+    }
+
+    /* The port AMARU packets are sent from. */
+    dp->ports[1].conf = xcalloc(1, sizeof *dp->ports[1].conf);
+}
+
+/* Returns a packet received in the ring, as netdev_recv_ring() does. */
+static struct packet *
+ring_packet(void)
+{
+    struct ofpbuf *buf = packet_buffer_header();
+
+    ofpbuf_use_foreign(buf, ring, sizeof ring);
+    ofpbuf_reserve(buf, RING_HEADROOM);
+    ofpbuf_put(buf, udp, sizeof udp);
+    return packet_create(dp, 1, buf, false);
+}
+
+/* Returns a packet received into a buffer. */
+static struct packet *
+buffer_packet(void)
+{
+    struct ofpbuf *buf = packet_buffer_new(sizeof udp, RING_HEADROOM);
+
+    ofpbuf_put(buf, udp, sizeof udp);
+    return packet_create(dp, 1, buf, false);
+}
+
+static bool
+in_ring(const struct packet *pkt)
+{
+    return ((uint8_t *) pkt->buffer->data == ring + RING_HEADROOM);
+}
+
+/* The clones of a packet in the ring use the ring, until they are modified,
+ * and the modified ones get a copy. */
+static void
+test_share_in_place(void)
+{
+    struct packet *pkt = ring_packet();
+    struct packet *clone = packet_clone_shared(pkt);
+
+    if (!in_ring(pkt) || !in_ring(clone)) {
+        fail("packet in the ring copied when shared");
+    }
+    packet_make_writable(clone);
+    if (!in_ring(pkt) || in_ring(clone)
+        || memcmp(clone->buffer->data, udp, sizeof udp)) {
+        fail("shared packet not copied when modified");
+    }
+    ((uint8_t *) clone->buffer->data)[0] = 0xff;
+    if (ring[RING_HEADROOM] != udp[0]) {
+        fail("modified clone changed the ring");
+    }
+    packet_destroy(clone);
+
+    packet_make_writable(pkt);
+    if (!in_ring(pkt)) {
+        fail("unshared packet copied out of the ring");
+    }
+    packet_destroy(pkt);
+}
+
+/* Receives a batch of two packets, one in the ring and one in a buffer, and
+ * makes an AMARU packet. */
+static void
+run_batch(void)
+{
+    uint8_t amac[AMAC_LEN];
+    struct packet *pkts[2];
+
+    pkts[0] = ring_packet();
+    pkts[1] = buffer_packet();
+    pipeline_process_batch(dp->pipeline, pkts, 2);
+
+    memset(amac, 0, sizeof amac);
+    packet_destroy(packet_Amaru(dp, 1, false, 1, 1, amac));
+}
+
+static void
+test_no_allocations(void)
+{
+    int i;
+
+    for (i = 0; i < 100; i++) {
+        run_batch();
+    }
+    counting = true;
+    for (i = 0; i < 1000; i++) {
+        run_batch();
+    }
+    counting = false;
+    if (n_allocs != 0) {
+        fprintf(stderr, "%lu allocations in 1000 warm batches\n", n_allocs);
+        fail("packets allocated memory");
+    }
+}
+
+int
+main(void)
+{
+    time_init();
+    dp = dp_new();
+    remote.role = OFPCR_ROLE_EQUAL;
+    setup();
+
+    test_share_in_place();
+    test_no_allocations();
+    return EXIT_SUCCESS;
+}
+
+#else /* !__GLIBC__ */
+
+int
+main(void)
+{
+    /* Allocations cannot be counted without the C library's entry points. */
+    return 77;
+}
+
+#endif /* !__GLIBC__ */
@@ -0,0 +1,517 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Parses fixed frames with the native parser, and checks that the parser
+ * generated from customnetpdl.xml and, when it is built in, NetBee agree with
+ * it: same fields in the packet key, same header pointers.  The fields whose
+ * decoding was fixed are also checked against their old and new values. */
+
+#include <config.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hmap.h"
+#include "ofpbuf.h"
+#include "oflib/ofl-structs.h"
+#include "openflow/openflow.h"
+#include "packet_key.h"
+#include "packet_parse.h"
+#include "packets.h"
+
+#define ETH_ADDRS \
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01
+
+#define IPV4_UDP \
+    0x45, 0x00, 0x00, 0x1c, 0x00, 0x01, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00, \
+    0x0a, 0x00, 0x00, 0x01, 0x0a, 0x00, 0x00, 0x02, \
+    0x04, 0xd2, 0x16, 0x2e, 0x00, 0x08, 0x00, 0x00
+
+#define IPV6_ADDRS \
+    0x20, 0x01, 0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00, \
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, \
+    0x20, 0x01, 0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00, \
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02
+
+static const uint8_t ipv4_tcp[] = {
+    ETH_ADDRS, 0x08, 0x00,
+    /* IPv4, DSCP 11, ECN 2. */
+    0x45, 0x2e, 0x00, 0x28, 0x00, 0x01, 0x00, 0x00, 0x40, 0x06, 0x00, 0x00,
+    0x0a, 0x00, 0x00, 0x01, 0x0a, 0x00, 0x00, 0x02,
+    /* TCP. */
+    0x04, 0xd2, 0x00, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x50, 0x02, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8_t vlan_udp[] = {
+    ETH_ADDRS, 0x81, 0x00,
+    /* PCP 5, VID 100. */
+    0xa0, 0x64, 0x08, 0x00,
+    IPV4_UDP
+};
+
+static const uint8_t qinq_icmp[] = {
+    ETH_ADDRS, 0x88, 0xa8,
+    /* Outer tag, PCP 1, VID 10, then inner tag, VID 20. */
+    0x20, 0x0a, 0x81, 0x00,
+    0x00, 0x14, 0x08, 0x00,
+    /* IPv4. */
+    0x45, 0x00, 0x00, 0x1c, 0x00, 0x01, 0x00, 0x00, 0x40, 0x01, 0x00, 0x00,
+    0x0a, 0x00, 0x00, 0x01, 0x0a, 0x00, 0x00, 0x02,
+    /* ICMP echo request. */
+    0x08, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01
+};
+
+static const uint8_t qinq_9100_udp[] = {
+    ETH_ADDRS, 0x91, 0x00,
+    /* Tag with the pre-standard QinQ type, VID 30. */
+    0x00, 0x1e, 0x08, 0x00,
+    IPV4_UDP
+};
+
+static const uint8_t icmp_extended_echo[] = {
+    ETH_ADDRS, 0x08, 0x00,
+    0x45, 0x00, 0x00, 0x1c, 0x00, 0x01, 0x00, 0x00, 0x40, 0x01, 0x00, 0x00,
+    0x0a, 0x00, 0x00, 0x01, 0x0a, 0x00, 0x00, 0x02,
+    /* ICMP extended echo request, a type customnetpdl.xml does not list. */
+    0x2a, 0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x00
+};
+
+static const uint8_t arp_request[] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x08, 0x06,
+    0x00, 0x01, 0x08, 0x00, 0x06, 0x04, 0x00, 0x01,
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x0a, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x02
+};
+
+static const uint8_t ipv4_sctp[] = {
+    ETH_ADDRS, 0x08, 0x00,
+    0x45, 0x00, 0x00, 0x20, 0x00, 0x01, 0x00, 0x00, 0x40, 0x84, 0x00, 0x00,
+    0x0a, 0x00, 0x00, 0x01, 0x0a, 0x00, 0x00, 0x02,
+    /* SCTP common header. */
+    0x04, 0xd2, 0x00, 0x50, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8_t ipv6_tcp[] = {
+    ETH_ADDRS, 0x86, 0xdd,
+    /* IPv6, traffic class 0x2b (DSCP 10, ECN 3), flow label 0x12345. */
+    0x62, 0xb1, 0x23, 0x45, 0x00, 0x14, 0x06, 0x40,
+    IPV6_ADDRS,
+    /* TCP. */
+    0x04, 0xd2, 0x00, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x50, 0x02, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8_t ipv6_exthdrs[] = {
+    ETH_ADDRS, 0x86, 0xdd,
+    0x60, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x40,
+    IPV6_ADDRS,
+    /* Hop-by-hop options, destination options and routing headers, in the
+     * recommended order. */
+    0x3c, 0x00, 0x01, 0x04, 0x00, 0x00, 0x00, 0x00,
+    0x2b, 0x00, 0x01, 0x04, 0x00, 0x00, 0x00, 0x00,
+    0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* UDP. */
+    0x04, 0xd2, 0x16, 0x2e, 0x00, 0x08, 0x00, 0x00
+};
+
+static const uint8_t ipv6_unseq_esp[] = {
+    ETH_ADDRS, 0x86, 0xdd,
+    0x60, 0x00, 0x00, 0x00, 0x00, 0x18, 0x3c, 0x40,
+    IPV6_ADDRS,
+    /* Destination options before hop-by-hop options, then ESP. */
+    0x00, 0x00, 0x01, 0x04, 0x00, 0x00, 0x00, 0x00,
+    0x32, 0x00, 0x01, 0x04, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x01
+};
+
+static const uint8_t ipv6_ah_udp[] = {
+    ETH_ADDRS, 0x86, 0xdd,
+    0x60, 0x00, 0x00, 0x00, 0x00, 0x20, 0x33, 0x40,
+    IPV6_ADDRS,
+    /* Authentication header, with a 12 byte integrity check value. */
+    0x11, 0x04, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00,
+    0x00, 0x00, 0x00, 0x01, 0xaa, 0xbb, 0xcc, 0xdd,
+    0xee, 0xff, 0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+    /* UDP. */
+    0x04, 0xd2, 0x16, 0x2e, 0x00, 0x08, 0x00, 0x00
+};
+
+static const uint8_t ipv6_frag[] = {
+    ETH_ADDRS, 0x86, 0xdd,
+    0x60, 0x00, 0x00, 0x00, 0x00, 0x10, 0x2c, 0x40,
+    IPV6_ADDRS,
+    /* Fragment header, offset 8, then data that looks like UDP. */
+    0x11, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x01,
+    0x04, 0xd2, 0x16, 0x2e, 0x00, 0x08, 0x00, 0x00
+};
+
+static const uint8_t icmpv6_private[] = {
+    ETH_ADDRS, 0x86, 0xdd,
+    0x60, 0x00, 0x00, 0x00, 0x00, 0x08, 0x3a, 0x40,
+    IPV6_ADDRS,
+    /* ICMPv6 private experimentation message, code 1. */
+    0xc8, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8_t ipv6_nd[] = {
+    ETH_ADDRS, 0x86, 0xdd,
+    0x60, 0x00, 0x00, 0x00, 0x00, 0x20, 0x3a, 0xff,
+    IPV6_ADDRS,
+    /* Neighbor solicitation, with the source link-layer address option. */
+    0x87, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x20, 0x01, 0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03,
+    0x01, 0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01
+};
+
+static const uint8_t pbb_udp[] = {
+    ETH_ADDRS, 0x88, 0xa8,
+    /* B-tag, VID 5. */
+    0x00, 0x05, 0x88, 0xe7,
+    /* I-tag, I-SID 0x123456, and the customer addresses. */
+    0x00, 0x12, 0x34, 0x56,
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00, 0x03,
+    0x08, 0x00,
+    IPV4_UDP
+};
+
+static const uint8_t mpls[] = {
+    ETH_ADDRS, 0x88, 0x47,
+    /* Label 0x12345, TC 5, bottom of stack. */
+    0x12, 0x34, 0x5b, 0x40,
+    IPV4_UDP
+};
+
+static const uint8_t mpls_ipv6[] = {
+    ETH_ADDRS, 0x88, 0x47,
+    /* Label 16, then the IPv6 explicit null label at the bottom. */
+    0x00, 0x01, 0x00, 0x40, 0x00, 0x00, 0x21, 0x40,
+    0x60, 0x00, 0x00, 0x00, 0x00, 0x14, 0x06, 0x40,
+    IPV6_ADDRS,
+    /* TCP. */
+    0x04, 0xd2, 0x00, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x50, 0x02, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8_t amaru[] = {
+    ETH_ADDRS, 0xaa, 0xaa,
+    /* Level 3. */
+    0x03,
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c,
+    0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18,
+    0x19, 0x1a, 0x1b, 0x1c,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+struct parse_case {
+    const char    *name;
+    const uint8_t *data;
+    size_t         size;
+};
+
+#define CASE(NAME) { #NAME, NAME, sizeof NAME }
+
+static const struct parse_case cases[] = {
+    CASE(ipv4_tcp),
+    CASE(vlan_udp),
+    CASE(qinq_icmp),
+    CASE(qinq_9100_udp),
+    CASE(icmp_extended_echo),
+    CASE(arp_request),
+    CASE(ipv4_sctp),
+    CASE(ipv6_tcp),
+    CASE(ipv6_exthdrs),
+    CASE(ipv6_unseq_esp),
+    CASE(ipv6_ah_udp),
+    CASE(ipv6_frag),
+    CASE(icmpv6_private),
+    CASE(ipv6_nd),
+    CASE(pbb_udp),
+    CASE(mpls),
+    CASE(mpls_ipv6),
+    CASE(amaru),
+};
+
+/* Fields whose decoding was fixed, in frames of 'cases', with the value the
+ * parsers give them now and the one they gave before.  A NULL value stands
+ * for a missing field. */
+struct fix_case {
+    const char    *name;
+    const uint8_t *data;
+    size_t         size;
+    uint32_t       header;
+    const void    *value;
+    const void    *old_value;
+};
+
+/* In wire order.  The middle byte used to be lost. */
+static const uint8_t pbb_isid[PBB_ISID_LEN] = { 0x12, 0x34, 0x56 };
+static const uint8_t pbb_isid_old[PBB_ISID_LEN] = { 0x00, 0x12, 0x56 };
+
+/* The payload after the customer addresses used to be left undecoded. */
+static const uint16_t pbb_udp_src = 1234;
+
+/* From the traffic class.  It used to be the low bits of the flow label. */
+static const uint8_t ipv6_ecn = 3;
+static const uint8_t ipv6_ecn_old = 1;
+
+/* In the order of the packet, with ESP.  The destination options header used
+ * to be looked at after the hop-by-hop one, which gave OFPIEH_HOP |
+ * OFPIEH_DEST | OFPIEH_UNSEQ, byte swapped. */
+static const uint16_t unseq_esp_flags = OFPIEH_DEST | OFPIEH_HOP | OFPIEH_ESP
+                                        | OFPIEH_UNSEQ;
+static const uint8_t unseq_esp_flags_old[2] = { 0x01, 0x48 };
+
+/* After the integrity check value, which used to be read as UDP. */
+static const uint16_t ah_udp_src = 1234;
+static const uint16_t ah_udp_src_old = 0xaabb;
+
+/* The payload after the bottom of the label stack used to be left
+ * undecoded. */
+static const uint16_t mpls_udp_src = 1234;
+static const uint16_t mpls_tcp_src = 1234;
+
+/* Only the first fragment carries the transport header.  The data of the
+ * others used to be read as one. */
+static const uint16_t frag_udp_src_old = 1234;
+
+/* A 0x9100 tag used to be taken for one only after a PBB header. */
+static const uint16_t qinq_9100_vid = 30;
+
+/* For the ICMP types customnetpdl.xml did not list, the type used to be
+ * taken for the code. */
+static const uint8_t icmp_code = 0;
+static const uint8_t icmp_code_old = 42;
+static const uint8_t icmpv6_code = 1;
+static const uint8_t icmpv6_code_old = 200;
+
+#define FIX(NAME, HEADER, VALUE, OLD_VALUE) \
+    { #NAME, NAME, sizeof NAME, HEADER, VALUE, OLD_VALUE }
+
+static const struct fix_case fixes[] = {
+    FIX(pbb_udp, OXM_OF_PBB_ISID, pbb_isid, pbb_isid_old),
+    FIX(pbb_udp, OXM_OF_UDP_SRC, &pbb_udp_src, NULL),
+    FIX(ipv6_tcp, OXM_OF_IP_ECN, &ipv6_ecn, &ipv6_ecn_old),
+    FIX(ipv6_unseq_esp, OXM_OF_IPV6_EXTHDR, &unseq_esp_flags,
+        unseq_esp_flags_old),
+    FIX(ipv6_ah_udp, OXM_OF_UDP_SRC, &ah_udp_src, &ah_udp_src_old),
+    FIX(mpls, OXM_OF_UDP_SRC, &mpls_udp_src, NULL),
+    FIX(mpls_ipv6, OXM_OF_TCP_SRC, &mpls_tcp_src, NULL),
+    FIX(ipv6_frag, OXM_OF_UDP_SRC, NULL, &frag_udp_src_old),
+    FIX(qinq_9100_udp, OXM_OF_VLAN_VID, &qinq_9100_vid, NULL),
+    FIX(icmp_extended_echo, OXM_OF_ICMPV4_CODE, &icmp_code, &icmp_code_old),
+    FIX(icmpv6_private, OXM_OF_ICMPV6_CODE, &icmpv6_code, &icmpv6_code_old),
+};
+
+/* Returns true if 'key' has the field 'header' with the given value, or
+ * lacks it if 'value' is NULL. */
+static bool
+field_is(const struct packet_key *key, uint32_t header, const void *value)
+{
+    const uint8_t *v = packet_key_get(key, header);
+
+    if (value == NULL || v == NULL) {
+        return value == v;
+    }
+    return !memcmp(v, value, OXM_LENGTH(header));
+}
+
+/* Returns the header of a field the two keys disagree on, or 0. */
+static uint32_t
+key_diff(const struct packet_key *a, const struct packet_key *b)
+{
+    int field;
+
+    for (field = 0; field < PACKET_KEY_N_FIELDS; field++) {
+        uint64_t bit = UINT64_C(1) << field;
+        const struct packet_key_field *kf = &packet_key_fields[field];
+        uint32_t header = packet_key_header(field);
+
+        if ((a->present & bit) != (b->present & bit)
+            || ((a->present & bit)
+                && memcmp((const uint8_t *) a + kf->ofs,
+                          (const uint8_t *) b + kf->ofs, kf->len))) {
+            return header;
+        }
+    }
+    return 0;
+}
+
+/* Parses the frame of 'c' with 'parse', and compares the result with the
+ * native parser's.  Returns false if they disagree. */
+static bool
+check_parser(const struct parse_case *c, struct ofpbuf *buf,
+             const struct packet_key *native,
+             const struct protocols_std *native_proto, const char *name,
+             int (*parse)(struct ofpbuf *, struct packet_key *,
+                          struct protocols_std *))
+{
+    struct protocols_std proto;
+    struct packet_key key;
+    uint32_t header;
+
+    packet_key_init(&key);
+    if (parse(buf, &key, &proto) < 0) {
+        fprintf(stderr, "%s: the %s parser failed\n", c->name, name);
+        return false;
+    }
+    header = key_diff(native, &key);
+    if (header != 0) {
+        fprintf(stderr, "%s: the native and %s parsers disagree on field "
+                "0x%08"PRIx32"\n", c->name, name, header);
+        return false;
+    }
+    if (memcmp(native_proto, &proto, sizeof proto)) {
+        fprintf(stderr, "%s: the native and %s parsers disagree on the "
+                "headers\n", c->name, name);
+        return false;
+    }
+    return true;
+}
+
+/* Parses the frame of 'f' with the native parser, which the others agree
+ * with, and checks the value of the fixed field.  Returns false if it is
+ * wrong. */
+static bool
+check_fix(const struct fix_case *f)
+{
+    struct ofpbuf *buf = ofpbuf_new(f->size);
+    struct protocols_std proto;
+    struct packet_key key;
+    bool ok;
+
+    ofpbuf_put(buf, f->data, f->size);
+    packet_key_init(&key);
+    ok = packet_parse_native(buf, &key, &proto) >= 0
+         && field_is(&key, f->header, f->value)
+         && !field_is(&key, f->header, f->old_value);
+    if (!ok) {
+        fprintf(stderr, "%s: field 0x%08"PRIx32" is not fixed\n", f->name,
+                f->header);
+    }
+    ofpbuf_delete(buf);
+    return ok;
+}
+
+/* Checks that an AMARU level match built by oflib, as for the flows of a
+ * controller, holds the level the parsers decode from the 'amaru' frame.  It
+ * used to hold the low byte of the pointer to the level. */
+static bool
+check_amaru_match(void)
+{
+    struct ofl_match_tlv *tlv, *next;
+    struct ofl_match match;
+    struct packet_key key;
+    uint8_t level = amaru[ETH_HEADER_LEN];
+    const uint8_t *value;
+    bool ok;
+
+    ofl_structs_match_init(&match);
+    ofl_structs_match_amaru_level(&match, OXM_OF_AMARU_LEVEL, &level);
+    packet_key_init(&key);
+    packet_key_from_match(&key, &match);
+    value = packet_key_get(&key, OXM_OF_AMARU_LEVEL);
+    ok = value != NULL && *value == 3;
+    if (!ok) {
+        fprintf(stderr, "amaru: the level of the match is not 3\n");
+    }
+    HMAP_FOR_EACH_SAFE (tlv, next, struct ofl_match_tlv, hmap_node,
+                        &match.match_fields) {
+        free(tlv->value);
+        free(tlv);
+    }
+    hmap_destroy(&match.match_fields);
+    return ok;
+}
+
+#ifdef HAVE_NBEE
+static int
+parse_nbee(struct ofpbuf *buf, struct packet_key *key,
+           struct protocols_std *proto)
+{
+    return packet_parse(buf, key, proto);
+}
+#endif
+
+int
+main(void)
+{
+    bool ok = true;
+    size_t i;
+
+#ifdef HAVE_NBEE
+    /* NetBee looks for customnetpdl.xml in the current directory first. */
+    const char *srcdir = getenv("srcdir");
+
+    if (srcdir != NULL && chdir(srcdir) < 0) {
+        fprintf(stderr, "could not change to %s\n", srcdir);
+        return EXIT_FAILURE;
+    }
+    if (!packet_parse_set_parser("nbee")) {
+        fprintf(stderr, "NetBee is not built in\n");
+        return EXIT_FAILURE;
+    }
+    packet_parse_init();
+    if (packet_parse_is_native()) {
+        fprintf(stderr, "could not initialize NetBee\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    for (i = 0; i < ARRAY_SIZE(cases); i++) {
+        const struct parse_case *c = &cases[i];
+        struct ofpbuf *buf = ofpbuf_new(c->size);
+        struct protocols_std proto;
+        struct packet_key key;
+
+        ofpbuf_put(buf, c->data, c->size);
+        packet_key_init(&key);
+        if (packet_parse_native(buf, &key, &proto) < 0) {
+            fprintf(stderr, "%s: the native parser failed\n", c->name);
+            ok = false;
+        } else {
+            ok &= check_parser(c, buf, &key, &proto, "netpdl",
+                               packet_parse_netpdl);
+#ifdef HAVE_NBEE
+            ok &= check_parser(c, buf, &key, &proto, "NetBee", parse_nbee);
+#endif
+        }
+        ofpbuf_delete(buf);
+    }
+    for (i = 0; i < ARRAY_SIZE(fixes); i++) {
+        ok &= check_fix(&fixes[i]);
+    }
+    ok &= check_amaru_match();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
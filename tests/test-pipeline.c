@@ -0,0 +1,439 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Runs packets through a pipeline, one at a time and in batches, and checks
+ * which flow entries they hit: that the flow cache replays cached traversals
+ * and drops them when the flow tables change, and that it does not replay the
+ * tables after an entry which changes the packet for another packet with the
+ * same key. */
+
+#include <config.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "datapath.h"
+#include "flow_cache.h"
+#include "flow_entry.h"
+#include "flow_table.h"
+#include "meter_entry.h"
+#include "meter_table.h"
+#include "oflib/ofl-actions.h"
+#include "oflib/ofl-messages.h"
+#include "oflib/ofl-structs.h"
+#include "oflib/oxm-match.h"
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "packet.h"
+#include "packets.h"
+#include "pipeline.h"
+#include "timeval.h"
+#include "util.h"
+
+#define ETH_ADDRS \
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01
+
+/* IPv4 header with the given TOS, and UDP. */
+#define IPV4_UDP(TOS) \
+    0x45, TOS, 0x00, 0x1c, 0x00, 0x01, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00, \
+    0x0a, 0x00, 0x00, 0x01, 0x0a, 0x00, 0x00, 0x02, \
+    0x04, 0xd2, 0x16, 0x2e, 0x00, 0x08, 0x00, 0x00
+
+static const uint8_t udp[] = {
+    ETH_ADDRS, 0x08, 0x00,
+    IPV4_UDP(0x00)
+};
+
+/* DSCP 10 (AF11), which a DSCP remark band turns into AF12. */
+static const uint8_t udp_af11[] = {
+    ETH_ADDRS, 0x08, 0x00,
+    IPV4_UDP(0x28)
+};
+
+/* Outer tag VID 10; the inner tags differ. */
+static const uint8_t qinq_100[] = {
+    ETH_ADDRS, 0x88, 0xa8,
+    0x00, 0x0a, 0x81, 0x00,
+    0x00, 0x64, 0x08, 0x00,
+    IPV4_UDP(0x00)
+};
+
+static const uint8_t qinq_200[] = {
+    ETH_ADDRS, 0x88, 0xa8,
+    0x00, 0x0a, 0x81, 0x00,
+    0x00, 0xc8, 0x08, 0x00,
+    IPV4_UDP(0x00)
+};
+
+static struct datapath *dp;
+static struct remote remote;
+static const struct sender sender = { &remote, 0, 0 };
+
+/* Whether packets are run through pipeline_process_batch(). */
+static bool batched;
+static const char *test_name;
+
+static void
+fail(const char *msg)
+{
+    fprintf(stderr, "%s (%s): %s\n", test_name,
+            batched ? "batched" : "one at a time", msg);
+    exit(EXIT_FAILURE);
+}
+
+static struct ofl_match *
+match_new(void)
+{
+    struct ofl_match *match = xmalloc(sizeof *match);
+
+    ofl_structs_match_init(match);
+    return match;
+}
+
+static struct ofl_instruction_header *
+inst_goto(uint8_t table_id)
+{
+    struct ofl_instruction_goto_table *inst = xmalloc(sizeof *inst);
+
+    inst->header.type = OFPIT_GOTO_TABLE;
+    inst->table_id = table_id;
+    return &inst->header;
+}
+
+static struct ofl_instruction_header *
+inst_meter(uint32_t meter_id)
+{
+    struct ofl_instruction_meter *inst = xmalloc(sizeof *inst);
+
+    inst->header.type = OFPIT_METER;
+    inst->meter_id = meter_id;
+    return &inst->header;
+}
+
+static struct ofl_instruction_header *
+inst_pop_vlan(void)
+{
+    struct ofl_instruction_actions *inst = xmalloc(sizeof *inst);
+    struct ofl_action_header *act = xmalloc(sizeof *act);
+
+    act->type = OFPAT_POP_VLAN;
+    act->len = sizeof(struct ofp_action_header);
+    inst->header.type = OFPIT_APPLY_ACTIONS;
+    inst->actions_num = 1;
+    inst->actions = xmalloc(sizeof *inst->actions);
+    inst->actions[0] = act;
+    return &inst->header;
+}
+
+/* Sends a flow_mod with the given command, taking ownership of 'match' and of
+ * the 'n_insts' instructions that follow. */
+static void
+flow_mod(enum ofp_flow_mod_command command, uint8_t table_id,
+         uint16_t priority, struct ofl_match *match, size_t n_insts, ...)
+{
+    struct ofl_msg_flow_mod *msg = xcalloc(1, sizeof *msg);
+    va_list args;
+    size_t i;
+
+    msg->header.type = OFPT_FLOW_MOD;
+    msg->table_id = table_id;
+    msg->command = command;
+    msg->priority = priority;
+    msg->buffer_id = OFP_NO_BUFFER;
+    msg->out_port = OFPP_ANY;
+    msg->out_group = OFPG_ANY;
+    msg->match = &match->header;
+    msg->instructions_num = n_insts;
+    msg->instructions = xmalloc(sizeof *msg->instructions
+                                * (n_insts > 0 ? n_insts : 1));
+    va_start(args, n_insts);
+    for (i = 0; i < n_insts; i++) {
+        msg->instructions[i] = va_arg(args, struct ofl_instruction_header *);
+    }
+    va_end(args);
+
+    if (pipeline_handle_flow_mod(dp->pipeline, msg, &sender)) {
+        fail("flow_mod rejected");
+    }
+}
+
+/* Removes all the flow entries. */
+static void
+flow_clear(void)
+{
+    flow_mod(OFPFC_DELETE, 0xff, 0, match_new(), 0);
+}
+
+/* Returns the flow entry of table 'table_id' with the given priority. */
+static struct flow_entry *
+flow_find(uint8_t table_id, uint16_t priority)
+{
+    struct flow_entry *entry;
+
+    LIST_FOR_EACH (entry, struct flow_entry, match_node,
+                   &dp->pipeline->tables[table_id]->match_entries) {
+        if (entry->stats->priority == priority) {
+            return entry;
+        }
+    }
+    fail("flow entry not found");
+    return NULL;
+}
+
+static void
+check_count(uint8_t table_id, uint16_t priority, uint64_t n_packets)
+{
+    if (flow_find(table_id, priority)->stats->packet_count != n_packets) {
+        fprintf(stderr, "table %d priority %d: %"PRIu64" packets, "
+                "expected %"PRIu64"\n", table_id, priority,
+                flow_find(table_id, priority)->stats->packet_count,
+                n_packets);
+        fail("wrong flow entry hit");
+    }
+}
+
+static struct packet *
+packet_new(const uint8_t *data, size_t size)
+{
+    struct ofpbuf *buf = ofpbuf_new(size);
+
+    ofpbuf_put(buf, data, size);
+    return packet_create(dp, 1, buf, false);
+}
+
+/* Runs a packet through the pipeline.  In batched mode, packets are held
+ * back and run in pairs; flush_packets() runs a leftover one. */
+static struct packet *pending;
+
+static void
+flush_packets(void)
+{
+    if (pending != NULL) {
+        pipeline_process_batch(dp->pipeline, &pending, 1);
+        pending = NULL;
+    }
+}
+
+static void
+send_packet(const uint8_t *data, size_t size)
+{
+    struct packet *pkts[2];
+
+    if (!batched) {
+        pipeline_process_packet(dp->pipeline, packet_new(data, size));
+    } else if (pending == NULL) {
+        pending = packet_new(data, size);
+    } else {
+        pkts[0] = pending;
+        pkts[1] = packet_new(data, size);
+        pending = NULL;
+        pipeline_process_batch(dp->pipeline, pkts, 2);
+    }
+}
+
+static uint64_t
+cache_hits(void)
+{
+    struct flow_cache_stats stats;
+
+    memset(&stats, 0, sizeof stats);
+    flow_cache_add_stats(&dp->pipeline->cache, &stats);
+    return stats.n_hits + stats.n_megaflow_hits;
+}
+
+/* A traversal of two tables is replayed from the cache. */
+static void
+test_replay(void)
+{
+    struct ofl_match *match;
+    uint64_t n_hits;
+    int i;
+
+    match = match_new();
+    ofl_structs_match_put16(match, OXM_OF_ETH_TYPE, ETH_TYPE_IP);
+    flow_mod(OFPFC_ADD, 0, 10, match, 1, inst_goto(1));
+    match = match_new();
+    ofl_structs_match_put16(match, OXM_OF_ETH_TYPE, ETH_TYPE_IP);
+    ofl_structs_match_put8(match, OXM_OF_IP_PROTO, IP_TYPE_UDP);
+    flow_mod(OFPFC_ADD, 1, 10, match, 0);
+
+    n_hits = cache_hits();
+    for (i = 0; i < 4; i++) {
+        send_packet(udp, sizeof udp);
+    }
+    flush_packets();
+    check_count(0, 10, 4);
+    check_count(1, 10, 4);
+    if (cache_hits() - n_hits < 2) {
+        fail("traversal not replayed from the cache");
+    }
+}
+
+/* Adding and removing an entry is seen by packets of a cached flow. */
+static void
+test_invalidation(void)
+{
+    struct ofl_match *match;
+
+    test_replay();
+
+    match = match_new();
+    ofl_structs_match_put16(match, OXM_OF_ETH_TYPE, ETH_TYPE_IP);
+    ofl_structs_match_put8(match, OXM_OF_IP_PROTO, IP_TYPE_UDP);
+    ofl_structs_match_put16(match, OXM_OF_UDP_DST, 5678);
+    flow_mod(OFPFC_ADD, 1, 20, match, 0);
+    send_packet(udp, sizeof udp);
+    send_packet(udp, sizeof udp);
+    flush_packets();
+    check_count(1, 20, 2);
+    check_count(1, 10, 4);
+
+    match = match_new();
+    ofl_structs_match_put16(match, OXM_OF_ETH_TYPE, ETH_TYPE_IP);
+    ofl_structs_match_put8(match, OXM_OF_IP_PROTO, IP_TYPE_UDP);
+    ofl_structs_match_put16(match, OXM_OF_UDP_DST, 5678);
+    flow_mod(OFPFC_DELETE_STRICT, 1, 20, match, 0);
+    send_packet(udp, sizeof udp);
+    send_packet(udp, sizeof udp);
+    flush_packets();
+    check_count(1, 10, 6);
+}
+
+/* Popping the outer tag exposes an inner tag the cache key does not hold. */
+static void
+test_pop_vlan(void)
+{
+    struct ofl_match *match;
+    int i;
+
+    flow_mod(OFPFC_ADD, 0, 10, match_new(), 2, inst_pop_vlan(), inst_goto(1));
+    match = match_new();
+    ofl_structs_match_put16(match, OXM_OF_VLAN_VID, OFPVID_PRESENT | 100);
+    flow_mod(OFPFC_ADD, 1, 100, match, 0);
+    match = match_new();
+    ofl_structs_match_put16(match, OXM_OF_VLAN_VID, OFPVID_PRESENT | 200);
+    flow_mod(OFPFC_ADD, 1, 200, match, 0);
+
+    for (i = 0; i < 3; i++) {
+        send_packet(qinq_100, sizeof qinq_100);
+        send_packet(qinq_200, sizeof qinq_200);
+    }
+    flush_packets();
+    check_count(1, 100, 3);
+    check_count(1, 200, 3);
+}
+
+/* Sends a meter_mod for meter 1, with a DSCP remark band if 'command' is
+ * OFPMC_ADD. */
+static void
+meter_mod(uint16_t command)
+{
+    struct ofl_msg_meter_mod *mod = xcalloc(1, sizeof *mod);
+    struct ofl_meter_band_dscp_remark *band;
+
+    mod->header.type = OFPT_METER_MOD;
+    mod->command = command;
+    mod->flags = OFPMF_KBPS;
+    mod->meter_id = 1;
+    if (command == OFPMC_ADD) {
+        band = xcalloc(1, sizeof *band);
+        band->type = OFPMBT_DSCP_REMARK;
+        band->rate = 1;
+        band->prec_level = 1;
+        mod->meter_bands_num = 1;
+        mod->bands = xmalloc(sizeof *mod->bands);
+        mod->bands[0] = (struct ofl_meter_band_header *) band;
+    }
+    if (meter_table_handle_meter_mod(dp->meters, mod, &sender)) {
+        fail("meter_mod rejected");
+    }
+}
+
+/* Whether a DSCP remark band applies depends on the rate, not on the
+ * packet. */
+static void
+test_meter_remark(void)
+{
+    struct ofl_meter_band_stats *bucket;
+    struct ofl_match *match;
+    int i;
+
+    meter_mod(OFPMC_ADD);
+    bucket = meter_table_find(dp->meters, 1)->stats->band_stats[0];
+
+    flow_mod(OFPFC_ADD, 0, 10, match_new(), 2, inst_meter(1), inst_goto(1));
+    match = match_new();
+    ofl_structs_match_put16(match, OXM_OF_ETH_TYPE, ETH_TYPE_IP);
+    ofl_structs_match_put8(match, OXM_OF_IP_DSCP, 10);
+    flow_mod(OFPFC_ADD, 1, 10, match, 0);
+    flow_mod(OFPFC_ADD, 1, 1, match_new(), 0);
+
+    /* The bucket is only refilled by the datapath, so the packets are
+     * within the rate exactly when it is filled here. */
+    for (i = 0; i < 4; i++) {
+        bucket->tokens = i % 2 ? 0 : 100000;
+        send_packet(udp_af11, sizeof udp_af11);
+        flush_packets();
+    }
+    check_count(1, 10, 2);
+    check_count(1, 1, 2);
+
+    flow_clear();
+    meter_mod(OFPMC_DELETE);
+}
+
+static void
+run(const char *name, void (*test)(void))
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        test_name = name;
+        batched = i;
+        test();
+        flow_clear();
+    }
+}
+
+int
+main(void)
+{
+    time_init();
+    dp = dp_new();
+    remote.role = OFPCR_ROLE_EQUAL;
+
+    run("replay", test_replay);
+    run("invalidation", test_invalidation);
+    run("pop_vlan", test_pop_vlan);
+    run("meter_remark", test_meter_remark);
+    return EXIT_SUCCESS;
+}
@@ -29,15 +29,16 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "action_set.h"
 #include "dp_actions.h"
 #include "datapath.h"
+#include "dp_pool.h"
 #include "packet.h"
 #include "oflib/ofl.h"
 #include "oflib/ofl-actions.h"
 #include "oflib/ofl-print.h"
 #include "packet.h"
-#include "list.h"
 #include "util.h"
 #include "vlog.h"
 
@@ -45,51 +46,106 @@
 
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 
-struct action_set_entry;
+/* The slots of an action set, one per action type, by the rank of their
+ * actions in the execution order defined by the specification: copy TTL
+ * inwards, pop, push, copy TTL outwards, decrement TTL, set, queue,
+ * experimenter, group and output.  Set-field actions are kept apart, one per
+ * field. */
+enum action_set_slot {
+    SLOT_COPY_TTL_IN,
+    SLOT_POP_VLAN,
+    SLOT_POP_PBB,
+    SLOT_POP_MPLS,
+    SLOT_PUSH_MPLS,
+    SLOT_PUSH_PBB,
+    SLOT_PUSH_VLAN,
+    SLOT_COPY_TTL_OUT,
+    SLOT_DEC_MPLS_TTL,
+    SLOT_DEC_NW_TTL,
+    SLOT_SET_MPLS_TTL,
+    SLOT_SET_NW_TTL,
+    SLOT_SET_FIELD,     /* set-field actions are executed here. */
+    SLOT_SET_QUEUE,
+    SLOT_EXPERIMENTER,
+    SLOT_OTHER,
+    SLOT_GROUP,
+    SLOT_OUTPUT,
+    ACTION_SET_SLOTS
+};
 
-struct action_set {
-    struct list     actions;   /* the list of actions in the action set,
-+                                   stored in the order of precedence as defined
-+                                   by the specification. */
-    struct ofl_exp *exp;       /* experimenter callbacks */
+/* The rank of each slot.  Actions of the same rank are executed in the order
+ * they were first written to the set. */
+static const uint8_t slot_rank[ACTION_SET_SLOTS] = {
+    [SLOT_COPY_TTL_IN]  = 10,
+    [SLOT_POP_VLAN]     = 20,
+    [SLOT_POP_PBB]      = 20,
+    [SLOT_POP_MPLS]     = 20,
+    [SLOT_PUSH_MPLS]    = 30,
+    [SLOT_PUSH_PBB]     = 30,
+    [SLOT_PUSH_VLAN]    = 30,
+    [SLOT_COPY_TTL_OUT] = 40,
+    [SLOT_DEC_MPLS_TTL] = 50,
+    [SLOT_DEC_NW_TTL]   = 50,
+    [SLOT_SET_MPLS_TTL] = 60,
+    [SLOT_SET_NW_TTL]   = 60,
+    [SLOT_SET_FIELD]    = 60,
+    [SLOT_SET_QUEUE]    = 70,
+    [SLOT_EXPERIMENTER] = 75,
+    [SLOT_OTHER]        = 79,
+    [SLOT_GROUP]        = 80,
+    [SLOT_OUTPUT]       = 90
 };
 
-struct action_set_entry {
-    struct list                node;
+/* Maximum number of set-field actions in an action set; more than there are
+ * settable fields. */
+#define ACTION_SET_MAX_FIELDS 64
 
-    struct ofl_action_header  *action;  /* these actions point to actions in
-+                                        * flow table entry instructions */
-    int                        order;   /* order of the entry as defined */
+struct action_set {
+    /* These actions point to actions in flow table entry instructions. */
+    struct ofl_action_header  *slots[ACTION_SET_SLOTS];
+    struct ofl_action_header  *fields[ACTION_SET_MAX_FIELDS]; /* set-field
+                                     actions, in the order of their first
+                                     write. */
+    size_t                     fields_num;
+
+    /* The order in which the actions were first written; an action replacing
+     * another one keeps its place. */
+    unsigned int               slot_seqs[ACTION_SET_SLOTS];
+    unsigned int               field_seqs[ACTION_SET_MAX_FIELDS];
+    unsigned int               next_seq;
+
+    struct ofl_exp            *exp;       /* experimenter callbacks */
 };
 
+/* Largest number of actions in an action set. */
+#define ACTION_SET_MAX_ACTIONS (ACTION_SET_SLOTS + ACTION_SET_MAX_FIELDS)
 
+static struct dp_pool set_pool =
+    DP_POOL_INITIALIZER("action set", sizeof(struct action_set), NULL);
 
 
-/* Returns the priority of the action it should be executed in
- * according to the spec. Note, that the actions are already
- * stored in this order.
- */
-static int
-action_set_order(struct ofl_action_header *act) {
+/* Returns the slot of the action set an action goes to. */
+static enum action_set_slot
+action_set_slot(struct ofl_action_header *act) {
     switch (act->type) {
-        case (OFPAT_COPY_TTL_OUT):   return 40;
-        case (OFPAT_COPY_TTL_IN):    return 10;
-        case (OFPAT_SET_FIELD):      return 60;
-        case (OFPAT_SET_MPLS_TTL):   return 60;
-        case (OFPAT_DEC_MPLS_TTL):   return 50;
-        case (OFPAT_PUSH_PBB):       return 30;
-        case (OFPAT_POP_PBB):        return 20;
-        case (OFPAT_PUSH_VLAN):      return 30;
-        case (OFPAT_POP_VLAN):       return 20;
-        case (OFPAT_PUSH_MPLS):      return 30;
-        case (OFPAT_POP_MPLS):       return 20;
-        case (OFPAT_SET_QUEUE):      return 70;
-        case (OFPAT_GROUP):          return 80;
-        case (OFPAT_SET_NW_TTL):     return 60;
-        case (OFPAT_DEC_NW_TTL):     return 50;
-        case (OFPAT_OUTPUT):         return 90;
-        case (OFPAT_EXPERIMENTER):   return 75;
-        default:                     return 79;
+        case (OFPAT_COPY_TTL_OUT):   return SLOT_COPY_TTL_OUT;
+        case (OFPAT_COPY_TTL_IN):    return SLOT_COPY_TTL_IN;
+        case (OFPAT_SET_FIELD):      return SLOT_SET_FIELD;
+        case (OFPAT_SET_MPLS_TTL):   return SLOT_SET_MPLS_TTL;
+        case (OFPAT_DEC_MPLS_TTL):   return SLOT_DEC_MPLS_TTL;
+        case (OFPAT_PUSH_PBB):       return SLOT_PUSH_PBB;
+        case (OFPAT_POP_PBB):        return SLOT_POP_PBB;
+        case (OFPAT_PUSH_VLAN):      return SLOT_PUSH_VLAN;
+        case (OFPAT_POP_VLAN):       return SLOT_POP_VLAN;
+        case (OFPAT_PUSH_MPLS):      return SLOT_PUSH_MPLS;
+        case (OFPAT_POP_MPLS):       return SLOT_POP_MPLS;
+        case (OFPAT_SET_QUEUE):      return SLOT_SET_QUEUE;
+        case (OFPAT_GROUP):          return SLOT_GROUP;
+        case (OFPAT_SET_NW_TTL):     return SLOT_SET_NW_TTL;
+        case (OFPAT_DEC_NW_TTL):     return SLOT_DEC_NW_TTL;
+        case (OFPAT_OUTPUT):         return SLOT_OUTPUT;
+        case (OFPAT_EXPERIMENTER):   return SLOT_EXPERIMENTER;
+        default:                     return SLOT_OTHER;
     }
 }
 
@@ -97,85 +153,119 @@ action_set_order(struct ofl_action_header *act) {
 /* Creates a new set entry */
 struct action_set *
 action_set_create(struct ofl_exp *exp) {
-    struct action_set *set = xmalloc(sizeof(struct action_set));
-    list_init(&set->actions);
+    struct action_set *set = dp_pool_alloc(&set_pool);
+    action_set_clear_actions(set);
     set->exp = exp;
 
     return set;
 }
 
 void action_set_destroy(struct action_set *set) {
-    action_set_clear_actions(set);
-    free(set);
-}
-
-static struct action_set_entry *
-action_set_create_entry(struct ofl_action_header *act) {
-    struct action_set_entry *entry;
-
-    entry = xmalloc(sizeof(struct action_set_entry));
-    entry->action = act;
-    entry->order = action_set_order(act);
-
-    return entry;
+    dp_pool_free(&set_pool, set);
 }
 
 struct action_set *
 action_set_clone(struct action_set *set) {
-    struct action_set *s = xmalloc(sizeof(struct action_set));
-    struct action_set_entry *entry, *new_entry;
-
-    list_init(&s->actions);
+    struct action_set *s = dp_pool_alloc(&set_pool);
+
+    memcpy(s->slots, set->slots, sizeof s->slots);
+    memcpy(s->fields, set->fields, set->fields_num * sizeof *s->fields);
+    s->fields_num = set->fields_num;
+    memcpy(s->slot_seqs, set->slot_seqs, sizeof s->slot_seqs);
+    memcpy(s->field_seqs, set->field_seqs,
+           set->fields_num * sizeof *s->field_seqs);
+    s->next_seq = set->next_seq;
     s->exp = set->exp;
 
-    LIST_FOR_EACH(entry, struct action_set_entry, node, &set->actions) {
-        new_entry = action_set_create_entry(entry->action);
-        list_push_back(&s->actions, &new_entry->node);
-    }
-
     return s;
 }
 
 
+/* Writes a set-field action to the action set, overwriting the one setting
+ * the same field, if any. */
+static void
+action_set_write_field(struct action_set *set,
+                       struct ofl_action_header *act) {
+    uint32_t header = ((struct ofl_action_set_field *) act)->field->header;
+    size_t i;
+
+    for (i = 0; i < set->fields_num; i++) {
+        if (((struct ofl_action_set_field *) set->fields[i])->field->header
+                == header) {
+            /* NOTE: the replaced action must not be freed, as it is owned by
+             *       the write instruction which added the action to the set */
+            set->fields[i] = act;
+            return;
+        }
+    }
+    if (set->fields_num == ACTION_SET_MAX_FIELDS) {
+        VLOG_WARN_RL(LOG_MODULE, &rl, "Too many set-field actions in the "
+                     "action set, dropping one.");
+        return;
+    }
+    set->field_seqs[set->fields_num] = set->next_seq++;
+    set->fields[set->fields_num++] = act;
+}
+
 /* Writes a single action to the action set. Overwrites existing actions with
- * the same type in the set. The list order is based on the precedence defined
- * in the specification. */
+ * the same type in the set, or for set-field actions, with the same field. */
 static void
 action_set_write_action(struct action_set *set,
                         struct ofl_action_header *act) {
-    struct action_set_entry *entry, *new_entry;
-
-    new_entry = action_set_create_entry(act);
-
-    LIST_FOR_EACH(entry, struct action_set_entry, node, &set->actions) {
-        if (entry->action->type == new_entry->action->type) {
-            if(entry->action->type == OFPAT_SET_FIELD){
-                struct ofl_action_set_field *new_act = 
-                        (struct ofl_action_set_field*) new_entry->action;
-                struct ofl_action_set_field *act = 
-                            (struct ofl_action_set_field *) entry->action;
-                if(act->field->header != new_act->field->header){
-                    continue;
-                }     
-            } 
-            /* replace same type of action */
-            list_replace(&new_entry->node, &entry->node);
-            /* NOTE: action in entry must not be freed, as it is owned by the
-             *       write instruction which added the action to the set */
-            free(entry);
+    enum action_set_slot slot = action_set_slot(act);
 
-            return;
+    if (slot == SLOT_SET_FIELD) {
+        action_set_write_field(set, act);
+    } else {
+        if (set->slots[slot] == NULL) {
+            set->slot_seqs[slot] = set->next_seq++;
         }
-        if (new_entry->order < entry->order) {
-            /* insert higher order action before */
-            list_insert(&entry->node, &new_entry->node);
+        set->slots[slot] = act;
+    }
+}
 
-            return;
-        }
+/* Inserts 'act', first written at 'seq', among the 'n' actions of 'acts'
+ * from 'begin' on, which are sorted by their first write.  Returns the new
+ * number of actions. */
+static size_t
+action_set_insert_ordered(struct ofl_action_header **acts, unsigned int *seqs,
+                          size_t begin, size_t n,
+                          struct ofl_action_header *act, unsigned int seq) {
+    size_t i;
+
+    for (i = n; i > begin && seqs[i - 1] > seq; i--) {
+        acts[i] = acts[i - 1];
+        seqs[i] = seqs[i - 1];
     }
+    acts[i] = act;
+    seqs[i] = seq;
+    return n + 1;
+}
 
-    /* add action to the end of set */
-    list_insert(&entry->node, &new_entry->node);
+/* Stores the actions of the set in 'acts', in execution order, and returns
+ * their number. */
+static size_t
+action_set_ordered(const struct action_set *set,
+                   struct ofl_action_header **acts) {
+    unsigned int seqs[ACTION_SET_MAX_ACTIONS];
+    size_t n = 0, begin = 0, i, j;
+
+    for (i = 0; i < ACTION_SET_SLOTS; i++) {
+        if (i > 0 && slot_rank[i] != slot_rank[i - 1]) {
+            begin = n;
+        }
+        if (i == SLOT_SET_FIELD) {
+            for (j = 0; j < set->fields_num; j++) {
+                n = action_set_insert_ordered(acts, seqs, begin, n,
+                                              set->fields[j],
+                                              set->field_seqs[j]);
+            }
+        } else if (set->slots[i] != NULL) {
+            n = action_set_insert_ordered(acts, seqs, begin, n,
+                                          set->slots[i], set->slot_seqs[i]);
+        }
+    }
+    return n;
 }
 
 
@@ -188,28 +278,37 @@ action_set_write_actions(struct action_set *set,
     for (i=0; i<actions_num; i++) {
         action_set_write_action(set, actions[i]);
     }
-    VLOG_DBG_RL(LOG_MODULE, &rl, "%s", action_set_to_string(set));
+    if (VLOG_IS_DBG_ENABLED(LOG_MODULE)) {
+        char *str = action_set_to_string(set);
+
+        VLOG_DBG_RL(LOG_MODULE, &rl, "%s", str);
+        free(str);
+    }
 }
 
 void
 action_set_clear_actions(struct action_set *set) {
-    struct action_set_entry *entry, *next;
+    // NOTE: the actions must not be freed, as they are owned by the write
+    //       instructions which added them to the set
+    memset(set->slots, 0, sizeof set->slots);
+    set->fields_num = 0;
+    set->next_seq = 0;
+}
 
-    LIST_FOR_EACH_SAFE(entry, next, struct action_set_entry, node, &set->actions) {
-        list_remove(&entry->node);
-        // NOTE: action in entry must not be freed, as it is owned by the write instruction
-        //       which added the action to the set
-        free(entry);
-    }
+bool
+action_set_is_empty(const struct action_set *set) {
+    /* Every action written since the set was last cleared took a seq. */
+    return set->next_seq == 0;
 }
 
 void
 action_set_execute(struct action_set *set, struct packet *pkt, uint64_t cookie) {
-    struct action_set_entry *entry, *next;
-    LIST_FOR_EACH_SAFE(entry, next, struct action_set_entry, node, &set->actions) {
-        dp_execute_action(pkt, entry->action);
-        list_remove(&entry->node);
-        free(entry);
+    struct ofl_action_header *acts[ACTION_SET_MAX_ACTIONS];
+    size_t n, i;
+
+    n = action_set_ordered(set, acts);
+    for (i = 0; i < n; i++) {
+        dp_execute_action(pkt, acts[i]);
     }
     
     /* Clear the action set in any case. Group processing depend on
@@ -235,7 +334,7 @@ action_set_execute(struct action_set *set, struct packet *pkt, uint64_t cookie)
             pkt->out_queue = 0;
 
 
-            dp_actions_output_port(pkt, port_id, queue_id, max_len, cookie);
+            dp_actions_output_last(pkt, port_id, queue_id, max_len, cookie);
             packet_destroy(pkt);
             return;
         }
@@ -258,13 +357,15 @@ action_set_to_string(struct action_set *set) {
 
 void
 action_set_print(FILE *stream, struct action_set *set) {
-    struct action_set_entry *entry;
+    struct ofl_action_header *acts[ACTION_SET_MAX_ACTIONS];
+    size_t n, i;
 
     fprintf(stream, "[");
 
-    LIST_FOR_EACH(entry, struct action_set_entry, node, &set->actions) {
-        ofl_action_print(stream, entry->action, set->exp);
-        if (entry->node.next != &set->actions) { fprintf(stream, ", "); }
+    n = action_set_ordered(set, acts);
+    for (i = 0; i < n; i++) {
+        if (i > 0) { fprintf(stream, ", "); }
+        ofl_action_print(stream, acts[i], set->exp);
     }
 
     fprintf(stream, "]");
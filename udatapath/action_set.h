@@ -73,6 +73,10 @@ action_set_write_actions(struct action_set *set,
 void
 action_set_clear_actions(struct action_set *set);
 
+/* Returns true if the set has no actions. */
+bool
+action_set_is_empty(const struct action_set *set);
+
 /* Executes the actions in the set on the packet. Packet is the owner of the
  * action set right now, but this might be changed in the future. */
 void
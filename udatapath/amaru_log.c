@@ -0,0 +1,303 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <config.h>
+#include "amaru_log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include "compiler.h"
+#include "datapath.h"
+#include "dp_ports.h"
+#include "dynamic-string.h"
+#include "util.h"
+#include "vlog.h"
+
+#define LOG_MODULE VLM_amaru_log
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+/* Longest time a record stays in memory, in seconds. */
+#define AMARU_LOG_FLUSH_INTERVAL 1
+
+/* Bytes pending for a file that wake up the writer before the interval. */
+#define AMARU_LOG_FLUSH_SIZE (64 * 1024)
+
+/* Most bytes pending for a file; the records beyond are dropped. */
+#define AMARU_LOG_MAX_PENDING (4 * 1024 * 1024)
+
+/* Configuration, set before the writer thread starts. */
+static bool enabled;
+static char *log_dir;
+static enum amaru_log_mode log_mode;
+static off_t log_max_size;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+/* Protected by 'mutex'. */
+static struct ds table_pending = DS_EMPTY_INITIALIZER; /* Amaru_switch_ID. */
+static struct ds sent_pending = DS_EMPTY_INITIALIZER;  /* Num_Pkt_Amaru. */
+static bool flush_requested;
+static uint64_t n_dropped;
+static uint64_t log_dp_id;
+static struct amaru_log_counters counters;
+static bool counters_changed;
+
+void
+amaru_log_init(const char *dir, enum amaru_log_mode mode, size_t max_size) {
+    log_dir = xstrdup(dir);
+    log_mode = mode;
+    log_max_size = max_size;
+    enabled = true;
+}
+
+/* Returns true if a record may be added to 'pending', and wakes up the
+ * writer if 'pending' is worth writing right away.  Called with 'mutex'
+ * held. */
+static bool
+may_add(struct ds *pending) {
+    if (pending->length >= AMARU_LOG_MAX_PENDING) {
+        n_dropped++;
+        return false;
+    }
+    if (pending->length >= AMARU_LOG_FLUSH_SIZE && !flush_requested) {
+        flush_requested = true;
+        pthread_cond_signal(&cond);
+    }
+    return true;
+}
+
+static void
+put_table(struct ds *s, const struct table_AMACS *table) {
+    const struct reg_AMAC *reg;
+    int i, j;
+
+    ds_put_cstr(s, "\nPos|\t\tAMAC \t\t\t| Level | Puerto | Activa\n");
+    ds_put_cstr(s, "----------------------------------------------------------\n");
+    i = 1;
+    LIST_FOR_EACH (reg, struct reg_AMAC, node, &table->amacs) {
+        ds_put_format(s, "%d|%x:", i, reg->AMAC[0]);
+        for (j = 1; j < AMAC_LEN; j++) {
+            if (reg->AMAC[j]) {
+                ds_put_format(s, "%x", reg->AMAC[j]);
+            }
+            if (j != AMAC_LEN - 1) {
+                ds_put_char(s, ':');
+            }
+        }
+        ds_put_format(s, "|%d|%d|%d|\n", reg->level, reg->port_in,
+                      reg->active);
+        i++;
+    }
+    ds_put_char(s, '\n');
+}
+
+void
+amaru_log_table(const struct table_AMACS *table, uint64_t dp_id) {
+    const struct reg_AMAC *reg;
+    uint32_t n_amacs = 0, n_active = 0;
+
+    if (!enabled) {
+        return;
+    }
+
+    LIST_FOR_EACH (reg, struct reg_AMAC, node, &table->amacs) {
+        n_amacs++;
+        n_active += reg->active;
+    }
+
+    pthread_mutex_lock(&mutex);
+    log_dp_id = dp_id;
+    counters.n_updates++;
+    counters.n_amacs = n_amacs;
+    counters.n_active = n_active;
+    counters_changed = true;
+    if (log_mode == AMARU_LOG_TEXT && may_add(&table_pending)) {
+        put_table(&table_pending, table);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void
+amaru_log_sent(uint64_t dp_id) {
+    if (!enabled) {
+        return;
+    }
+
+    pthread_mutex_lock(&mutex);
+    log_dp_id = dp_id;
+    counters.n_sent++;
+    counters_changed = true;
+    if (log_mode == AMARU_LOG_TEXT && may_add(&sent_pending)) {
+        ds_put_cstr(&sent_pending, "Paquete correctamente enviado\n");
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+static long long int
+wall_msec(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (long long int) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/* Appends 's' to file 'name' + 'extension' of the log directory, after
+ * renaming the file with a timestamp suffix if it has grown too big. */
+static void
+write_file(const char *name, const char *extension, const struct ds *s) {
+    char *path = xasprintf("%s/%s%s", log_dir, name, extension);
+    const char *p = s->string;
+    size_t left = s->length;
+    struct stat st;
+    int fd;
+
+    if (!stat(path, &st) && st.st_size > log_max_size) {
+        char *old = xasprintf("%s/%s-%lld%s", log_dir, name, wall_msec(),
+                              extension);
+        if (rename(path, old)) {
+            VLOG_WARN_RL(LOG_MODULE, &rl, "could not rename %s to %s: %s",
+                         path, old, strerror(errno));
+        }
+        free(old);
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+    if (fd < 0) {
+        VLOG_WARN_RL(LOG_MODULE, &rl, "could not open %s: %s",
+                     path, strerror(errno));
+        free(path);
+        return;
+    }
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            VLOG_WARN_RL(LOG_MODULE, &rl, "error writing %s: %s",
+                         path, strerror(errno));
+            break;
+        }
+        p += n;
+        left -= n;
+    }
+    close(fd);
+    free(path);
+}
+
+static void
+swap_ds(struct ds *a, struct ds *b) {
+    struct ds tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+static void *
+writer_main(void *aux UNUSED) {
+    struct ds table_buf = DS_EMPTY_INITIALIZER;
+    struct ds sent_buf = DS_EMPTY_INITIALIZER;
+
+    for (;;) {
+        struct amaru_log_counters record;
+        bool write_record;
+        uint64_t dp_id, dropped;
+        struct timespec deadline;
+        char *name;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += AMARU_LOG_FLUSH_INTERVAL;
+
+        pthread_mutex_lock(&mutex);
+        while (!flush_requested
+               && pthread_cond_timedwait(&cond, &mutex, &deadline) != ETIMEDOUT) {
+            continue;
+        }
+        flush_requested = false;
+        swap_ds(&table_buf, &table_pending);
+        swap_ds(&sent_buf, &sent_pending);
+        record = counters;
+        write_record = log_mode == AMARU_LOG_COUNTERS && counters_changed;
+        counters_changed = false;
+        dp_id = log_dp_id;
+        dropped = n_dropped;
+        n_dropped = 0;
+        pthread_mutex_unlock(&mutex);
+
+        if (write_record) {
+            record.time = wall_msec();
+            record.dp_id = dp_id;
+            ds_put_buffer(&table_buf, (const char *) &record, sizeof record);
+        }
+        if (table_buf.length) {
+            name = xasprintf("Amaru_switch_%"PRIu64, dp_id);
+            write_file(name, log_mode == AMARU_LOG_TEXT ? ".log" : ".counters",
+                       &table_buf);
+            free(name);
+            ds_clear(&table_buf);
+        }
+        if (sent_buf.length) {
+            write_file("Num_Pkt_Amaru", ".log", &sent_buf);
+            ds_clear(&sent_buf);
+        }
+        if (dropped) {
+            VLOG_WARN_RL(LOG_MODULE, &rl, "dropped %"PRIu64" records while "
+                         "the log was not written fast enough", dropped);
+        }
+    }
+    return NULL;
+}
+
+void
+amaru_log_start(void) {
+    pthread_t thread;
+    int error;
+
+    if (!enabled) {
+        return;
+    }
+
+    error = pthread_create(&thread, NULL, writer_main, NULL);
+    if (error) {
+        ofp_fatal(error, "could not create AMARU log thread");
+    }
+    pthread_detach(thread);
+    VLOG_INFO(LOG_MODULE, "logging AMARU %s into %s",
+              log_mode == AMARU_LOG_TEXT ? "events" : "counters", log_dir);
+}
@@ -0,0 +1,88 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef AMARU_LOG_H
+#define AMARU_LOG_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct table_AMACS;
+
+/****************************************************************************
+ * AMARU log.
+ *
+ * Records the AMAC table of the switch each time it changes, and the AMARU
+ * packets the switch sends, into files of a log directory.  The records are
+ * buffered in memory and written out by a background thread, once a second
+ * or as soon as enough of them are pending, so the datapath never waits for
+ * the disk.  A file that has grown beyond the maximum size is renamed with a
+ * timestamp suffix before being written to, and started anew.
+ *
+ * The records still pending when the process is killed are lost.
+ ****************************************************************************/
+
+enum amaru_log_mode {
+    AMARU_LOG_TEXT,     /* the AMAC table as text in Amaru_switch_ID.log,
+                           a line per packet sent in Num_Pkt_Amaru.log. */
+    AMARU_LOG_COUNTERS  /* struct amaru_log_counters records in
+                           Amaru_switch_ID.counters. */
+};
+
+/* A record of AMARU_LOG_COUNTERS mode, in host byte order.  A record is
+ * written at the end of each flush period in which the counters changed. */
+struct amaru_log_counters {
+    uint64_t time;              /* in ms since the epoch. */
+    uint64_t dp_id;
+    uint64_t n_sent;            /* AMARU packets sent so far. */
+    uint64_t n_updates;         /* AMAC table changes so far. */
+    uint32_t n_amacs;           /* entries in the AMAC table. */
+    uint32_t n_active;          /* active entries in the AMAC table. */
+};
+
+/* Default maximum size of a log file, in bytes. */
+#define AMARU_LOG_MAX_SIZE (1024 * 1024)
+
+/* Enables the log, into directory 'dir'.  Records are buffered from now on,
+ * and written once amaru_log_start() is called. */
+void amaru_log_init(const char *dir, enum amaru_log_mode mode,
+                    size_t max_size);
+
+/* Starts the thread writing the log, if it is enabled. */
+void amaru_log_start(void);
+
+/* Records the AMAC table of datapath 'dp_id', after a change.  The caller
+ * must keep the table from changing meanwhile. */
+void amaru_log_table(const struct table_AMACS *table, uint64_t dp_id);
+
+/* Records that datapath 'dp_id' sent an AMARU packet. */
+void amaru_log_sent(uint64_t dp_id);
+
+#endif /* AMARU_LOG_H */
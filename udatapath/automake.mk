@@ -8,6 +8,8 @@ man_MANS += udatapath/ofdatapath.8
 udatapath_ofdatapath_SOURCES = \
 	udatapath/action_set.c \
 	udatapath/action_set.h \
+	udatapath/amaru_log.c \
+	udatapath/amaru_log.h \
 	udatapath/crc32.c \
 	udatapath/crc32.h \
 	udatapath/datapath.c \
@@ -20,8 +22,16 @@ udatapath_ofdatapath_SOURCES = \
 	udatapath/dp_control.h \
 	udatapath/dp_exp.c \
 	udatapath/dp_exp.h \
+	udatapath/dp_pool.c \
+	udatapath/dp_pool.h \
 	udatapath/dp_ports.c \
 	udatapath/dp_ports.h \
+	udatapath/dp_workers.c \
+	udatapath/dp_workers.h \
+	udatapath/flow_cache.c \
+	udatapath/flow_cache.h \
+	udatapath/flow_classifier.c \
+	udatapath/flow_classifier.h \
 	udatapath/flow_table.c \
 	udatapath/flow_table.h \
 	udatapath/flow_entry.c \
@@ -40,17 +50,38 @@ udatapath_ofdatapath_SOURCES = \
 	udatapath/packet.h \
 	udatapath/packet_handle_std.c \
     udatapath/packet_handle_std.h \
+	udatapath/packet_key.c \
+	udatapath/packet_key.h \
+	udatapath/packet_parse.c \
+	udatapath/packet_parse.h \
 	udatapath/pipeline.c \
 	udatapath/pipeline.h \
 	udatapath/udatapath.c
 
-udatapath_ofdatapath_LDADD = lib/libopenflow.a oflib/liboflib.a oflib-exp/liboflib_exp.a nbee_link/libnbee_link.a $(SSL_LIBS) $(FAULT_LIBS)
-udatapath_ofdatapath_CPPFLAGS = $(AM_CPPFLAGS)
+if HAVE_NBEE
+udatapath_nbee_libs = nbee_link/libnbee_link.a $(NBEE_LIBS)
+endif
+
+nodist_udatapath_ofdatapath_SOURCES = udatapath/packet_parse_netpdl.c
+
+udatapath_ofdatapath_LDADD = $(udatapath_nbee_libs) lib/libopenflow.a oflib/liboflib.a oflib-exp/liboflib_exp.a $(SSL_LIBS) $(FAULT_LIBS)
+udatapath_ofdatapath_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
 nodist_EXTRA_udatapath_ofdatapath_SOURCES = dummy.cxx
 
 EXTRA_DIST += udatapath/ofdatapath.8.in
 DISTCLEANFILES += udatapath/ofdatapath.8
 
+# The netpdl packet parser is compiled from the protocol description.
+udatapath/packet_parse_netpdl.c: udatapath/netpdl2c.pl customnetpdl.xml \
+		include/openflow/openflow.h lib/packets.h
+	$(PERL) $(srcdir)/udatapath/netpdl2c.pl \
+	    --openflow=$(srcdir)/include/openflow/openflow.h \
+	    --packets=$(srcdir)/lib/packets.h \
+	    $(srcdir)/customnetpdl.xml > $@.tmp && mv $@.tmp $@
+
+EXTRA_DIST += udatapath/netpdl2c.pl customnetpdl.xml
+CLEANFILES += udatapath/packet_parse_netpdl.c
+
 if BUILD_HW_LIBS
 
 # Options for each platform
@@ -70,6 +101,8 @@ noinst_LIBRARIES += udatapath/libudatapath.a
 udatapath_libudatapath_a_SOURCES = \
 	udatapath/action_set.c \
 	udatapath/action_set.h \
+	udatapath/amaru_log.c \
+	udatapath/amaru_log.h \
 	udatapath/crc32.c \
 	udatapath/crc32.h \
 	udatapath/datapath.c \
@@ -82,6 +115,14 @@ udatapath_libudatapath_a_SOURCES = \
 	udatapath/dp_control.h \
 	udatapath/dp_exp.c \
 	udatapath/dp_exp.h \
+	udatapath/dp_pool.c \
+	udatapath/dp_pool.h \
+	udatapath/dp_workers.c \
+	udatapath/dp_workers.h \
+	udatapath/flow_cache.c \
+	udatapath/flow_cache.h \
+	udatapath/flow_classifier.c \
+	udatapath/flow_classifier.h \
 	udatapath/flow_table.c \
 	udatapath/flow_table.h \
 	udatapath/flow_entry.c \
@@ -96,11 +137,17 @@ udatapath_libudatapath_a_SOURCES = \
 	udatapath/packet.h \
 	udatapath/packet_handle_std.c \
 	udatapath/packet_handle_std.h \
+	udatapath/packet_key.c \
+	udatapath/packet_key.h \
+	udatapath/packet_parse.c \
+	udatapath/packet_parse.h \
 	udatapath/pipeline.c \
 	udatapath/pipeline.h \
 	udatapath/udatapath.c
 
-udatapath_libudatapath_a_CPPFLAGS = $(AM_CPPFLAGS)
+nodist_udatapath_libudatapath_a_SOURCES = udatapath/packet_parse_netpdl.c
+
+udatapath_libudatapath_a_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
 udatapath_libudatapath_a_CPPFLAGS += -DOF_HW_PLAT -DUDATAPATH_AS_LIB -g -lnbee_link
 
 endif
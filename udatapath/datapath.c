@@ -47,6 +47,8 @@
 #include "csum.h"
 #include "dp_buffers.h"
 #include "dp_control.h"
+#include "dp_pool.h"
+#include "dp_workers.h"
 #include "ofp.h"
 #include "ofpbuf.h"
 #include "group_table.h"
@@ -74,8 +76,11 @@ static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 static struct remote *remote_create(struct datapath *dp, struct rconn *rconn, struct rconn *rconn_aux);
 static void remote_run(struct datapath *, struct remote *);
 static void remote_rconn_run(struct datapath *, struct remote *, uint8_t);
+static bool control_msg_is_request(struct ofl_msg_header *msg);
 static void remote_wait(struct remote *);
 static void remote_destroy(struct remote *);
+static int send_openflow_buffer(struct datapath *, struct ofpbuf *,
+                                const struct sender *);
 
 
 #define MFR_DESC     "Stanford University, Ericsson Research and CPqD Research"
@@ -150,6 +155,12 @@ dp_new(void) {
     list_init(&dp->port_list);
     dp->ports_num = 0;
     dp->max_queues = NETDEV_MAX_QUEUES;
+    dp->rx_burst = DP_RX_BURST;
+    svec_init(&dp->mmap_ports);
+    svec_init(&dp->xdp_ports);
+    svec_init(&dp->fanout_ports);
+    dp->n_workers = 0;
+    dp->workers = NULL;
 
     dp->exp = &dp_exp;
 
@@ -189,21 +200,31 @@ void
 dp_run(struct datapath *dp) {
     time_t now = time_now();
     struct remote *r, *rn;
+    struct ofpbuf *deferred;
     size_t i;
 
     if (now != dp->last_timeout) {
         dp->last_timeout = now;
         meter_table_add_tokens(dp->meters);
+        dp_workers_block(dp);
         pipeline_timeout(dp->pipeline);
+        dp_workers_unblock(dp);
+        dp_pool_log_stats();
     }
 
     poll_timer_wait(100);
     dp_ports_run(dp);
 
+    /* Send the messages generated by worker threads. */
+    while ((deferred = dp_workers_deferred(dp)) != NULL) {
+        send_openflow_buffer(dp, deferred, NULL);
+    }
+
     /* Talk to remotes. */
     LIST_FOR_EACH_SAFE (r, rn, struct remote, node, &dp->remotes) {
         remote_run(dp, r);
     }
+    dp_ports_flush(dp);
 
     for (i = 0; i < dp->n_listeners; ) {
         struct pvconn *pvconn = dp->listeners[i];
@@ -249,6 +270,21 @@ remote_run(struct datapath *dp, struct remote *r)
     remote_rconn_run(dp, r, PTIN_CONNECTION);
 }
 
+/* Returns true if handling 'msg' only reads the datapath, so that the worker
+ * threads may keep running meanwhile. */
+static bool
+control_msg_is_request(struct ofl_msg_header *msg) {
+    return msg->type == OFPT_HELLO
+        || msg->type == OFPT_ECHO_REQUEST
+        || msg->type == OFPT_ECHO_REPLY
+        || msg->type == OFPT_FEATURES_REQUEST
+        || msg->type == OFPT_GET_CONFIG_REQUEST
+        || msg->type == OFPT_BARRIER_REQUEST
+        || msg->type == OFPT_MULTIPART_REQUEST
+        || msg->type == OFPT_QUEUE_GET_CONFIG_REQUEST
+        || msg->type == OFPT_GET_ASYNC_REQUEST;
+}
+
 static void
 remote_rconn_run(struct datapath *dp, struct remote *r, uint8_t conn_id) {
     struct rconn *rconn = NULL;
@@ -278,7 +314,15 @@ remote_rconn_run(struct datapath *dp, struct remote *r, uint8_t conn_id) {
                 error = ofl_msg_unpack(buffer->data, buffer->size, &msg, &(sender.xid), dp->exp);
 
                 if (!error) {
+                    bool block = !control_msg_is_request(msg);
+
+                    if (block) {
+                        dp_workers_block(dp);
+                    }
                     error = handle_control_msg(dp, msg, &sender);
+                    if (block) {
+                        dp_workers_unblock(dp);
+                    }
 
                     if (error) {
                         ofl_msg_free(msg, dp->exp);
@@ -376,12 +420,16 @@ dp_wait(struct datapath *dp)
     struct remote *r;
     size_t i;
 
-    LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
-        if (IS_HW_PORT(p)) {
-            continue;
+    if (dp->workers == NULL) {
+        LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
+            if (IS_HW_PORT(p)) {
+                continue;
+            }
+            netdev_recv_wait(p->netdev);
         }
-        netdev_recv_wait(p->netdev);
     }
+    netdev_wait();
+    dp_workers_wait(dp);
     LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
         remote_wait(r);
     }
@@ -430,6 +478,34 @@ dp_set_max_queues(struct datapath *dp, uint32_t max_queues) {
     dp->max_queues = max_queues;
 }
 
+void
+dp_set_rx_burst(struct datapath *dp, size_t rx_burst) {
+    dp->rx_burst = rx_burst;
+}
+
+void
+dp_add_mmap_port(struct datapath *dp, const char *netdev) {
+    svec_add(&dp->mmap_ports, netdev);
+    svec_sort(&dp->mmap_ports);
+}
+
+void
+dp_add_xdp_port(struct datapath *dp, const char *netdev) {
+    svec_add(&dp->xdp_ports, netdev);
+    svec_sort(&dp->xdp_ports);
+}
+
+void
+dp_add_fanout_port(struct datapath *dp, const char *netdev) {
+    svec_add(&dp->fanout_ports, netdev);
+    svec_sort(&dp->fanout_ports);
+}
+
+void
+dp_set_n_workers(struct datapath *dp, size_t n_workers) {
+    dp->n_workers = n_workers;
+}
+
 
 static int
 send_openflow_buffer_to_remote(struct ofpbuf *buffer, struct remote *remote) {
@@ -572,6 +648,12 @@ dp_send_message(struct datapath *dp, struct ofl_msg_header *msg,
     if (msg->type == OFPT_PACKET_IN)
         ofpbuf->conn_id = PTIN_CONNECTION;
 
+    /* Connections belong to the main thread. */
+    if (dp_workers_is_worker()) {
+        dp_workers_defer(dp, ofpbuf);
+        return 0;
+    }
+
     error = send_openflow_buffer(dp, ofpbuf, sender);
     if (error) {
         VLOG_WARN_RL(LOG_MODULE, &rl, "There was an error sending the message!");
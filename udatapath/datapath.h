@@ -53,11 +53,13 @@
 #include "group_table.h"
 #include "timeval.h"
 #include "list.h"
+#include "svec.h"
 
 
 struct rconn;
 struct pvconn;
 struct sender;
+struct dp_workers;
 
 /****************************************************************************
  * The datapath
@@ -100,6 +102,12 @@ struct datapath {
     /* Switch ports. */
     /* NOTE: ports are numbered starting at 1 in OF 1.1 */
     uint32_t         max_queues; /* used when creating ports */
+    size_t           rx_burst;   /* max packets received per port and run */
+    struct svec      mmap_ports; /* ports to use packet rings (sorted) */
+    struct svec      xdp_ports;  /* ports to use AF_XDP (sorted) */
+    struct svec      fanout_ports; /* ports to spread over workers (sorted) */
+    size_t           n_workers;  /* number of worker threads */
+    struct dp_workers *workers;  /* worker threads, if started */
     struct sw_port   ports[DP_MAX_PORTS + 1];
     struct sw_port  *local_port;  /* OFPP_LOCAL port, if any. */
     struct list      port_list; /* All ports, including local_port. */
@@ -193,6 +201,21 @@ dp_set_serial_num(struct datapath *dp, char *serial_num);
 void
 dp_set_max_queues(struct datapath *dp, uint32_t max_queues);
 
+void
+dp_set_rx_burst(struct datapath *dp, size_t rx_burst);
+
+void
+dp_add_mmap_port(struct datapath *dp, const char *netdev);
+
+void
+dp_add_xdp_port(struct datapath *dp, const char *netdev);
+
+void
+dp_add_fanout_port(struct datapath *dp, const char *netdev);
+
+void
+dp_set_n_workers(struct datapath *dp, size_t n_workers);
+
 
 /* Sends the given OFLib message to the connection represented by sender,
  * or to all open connections, if sender is null. */
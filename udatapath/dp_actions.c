@@ -31,6 +31,7 @@
  * Credits: Zoltán Lajos Kis
  */
 
+#include <inttypes.h>
 #include <netinet/in.h>
 #include "csum.h"
 #include "dp_exp.h"
@@ -47,6 +48,7 @@
 #include "util.h"
 #include "oflib/oxm-match.h"
 #include "hash.h"
+#include "trace.h"
 
 #define LOG_MODULE VLM_dp_acts
 
@@ -71,9 +73,8 @@ output(struct packet *pkt, struct ofl_action_output *action)
     }
 }
 
-/* Executes a set field action.
-TODO: if we use the the index structure to the packet fields
-revalidation is not needed  */
+/* Executes a set field action. Only the header holding the field is parsed
+ * again afterwards, see packet_handle_std_field_changed. */
 
 static void
 set_field(struct packet *pkt, struct ofl_action_set_field *act)
@@ -83,7 +84,8 @@ set_field(struct packet *pkt, struct ofl_action_set_field *act)
     {
         /*Field existence is guaranteed by the
         field pre-requisite on matching */
-        fprintf(stderr, "Header %d\n", OXM_FIELD(act->field->header));
+        TRACE(LOG_MODULE, "set_field", "field %"PRIu64" in_port %"PRIu64,
+              OXM_FIELD(act->field->header), pkt->in_port);
         switch (act->field->header)
         {
         case OXM_OF_ETH_DST:
@@ -465,21 +467,18 @@ set_field(struct packet *pkt, struct ofl_action_set_field *act)
         }
         case OXM_OF_TUNNEL_ID:
         {
-            struct ofl_match_tlv *f;
-            HMAP_FOR_EACH_WITH_HASH(f, struct ofl_match_tlv,
-                                    hmap_node, hash_int(OXM_OF_TUNNEL_ID, 0), &(pkt)->handle_std->match.match_fields)
+            uint64_t *tunnel_id = (uint64_t *)packet_key_get(&pkt->handle_std->key, OXM_OF_TUNNEL_ID);
+            if (tunnel_id != NULL)
             {
-                uint64_t *tunnel_id = (uint64_t *)f->value;
                 *tunnel_id = *((uint64_t *)act->field->value);
+                pkt->handle_std->match_valid = false;
             }
             break;
         }
         /*Modificacion UAH*/
         case OXM_OF_AMARU_LEVEL:
         {
-            struct ofl_match_tlv *f;
-            HMAP_FOR_EACH_WITH_HASH(f, struct ofl_match_tlv,
-                                    hmap_node, hash_int(OXM_OF_AMARU_LEVEL, 0), &(pkt)->handle_std->match.match_fields)
+            if (packet_key_has(&pkt->handle_std->key, OXM_OF_AMARU_LEVEL))
             {
                 memcpy(&pkt->handle_std->proto->amaru->level, act->field->value, sizeof(uint8_t));
             }
@@ -487,9 +486,7 @@ set_field(struct packet *pkt, struct ofl_action_set_field *act)
         }
         case OXM_OF_AMARU_AMAC:
         {
-            struct ofl_match_tlv *f;
-            HMAP_FOR_EACH_WITH_HASH(f, struct ofl_match_tlv,
-                                    hmap_node, hash_int(OXM_OF_AMARU_AMAC, 0), &(pkt)->handle_std->match.match_fields)
+            if (packet_key_has(&pkt->handle_std->key, OXM_OF_AMARU_AMAC))
             {
                 memcpy(&pkt->handle_std->proto->amaru->amac, act->field->value, AMARU_LEN_OF);
             }
@@ -500,7 +497,7 @@ set_field(struct packet *pkt, struct ofl_action_set_field *act)
             VLOG_WARN_RL(LOG_MODULE, &rl, "Trying to set unknow field.");
             break;
         }
-        pkt->handle_std->valid = false;
+        packet_handle_std_field_changed(pkt->handle_std, act->field->header);
         return;
     }
 }
@@ -667,9 +664,7 @@ push_vlan(struct packet *pkt, struct ofl_action_push *act)
             new_eth->eth_type = ntohs(act->ethertype);
         }
 
-        // TODO Zoltan: This could be faster if VLAN match is updated
-        //              and proto pointers are shifted in case of realloc, ...
-        pkt->handle_std->valid = false;
+        packet_handle_std_tags_changed(pkt->handle_std, false);
     }
     else
     {
@@ -706,8 +701,7 @@ pop_vlan(struct packet *pkt, struct ofl_action_header *act UNUSED)
 
         memmove(pkt->buffer->data, eth, move_size);
 
-        //TODO Zoltan: revalidating might not be necessary in all cases
-        pkt->handle_std->valid = false;
+        packet_handle_std_tags_changed(pkt->handle_std, false);
     }
     else
     {
@@ -867,9 +861,8 @@ push_mpls(struct packet *pkt, struct ofl_action_push *act)
             new_eth->eth_type = htons(ntohs(new_eth->eth_type) + MPLS_HEADER_LEN);
         }
 
-        // in 1.1 all proto but eth and mpls will be hidden,
-        // so revalidating won't be a tedious work (probably)
-        pkt->handle_std->valid = false;
+        // in 1.1 all proto but eth and mpls will be hidden
+        packet_handle_std_tags_changed(pkt->handle_std, true);
     }
     else
     {
@@ -916,8 +909,7 @@ pop_mpls(struct packet *pkt, struct ofl_action_pop_mpls *act)
             new_eth->eth_type = htons(ntohs(new_eth->eth_type) + MPLS_HEADER_LEN);
         }
 
-        //TODO Zoltan: revalidating might not be necessary at all cases
-        pkt->handle_std->valid = false;
+        packet_handle_std_tags_changed(pkt->handle_std, true);
     }
     else
     {
@@ -1001,7 +993,7 @@ push_pbb(struct packet *pkt, struct ofl_action_push *act)
             new_eth->eth_type = ntohs(act->ethertype);
         }
 
-        pkt->handle_std->valid = false;
+        packet_handle_std_tags_changed(pkt->handle_std, false);
     }
     else
     {
@@ -1027,7 +1019,7 @@ pop_pbb(struct packet *pkt, struct ofl_action_header *act UNUSED)
         memmove(pkt->buffer->data, pbb->c_eth_dst, (pkt->buffer->size - move_size));
         pkt->buffer->size -= move_size;
 
-        pkt->handle_std->valid = false;
+        packet_handle_std_tags_changed(pkt->handle_std, false);
     }
     else
     {
@@ -1120,6 +1112,13 @@ void dp_execute_action(struct packet *pkt,
         free(a);
     }
 
+    /* Packets cloned for groups share their buffers until modified. */
+    if (action->type != OFPAT_OUTPUT && action->type != OFPAT_SET_QUEUE &&
+        action->type != OFPAT_GROUP)
+    {
+        packet_make_writable(pkt);
+    }
+
     switch (action->type)
     {
     case (OFPAT_SET_FIELD):
@@ -1222,7 +1221,8 @@ void dp_execute_action(struct packet *pkt,
 }
 
 void dp_execute_action_list(struct packet *pkt,
-                            size_t actions_num, struct ofl_action_header **actions, uint64_t cookie)
+                            size_t actions_num, struct ofl_action_header **actions, uint64_t cookie,
+                            bool last)
 {
     size_t i;
     VLOG_DBG_RL(LOG_MODULE, &rl, "Executing action list.");
@@ -1242,8 +1242,8 @@ void dp_execute_action_list(struct packet *pkt,
              * version of the packet. The group must also ignore the current
 	     * action-set. We need to clone the packet with an empty
              * action-set. Jean II */
-            pkt_clone = packet_clone(pkt);
-            group_table_execute(pkt_clone->dp->groups, pkt_clone, group);
+            pkt_clone = packet_clone_shared(pkt);
+            group_table_execute(pkt->dp->groups, pkt_clone, group);
         }
         else if (pkt->out_port != OFPP_ANY)
         {
@@ -1254,7 +1254,14 @@ void dp_execute_action_list(struct packet *pkt,
             pkt->out_port_max_len = 0;
             pkt->out_queue = 0;
             VLOG_DBG_RL(LOG_MODULE, &rl, "Port action; sending to port (%u).", port);
-            dp_actions_output_port(pkt, port, queue, max_len, cookie);
+            if (last && i == actions_num - 1)
+            {
+                dp_actions_output_last(pkt, port, queue, max_len, cookie);
+            }
+            else
+            {
+                dp_actions_output_port(pkt, port, queue, max_len, cookie);
+            }
         }
     }
 }
@@ -1309,14 +1316,10 @@ void dp_actions_output_port(struct packet *pkt, uint32_t out_port, uint32_t out_
             msg.data_length = pkt->buffer->size;
         }
 
-        if (!pkt->handle_std->valid)
-        {
-            packet_handle_std_validate(pkt->handle_std);
-        }
         /* In this implementation the fields in_port and in_phy_port
                 always will be the same, because we are not considering logical
                 ports*/
-        msg.match = (struct ofl_match_header *)&pkt->handle_std->match;
+        msg.match = (struct ofl_match_header *)packet_handle_std_ofl_match(pkt->handle_std);
         dp_send_message(pkt->dp, (struct ofl_msg_header *)&msg, NULL);
         break;
     }
@@ -1344,6 +1347,22 @@ void dp_actions_output_port(struct packet *pkt, uint32_t out_port, uint32_t out_
     }
 }
 
+void dp_actions_output_last(struct packet *pkt, uint32_t out_port, uint32_t out_queue, uint16_t max_len, uint64_t cookie)
+{
+    if (out_port <= OFPP_MAX && out_port != pkt->in_port &&
+        pkt->buffer_id == NO_BUFFER && !packet_is_shared(pkt))
+    {
+        /* No other packet uses the data, so the port may send them from the
+         * receive ring they are in. */
+        VLOG_DBG_RL(LOG_MODULE, &rl, "Outputting packet on port %u.", out_port);
+        dp_ports_output_in_place(pkt->dp, pkt->buffer, out_port, out_queue);
+    }
+    else
+    {
+        dp_actions_output_port(pkt, out_port, out_queue, max_len, cookie);
+    }
+}
+
 bool dp_actions_list_has_out_port(size_t actions_num, struct ofl_action_header **actions, uint32_t port)
 {
     size_t i;
@@ -48,15 +48,25 @@ dp_execute_action(struct packet *pkt,
                   struct ofl_action_header *action);
 
 
-/* Executes the list of action on the given packet. */
+/* Executes the list of action on the given packet.  If 'last' is true, the
+ * packet is destroyed after the actions without its data being read, so that
+ * an output action at the end of the list may send them from where they are
+ * (see dp_actions_output_last()). */
 void
 dp_execute_action_list(struct packet *pkt,
-                size_t actions_num, struct ofl_action_header **actions, uint64_t cookie);
+                size_t actions_num, struct ofl_action_header **actions, uint64_t cookie,
+                bool last);
 
 /* Outputs the packet on the given port and queue. */
 void
 dp_actions_output_port(struct packet *pkt, uint32_t out_port, uint32_t out_queue, uint16_t max_len, uint64_t cookie);
 
+/* Outputs the packet on the given port and queue, as dp_actions_output_port()
+ * does, for a caller that destroys the packet right after, without reading
+ * its data. */
+void
+dp_actions_output_last(struct packet *pkt, uint32_t out_port, uint32_t out_queue, uint16_t max_len, uint64_t cookie);
+
 /* Returns true if the given list of actions has an output action to the port. */
 bool
 dp_actions_list_has_out_port(size_t actions_num, struct ofl_action_header **actions, uint32_t port);
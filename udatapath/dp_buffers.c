@@ -37,12 +37,14 @@
  * Author: Zoltán Lajos Kis <zoltan.lajos.kis@ericsson.com>
  */
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 
 #include "dp_buffers.h"
 #include "timeval.h"
 #include "packet.h"
+#include "packet_handle_std.h"
 #include "vlog.h"
 
 #define LOG_MODULE VLM_dp_buf
@@ -78,6 +80,7 @@ struct packet_buffer {
 
 struct dp_buffers {
     struct datapath       *dp;
+    pthread_mutex_t        mutex;  /* buffers are saved by worker threads. */
     size_t                 buffer_idx;
     size_t                 buffers_num;
     struct packet_buffer   buffers[N_PKT_BUFFERS];
@@ -90,6 +93,7 @@ dp_buffers_create(struct datapath *dp) {
     size_t i;
 
     dpb->dp          = dp;
+    pthread_mutex_init(&dpb->mutex, NULL);
     dpb->buffer_idx  = (size_t)-1;
     dpb->buffers_num = N_PKT_BUFFERS;
 
@@ -107,14 +111,27 @@ dp_buffers_size(struct dp_buffers *dpb) {
     return dpb->buffers_num;
 }
 
+/* Returns true if the packet in buffer 'id' is not timed out. */
+static bool
+is_alive(struct dp_buffers *dpb, uint32_t id) {
+    struct packet_buffer *p;
+
+    p = &dpb->buffers[id & PKT_BUFFER_MASK];
+    return ((p->cookie == id >> PKT_BUFFER_BITS) &&
+            (time_now() < p->timeout));
+}
+
 uint32_t
 dp_buffers_save(struct dp_buffers *dpb, struct packet *pkt) {
     struct packet_buffer *p;
+    struct packet *old = NULL;
     uint32_t id;
 
+    pthread_mutex_lock(&dpb->mutex);
     /* if packet is already in buffer, do not save again */
     if (pkt->buffer_id != NO_BUFFER) {
-        if (dp_buffers_is_alive(dpb, pkt->buffer_id)) {
+        if (is_alive(dpb, pkt->buffer_id)) {
+            pthread_mutex_unlock(&dpb->mutex);
             return pkt->buffer_id;
         }
     }
@@ -124,22 +141,29 @@ dp_buffers_save(struct dp_buffers *dpb, struct packet *pkt) {
     p = &dpb->buffers[dpb->buffer_idx];
     if (p->pkt != NULL) {
         if (time_now() < p->timeout) {
+            pthread_mutex_unlock(&dpb->mutex);
             return NO_BUFFER;
         } else {
-            p->pkt->buffer_id = NO_BUFFER;
-            packet_destroy(p->pkt);
+            old = p->pkt;
+            old->buffer_id = NO_BUFFER;
         }
     }
     /* Don't use maximum cookie value since the all-bits-1 id is
      * special. */
     if (++p->cookie >= (1u << PKT_COOKIE_BITS) - 1)
         p->cookie = 0;
+    /* The packet may be in a port's receive ring, which it outlives. */
+    packet_own_buffer(pkt);
     p->pkt = pkt;
     p->timeout = time_now() + OVERWRITE_SECS;
     id = dpb->buffer_idx | (p->cookie << PKT_BUFFER_BITS);
 
     pkt->buffer_id  = id;
+    pthread_mutex_unlock(&dpb->mutex);
 
+    if (old != NULL) {
+        packet_destroy(old);
+    }
     return id;
 }
 
@@ -148,6 +172,7 @@ dp_buffers_retrieve(struct dp_buffers *dpb, uint32_t id) {
     struct packet *pkt = NULL;
     struct packet_buffer *p;
 
+    pthread_mutex_lock(&dpb->mutex);
     p = &dpb->buffers[id & PKT_BUFFER_MASK];
     if (p->cookie == id >> PKT_BUFFER_BITS && p->pkt != NULL) {
         pkt = p->pkt;
@@ -159,31 +184,56 @@ dp_buffers_retrieve(struct dp_buffers *dpb, uint32_t id) {
         VLOG_WARN_RL(LOG_MODULE, &rl, "cookie mismatch: %x != %x\n",
                           id >> PKT_BUFFER_BITS, p->cookie);
     }
+    pthread_mutex_unlock(&dpb->mutex);
 
     return pkt;
 }
 
 bool
 dp_buffers_is_alive(struct dp_buffers *dpb, uint32_t id) {
-    struct packet_buffer *p;
+    bool alive;
 
-    p = &dpb->buffers[id & PKT_BUFFER_MASK];
-    return ((p->cookie == id >> PKT_BUFFER_BITS) &&
-            (time_now() < p->timeout));
+    pthread_mutex_lock(&dpb->mutex);
+    alive = is_alive(dpb, id);
+    pthread_mutex_unlock(&dpb->mutex);
+    return alive;
 }
 
+bool
+dp_buffers_release(struct dp_buffers *dpb, uint32_t id) {
+    struct packet_buffer *p;
+    bool alive;
+
+    pthread_mutex_lock(&dpb->mutex);
+    alive = is_alive(dpb, id);
+    if (!alive) {
+        p = &dpb->buffers[id & PKT_BUFFER_MASK];
+        if (p->cookie == id >> PKT_BUFFER_BITS) {
+            p->pkt = NULL;
+        }
+    }
+    pthread_mutex_unlock(&dpb->mutex);
+    return alive;
+}
 
 void
 dp_buffers_discard(struct dp_buffers *dpb, uint32_t id, bool destroy) {
     struct packet_buffer *p;
+    struct packet *pkt = NULL;
 
+    pthread_mutex_lock(&dpb->mutex);
     p = &dpb->buffers[id & PKT_BUFFER_MASK];
 
     if (p->cookie == id >> PKT_BUFFER_BITS) {
         if (destroy) {
-            p->pkt->buffer_id = NO_BUFFER;
-            packet_destroy(p->pkt);
+            pkt = p->pkt;
+            pkt->buffer_id = NO_BUFFER;
         }
         p->pkt = NULL;
     }
+    pthread_mutex_unlock(&dpb->mutex);
+
+    if (pkt != NULL) {
+        packet_destroy(pkt);
+    }
 }
@@ -77,6 +77,13 @@ dp_buffers_retrieve(struct dp_buffers *dpb, uint32_t id);
 bool
 dp_buffers_is_alive(struct dp_buffers *dpb, uint32_t id);
 
+/* Called by the owner of the packet saved in the given buffer when it is done
+ * with the packet.  Returns true if the buffer is still alive and keeps the
+ * packet; otherwise the packet is removed from the buffer, and the caller must
+ * destroy it. */
+bool
+dp_buffers_release(struct dp_buffers *dpb, uint32_t id);
+
 /* Discards the packet in the given buffer, and destroys the packet if destroy is set. */
 void
 dp_buffers_discard(struct dp_buffers *dpb, uint32_t id, bool destroy);
@@ -0,0 +1,227 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <config.h>
+#include "dp_pool.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compiler.h"
+#include "dynamic-string.h"
+#include "util.h"
+#include "vlog.h"
+
+#define LOG_MODULE VLM_dp_pool
+
+/* Number of free objects a thread keeps per pool. */
+#define DP_POOL_CACHE_SIZE 64
+
+/* Number of objects moved at once between a thread cache and the depot. */
+#define DP_POOL_BATCH (DP_POOL_CACHE_SIZE / 2)
+
+/* Maximum number of free objects in the depot of a pool. */
+#define DP_POOL_DEPOT_SIZE 4096
+
+/* Free objects of one pool cached by a thread. */
+struct dp_pool_cache {
+    void     *objs[DP_POOL_CACHE_SIZE];
+    size_t    n;
+    uint64_t  n_reused;   /* objects handed out by this cache. */
+};
+
+/* The caches of a thread. */
+struct dp_pool_thread {
+    struct dp_pool_cache    caches[DP_POOL_MAX];
+    struct dp_pool_thread  *next;  /* in 'threads'. */
+};
+
+static THREAD_LOCAL struct dp_pool_thread *self;
+
+/* Registry of the pools and threads in use, for statistics. */
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct dp_pool *pools[DP_POOL_MAX];
+static size_t n_pools;
+static struct dp_pool_thread *threads;
+
+/* Registers 'pool' on first use. */
+static void
+pool_register(struct dp_pool *pool) {
+    pthread_mutex_lock(&registry_mutex);
+    if (pool->idx < 0) {
+        if (n_pools >= DP_POOL_MAX) {
+            ofp_fatal(0, "too many object pools");
+        }
+        pool->depot = xmalloc(DP_POOL_DEPOT_SIZE * sizeof *pool->depot);
+        pools[n_pools] = pool;
+        __atomic_store_n(&pool->idx, (int) n_pools, __ATOMIC_RELEASE);
+        n_pools++;
+    }
+    pthread_mutex_unlock(&registry_mutex);
+}
+
+/* Returns the current thread's cache for 'pool'. */
+static struct dp_pool_cache *
+pool_cache(struct dp_pool *pool) {
+    int idx = __atomic_load_n(&pool->idx, __ATOMIC_ACQUIRE);
+
+    if (idx < 0) {
+        pool_register(pool);
+        idx = pool->idx;
+    }
+    if (self == NULL) {
+        self = xcalloc(1, sizeof *self);
+        pthread_mutex_lock(&registry_mutex);
+        self->next = threads;
+        threads = self;
+        pthread_mutex_unlock(&registry_mutex);
+    }
+    return &self->caches[idx];
+}
+
+void *
+dp_pool_get(struct dp_pool *pool) {
+    struct dp_pool_cache *cache = pool_cache(pool);
+    size_t n;
+
+    if (cache->n == 0) {
+        pthread_mutex_lock(&pool->mutex);
+        n = MIN(pool->n_depot, DP_POOL_BATCH);
+        pool->n_depot -= n;
+        memcpy(cache->objs, &pool->depot[pool->n_depot],
+               n * sizeof *cache->objs);
+        if (n == 0) {
+            pool->n_created++;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+        if (n == 0) {
+            return NULL;
+        }
+        __atomic_store_n(&cache->n, n, __ATOMIC_RELAXED);
+    }
+    n = cache->n - 1;
+    __atomic_store_n(&cache->n, n, __ATOMIC_RELAXED);
+    __atomic_store_n(&cache->n_reused, cache->n_reused + 1, __ATOMIC_RELAXED);
+    return cache->objs[n];
+}
+
+void *
+dp_pool_alloc(struct dp_pool *pool) {
+    void *obj = dp_pool_get(pool);
+
+    return obj != NULL ? obj : xmalloc_aligned(CACHE_LINE_SIZE, pool->size);
+}
+
+void
+dp_pool_free(struct dp_pool *pool, void *obj) {
+    struct dp_pool_cache *cache = pool_cache(pool);
+    size_t n = cache->n;
+
+    if (n == DP_POOL_CACHE_SIZE) {
+        void **spill = &cache->objs[n - DP_POOL_BATCH];
+        size_t n_spill = DP_POOL_BATCH;
+        size_t n_moved, i;
+
+        pthread_mutex_lock(&pool->mutex);
+        n_moved = MIN(n_spill, DP_POOL_DEPOT_SIZE - pool->n_depot);
+        memcpy(&pool->depot[pool->n_depot], spill,
+               n_moved * sizeof *spill);
+        pool->n_depot += n_moved;
+        pool->n_destroyed += n_spill - n_moved;
+        pthread_mutex_unlock(&pool->mutex);
+
+        for (i = n_moved; i < n_spill; i++) {
+            if (pool->destroy != NULL) {
+                pool->destroy(spill[i]);
+            } else {
+                free(spill[i]);
+            }
+        }
+        n -= n_spill;
+    }
+    cache->objs[n] = obj;
+    __atomic_store_n(&cache->n, n + 1, __ATOMIC_RELAXED);
+}
+
+/* Appends the statistics of the pool at 'idx' in the registry to 'ds'.  The
+ * caller must hold 'registry_mutex'. */
+static void
+format_pool_stats(size_t idx, struct ds *ds) {
+    struct dp_pool *pool = pools[idx];
+    struct dp_pool_thread *t;
+    uint64_t n_created, n_reused = 0, n_destroyed;
+    size_t n_depot, n_cached = 0;
+
+    for (t = threads; t != NULL; t = t->next) {
+        n_cached += __atomic_load_n(&t->caches[idx].n, __ATOMIC_RELAXED);
+        n_reused += __atomic_load_n(&t->caches[idx].n_reused,
+                                    __ATOMIC_RELAXED);
+    }
+    pthread_mutex_lock(&pool->mutex);
+    n_created = pool->n_created;
+    n_destroyed = pool->n_destroyed;
+    n_depot = pool->n_depot;
+    pthread_mutex_unlock(&pool->mutex);
+
+    ds_put_format(ds, "%s pool: %"PRIu64" allocated, %"PRIu64" reused, "
+                  "%"PRIu64" destroyed, %zu free (%zu in the depot).",
+                  pool->name, n_created, n_reused, n_destroyed,
+                  n_depot + n_cached, n_depot);
+}
+
+void
+dp_pool_log_stats(void) {
+    struct ds ds = DS_EMPTY_INITIALIZER;
+    size_t i;
+
+    if (!VLOG_IS_DBG_ENABLED(LOG_MODULE)) {
+        return;
+    }
+
+    pthread_mutex_lock(&registry_mutex);
+    for (i = 0; i < n_pools; i++) {
+        ds_clear(&ds);
+        format_pool_stats(i, &ds);
+        VLOG_DBG(LOG_MODULE, "%s", ds_cstr(&ds));
+    }
+    pthread_mutex_unlock(&registry_mutex);
+    ds_destroy(&ds);
+}
+
+void
+dp_pool_format_stats(struct ds *ds) {
+    size_t i;
+
+    pthread_mutex_lock(&registry_mutex);
+    for (i = 0; i < n_pools; i++) {
+        format_pool_stats(i, ds);
+        ds_put_char(ds, '\n');
+    }
+    pthread_mutex_unlock(&registry_mutex);
+}
@@ -0,0 +1,92 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef DP_POOL_H
+#define DP_POOL_H 1
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct ds;
+
+/****************************************************************************
+ * Object pools.
+ *
+ * A pool recycles fixed size objects allocated and freed for every packet
+ * (packets, their action sets and parsed headers, receive buffers), so the
+ * packet path does not go through malloc() once the pools are warm.
+ *
+ * Each thread keeps a small cache of free objects per pool, used without
+ * locking.  Full and empty caches exchange objects with the pool's shared
+ * depot a batch at a time, under the pool's mutex; objects beyond the depot's
+ * capacity are destroyed.  An object may be freed by another thread than the
+ * one that allocated it.
+ ****************************************************************************/
+
+/* Maximum number of pools. */
+#define DP_POOL_MAX 16
+
+struct dp_pool {
+    const char       *name;
+    size_t            size;       /* of the objects allocated by the pool. */
+    void            (*destroy)(void *); /* frees an object, if not free(). */
+
+    /* Private to dp_pool.c. */
+    int               idx;        /* in the pool registry, -1 until used. */
+    pthread_mutex_t   mutex;      /* protects the members below. */
+    void            **depot;      /* free objects shared by the threads. */
+    size_t            n_depot;
+    uint64_t          n_created;  /* objects the pool had to allocate. */
+    uint64_t          n_destroyed;
+};
+
+#define DP_POOL_INITIALIZER(NAME, SIZE, DESTROY)                        \
+    { NAME, SIZE, DESTROY, -1, PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, 0 }
+
+/* Returns a free object from 'pool', or NULL if the pool has none, in which
+ * case the caller allocates a new one itself.  The object is not
+ * initialized: it holds what it held when it was freed. */
+void *dp_pool_get(struct dp_pool *pool);
+
+/* Returns a free object from 'pool', allocating a new, cache line aligned
+ * one if the pool has none. */
+void *dp_pool_alloc(struct dp_pool *pool);
+
+/* Gives 'obj' back to 'pool'. */
+void dp_pool_free(struct dp_pool *pool, void *obj);
+
+/* Logs the number of objects allocated and free in each pool. */
+void dp_pool_log_stats(void);
+
+/* Appends the same numbers to 'ds', one line per pool. */
+void dp_pool_format_stats(struct ds *ds);
+
+#endif /* DP_POOL_H */
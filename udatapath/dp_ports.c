@@ -41,9 +41,13 @@
 #include <assert.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include "amaru_log.h"
 #include "dp_exp.h"
+#include "dp_workers.h"
 #include "dp_ports.h"
 #include "datapath.h"
+#include "hash.h"
 #include "packets.h"
 #include "pipeline.h"
 #include "oflib/ofl.h"
@@ -52,6 +56,7 @@
 #include "oflib/ofl-log.h"
 #include "util.h"
 
+#include "trace.h"
 #include "vlog.h"
 #define LOG_MODULE VLM_dp_ports
 /*Modificaciones Boby UAH*/
@@ -62,7 +67,6 @@ static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 
 #if defined(OF_HW_PLAT)
 #include <openflow/of_hw_api.h>
-#include <pthread.h>
 #endif
 
 #if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
@@ -225,61 +229,32 @@ dp_hw_drv_init(struct datapath *dp)
 
 #endif
 
-/* Runs a datapath packet through the pipeline, if the port is not set to down. */
-static void
+/* Makes a datapath packet of a received buffer, to be run through the
+ * pipeline, if the port is not set to down.  Otherwise drops the buffer and
+ * returns NULL. */
+static struct packet *
 process_buffer(struct datapath *dp, struct sw_port *p, struct ofpbuf *buffer)
 {
-    struct packet *pkt;
-
     if ((p->conf->config & (OFPPC_NO_RECV | OFPPC_PORT_DOWN)) != 0)
     {
-        ofpbuf_delete(buffer);
-        return;
+        packet_buffer_delete(buffer);
+        return NULL;
     }
     // packet takes ownership of ofpbuf buffer
-    pkt = packet_create(dp, p->stats->port_no, buffer, false);
-    pipeline_process_packet(dp->pipeline, pkt);
+    return packet_create(dp, p->stats->port_no, buffer, false);
 }
 
-void dp_ports_run(struct datapath *dp)
-{
-    // static, so an unused buffer can be reused at the dp_ports_run call
-    static struct ofpbuf *buffer = NULL;
-    int max_mtu = 0;
+/* Largest MTU of the ports, updated by the main thread. */
+static int max_mtu;
 
+/* Updates the state of the ports whose link went up or down. */
+static void
+dp_ports_update_links(struct datapath *dp)
+{
     struct sw_port *p, *pn;
 
-#if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
-    { /* Process packets received from callback thread */
-        struct ofpbuf *buffer;
-        of_port_t port_no;
-        int reason;
-        struct sw_port *p;
-
-        while (dequeue_pkt(dp, &buffer, &port_no, &reason))
-        {
-            p = dp_ports_lookup(dp, port_no);
-            /* FIXME:  We're throwing away the reason that came from HW */
-            process_packet(dp, p, buffer);
-        }
-    }
-#endif
-
-    // find largest MTU on our interfaces
-    // buffer is shared among all (idle) interfaces...
     LIST_FOR_EACH_SAFE(p, pn, struct sw_port, node, &dp->port_list)
     {
-        const int mtu = netdev_get_mtu(p->netdev);
-        if (IS_HW_PORT(p))
-            continue;
-        if (mtu > max_mtu)
-            max_mtu = mtu;
-    }
-
-    LIST_FOR_EACH_SAFE(p, pn, struct sw_port, node, &dp->port_list)
-    {
-        int error;
-        /* Check for interface state change */
         enum netdev_link_state link_state = netdev_link_state(p->netdev);
 
         if (link_state == NETDEV_LINK_UP)
@@ -290,7 +265,7 @@ void dp_ports_run(struct datapath *dp)
             if (p->conf->port_no != OFPP_LOCAL)
             {
                 enable_valid_amacs_UAH(&table_AMAC, p->conf->port_no); //Se reactivan las amacs válidas si estaban desactivadas
-                visualizar_tabla_AMAC(&table_AMAC, dp->id);
+                amaru_log_table(&table_AMAC, dp->id);
             }
             /*+++FIN+++*/
         }
@@ -317,9 +292,9 @@ void dp_ports_run(struct datapath *dp)
             }
 
             disable_invalid_amacs_UAH(&table_AMAC, p->conf->port_no); //Se desactivan las AMACs asociadas al puerto que se ha caído.
-            visualizar_tabla_AMAC(&table_AMAC, dp->id);
+            amaru_log_table(&table_AMAC, dp->id);
 
-            if (!strcmp(p->conf->name, dp->local_port->conf->name) && (dp->id != 1))
+            if (dp->local_port != NULL && !strcmp(p->conf->name, dp->local_port->conf->name) && (dp->id != 1))
             {
                 struct in_addr ip_if;
                 uint32_t old_local_port;
@@ -332,6 +307,177 @@ void dp_ports_run(struct datapath *dp)
             }
             /*+++FIN+++*/
         }
+    }
+}
+
+void dp_ports_run(struct datapath *dp)
+{
+    // static, so unused buffers can be reused at the dp_ports_run call
+    static struct ofpbuf *buffers[NETDEV_MAX_BATCH];
+    static unsigned int last_change_seq;
+    unsigned int change_seq;
+
+    struct sw_port *p;
+
+#if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
+    { /* Process packets received from callback thread */
+        struct ofpbuf *buffer;
+        of_port_t port_no;
+        int reason;
+        struct sw_port *p;
+
+        while (dequeue_pkt(dp, &buffer, &port_no, &reason))
+        {
+            p = dp_ports_lookup(dp, port_no);
+            /* FIXME:  We're throwing away the reason that came from HW */
+            process_packet(dp, p, buffer);
+        }
+    }
+#endif
+
+    /* Port state and MTUs only need a look when the kernel reported a
+     * change, or a port was added or removed. */
+    netdev_run();
+    change_seq = netdev_change_seq();
+    if (change_seq != last_change_seq)
+    {
+        last_change_seq = change_seq;
+        dp_workers_block(dp);
+        dp_ports_update_links(dp);
+
+        // find largest MTU on our interfaces
+        // buffer is shared among all (idle) interfaces...
+        max_mtu = 0;
+        LIST_FOR_EACH(p, struct sw_port, node, &dp->port_list)
+        {
+            const int mtu = netdev_get_mtu(p->netdev);
+            if (IS_HW_PORT(p))
+                continue;
+            if (mtu > max_mtu)
+                max_mtu = mtu;
+        }
+        dp_workers_unblock(dp);
+    }
+
+    if (dp->workers == NULL)
+    {
+        dp_ports_run_worker(dp, buffers, 0, 1);
+    }
+}
+
+/* Receives packets from receive socket 'member' of port 'p' into 'buffers'
+ * (NETDEV_MAX_BATCH long), and runs them through the pipeline. */
+static void
+port_recv(struct datapath *dp, struct sw_port *p, int member,
+          struct ofpbuf **buffers)
+{
+    struct ofpbuf *ring_buffers[NETDEV_MAX_BATCH];
+    struct packet *pkts[NETDEV_MAX_BATCH];
+    struct sw_port_rx_stats *rx_stats = &p->rx_stats[member];
+    struct ofpbuf **received;
+    size_t n_received, n_pkts, i;
+    int error;
+
+    if (netdev_has_rx_ring(p->netdev))
+    {
+        /* Packets are processed in place, in the port's receive ring. */
+        received = ring_buffers;
+        for (i = 0; i < dp->rx_burst; i++)
+        {
+            ring_buffers[i] = packet_buffer_header();
+        }
+        error = netdev_recv_ring(p->netdev, received, dp->rx_burst,
+                                 &n_received);
+        for (i = n_received; i < dp->rx_burst; i++)
+        {
+            packet_buffer_delete(ring_buffers[i]);
+        }
+    }
+    else
+    {
+        received = buffers;
+        for (i = 0; i < dp->rx_burst; i++)
+        {
+            /* Drop buffers left over from a run with a smaller MTU. */
+            if (buffers[i] != NULL &&
+                ofpbuf_tailroom(buffers[i]) < VLAN_ETH_HEADER_LEN + max_mtu)
+            {
+                ofpbuf_delete(buffers[i]);
+                buffers[i] = NULL;
+            }
+            if (buffers[i] == NULL)
+            {
+                /* Allocate buffer with some headroom to add headers in
+                 * forwarding to the controller or adding a vlan tag, plus
+                 * an extra 2 bytes to allow IP headers to be aligned on a
+                 * 4-byte boundary.  */
+                const int headroom = 128 + 2;
+                buffers[i] = packet_buffer_new(VLAN_ETH_HEADER_LEN + max_mtu, headroom);
+            }
+        }
+        error = netdev_fanout_recv_batch(p->netdev, member, buffers,
+                                         dp->rx_burst,
+                                         VLAN_ETH_HEADER_LEN + max_mtu,
+                                         &n_received);
+    }
+    n_pkts = 0;
+    for (i = 0; i < n_received; i++)
+    {
+        struct ofpbuf *buffer = received[i];
+
+        received[i] = NULL;
+        rx_stats->packets++;
+        rx_stats->bytes += buffer->size;
+        // process_buffer takes ownership of ofpbuf buffer
+        pkts[n_pkts] = process_buffer(dp, p, buffer);
+        if (pkts[n_pkts] != NULL)
+        {
+            n_pkts++;
+        }
+    }
+    pipeline_process_batch(dp->pipeline, pkts, n_pkts);
+    if (n_received > 0)
+    {
+        /*Modificaciones Boby UAH*/
+        /*Se comprueba si se ha recibido paquetes en la interfaz configurada como puerto local para poder dar por finalizada la configuración del puerto local*/
+        if (dp->local_port != NULL && !strcmp(p->conf->name, dp->local_port->conf->name))
+        {
+
+            if (netdev_is_link_up(dp->local_port->netdev) && !local_port_ok)
+            {
+                VLOG_WARN(LOG_MODULE, "[DP PORTS RUN]: El nuevo puerto local >> %s << está operativo.", dp->local_port->conf->name);
+                // VLOG_WARN(LOG_MODULE, "[DP PORTS RUN]: IS_NET_IF_RUNNING: %d\tNETDEV_LINK_STATE = %d", is_net_interface_running_UAH(dp->local_port->conf->name), link_state);
+
+                local_port_ok = true; //Si se ha recibido paquetes a través de la interfac configurada como nuevo puerto local
+                                      //se considera que ha finalizado la cofniguración del nuevo puerto local
+            }
+        }
+        /*+++FIN+++*/
+    }
+    else if (error != EAGAIN)
+    {
+        VLOG_ERR_RL(LOG_MODULE, &rl, "error receiving data from %s: %s",
+                    netdev_get_name(p->netdev), strerror(error));
+    }
+}
+
+/* Returns true if receive socket 'member' of port 'p' is served by worker
+ * 'idx' of 'n_workers'.  The sockets of a port go to consecutive workers. */
+static bool
+port_member_is_served_by(const struct sw_port *p, int member,
+                         size_t idx, size_t n_workers)
+{
+    return (p->conf->port_no + member) % n_workers == idx;
+}
+
+void dp_ports_run_worker(struct datapath *dp, struct ofpbuf **buffers,
+                         size_t idx, size_t n_workers)
+{
+    struct sw_port *p, *pn;
+
+    LIST_FOR_EACH_SAFE(p, pn, struct sw_port, node, &dp->port_list)
+    {
+        int member;
 
         if (IS_HW_PORT(p))
         {
@@ -344,44 +490,135 @@ void dp_ports_run(struct datapath *dp)
         }
 
         //+++FIN+++//
-        if (buffer == NULL)
+        for (member = 0; member < netdev_n_fanout(p->netdev); member++)
         {
-            /* Allocate buffer with some headroom to add headers in forwarding
-             * to the controller or adding a vlan tag, plus an extra 2 bytes to
-             * allow IP headers to be aligned on a 4-byte boundary.  */
-            const int headroom = 128 + 2;
-            buffer = ofpbuf_new_with_headroom(VLAN_ETH_HEADER_LEN + max_mtu, headroom);
+            if (port_member_is_served_by(p, member, idx, n_workers))
+            {
+                port_recv(dp, p, member, buffers);
+            }
         }
-        error = netdev_recv(p->netdev, buffer, VLAN_ETH_HEADER_LEN + max_mtu);
-        if (!error)
+    }
+}
+
+void dp_ports_wait_worker(struct datapath *dp, size_t idx, size_t n_workers)
+{
+    struct sw_port *p;
+
+    LIST_FOR_EACH(p, struct sw_port, node, &dp->port_list)
+    {
+        int member;
+
+        if (IS_HW_PORT(p) || p->conf->port_no == OFPP_LOCAL)
         {
-            p->stats->rx_packets++;
-            p->stats->rx_bytes += buffer->size;
-            // process_buffer takes ownership of ofpbuf buffer
-            process_buffer(dp, p, buffer);
-            buffer = NULL;
+            continue;
+        }
+        for (member = 0; member < netdev_n_fanout(p->netdev); member++)
+        {
+            if (port_member_is_served_by(p, member, idx, n_workers))
+            {
+                netdev_fanout_recv_wait(p->netdev, member);
+            }
+        }
+    }
+}
 
-            /*Modificaciones Boby UAH*/
-            /*Se comprueba si se ha recibido paquetes en la interfaz configurada como puerto local para poder dar por finalizada la configuración del puerto local*/
-            if (dp->local_port != NULL && !strcmp(p->conf->name, dp->local_port->conf->name))
+/* With worker threads, any of them may transmit on any port. */
+static void
+port_tx_lock(struct sw_port *p)
+{
+    if (p->dp->workers != NULL)
+    {
+        pthread_mutex_lock(&p->tx_mutex);
+    }
+}
+
+static void
+port_tx_unlock(struct sw_port *p)
+{
+    if (p->dp->workers != NULL)
+    {
+        pthread_mutex_unlock(&p->tx_mutex);
+    }
+}
+
+/* Accounts for the packets tx_buffers[start] through tx_buffers[end - 1] of
+ * port 'p', which were sent if 'sent' is true, and dropped otherwise. */
+static void
+port_tx_count(struct sw_port *p, size_t start, size_t end, bool sent)
+{
+    size_t i;
+
+    for (i = start; i < end; i++)
+    {
+        struct sw_queue *q = p->tx_queues[i];
+        size_t size = p->tx_buffers[i]->size;
+
+        if (sent)
+        {
+            p->stats->tx_packets++;
+            p->stats->tx_bytes += size;
+            if (q != NULL)
             {
+                q->stats->tx_packets++;
+                q->stats->tx_bytes += size;
+            }
+        }
+        else
+        {
+            p->stats->tx_dropped++;
+        }
+    }
+}
 
-                link_state = netdev_link_state(dp->local_port->netdev);
-                if (link_state != NETDEV_LINK_DOWN && !local_port_ok)
-                {
-                    VLOG_WARN(LOG_MODULE, "[DP PORTS RUN]: El nuevo puerto local >> %s << está operativo.", dp->local_port->conf->name);
-                    // VLOG_WARN(LOG_MODULE, "[DP PORTS RUN]: IS_NET_IF_RUNNING: %d\tNETDEV_LINK_STATE = %d", is_net_interface_running_UAH(dp->local_port->conf->name), link_state);
+/* Sends the packets queued on port 'p', with one netdev_send_batch() for each
+ * run of packets that go to the same queue. */
+static void
+port_tx_flush(struct sw_port *p)
+{
+    size_t start, end;
 
-                    local_port_ok = true; //Si se ha recibido paquetes a través de la interfac configurada como nuevo puerto local
-                                          //se considera que ha finalizado la cofniguración del nuevo puerto local
-                }
+    for (start = 0; start < p->n_tx; start = end)
+    {
+        struct sw_queue *q = p->tx_queues[start];
+        uint16_t class_id = q != NULL ? q->class_id : 0;
+
+        end = start + 1;
+        while (end < p->n_tx && p->tx_queues[end] == q)
+        {
+            end++;
+        }
+
+        while (start < end)
+        {
+            size_t n_sent;
+            int error;
+
+            error = netdev_send_batch(p->netdev, &p->tx_buffers[start],
+                                      end - start, class_id, &n_sent);
+            port_tx_count(p, start, start + n_sent, true);
+            start += n_sent;
+            if (error)
+            {
+                port_tx_count(p, start, start + 1, false);
+                start++;
             }
-            /*+++FIN+++*/
         }
-        else if (error != EAGAIN)
+    }
+    p->n_tx = 0;
+}
+
+void dp_ports_flush(struct datapath *dp)
+{
+    struct sw_port *p;
+
+    LIST_FOR_EACH(p, struct sw_port, node, &dp->port_list)
+    {
+        if (!IS_HW_PORT(p))
         {
-            VLOG_ERR_RL(LOG_MODULE, &rl, "error receiving data from %s: %s",
-                        netdev_get_name(p->netdev), strerror(error));
+            port_tx_lock(p);
+            port_tx_flush(p);
+            netdev_send_flush(p->netdev);
+            port_tx_unlock(p);
         }
     }
 }
@@ -534,6 +771,22 @@ new_port(struct datapath *dp, struct sw_port *port, uint32_t port_no,
         }
     }
 
+    /* On failure the port falls back to the next option, and at last keeps
+     * using plain socket I/O. */
+    if (!svec_contains(&dp->xdp_ports, netdev_name) ||
+        netdev_enable_xdp(netdev))
+    {
+        if (svec_contains(&dp->mmap_ports, netdev_name))
+        {
+            netdev_enable_rings(netdev);
+        }
+    }
+    if (!netdev_has_rx_ring(netdev) && dp->n_workers > 1 &&
+        svec_contains(&dp->fanout_ports, netdev_name))
+    {
+        netdev_enable_fanout(netdev, dp->n_workers);
+    }
+
     /* NOTE: port struct is already allocated in struct dp */
     memset(port, '\0', sizeof *port);
 
@@ -606,8 +859,10 @@ new_port(struct datapath *dp, struct sw_port *port, uint32_t port_no,
     port->stats->collisions = 0;
     port->stats->duration_sec = 0;
     port->stats->duration_nsec = 0;
+    port->rx_stats = xcalloc(netdev_n_fanout(netdev), sizeof *port->rx_stats);
     port->flags |= SWP_USED;
     port->netdev = netdev;
+    pthread_mutex_init(&port->tx_mutex, NULL);
     port->max_queues = max_queues;
     port->num_queues = 0;
     port->created = now;
@@ -782,8 +1037,9 @@ dp_ports_lookup_queue(struct sw_port *p, uint32_t queue_id)
     return NULL;
 }
 
-void dp_ports_output(struct datapath *dp, struct ofpbuf *buffer, uint32_t out_port,
-                     uint32_t queue_id)
+static void
+port_output(struct datapath *dp, struct ofpbuf *buffer, uint32_t out_port,
+            uint32_t queue_id, bool in_place)
 {
     uint16_t class_id;
     struct sw_queue *q;
@@ -843,20 +1099,45 @@ void dp_ports_output(struct datapath *dp, struct ofpbuf *buffer, uint32_t out_po
                 }
             }
 
-            if (!netdev_send(p->netdev, buffer, class_id))
+            port_tx_lock(p);
+            if (netdev_has_tx_ring(p->netdev, class_id))
             {
-                p->stats->tx_packets++;
-                p->stats->tx_bytes += buffer->size;
-                if (q != NULL)
+                /* The ring already collects the packets until
+                 * dp_ports_flush(). */
+                int retval = (in_place
+                              ? netdev_send_in_place(p->netdev, buffer, class_id)
+                              : netdev_send(p->netdev, buffer, class_id));
+
+                if (!retval)
                 {
-                    q->stats->tx_packets++;
-                    q->stats->tx_bytes += buffer->size;
+                    p->stats->tx_packets++;
+                    p->stats->tx_bytes += buffer->size;
+                }
+                else
+                {
+                    p->stats->tx_dropped++;
                 }
             }
             else
             {
-                p->stats->tx_dropped++;
+                /* The packet is destroyed after its output, so a copy is
+                 * queued. */
+                struct ofpbuf *copy;
+
+                if (p->n_tx == DP_TX_BATCH)
+                {
+                    port_tx_flush(p);
+                }
+                copy = p->tx_buffers[p->n_tx];
+                if (copy == NULL)
+                {
+                    copy = p->tx_buffers[p->n_tx] = ofpbuf_new(buffer->size);
+                }
+                ofpbuf_clear(copy);
+                ofpbuf_put(copy, buffer->data, buffer->size);
+                p->tx_queues[p->n_tx++] = q;
             }
+            port_tx_unlock(p);
         }
         /* NOTE: no need to delete buffer, it is deleted along with the packet in caller. */
         return;
@@ -868,6 +1149,18 @@ error:
                 queue_id);
 }
 
+void dp_ports_output(struct datapath *dp, struct ofpbuf *buffer, uint32_t out_port,
+                     uint32_t queue_id)
+{
+    port_output(dp, buffer, out_port, queue_id, false);
+}
+
+void dp_ports_output_in_place(struct datapath *dp, struct ofpbuf *buffer,
+                              uint32_t out_port, uint32_t queue_id)
+{
+    port_output(dp, buffer, out_port, queue_id, true);
+}
+
 int dp_ports_output_all(struct datapath *dp, struct ofpbuf *buffer, int in_port, bool flood)
 {
     struct sw_port *p;
@@ -936,6 +1229,15 @@ dp_ports_handle_port_mod(struct datapath *dp, struct ofl_msg_port_mod *msg,
 static void
 dp_port_stats_update(struct sw_port *port)
 {
+    int i;
+
+    port->stats->rx_packets = 0;
+    port->stats->rx_bytes = 0;
+    for (i = 0; i < netdev_n_fanout(port->netdev); i++)
+    {
+        port->stats->rx_packets += port->rx_stats[i].packets;
+        port->stats->rx_bytes += port->rx_stats[i].bytes;
+    }
     port->stats->duration_sec = (time_msec() - port->created) / 1000;
     port->stats->duration_nsec = ((time_msec() - port->created) % 1000) * 1000000;
 }
@@ -1401,85 +1703,173 @@ dp_ports_handle_queue_delete(struct datapath *dp, struct ofl_exp_openflow_msg_qu
 /*Modificacion UAH*/
 void AMAC_table_new(struct table_AMACS *table_AMACS)
 {
-    table_AMACS->inicio = NULL;
-    table_AMACS->fin = NULL;
+    list_init(&table_AMACS->amacs);
+    hmap_init(&table_AMACS->ports);
+    hmap_init(&table_AMACS->trie);
+    table_AMACS->root.parent = NULL;
+    table_AMACS->root.byte = 0;
+    table_AMACS->root.n_children = 0;
+    table_AMACS->root.n_amacs = 0;
     table_AMACS->num_element = 0;
 }
 
-int table_AMACS_add_AMAC(struct table_AMACS *table_AMACS, uint8_t AMAC[AMAC_LEN], uint8_t level, uint32_t in_port, int time)
+/* Returns the number of leading bytes of an AMAC of 'level' that a new AMAC
+ * must not share with it. */
+static int
+amac_prefix_len(uint8_t level)
 {
+    int len = (max_len_dir == 0 ? level : (max_len_dir < level ? max_len_dir : level)); /*Modificación Boby*/
+    return len < AMAC_LEN ? len : AMAC_LEN;
+}
 
-    /*Modificaciones Boby UAH*/
-    struct reg_AMAC *nuevo_elemento = NULL;
-    if ((nuevo_elemento = xmalloc(sizeof(struct reg_AMAC))) == NULL)
+static uint32_t
+amac_node_hash(const struct amac_node *parent, uint8_t byte)
+{
+    return hash_int(byte, hash_pointer(parent, 0));
+}
+
+static struct amac_node *
+amac_node_child(const struct table_AMACS *table_AMACS,
+                const struct amac_node *parent, uint8_t byte)
+{
+    struct amac_node *node;
+
+    HMAP_FOR_EACH_WITH_HASH(node, struct amac_node, hmap_node,
+                            amac_node_hash(parent, byte), &table_AMACS->trie)
     {
-        return -1;
+        if (node->parent == parent && node->byte == byte)
+        {
+            return node;
+        }
     }
-    nuevo_elemento->port_in = in_port;
-    nuevo_elemento->time_entry = time_msec() + (time * 1000);
-    memcpy(nuevo_elemento->AMAC, AMAC, AMAC_LEN);
-    nuevo_elemento->level = level;
-    nuevo_elemento->next = NULL;
-    nuevo_elemento->active = true;
-    if (table_AMACS->num_element == 0)
+    return NULL;
+}
+
+/* Adds the first 'len' bytes of 'AMAC' to the trie, and returns their node. */
+static struct amac_node *
+amac_trie_insert(struct table_AMACS *table_AMACS, const uint8_t AMAC[AMAC_LEN],
+                 int len)
+{
+    struct amac_node *node = &table_AMACS->root;
+    int i;
+
+    for (i = 0; i < len; i++)
     {
-        table_AMACS->inicio = nuevo_elemento;
-        table_AMACS->fin = nuevo_elemento;
+        struct amac_node *child = amac_node_child(table_AMACS, node, AMAC[i]);
+        if (child == NULL)
+        {
+            child = xmalloc(sizeof *child);
+            child->parent = node;
+            child->byte = AMAC[i];
+            child->n_children = 0;
+            child->n_amacs = 0;
+            hmap_insert(&table_AMACS->trie, &child->hmap_node,
+                        amac_node_hash(node, AMAC[i]));
+            node->n_children++;
+        }
+        node = child;
     }
-    else
+    node->n_amacs++;
+    return node;
+}
+
+/* Removes an AMAC from trie node 'node', and the nodes left unused. */
+static void
+amac_trie_remove(struct table_AMACS *table_AMACS, struct amac_node *node)
+{
+    node->n_amacs--;
+    while (node != &table_AMACS->root && !node->n_amacs && !node->n_children)
     {
-        table_AMACS->fin->next = nuevo_elemento; /*Colocamos la nueva AMAC al final de la tabla*/
-        table_AMACS->fin = nuevo_elemento;
-    }
-    table_AMACS->num_element++;
+        struct amac_node *parent = node->parent;
 
-    return 0;
+        hmap_remove(&table_AMACS->trie, &node->hmap_node);
+        parent->n_children--;
+        free(node);
+        node = parent;
+    }
+}
 
-    /*+++FIN+++*/
-    // struct reg_AMAC *nuevo_elemento = NULL, *actual = table_AMACS->inicio;
+/* Returns the length of the validation prefix of an AMAC of the table that
+ * 'AMAC' starts with, or -1 if there is none. */
+static int
+amac_trie_match(const struct table_AMACS *table_AMACS,
+                const uint8_t AMAC[AMAC_LEN])
+{
+    const struct amac_node *node = &table_AMACS->root;
+    int i;
 
-    // if ((nuevo_elemento = xmalloc(sizeof(struct reg_AMAC))) == NULL)
-    //     return -1;
+    for (i = 0; node != NULL; i++)
+    {
+        if (node->n_amacs)
+        {
+            return i;
+        }
+        if (i == AMAC_LEN)
+        {
+            break;
+        }
+        node = amac_node_child(table_AMACS, node, AMAC[i]);
+    }
+    return -1;
+}
 
-    // nuevo_elemento->port_in = in_port;
-    // nuevo_elemento->time_entry = time_msec() + (time * 1000);
-    // memcpy(nuevo_elemento->AMAC, AMAC, AMAC_LEN);
-    // nuevo_elemento->level = level;
+static struct amac_port *
+amac_port_lookup(const struct table_AMACS *table_AMACS, uint32_t port_no)
+{
+    struct amac_port *port;
 
-    // if (table_AMACS->num_element == 0)
-    // {
-    //     table_AMACS->fin = nuevo_elemento; //si no existen elementos el primero y el ultimo son el mismo
-    //     nuevo_elemento->next = NULL;       //si es el primero de la lista debe apuntar a null su siguiente elemento
-    // }
-    // else
-    //     //colocamos el elemento al comienzo
-    //     nuevo_elemento->next = actual;
-    // //colocamos al comienzo de la lista el elemento
-    // table_AMACS->inicio = nuevo_elemento;
-    // table_AMACS->num_element++;
-    // return 0;
+    HMAP_FOR_EACH_WITH_HASH(port, struct amac_port, hmap_node,
+                            hash_int(port_no, 0), &table_AMACS->ports)
+    {
+        if (port->port_no == port_no)
+        {
+            return port;
+        }
+    }
+    return NULL;
 }
 
-int number_AMAC_assigned_port(struct table_AMACS *table_AMACS, uint32_t in_port)
+int table_AMACS_add_AMAC(struct table_AMACS *table_AMACS, uint8_t AMAC[AMAC_LEN], uint8_t level, uint32_t in_port, int time)
 {
-    struct reg_AMAC *aux = table_AMACS->inicio;
-    int num_AMAC = 0;
+    /*Modificaciones Boby UAH*/
+    struct reg_AMAC *nuevo_elemento = xmalloc(sizeof(struct reg_AMAC));
+    struct amac_port *port = amac_port_lookup(table_AMACS, in_port);
 
-    while (aux != NULL)
-    {
-        if (aux->port_in == in_port)
-            num_AMAC++;
+    nuevo_elemento->port_in = in_port;
+    nuevo_elemento->time_entry = time_msec() + (time * 1000);
+    memcpy(nuevo_elemento->AMAC, AMAC, AMAC_LEN);
+    nuevo_elemento->level = level;
+    nuevo_elemento->active = true;
+    /*Colocamos la nueva AMAC al final de la tabla*/
+    list_push_back(&table_AMACS->amacs, &nuevo_elemento->node);
 
-        //actual pasa a ser el siguiente
-        aux = aux->next;
+    if (port == NULL)
+    {
+        port = xmalloc(sizeof *port);
+        port->port_no = in_port;
+        list_init(&port->amacs);
+        port->n_amacs = 0;
+        hmap_insert(&table_AMACS->ports, &port->hmap_node, hash_int(in_port, 0));
     }
-    return num_AMAC;
+    list_push_back(&port->amacs, &nuevo_elemento->port_node);
+    port->n_amacs++;
+
+    nuevo_elemento->prefix = amac_trie_insert(table_AMACS, AMAC,
+                                              amac_prefix_len(level));
+    table_AMACS->num_element++;
+
+    return 0;
+}
+
+int number_AMAC_assigned_port(struct table_AMACS *table_AMACS, uint32_t in_port)
+{
+    struct amac_port *port = amac_port_lookup(table_AMACS, in_port);
+    return port != NULL ? port->n_amacs : 0;
 }
 
 int validate_AMAC_in_switch(struct table_AMACS *table_AMACS, uint8_t AMAC[AMAC_LEN], uint32_t in_port)
 {
-    struct reg_AMAC *aux = table_AMACS->inicio;
-    int length_cmp;
+    int match_len;
 
     //1º we need to check the max_dir_switch parameter
     if (table_AMACS->num_element >= max_dir_switch && max_dir_switch != 0)
@@ -1487,24 +1877,14 @@ int validate_AMAC_in_switch(struct table_AMACS *table_AMACS, uint8_t AMAC[AMAC_L
     //2 we need to check the max_dir_port parameter
     else if (number_AMAC_assigned_port(table_AMACS, in_port) >= max_dir_port && max_dir_port != 0)
         return 0; //we don't save more AMACS
-    //3 we need to check the AMAC
-    while (aux != NULL)
+    //3 we need to check the AMAC: it must not start with the validation
+    //prefix of any AMAC of the table
+    match_len = amac_trie_match(table_AMACS, AMAC);
+    if (match_len >= 0)
     {
-        //we add 1 on the level because we need compare the length of AMACS and the minimun is 1 when the minimun of level is 0
-        // length_cmp = (max_len_dir == 0 ? (aux->level + 1) : (max_len_dir < (aux->level + 1) ? max_len_dir : (aux->level + 1)));
-        length_cmp = (max_len_dir == 0 ? (aux->level) : (max_len_dir < (aux->level) ? max_len_dir : (aux->level))); /*Modificación Boby*/
-        /*Modificaciones Boby UAH*/
-        if ((aux->level + 1) == 4)
-        {
-            VLOG_WARN(LOG_MODULE, "[VALIDATE AMAC IN SWITCH]: Level AMAC: %d\t Length_cmp: %d", aux->level + 1, length_cmp);
-        }
-
-        /*+++FIN+++*/
-        if (memcmp(aux->AMAC, AMAC, length_cmp) == 0)
-            return 0; //tenemos una coincidencia
-
-        //actual pasa a ser el siguiente
-        aux = aux->next;
+        TRACE(LOG_MODULE, "amac_match", "in_port %"PRIu64" prefix_len %"PRIu64,
+              in_port, match_len);
+        return 0; //tenemos una coincidencia
     }
     return 1;
 }
@@ -1535,9 +1915,11 @@ int dp_ports_output_amaru(struct datapath *dp, struct ofpbuf *buffer UNUSED, uin
         // if (pkt->handle_std->proto->eth->eth_type == ETH_TYPE_AMARU) //Este if yo creo que sobra y debería ejecutarse ya que esta función se invoca cuando se recibe un paquete amaru
         // {
         packet_clone = packet_Amaru(dp, (uint32_t)in_port, false, (pkt->handle_std->proto->amaru->level + 1), p->conf->port_no, pkt->handle_std->proto->amaru->amac);
-        VLOG_INFO(LOG_MODULE, "Paquete creado: %s\n", packet_to_string(packet_clone));
+        TRACE(LOG_MODULE, "amaru_output", "in_port %"PRIu64" out_port %"PRIu64
+              " level %"PRIu64, in_port, p->conf->port_no,
+              pkt->handle_std->proto->amaru->level + 1);
         dp_ports_output(dp, packet_clone->buffer, p->conf->port_no, 0); //salgo por todos los puertos sin distincion
-        log_uah_num_pkt();
+        amaru_log_sent(dp->id);
         packet_destroy(packet_clone); //limpiamos la memoria reservada para el nuevo paquete
         // }
     }
@@ -1556,7 +1938,7 @@ int dp_ports_output_amaru(struct datapath *dp, struct ofpbuf *buffer UNUSED, uin
     //         packet_clone = packet_Amaru(dp, (uint32_t)in_port, 1, (pkt->handle_std->proto->amaru->level + 1), port, pkt->handle_std->proto->amaru->amac);
     //         VLOG_INFO(LOG_MODULE, "Paquete creado: %s\n", packet_to_string(packet_clone));
     //         dp_ports_output(dp, packet_clone->buffer, port, 0); //salgo por todos los puertos sin distincion
-    //         log_uah_num_pkt();
+    //         amaru_log_sent(dp->id);
     //         packet_destroy(packet_clone); //limpiamos la memoria reservada para el nuevo paquete
     //     }
     //     else
@@ -1565,128 +1947,13 @@ int dp_ports_output_amaru(struct datapath *dp, struct ofpbuf *buffer UNUSED, uin
     return 0;
 }
 
-void visualizar_tabla_AMAC(struct table_AMACS *table_AMACS, int64_t id_datapath)
-{
-    char mac_tabla[4000], AMAC_view[40] = {0};
-    struct reg_AMAC *aux = table_AMACS->inicio;
-    int i = 1, j = 0;
-
-    // log_uah("\npos|		AMAC 			| level | Puerto \n", id_datapath);
-    log_uah("\nPos|		AMAC 			| Level | Puerto | Activa\n", id_datapath); /*Modificación Boby UAH*/
-    log_uah("----------------------------------------------------------\n", id_datapath);
-    while (aux != NULL)
-    {
-        sprintf(mac_tabla, "%d|", i);
-        //pasamos mac a que sea legible
-        sprintf(AMAC_view, "%x:", aux->AMAC[0]);
-        for (j = 1; j < AMAC_LEN; j++)
-        {
-            if (aux->AMAC[j])
-                sprintf(AMAC_view + strlen(AMAC_view), "%x", aux->AMAC[j]);
-            if (j != AMAC_LEN - 1)
-                sprintf(AMAC_view + strlen(AMAC_view), ":");
-        }
-        sprintf(mac_tabla + strlen(mac_tabla), "%s|", AMAC_view);
-        //pasamos puerto para ser legible
-        // sprintf(mac_tabla + strlen(mac_tabla), "%d|", (aux->level + 1));
-        sprintf(mac_tabla + strlen(mac_tabla), "%d|", (aux->level)); /*Modificacion BOby UAH*/
-        //pasamos puerto para ser legible
-        sprintf(mac_tabla + strlen(mac_tabla), "%d|", aux->port_in);
-        //Pasamos el estado de la entrada
-        sprintf(mac_tabla + strlen(mac_tabla), "%d|\n", aux->active);
-        //visualizamos linea
-        log_uah(mac_tabla, id_datapath);
-        //pass next
-        i++;
-        aux = aux->next;
-    }
-    log_uah("\n", id_datapath);
-}
-
-void visualizar_mac(uint8_t AMAC[AMAC_LEN], int64_t id)
-{
-    char mac_tabla[40];
-    int j = 0;
-
-    //pasamos mac a que sea legible
-    VLOG_INFO(LOG_MODULE, "Traza UAH -> mac_tabla: %s\n", mac_tabla);
-    sprintf(mac_tabla, "%x:", AMAC[0]);
-    for (j = 1; j < AMAC_LEN; j++)
-    {
-        if (AMAC[j])
-            sprintf(mac_tabla + strlen(mac_tabla), "%x", AMAC[j]);
-        if (j != AMAC_LEN - 1)
-            sprintf(mac_tabla + strlen(mac_tabla), ":");
-        VLOG_INFO(LOG_MODULE, "Traza UAH -> mac_tabla: %s\n", mac_tabla);
-    }
-    sprintf(mac_tabla + strlen(mac_tabla), "\n");
-    VLOG_INFO(LOG_MODULE, "Traza UAH -> mac_tabla: %s\n", mac_tabla);
-    log_uah(mac_tabla, id);
-}
-
-void log_uah(const void *Mensaje, int64_t id)
-{
-
-    FILE *file;
-    char nombre[90], nombre2[90];
-
-    VLOG_INFO(LOG_MODULE, "Traza UAH -> Entro a Crear Log");
-    // sprintf(nombre, "/home/arppath/mininet/custom/pruebas_boby/logs/Amaru_switch_%d.log", (int)id); //Logs server7
-    sprintf(nombre, "/home/boby/logs/Amaru_switch_%d.log", (int)id);
-
-    file = fopen(nombre, "a");
-    if (file != NULL)
-    {
-        fseek(file, 0L, SEEK_END);
-        if (ftell(file) > 1600)
-        {
-            fclose(file);
-            // sprintf(nombre2, "/home/arppath/mininet/custom/pruebas_boby/logs/Amaru_switch_%d-%lu.log", (int)id, (long)time_msec()); //Logs server7
-            sprintf(nombre2, "/home/boby/logs/Amaru_switch_%d-%lu.log", (int)id, (long)time_msec());
-            rename(nombre, nombre2);
-        }
-        file = fopen(nombre, "a");
-        fputs(Mensaje, file);
-        fclose(file);
-    }
-    else
-        VLOG_INFO(LOG_MODULE, "Traza UAH -> Archivo no abierto");
-}
-
-void log_uah_num_pkt(void)
-{
-
-    FILE *file;
-    char nombre[90], nombre2[90];
-
-    VLOG_INFO(LOG_MODULE, "Traza UAH -> Entro a Crear Log");
-    // sprintf(nombre, "/home/arppath/mininet/custom/pruebas_boby/logs/Num_Pkt_Amaru.log"); //Logs server7
-    sprintf(nombre, "/home/boby/logs/Num_Pkt_Amaru.log");
-
-    file = fopen(nombre, "a");
-    if (file != NULL)
-    {
-        fseek(file, 0L, SEEK_END);
-        if (ftell(file) > 500000)
-        {
-            fclose(file);
-            // sprintf(nombre2, "/home/arppath/mininet/custom/pruebas_boby/logs/Num_Pkt_Amaru-%lu.log", (long)time_msec()); //Logs server7
-            sprintf(nombre2, "/home/boby/logs/Num_Pkt_Amaru-%lu.log", (long)time_msec());
-            rename(nombre, nombre2);
-        }
-        file = fopen(nombre, "a");
-        fputs("Paquete correctamente enviado\n", file);
-        fclose(file);
-    }
-    else
-        VLOG_INFO(LOG_MODULE, "Traza UAH -> Archivo no abierto");
-}
 /*FIN MODIFICACION UAH*/
 
 /*Modificacion Boby UAH*/
 struct in_addr remove_local_port_UAH(struct datapath *dp)
 {
     int error;
+    size_t i;
     struct in_addr ip_0 = {INADDR_ANY}, ip_if;                                //Para poner a 0 la ip de la interfaz a eliminar
     netdev_get_in4(dp->local_port->netdev, &ip_if);                           //Se obtiene la ip de la interfaz
     netdev_set_in4(dp->local_port->netdev, ip_0, ip_0);                       //Se configura la ip a 0
@@ -1701,6 +1968,11 @@ struct in_addr remove_local_port_UAH(struct datapath *dp)
 
     free(dp->local_port->conf);
     free(dp->local_port->stats);
+    free(dp->local_port->rx_stats);
+    for (i = 0; i < DP_TX_BATCH; i++)
+    {
+        ofpbuf_delete(dp->local_port->tx_buffers[i]);
+    }
     free(dp->local_port); //Se libera la memoria del peurto local
     dp->ports_num--;      //Se decrementa el número de puertos
     dp->local_port = NULL;
@@ -1709,64 +1981,52 @@ struct in_addr remove_local_port_UAH(struct datapath *dp)
 }
 int disable_invalid_amacs_UAH(struct table_AMACS *table_AMACS, uint32_t down_port)
 {
-    struct reg_AMAC *aux_AMAC = table_AMACS->inicio;
-    while (aux_AMAC != NULL)
+    struct amac_port *port = amac_port_lookup(table_AMACS, down_port);
+    struct reg_AMAC *aux_AMAC;
+
+    if (port != NULL)
     {
-        if (aux_AMAC->port_in == down_port && aux_AMAC->active == true)
+        LIST_FOR_EACH(aux_AMAC, struct reg_AMAC, port_node, &port->amacs)
         {
             aux_AMAC->active = false;
         }
-
-        aux_AMAC = aux_AMAC->next;
     }
     return 0;
 }
 
 int enable_valid_amacs_UAH(struct table_AMACS *table_AMACS, uint32_t up_port)
 {
-    struct reg_AMAC *aux_AMAC = table_AMACS->inicio;
-    while (aux_AMAC != NULL)
+    struct amac_port *port = amac_port_lookup(table_AMACS, up_port);
+    struct reg_AMAC *aux_AMAC;
+
+    if (port != NULL)
     {
-        if (aux_AMAC->port_in == up_port && aux_AMAC->active == false)
+        LIST_FOR_EACH(aux_AMAC, struct reg_AMAC, port_node, &port->amacs)
         {
             aux_AMAC->active = true;
         }
-
-        aux_AMAC = aux_AMAC->next;
     }
     return 0;
 }
 
 int remove_invalid_amacs_UAH(struct table_AMACS *table_AMACS, uint32_t down_port)
 {
-    struct reg_AMAC *aux_AMAC = table_AMACS->inicio, *prev_aux_AMAC = NULL, *wrong_AMAC;
-    while (aux_AMAC->port_in == down_port && aux_AMAC != NULL)
-    {
-        wrong_AMAC = aux_AMAC;
+    struct amac_port *port = amac_port_lookup(table_AMACS, down_port);
+    struct reg_AMAC *aux_AMAC, *next_AMAC;
 
-        if (table_AMACS->inicio == table_AMACS->fin) //Comprobamos si hay una única AMAC en la tabla
-        {
-            table_AMACS->inicio = table_AMACS->fin = NULL; //No quedan AMACs en la tabla
-        }
-        else if (aux_AMAC == table_AMACS->inicio)
-        {
-            table_AMACS->inicio = aux_AMAC->next;
-        }
-        else if (aux_AMAC == table_AMACS->fin)
-        {
-            prev_aux_AMAC->next = NULL;
-            table_AMACS->fin = prev_aux_AMAC;
-        }
-        else
-        {
-            prev_aux_AMAC->next = aux_AMAC->next;
-        }
-        free(wrong_AMAC);
+    if (port == NULL)
+    {
+        return 0;
+    }
+    LIST_FOR_EACH_SAFE(aux_AMAC, next_AMAC, struct reg_AMAC, port_node, &port->amacs)
+    {
+        list_remove(&aux_AMAC->node);
+        amac_trie_remove(table_AMACS, aux_AMAC->prefix);
+        free(aux_AMAC);
         table_AMACS->num_element--; //Decrementamos el número de AMACs de la tabla
-
-        prev_aux_AMAC = aux_AMAC;
-        aux_AMAC = aux_AMAC->next;
     }
+    list_init(&port->amacs);
+    port->n_amacs = 0;
     return 0;
 }
 
@@ -1774,10 +2034,10 @@ int configure_new_local_port_amaru_UAH(struct datapath *dp, struct table_AMACS *
 {
     int error;
     struct sw_port *p;
-    struct reg_AMAC *aux = table_AMACS->inicio;
+    struct reg_AMAC *aux;
     char ip_aux[INET_ADDRSTRLEN];
     struct in_addr mask, local_ip = *ip;
-    while (aux != NULL)
+    LIST_FOR_EACH(aux, struct reg_AMAC, node, &table_AMACS->amacs)
     {
 
         if (aux->active)
@@ -1800,8 +2060,6 @@ int configure_new_local_port_amaru_UAH(struct datapath *dp, struct table_AMACS *
             send_amaru_new_localport_packet_UAH(dp, p->conf->port_no, p->conf->name, ip, &old_local_port); //Se envía al ofprotocol el nuevo puerto local
             return 0;
         }
-        //actual pasa a ser el siguiente
-        aux = aux->next;
     }
     return 1;
 }
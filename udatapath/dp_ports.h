@@ -40,6 +40,8 @@
 #ifndef DP_PORTS_H
 #define DP_PORTS_H 1
 
+#include <pthread.h>
+#include "hmap.h"
 #include "list.h"
 #include "netdev.h"
 #include "dp_exp.h"
@@ -82,6 +84,17 @@ enum sw_port_flags
 
 #define PORT_IN_USE(p) (((p) != NULL) && (p)->flags & SWP_USED)
 
+/* Maximum number of packets queued on a port for transmission; a port whose
+ * queue is full is flushed right away. */
+#define DP_TX_BATCH NETDEV_MAX_BATCH
+
+/* Receive counters of one of the receive sockets of a port. */
+struct sw_port_rx_stats
+{
+    uint64_t packets;
+    uint64_t bytes;
+};
+
 struct sw_port
 {
     struct list node; /* Element in datapath.ports. */
@@ -89,8 +102,18 @@ struct sw_port
     uint32_t flags; /* SWP_* flags above */
     struct datapath *dp;
     struct netdev *netdev;
+    pthread_mutex_t tx_mutex; /* Serializes transmission by worker threads. */
     struct ofl_port *conf;
     struct ofl_port_stats *stats;
+    /* One per receive socket of 'netdev', summed into 'stats'. */
+    struct sw_port_rx_stats *rx_stats;
+    /* Packets queued for transmission by dp_ports_output(), sent by
+     * dp_ports_flush(): copies of the packets, in buffers reused from flush
+     * to flush, and the queue each of them goes to (NULL for the default
+     * queue).  Protected by 'tx_mutex'. */
+    struct ofpbuf *tx_buffers[DP_TX_BATCH];
+    struct sw_queue *tx_queues[DP_TX_BATCH];
+    size_t n_tx;
     /* port queues */
     uint16_t max_queues;
     uint16_t num_queues;
@@ -113,25 +136,49 @@ struct hw_pkt_q_entry
 #define max_dir_port 10
 #define max_len_dir 3
 
+#define AMAC_LEN 28
+
+/* A node of the prefix trie of the AMACs of a table: the prefix spelled by the
+ * 'byte's of the nodes from the root down to it. */
+struct amac_node
+{
+    struct hmap_node hmap_node; /* In table_AMACS 'trie', by parent and byte. */
+    struct amac_node *parent;
+    uint8_t byte;
+    int n_children;
+    int n_amacs; /* AMACs whose validation prefix ends here. */
+};
+
+/* The AMACs learned on a port. */
+struct amac_port
+{
+    struct hmap_node hmap_node; /* In table_AMACS 'ports', by port_no. */
+    uint32_t port_no;
+    struct list amacs; /* struct reg_AMAC, by 'port_node'. */
+    int n_amacs;
+};
+
 //estructura que contiene todas las AMACS
 struct table_AMACS
 {
-    struct reg_AMAC *inicio;
-    struct reg_AMAC *fin;
+    struct list amacs;     /* struct reg_AMAC, in order of arrival. */
+    struct hmap ports;     /* struct amac_port. */
+    struct hmap trie;      /* struct amac_node, but 'root'. */
+    struct amac_node root; /* The empty prefix. */
     int num_element;
 };
 
 //estructura que contiene cada registro de AMACS
-#define AMAC_LEN 28
-
 struct reg_AMAC
 {
+    struct list node;         /* In table_AMACS 'amacs'. */
+    struct list port_node;    /* In amac_port 'amacs'. */
+    struct amac_node *prefix; /* Trie node of the validation prefix. */
     uint8_t level;
     uint8_t AMAC[AMAC_LEN];
     uint16_t port_in;
     uint64_t time_entry;
     bool active; /*Modificación Boby UAH*/
-    struct reg_AMAC *next;
 };
 //declaracion de table amacs
 struct table_AMACS table_AMAC;
@@ -144,6 +191,10 @@ int *Matriz_bc[16];
 #define DP_MAX_PORTS 255
 BUILD_ASSERT_DECL(DP_MAX_PORTS <= OFPP_MAX);
 
+/* Default number of packets received from a port in one dp_ports_run(). */
+#define DP_RX_BURST 32
+BUILD_ASSERT_DECL(DP_RX_BURST <= NETDEV_MAX_BATCH);
+
 /* Adds a port to the datapath. */
 int dp_ports_add(struct datapath *dp, const char *netdev);
 
@@ -153,6 +204,21 @@ int dp_ports_add_local(struct datapath *dp, const char *netdev);
 /* Receives datapath packets, and runs them through the pipeline. */
 void dp_ports_run(struct datapath *dp);
 
+/* Receives packets on the ports served by worker 'idx' of 'n_workers', into
+ * 'buffers' (NETDEV_MAX_BATCH long), and runs them through the pipeline.  Each
+ * receive socket of a port with packet fanout is served by a different
+ * worker. */
+void dp_ports_run_worker(struct datapath *dp, struct ofpbuf **buffers,
+                         size_t idx, size_t n_workers);
+
+/* Registers with the poll loop to wake up when the ports served by worker
+ * 'idx' of 'n_workers' have packets to receive. */
+void dp_ports_wait_worker(struct datapath *dp, size_t idx, size_t n_workers);
+
+/* Transmits the packets queued on the ports by dp_ports_output(), and those
+ * queued on their transmit rings. */
+void dp_ports_flush(struct datapath *dp);
+
 /* Returns the given port. */
 struct sw_port *
 dp_ports_lookup(struct datapath *, uint32_t);
@@ -165,6 +231,12 @@ dp_ports_lookup_queue(struct sw_port *, uint32_t);
 void dp_ports_output(struct datapath *dp, struct ofpbuf *buffer, uint32_t out_port,
                      uint32_t queue_id);
 
+/* Outputs a datapath packet on the port, as dp_ports_output() does, for a
+ * caller that neither reads nor modifies the data of 'buffer' afterwards, so
+ * that a packet received on an AF_XDP port is sent from where it is. */
+void dp_ports_output_in_place(struct datapath *dp, struct ofpbuf *buffer,
+                              uint32_t out_port, uint32_t queue_id);
+
 /* Outputs a datapath packet on all ports except for in_port. If flood is set,
  * packet is not sent out on ports with flooding disabled. */
 int dp_ports_output_all(struct datapath *dp, struct ofpbuf *buffer, int in_port, bool flood);
@@ -223,15 +295,7 @@ int validate_AMAC_in_switch(struct table_AMACS *table_AMACS, uint8_t AMAC[AMAC_L
 
 //flood random port
 int dp_ports_output_amaru(struct datapath *dp, struct ofpbuf *buffer, uint32_t in_port, bool random, struct packet *pkt);
-
-//logs uah
-void visualizar_mac(uint8_t AMAC[AMAC_LEN], int64_t id); //to see the amacs
-//Log total
-void log_uah(const void *Mensaje, int64_t id);
-//log table amac
-void visualizar_tabla_AMAC(struct table_AMACS *table_AMACS, int64_t id_datapath);
 //void insert_new_AMAC(struct packet *pkt, int port, uint8_t AMAC[AMAC_LEN]);
-void log_uah_num_pkt(void);
 /*Fin UAH*/
 
 /*Modificacion Boby UAH*/
@@ -0,0 +1,252 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <config.h>
+#include "dp_workers.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "datapath.h"
+#include "dp_ports.h"
+#include "flow_cache.h"
+#include "netdev.h"
+#include "ofpbuf.h"
+#include "pipeline.h"
+#include "poll-loop.h"
+#include "socket-util.h"
+#include "util.h"
+#include "vlog.h"
+
+#define LOG_MODULE VLM_dp_workers
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+/* Longest time a worker sleeps without checking its set of ports, in ms. */
+#define DP_WORKER_MAX_SLEEP 100
+
+/* A worker thread. */
+struct dp_worker {
+    struct datapath   *dp;
+    pthread_t          thread;
+    size_t             idx;         /* serves the ports with
+                                       port_no % n_workers == idx. */
+    struct ofpbuf     *buffers[NETDEV_MAX_BATCH]; /* receive buffers. */
+    struct flow_cache  cache;       /* the worker's pipeline cache. */
+    uint64_t           n_invalidations; /* of the main thread's cache, when
+                                       'cache' was last invalidated. */
+};
+
+struct dp_workers {
+    pthread_rwlock_t   rwlock;      /* held for writing by the main thread
+                                       while it changes the datapath, and
+                                       for reading by busy workers. */
+
+    pthread_mutex_t    queue_mutex; /* protects the message queue. */
+    struct ofpbuf     *queue_head;  /* messages for the main thread. */
+    struct ofpbuf     *queue_tail;
+    int                wake_fds[2]; /* pipe to wake up the main thread. */
+
+    size_t             n;
+    struct dp_worker  *workers;
+};
+
+/* The worker running in the current thread, if any. */
+static THREAD_LOCAL struct dp_worker *self;
+
+static void *
+worker_main(void *worker_) {
+    struct dp_worker *w = worker_;
+    struct datapath *dp = w->dp;
+    struct dp_workers *workers = dp->workers;
+
+    self = w;
+    for (;;) {
+        pthread_rwlock_rdlock(&workers->rwlock);
+        dp_ports_run_worker(dp, w->buffers, w->idx, workers->n);
+        dp_ports_flush(dp);
+        dp_ports_wait_worker(dp, w->idx, workers->n);
+        pthread_rwlock_unlock(&workers->rwlock);
+
+        /* Ports come and go while the worker sleeps. */
+        poll_timer_wait(DP_WORKER_MAX_SLEEP);
+        poll_block();
+    }
+    return NULL;
+}
+
+void
+dp_workers_start(struct datapath *dp) {
+    struct dp_workers *workers;
+    pthread_rwlockattr_t rwattr;
+    size_t i;
+
+    if (dp->n_workers == 0) {
+        return;
+    }
+
+    workers = xcalloc(1, sizeof *workers);
+
+    /* With the default policy, a steady flow of packets keeps the main thread
+     * out. */
+    pthread_rwlockattr_init(&rwattr);
+    pthread_rwlockattr_setkind_np(&rwattr,
+                                  PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&workers->rwlock, &rwattr);
+    pthread_rwlockattr_destroy(&rwattr);
+
+    pthread_mutex_init(&workers->queue_mutex, NULL);
+    if (pipe(workers->wake_fds)
+        || set_nonblocking(workers->wake_fds[0])
+        || set_nonblocking(workers->wake_fds[1])) {
+        ofp_fatal(errno, "could not create pipe");
+    }
+
+    workers->n = dp->n_workers;
+    workers->workers = xcalloc(workers->n, sizeof *workers->workers);
+
+    dp->workers = workers;
+    for (i = 0; i < workers->n; i++) {
+        struct dp_worker *w = &workers->workers[i];
+        int error;
+
+        w->dp = dp;
+        w->idx = i;
+        flow_cache_init(&w->cache);
+        w->n_invalidations = dp->pipeline->cache.n_invalidations;
+        error = pthread_create(&w->thread, NULL, worker_main, w);
+        if (error) {
+            ofp_fatal(error, "could not create worker thread");
+        }
+    }
+    VLOG_INFO(LOG_MODULE, "started %zu worker threads", workers->n);
+}
+
+void
+dp_workers_block(struct datapath *dp) {
+    if (dp->workers != NULL) {
+        pthread_rwlock_wrlock(&dp->workers->rwlock);
+    }
+}
+
+void
+dp_workers_unblock(struct datapath *dp) {
+    if (dp->workers != NULL) {
+        pthread_rwlock_unlock(&dp->workers->rwlock);
+    }
+}
+
+bool
+dp_workers_is_worker(void) {
+    return self != NULL;
+}
+
+struct flow_cache *
+dp_workers_flow_cache(const struct flow_cache *shared) {
+    if (self == NULL) {
+        return NULL;
+    }
+    /* The main thread only changes the pipeline while the workers are
+     * blocked, and always invalidates its own cache when it does. */
+    if (self->n_invalidations != shared->n_invalidations) {
+        self->n_invalidations = shared->n_invalidations;
+        flow_cache_invalidate(&self->cache);
+    }
+    return &self->cache;
+}
+
+void
+dp_workers_add_cache_stats(struct datapath *dp, struct flow_cache_stats *stats) {
+    size_t i;
+
+    if (dp->workers == NULL) {
+        return;
+    }
+    for (i = 0; i < dp->workers->n; i++) {
+        flow_cache_add_stats(&dp->workers->workers[i].cache, stats);
+    }
+}
+
+void
+dp_workers_defer(struct datapath *dp, struct ofpbuf *msg) {
+    struct dp_workers *workers = dp->workers;
+    bool was_empty;
+
+    msg->next = NULL;
+    pthread_mutex_lock(&workers->queue_mutex);
+    was_empty = workers->queue_head == NULL;
+    if (was_empty) {
+        workers->queue_head = msg;
+    } else {
+        workers->queue_tail->next = msg;
+    }
+    workers->queue_tail = msg;
+    pthread_mutex_unlock(&workers->queue_mutex);
+
+    if (was_empty && write(workers->wake_fds[1], "", 1) < 0
+        && errno != EAGAIN) {
+        VLOG_WARN_RL(LOG_MODULE, &rl, "could not wake up main thread: %s",
+                     strerror(errno));
+    }
+}
+
+struct ofpbuf *
+dp_workers_deferred(struct datapath *dp) {
+    struct dp_workers *workers = dp->workers;
+    struct ofpbuf *msg;
+
+    if (workers == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&workers->queue_mutex);
+    msg = workers->queue_head;
+    if (msg != NULL) {
+        workers->queue_head = msg->next;
+        msg->next = NULL;
+    } else {
+        char buf[64];
+
+        workers->queue_tail = NULL;
+        while (read(workers->wake_fds[0], buf, sizeof buf) > 0) {
+            continue;
+        }
+    }
+    pthread_mutex_unlock(&workers->queue_mutex);
+    return msg;
+}
+
+void
+dp_workers_wait(struct datapath *dp) {
+    if (dp->workers != NULL) {
+        poll_fd_wait(dp->workers->wake_fds[0], POLLIN);
+    }
+}
@@ -0,0 +1,105 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef DP_WORKERS_H
+#define DP_WORKERS_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct datapath;
+struct flow_cache;
+struct flow_cache_stats;
+struct ofpbuf;
+
+/****************************************************************************
+ * Worker threads.
+ *
+ * By default the datapath runs in a single thread.  With worker threads, the
+ * ports are spread across the workers, and each one receives packets on its
+ * own ports and runs them through the pipeline.  The main thread keeps
+ * handling the controller connections, timeouts and port changes.
+ *
+ * The workers run alongside the main thread.  The main thread only takes
+ * exclusive access to the datapath, with dp_workers_block(), around the
+ * work that changes what the workers use: flow, group and meter mods and
+ * other controller messages that are not mere requests, flow timeouts, and
+ * port changes.  Flow, group and meter tables are thus never modified under
+ * the workers' feet, and nothing they may be using is freed.  Workers share
+ * the tables; anything else the packet path writes to is either per-thread
+ * (receive buffers, the flow cache), updated atomically (flow, table and
+ * group counters), or protected by a lock of its own (meters, buffered
+ * packets, select groups, AMARU state).  OpenFlow messages the workers
+ * generate are handed to the main thread for sending.
+ ****************************************************************************/
+
+#define DP_MAX_WORKERS 64
+
+/* Starts the worker threads, if any were asked for with dp_set_n_workers().
+ * Must be called after daemonizing, as threads do not survive a fork(). */
+void
+dp_workers_start(struct datapath *dp);
+
+/* Called by the main thread to take, and give up, exclusive access to the
+ * datapath.  Waits for the workers to finish the packets at hand. */
+void
+dp_workers_block(struct datapath *dp);
+
+void
+dp_workers_unblock(struct datapath *dp);
+
+/* Returns true if called from a worker thread. */
+bool
+dp_workers_is_worker(void);
+
+/* Returns the flow cache of the calling worker thread, after invalidating it
+ * if 'shared', the main thread's cache, was invalidated since the last call;
+ * returns NULL if called from the main thread. */
+struct flow_cache *
+dp_workers_flow_cache(const struct flow_cache *shared);
+
+/* Adds the counters of the workers' flow caches to 'stats'. */
+void
+dp_workers_add_cache_stats(struct datapath *dp, struct flow_cache_stats *stats);
+
+/* Queues the OpenFlow message 'msg' from a worker thread, to be sent by the
+ * main thread. */
+void
+dp_workers_defer(struct datapath *dp, struct ofpbuf *msg);
+
+/* Returns the next message queued with dp_workers_defer(), or NULL. */
+struct ofpbuf *
+dp_workers_deferred(struct datapath *dp);
+
+/* Wakes up the main thread when messages are queued. */
+void
+dp_workers_wait(struct datapath *dp);
+
+#endif /* DP_WORKERS_H */
@@ -0,0 +1,306 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flow_cache.h"
+#include "flow_classifier.h"
+#include "hash.h"
+#include "hmap.h"
+#include "util.h"
+#include "openflow/openflow.h"
+
+/* A set of fields and masks shared by megaflows. */
+struct megaflow_mask {
+    struct list           node;      /* element in flow_cache.masks. */
+    size_t                n_fields;
+    struct flow_wc_field *fields;    /* fields, ordered by header. */
+    size_t                key_len;
+    struct hmap           flows;     /* megaflows, hashed by their key. */
+};
+
+/* A cached traversal covering all packets with the same masked fields. */
+struct megaflow {
+    struct hmap_node      node;      /* element in megaflow_mask.flows. */
+    uint8_t              *key;
+    size_t                n_entries;
+    struct flow_entry    *entries[FLOW_CACHE_MAX_CHAIN];
+};
+
+/* The counters are only written by the thread owning the cache, but may be read
+ * by others with flow_cache_add_stats(). */
+static inline void
+count(uint64_t *counter) {
+    __atomic_store_n(counter, *counter + 1, __ATOMIC_RELAXED);
+}
+
+static void
+megaflow_flush(struct flow_cache *cache) {
+    struct megaflow_mask *m, *next_m;
+    struct megaflow *f, *next_f;
+
+    LIST_FOR_EACH_SAFE (m, next_m, struct megaflow_mask, node, &cache->masks) {
+        HMAP_FOR_EACH_SAFE (f, next_f, struct megaflow, node, &m->flows) {
+            hmap_remove(&m->flows, &f->node);
+            free(f->key);
+            free(f);
+        }
+        hmap_destroy(&m->flows);
+        list_remove(&m->node);
+        free(m->fields);
+        free(m);
+    }
+    __atomic_store_n(&cache->n_megaflows, 0, __ATOMIC_RELAXED);
+    cache->megaflow_generation = cache->generation;
+}
+
+/* Appends the field to a megaflow key: a presence byte followed by the masked
+ * value. 'value' is NULL if the field is not present. */
+static size_t
+megaflow_put_field(uint8_t *key, const struct flow_wc_field *f, const uint8_t *value) {
+    size_t len = OXM_LENGTH(f->header);
+    size_t i;
+
+    key[0] = value != NULL;
+    for (i = 0; i < len; i++) {
+        key[1 + i] = value != NULL ? value[i] & f->mask[i] : 0;
+    }
+    return 1 + len;
+}
+
+static struct megaflow *
+megaflow_find(struct megaflow_mask *m, const uint8_t *key, uint32_t hash) {
+    struct megaflow *f;
+
+    HMAP_FOR_EACH_WITH_HASH (f, struct megaflow, node, hash, &m->flows) {
+        if (memcmp(f->key, key, m->key_len) == 0) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
+static struct megaflow *
+megaflow_lookup(struct flow_cache *cache, const struct packet_key *pkt_key) {
+    uint8_t key[FLOW_WC_MAX_FIELDS * (1 + FLOW_WC_MAX_LEN)];
+    struct megaflow_mask *m;
+    struct megaflow *f;
+    size_t i, ofs;
+
+    LIST_FOR_EACH (m, struct megaflow_mask, node, &cache->masks) {
+        ofs = 0;
+        for (i = 0; i < m->n_fields; i++) {
+            ofs += megaflow_put_field(key + ofs, &m->fields[i],
+                                      packet_key_get(pkt_key, m->fields[i].header));
+        }
+        f = megaflow_find(m, key, hash_bytes(key, ofs, 0));
+        if (f != NULL) {
+            /* Keep the busiest masks in front. */
+            list_remove(&m->node);
+            list_push_front(&cache->masks, &m->node);
+            return f;
+        }
+    }
+    return NULL;
+}
+
+static int
+megaflow_field_cmp(const void *a_, const void *b_) {
+    const struct flow_wc_field *a = a_;
+    const struct flow_wc_field *b = b_;
+
+    return a->header < b->header ? -1 : a->header > b->header;
+}
+
+static void
+megaflow_insert(struct flow_cache *cache, const struct flow_cache_key *pkt_key,
+                struct flow_entry **entries, size_t n_entries,
+                const struct flow_wildcards *wc) {
+    uint8_t key[FLOW_WC_MAX_FIELDS * (1 + FLOW_WC_MAX_LEN)];
+    struct flow_wc_field fields[FLOW_WC_MAX_FIELDS];
+    struct megaflow_mask *m;
+    struct megaflow *f;
+    size_t i, ofs;
+    uint32_t hash;
+
+    if (cache->n_megaflows >= FLOW_CACHE_MAX_MEGAFLOWS) {
+        megaflow_flush(cache);
+    }
+
+    memcpy(fields, wc->fields, sizeof(struct flow_wc_field) * wc->n_fields);
+    qsort(fields, wc->n_fields, sizeof(struct flow_wc_field), megaflow_field_cmp);
+
+    LIST_FOR_EACH (m, struct megaflow_mask, node, &cache->masks) {
+        if (m->n_fields == wc->n_fields &&
+            memcmp(m->fields, fields, sizeof(struct flow_wc_field) * wc->n_fields) == 0) {
+            break;
+        }
+    }
+    if (&m->node == &cache->masks) {
+        m = xmalloc(sizeof(struct megaflow_mask));
+        m->n_fields = wc->n_fields;
+        m->fields = xmalloc(sizeof(struct flow_wc_field) * (wc->n_fields > 0 ? wc->n_fields : 1));
+        memcpy(m->fields, fields, sizeof(struct flow_wc_field) * wc->n_fields);
+        m->key_len = 0;
+        for (i = 0; i < m->n_fields; i++) {
+            m->key_len += 1 + OXM_LENGTH(m->fields[i].header);
+        }
+        hmap_init(&m->flows);
+        list_push_back(&cache->masks, &m->node);
+    }
+
+    /* The key is built from the packet as it entered the pipeline, as the
+     * packet itself may have been modified by the time it left. */
+    ofs = 0;
+    for (i = 0; i < m->n_fields; i++) {
+        ofs += megaflow_put_field(key + ofs, &m->fields[i],
+                                  packet_key_get(&pkt_key->pkt, m->fields[i].header));
+    }
+    hash = hash_bytes(key, ofs, 0);
+    if (megaflow_find(m, key, hash) != NULL) {
+        return;
+    }
+
+    f = xmalloc(sizeof(struct megaflow));
+    f->key = xmalloc(ofs > 0 ? ofs : 1);
+    memcpy(f->key, key, ofs);
+    f->n_entries = n_entries;
+    memcpy(f->entries, entries, sizeof(struct flow_entry *) * n_entries);
+    hmap_insert(&m->flows, &f->node, hash);
+    __atomic_store_n(&cache->n_megaflows, cache->n_megaflows + 1,
+                     __ATOMIC_RELAXED);
+}
+
+void
+flow_cache_init(struct flow_cache *cache) {
+    cache->slots = xmalloc_aligned(CACHE_LINE_SIZE,
+                                   FLOW_CACHE_SIZE * sizeof(struct flow_cache_entry));
+    memset(cache->slots, 0, FLOW_CACHE_SIZE * sizeof(struct flow_cache_entry));
+    cache->generation = 1;
+    list_init(&cache->masks);
+    cache->n_megaflows = 0;
+    cache->megaflow_generation = cache->generation;
+    cache->n_hits = 0;
+    cache->n_megaflow_hits = 0;
+    cache->n_misses = 0;
+    cache->n_invalidations = 0;
+}
+
+void
+flow_cache_destroy(struct flow_cache *cache) {
+    megaflow_flush(cache);
+    free(cache->slots);
+    cache->slots = NULL;
+}
+
+void
+flow_cache_invalidate(struct flow_cache *cache) {
+    /* Megaflows are freed lazily, on the next lookup or insertion. */
+    cache->generation++;
+    count(&cache->n_invalidations);
+}
+
+void
+flow_cache_add_stats(const struct flow_cache *cache,
+                     struct flow_cache_stats *stats) {
+    stats->n_hits += __atomic_load_n(&cache->n_hits, __ATOMIC_RELAXED);
+    stats->n_megaflow_hits += __atomic_load_n(&cache->n_megaflow_hits,
+                                              __ATOMIC_RELAXED);
+    stats->n_misses += __atomic_load_n(&cache->n_misses, __ATOMIC_RELAXED);
+    stats->n_megaflows += __atomic_load_n(&cache->n_megaflows,
+                                          __ATOMIC_RELAXED);
+}
+
+void
+flow_cache_key_init(struct flow_cache_key *key, const struct packet_key *pkt_key) {
+    /* Absent fields are zero in the packet key, so the whole of it can be
+     * hashed and compared. */
+    memcpy(&key->pkt, pkt_key, sizeof key->pkt);
+    key->hash = hash_bytes(&key->pkt, sizeof key->pkt, 0);
+}
+
+static inline struct flow_cache_entry *
+flow_cache_slot(struct flow_cache *cache, uint32_t hash) {
+    return &cache->slots[hash & (FLOW_CACHE_SIZE - 1)];
+}
+
+static void
+flow_cache_insert_exact(struct flow_cache *cache, const struct flow_cache_key *key,
+                        struct flow_entry **entries, size_t n_entries) {
+    struct flow_cache_entry *e = flow_cache_slot(cache, key->hash);
+
+    e->generation = cache->generation;
+    memcpy(&e->key, key, sizeof e->key);
+    e->n_entries = n_entries;
+    memcpy(e->entries, entries, sizeof(struct flow_entry *) * n_entries);
+}
+
+const struct flow_cache_entry *
+flow_cache_lookup(struct flow_cache *cache, const struct flow_cache_key *key) {
+    struct flow_cache_entry *e = flow_cache_slot(cache, key->hash);
+    struct megaflow *f;
+
+    if (e->generation == cache->generation && e->key.hash == key->hash &&
+        memcmp(&e->key.pkt, &key->pkt, sizeof key->pkt) == 0) {
+        count(&cache->n_hits);
+        return e;
+    }
+
+    if (cache->megaflow_generation != cache->generation) {
+        megaflow_flush(cache);
+    }
+    f = megaflow_lookup(cache, &key->pkt);
+    if (f != NULL) {
+        count(&cache->n_megaflow_hits);
+        flow_cache_insert_exact(cache, key, f->entries, f->n_entries);
+        return e;
+    }
+
+    count(&cache->n_misses);
+    return NULL;
+}
+
+void
+flow_cache_insert(struct flow_cache *cache, const struct flow_cache_key *key,
+                  struct flow_entry **entries, size_t n_entries,
+                  const struct flow_wildcards *wc) {
+    if (n_entries > FLOW_CACHE_MAX_CHAIN) {
+        return;
+    }
+    flow_cache_insert_exact(cache, key, entries, n_entries);
+
+    if (wc != NULL && !wc->overflow) {
+        if (cache->megaflow_generation != cache->generation) {
+            megaflow_flush(cache);
+        }
+        megaflow_insert(cache, key, entries, n_entries, wc);
+    }
+}
@@ -0,0 +1,146 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef FLOW_CACHE_H
+#define FLOW_CACHE_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "hmap.h"
+#include "list.h"
+#include "packet_key.h"
+
+struct flow_entry;
+struct flow_wildcards;
+
+/****************************************************************************
+ * Exact-match cache of pipeline traversals. A cache entry is keyed by the
+ * packet key (all the fields parsed from a packet, including in_port), and
+ * stores the chain
+ * of flow entries the packet hit in the pipeline, so packets of the same flow
+ * can skip the flow table lookups.
+ *
+ * Behind the exact-match tier sits a megaflow tier. A megaflow is keyed only by
+ * the fields (and bits) the table lookups of a traversal depended on, as
+ * reported by the classifiers, so it covers every packet which would take the
+ * same path through the pipeline. Megaflows are grouped by mask and resolved
+ * with one hash probe per mask; a megaflow hit is promoted to the exact tier.
+ *
+ * Only the part of a traversal that depends on the packet as it entered the
+ * pipeline is cached: it ends at the first entry that may change the packet
+ * before going to another table, and the tables after it are looked up.
+ *
+ * The cache does not hold references to flow entries. Instead, any change to
+ * the pipeline must call flow_cache_invalidate(), which drops every cached
+ * entry at once.
+ ****************************************************************************/
+
+#define FLOW_CACHE_SIZE       1024  /* Number of cache slots; power of two. */
+#define FLOW_CACHE_MAX_CHAIN    16  /* Longest table chain that is cached. */
+#define FLOW_CACHE_MAX_MEGAFLOWS 8192 /* The megaflow tier is flushed when
+                                         it grows beyond this. */
+
+/* The packet key used for cache lookups. */
+struct flow_cache_key {
+    struct packet_key  pkt;
+    uint32_t           hash;
+};
+
+/* A cached pipeline traversal. */
+struct flow_cache_entry {
+    uint64_t              generation;  /* cache generation the entry belongs to;
+                                          0 if the slot was never used. */
+    struct flow_cache_key key;
+    size_t                n_entries;
+    struct flow_entry    *entries[FLOW_CACHE_MAX_CHAIN]; /* flow entries hit in
+                                          each visited table; the last one is NULL
+                                          if the packet missed in the last table. */
+};
+
+struct flow_cache {
+    struct flow_cache_entry *slots;
+    uint64_t                 generation;  /* current generation of the cache. */
+
+    struct list              masks;       /* megaflow masks, most recently
+                                             used first. */
+    size_t                   n_megaflows;
+    uint64_t                 megaflow_generation; /* generation the megaflows
+                                             belong to. */
+
+    uint64_t                 n_hits;
+    uint64_t                 n_megaflow_hits;
+    uint64_t                 n_misses;
+    uint64_t                 n_invalidations;
+};
+
+/* Counters of one or more caches. */
+struct flow_cache_stats {
+    uint64_t n_hits;
+    uint64_t n_megaflow_hits;
+    uint64_t n_misses;
+    size_t   n_megaflows;
+};
+
+/* Initializes an empty cache. */
+void
+flow_cache_init(struct flow_cache *cache);
+
+/* Frees the memory used by the cache. */
+void
+flow_cache_destroy(struct flow_cache *cache);
+
+/* Drops all entries of the cache. Must be called whenever a flow entry is
+ * added, modified or removed, or when anything else affecting the pipeline
+ * changes. */
+void
+flow_cache_invalidate(struct flow_cache *cache);
+
+/* Adds the counters of the cache to 'stats'. May be called from any thread. */
+void
+flow_cache_add_stats(const struct flow_cache *cache,
+                     struct flow_cache_stats *stats);
+
+/* Builds the cache key from the packet key. */
+void
+flow_cache_key_init(struct flow_cache_key *key, const struct packet_key *pkt_key);
+
+/* Returns the cached traversal for the key, or NULL if there is none. */
+const struct flow_cache_entry *
+flow_cache_lookup(struct flow_cache *cache, const struct flow_cache_key *key);
+
+/* Caches the traversal of the packet with the given key. If 'wc' is not NULL,
+ * a megaflow matching the fields in 'wc' is also installed. */
+void
+flow_cache_insert(struct flow_cache *cache, const struct flow_cache_key *key,
+                  struct flow_entry **entries, size_t n_entries,
+                  const struct flow_wildcards *wc);
+
+#endif /* FLOW_CACHE_H */
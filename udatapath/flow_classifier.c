@@ -0,0 +1,562 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flow_classifier.h"
+#include "flow_entry.h"
+#include "match_std.h"
+#include "hash.h"
+#include "packets.h"
+#include "util.h"
+#include "oflib/ofl-structs.h"
+#include "openflow/openflow.h"
+
+#include "vlog.h"
+#define LOG_MODULE VLM_flow_t
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+/* Upper limits of a subtable signature. Matches exceeding them are placed
+ * on the fallback list. */
+#define CLS_MAX_FIELDS  64
+#define CLS_MAX_KEY_LEN 256
+
+/* A match field taking part in a subtable key. */
+struct cls_field {
+    uint32_t   header;  /* unmasked header, as found in packet keys. */
+    size_t     ofs;     /* offset of the field value in the key. */
+    size_t     len;     /* length of the field value. */
+};
+
+/* Entries using the same match fields and masks. */
+struct cls_subtable {
+    struct hmap_node   node;         /* element in flow_classifier.subtables. */
+    struct list        prio_node;    /* element in flow_classifier.subtables_prio. */
+
+    size_t             n_fields;
+    struct cls_field  *fields;       /* fields, ordered by header. */
+    size_t             key_len;
+    uint8_t           *mask;         /* mask applied to the key, key_len bytes. */
+
+    struct hmap        buckets;      /* buckets, hashed by their key. */
+    size_t             n_entries;
+    uint16_t           max_priority; /* highest priority in the subtable. */
+};
+
+/* Entries of a subtable sharing the same masked key. */
+struct cls_bucket {
+    struct hmap_node      node;      /* element in cls_subtable.buckets. */
+    struct cls_subtable  *subtable;
+    uint8_t              *key;
+    struct list           entries;   /* entries, in lookup precedence order. */
+};
+
+/* Returns true if 'a' takes precedence over 'b' in a lookup. */
+static inline bool
+cls_entry_precedes(const struct flow_entry *a, const struct flow_entry *b) {
+    return a->stats->priority > b->stats->priority ||
+           (a->stats->priority == b->stats->priority && a->serial < b->serial);
+}
+
+/* Inserts the entry into the list, keeping lookup precedence order. */
+static void
+cls_list_insert(struct list *list, struct flow_entry *entry) {
+    struct flow_entry *e;
+
+    LIST_FOR_EACH (e, struct flow_entry, cls_node, list) {
+        if (cls_entry_precedes(entry, e)) {
+            list_insert(&e->cls_node, &entry->cls_node);
+            return;
+        }
+    }
+    list_push_back(list, &entry->cls_node);
+}
+
+static struct ofl_match_header *
+cls_entry_match(struct flow_entry *entry) {
+    return entry->match == NULL ? entry->stats->match : entry->match;
+}
+
+/* Returns the header of the field without the mask bit, i.e. the header
+ * under which the field is stored in packet keys. */
+static inline uint32_t
+cls_field_header(uint32_t header) {
+    uint32_t len = OXM_LENGTH(header);
+
+    if (OXM_HASMASK(header)) {
+        len /= 2;
+    }
+    return (header & 0xfffffe00) | len;
+}
+
+static int
+cls_tlv_cmp(const void *a_, const void *b_) {
+    uint32_t a = cls_field_header((*(struct ofl_match_tlv * const *)a_)->header);
+    uint32_t b = cls_field_header((*(struct ofl_match_tlv * const *)b_)->header);
+
+    return a < b ? -1 : a > b;
+}
+
+/* Computes the subtable signature ('fields', 'n_fields', 'mask', 'key_len')
+ * and the masked key of the match. Returns false if the match must be
+ * checked with packet_match() instead. */
+static bool
+cls_match_key(struct ofl_match_header *m, struct cls_field *fields,
+              size_t *n_fields, uint8_t *mask, uint8_t *key, size_t *key_len) {
+    struct ofl_match *match = (struct ofl_match *)m;
+    struct ofl_match_tlv *tlvs[CLS_MAX_FIELDS];
+    struct ofl_match_tlv *f;
+    size_t n, i, j, ofs;
+
+    if (m->type != OFPMT_OXM) {
+        return false;
+    }
+
+    n = 0;
+    if (m->length != 0) {
+        HMAP_FOR_EACH (f, struct ofl_match_tlv, hmap_node, &match->match_fields) {
+            if (n == CLS_MAX_FIELDS) {
+                return false;
+            }
+            tlvs[n++] = f;
+        }
+    }
+    qsort(tlvs, n, sizeof *tlvs, cls_tlv_cmp);
+
+    ofs = 0;
+    for (i = 0; i < n; i++) {
+        bool has_mask = OXM_HASMASK(tlvs[i]->header);
+        uint32_t header = cls_field_header(tlvs[i]->header);
+        size_t len = OXM_LENGTH(header);
+        uint8_t *value = tlvs[i]->value;
+        uint8_t vlan[2];
+
+        switch (header) {
+            case OXM_OF_AMARU_LEVEL:
+            case OXM_OF_AMARU_AMAC:
+            case OXM_OF_IPV6_EXTHDR: {
+                return false;
+            }
+            case OXM_OF_VLAN_VID: {
+                /* packet_match() gives OFPVID_NONE and OFPVID_PRESENT a
+                 * special meaning, and only compares the VLAN ID bits. */
+                uint16_t vid;
+
+                memcpy(&vid, value, sizeof vid);
+                if (vid == OFPVID_NONE || vid == OFPVID_PRESENT) {
+                    return false;
+                }
+                vid &= VLAN_VID_MASK;
+                memcpy(vlan, &vid, sizeof vid);
+                value = vlan;
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+
+        if (len != 1 && len != 2 && len != 3 && len != 4 &&
+            len != 6 && len != 8 && len != 16) {
+            return false;
+        }
+        if (ofs + len > CLS_MAX_KEY_LEN) {
+            return false;
+        }
+
+        fields[i].header = header;
+        fields[i].ofs = ofs;
+        fields[i].len = len;
+        for (j = 0; j < len; j++) {
+            mask[ofs + j] = has_mask ? tlvs[i]->value[len + j] : 0xff;
+            key[ofs + j] = value[j] & mask[ofs + j];
+        }
+        ofs += len;
+    }
+
+    *n_fields = n;
+    *key_len = ofs;
+    return true;
+}
+
+static uint32_t
+cls_subtable_hash(const struct cls_field *fields, size_t n_fields,
+                  const uint8_t *mask, size_t key_len) {
+    uint32_t hash = hash_bytes(mask, key_len, n_fields);
+    size_t i;
+
+    for (i = 0; i < n_fields; i++) {
+        hash = hash_int(fields[i].header, hash);
+    }
+    return hash;
+}
+
+static struct cls_subtable *
+cls_subtable_find(struct flow_classifier *cls, uint32_t hash,
+                  const struct cls_field *fields, size_t n_fields,
+                  const uint8_t *mask, size_t key_len) {
+    struct cls_subtable *st;
+    size_t i;
+
+    HMAP_FOR_EACH_WITH_HASH (st, struct cls_subtable, node, hash, &cls->subtables) {
+        if (st->n_fields != n_fields || st->key_len != key_len ||
+            memcmp(st->mask, mask, key_len) != 0) {
+            continue;
+        }
+        for (i = 0; i < n_fields; i++) {
+            if (st->fields[i].header != fields[i].header) {
+                break;
+            }
+        }
+        if (i == n_fields) {
+            return st;
+        }
+    }
+    return NULL;
+}
+
+/* Moves the subtable to its place in the priority ordered subtable list. */
+static void
+cls_subtable_reorder(struct flow_classifier *cls, struct cls_subtable *st) {
+    struct cls_subtable *s;
+
+    list_remove(&st->prio_node);
+    LIST_FOR_EACH (s, struct cls_subtable, prio_node, &cls->subtables_prio) {
+        if (st->max_priority > s->max_priority) {
+            list_insert(&s->prio_node, &st->prio_node);
+            return;
+        }
+    }
+    list_push_back(&cls->subtables_prio, &st->prio_node);
+}
+
+static struct cls_subtable *
+cls_subtable_create(struct flow_classifier *cls, uint32_t hash,
+                    const struct cls_field *fields, size_t n_fields,
+                    const uint8_t *mask, size_t key_len) {
+    struct cls_subtable *st = xmalloc(sizeof(struct cls_subtable));
+
+    st->n_fields = n_fields;
+    st->fields = xmalloc(sizeof(struct cls_field) * (n_fields > 0 ? n_fields : 1));
+    memcpy(st->fields, fields, sizeof(struct cls_field) * n_fields);
+    st->key_len = key_len;
+    st->mask = xmalloc(key_len > 0 ? key_len : 1);
+    memcpy(st->mask, mask, key_len);
+    hmap_init(&st->buckets);
+    st->n_entries = 0;
+    st->max_priority = 0;
+
+    hmap_insert(&cls->subtables, &st->node, hash);
+    list_push_back(&cls->subtables_prio, &st->prio_node);
+    return st;
+}
+
+static void
+cls_subtable_destroy(struct flow_classifier *cls, struct cls_subtable *st) {
+    struct cls_bucket *b, *next;
+
+    HMAP_FOR_EACH_SAFE (b, next, struct cls_bucket, node, &st->buckets) {
+        hmap_remove(&st->buckets, &b->node);
+        free(b->key);
+        free(b);
+    }
+    hmap_destroy(&st->buckets);
+    hmap_remove(&cls->subtables, &st->node);
+    list_remove(&st->prio_node);
+    free(st->fields);
+    free(st->mask);
+    free(st);
+}
+
+static struct cls_bucket *
+cls_bucket_find(struct cls_subtable *st, const uint8_t *key, uint32_t hash) {
+    struct cls_bucket *b;
+
+    HMAP_FOR_EACH_WITH_HASH (b, struct cls_bucket, node, hash, &st->buckets) {
+        if (memcmp(b->key, key, st->key_len) == 0) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/* Returns the entry with the highest precedence in the subtable matching the
+ * packet, or NULL if there is none. */
+static struct flow_entry *
+cls_subtable_lookup(struct cls_subtable *st, const struct packet_key *pkt_key,
+                    struct flow_wildcards *wc) {
+    uint8_t key[CLS_MAX_KEY_LEN];
+    struct cls_bucket *b;
+    size_t i, j;
+
+    if (wc != NULL) {
+        for (i = 0; i < st->n_fields; i++) {
+            flow_wildcards_add(wc, st->fields[i].header, st->mask + st->fields[i].ofs);
+        }
+    }
+
+    for (i = 0; i < st->n_fields; i++) {
+        struct cls_field *f = &st->fields[i];
+        const uint8_t *value = packet_key_get(pkt_key, f->header);
+
+        if (value == NULL) {
+            return NULL;
+        }
+        for (j = 0; j < f->len; j++) {
+            key[f->ofs + j] = value[j] & st->mask[f->ofs + j];
+        }
+    }
+
+    b = cls_bucket_find(st, key, hash_bytes(key, st->key_len, 0));
+    if (b == NULL) {
+        return NULL;
+    }
+    return CONTAINER_OF(list_front(&b->entries), struct flow_entry, cls_node);
+}
+
+/* Checks an entry of the fallback list against the packet. */
+static bool
+cls_fallback_match(struct flow_entry *entry, const struct packet_key *pkt_key,
+                   struct flow_wildcards *wc) {
+    struct ofl_match_header *m = cls_entry_match(entry);
+
+    switch (m->type) {
+        case (OFPMT_OXM): {
+            if (wc != NULL) {
+                /* packet_match() has special cases for these entries; depend
+                 * on the whole of every field they use. */
+                struct ofl_match_tlv *f;
+
+                HMAP_FOR_EACH (f, struct ofl_match_tlv, hmap_node,
+                               &((struct ofl_match *)m)->match_fields) {
+                    flow_wildcards_add(wc, cls_field_header(f->header), NULL);
+                }
+            }
+            if (!entry->matcher->fallback) {
+                return flow_matcher_match(entry->matcher, pkt_key);
+            }
+            return packet_match((struct ofl_match *)m, pkt_key);
+        }
+        default: {
+            VLOG_WARN_RL(LOG_MODULE, &rl, "Trying to process flow entry with unknown match type (%u).", m->type);
+            return false;
+        }
+    }
+}
+
+void
+flow_wildcards_init(struct flow_wildcards *wc) {
+    wc->n_fields = 0;
+    wc->overflow = false;
+}
+
+void
+flow_wildcards_add(struct flow_wildcards *wc, uint32_t header, const uint8_t *mask) {
+    size_t len = OXM_LENGTH(header);
+    struct flow_wc_field *f;
+    size_t i;
+
+    if (len > FLOW_WC_MAX_LEN) {
+        wc->overflow = true;
+        return;
+    }
+
+    for (i = 0; i < wc->n_fields; i++) {
+        if (wc->fields[i].header == header) {
+            break;
+        }
+    }
+    if (i == wc->n_fields) {
+        if (wc->n_fields == FLOW_WC_MAX_FIELDS) {
+            wc->overflow = true;
+            return;
+        }
+        f = &wc->fields[wc->n_fields++];
+        f->header = header;
+        memset(f->mask, 0, sizeof f->mask);
+    } else {
+        f = &wc->fields[i];
+    }
+
+    for (i = 0; i < len; i++) {
+        f->mask[i] |= mask != NULL ? mask[i] : 0xff;
+    }
+}
+
+void
+flow_classifier_init(struct flow_classifier *cls) {
+    hmap_init(&cls->subtables);
+    list_init(&cls->subtables_prio);
+    list_init(&cls->fallback);
+    cls->n_entries = 0;
+}
+
+void
+flow_classifier_destroy(struct flow_classifier *cls) {
+    struct cls_subtable *st, *next;
+    struct flow_entry *entry, *next_entry;
+
+    HMAP_FOR_EACH_SAFE (st, next, struct cls_subtable, node, &cls->subtables) {
+        cls_subtable_destroy(cls, st);
+    }
+    hmap_destroy(&cls->subtables);
+
+    LIST_FOR_EACH_SAFE (entry, next_entry, struct flow_entry, cls_node, &cls->fallback) {
+        list_remove(&entry->cls_node);
+        list_init(&entry->cls_node);
+    }
+    cls->n_entries = 0;
+}
+
+void
+flow_classifier_insert(struct flow_classifier *cls, struct flow_entry *entry) {
+    struct cls_field fields[CLS_MAX_FIELDS];
+    uint8_t mask[CLS_MAX_KEY_LEN];
+    uint8_t key[CLS_MAX_KEY_LEN];
+    struct cls_subtable *st;
+    struct cls_bucket *b;
+    size_t n_fields, key_len;
+    uint32_t st_hash, hash;
+
+    cls->n_entries++;
+    entry->cls_bucket = NULL;
+
+    if (!cls_match_key(cls_entry_match(entry), fields, &n_fields, mask, key, &key_len)) {
+        cls_list_insert(&cls->fallback, entry);
+        return;
+    }
+
+    st_hash = cls_subtable_hash(fields, n_fields, mask, key_len);
+    st = cls_subtable_find(cls, st_hash, fields, n_fields, mask, key_len);
+    if (st == NULL) {
+        st = cls_subtable_create(cls, st_hash, fields, n_fields, mask, key_len);
+    }
+
+    hash = hash_bytes(key, key_len, 0);
+    b = cls_bucket_find(st, key, hash);
+    if (b == NULL) {
+        b = xmalloc(sizeof(struct cls_bucket));
+        b->subtable = st;
+        b->key = xmalloc(key_len > 0 ? key_len : 1);
+        memcpy(b->key, key, key_len);
+        list_init(&b->entries);
+        hmap_insert(&st->buckets, &b->node, hash);
+    }
+
+    cls_list_insert(&b->entries, entry);
+    entry->cls_bucket = b;
+
+    st->n_entries++;
+    if (st->n_entries == 1 || entry->stats->priority > st->max_priority) {
+        st->max_priority = entry->stats->priority;
+        cls_subtable_reorder(cls, st);
+    }
+}
+
+void
+flow_classifier_remove(struct flow_classifier *cls, struct flow_entry *entry) {
+    struct cls_bucket *b = entry->cls_bucket;
+    struct cls_subtable *st;
+
+    if (list_is_empty(&entry->cls_node)) {
+        /* Not in the classifier. */
+        return;
+    }
+    list_remove(&entry->cls_node);
+    list_init(&entry->cls_node);
+    entry->cls_bucket = NULL;
+    cls->n_entries--;
+
+    if (b == NULL) {
+        /* Entry was on the fallback list. */
+        return;
+    }
+
+    st = b->subtable;
+    if (list_is_empty(&b->entries)) {
+        hmap_remove(&st->buckets, &b->node);
+        free(b->key);
+        free(b);
+    }
+
+    st->n_entries--;
+    if (st->n_entries == 0) {
+        cls_subtable_destroy(cls, st);
+        return;
+    }
+
+    if (entry->stats->priority == st->max_priority) {
+        /* The head of each bucket holds the bucket's highest priority. */
+        struct cls_bucket *sb;
+
+        st->max_priority = 0;
+        HMAP_FOR_EACH (sb, struct cls_bucket, node, &st->buckets) {
+            struct flow_entry *head;
+
+            head = CONTAINER_OF(list_front(&sb->entries), struct flow_entry, cls_node);
+            if (head->stats->priority > st->max_priority) {
+                st->max_priority = head->stats->priority;
+            }
+        }
+        cls_subtable_reorder(cls, st);
+    }
+}
+
+struct flow_entry *
+flow_classifier_lookup(struct flow_classifier *cls, const struct packet_key *pkt_key,
+                       struct flow_wildcards *wc) {
+    struct flow_entry *best = NULL;
+    struct flow_entry *entry;
+    struct cls_subtable *st;
+
+    LIST_FOR_EACH (st, struct cls_subtable, prio_node, &cls->subtables_prio) {
+        if (best != NULL && st->max_priority < best->stats->priority) {
+            /* No entry in the remaining subtables can beat 'best'. */
+            break;
+        }
+        entry = cls_subtable_lookup(st, pkt_key, wc);
+        if (entry != NULL && (best == NULL || cls_entry_precedes(entry, best))) {
+            best = entry;
+        }
+    }
+
+    LIST_FOR_EACH (entry, struct flow_entry, cls_node, &cls->fallback) {
+        if (best != NULL && !cls_entry_precedes(entry, best)) {
+            break;
+        }
+        if (cls_fallback_match(entry, pkt_key, wc)) {
+            return entry;
+        }
+    }
+
+    return best;
+}
@@ -0,0 +1,118 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef FLOW_CLASSIFIER_H
+#define FLOW_CLASSIFIER_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "hmap.h"
+#include "list.h"
+#include "packet_key.h"
+#include "oflib/ofl-structs.h"
+
+struct flow_entry;
+
+/****************************************************************************
+ * Tuple space search classifier indexing the entries of a flow table.
+ *
+ * Entries are grouped by the set of fields and masks their match uses. Each
+ * group (subtable) hashes its entries on the masked field values, so a lookup
+ * costs one hash probe per distinct mask instead of one comparison per entry.
+ * Subtables are probed in order of their highest priority, and probing stops
+ * once no remaining subtable can beat the best entry found.
+ *
+ * Matches which cannot be expressed as masked values (AMARU fields,
+ * OFPVID_NONE/OFPVID_PRESENT, IPv6 extension headers, non-OXM matches) are
+ * kept in priority order on a separate list and checked with packet_match().
+ ****************************************************************************/
+
+/* Match fields and masks a lookup depended on. A field is listed if the result
+ * of the lookup depends on its presence in the packet; its mask gives the bits
+ * of the value the result depends on. */
+#define FLOW_WC_MAX_FIELDS  64
+#define FLOW_WC_MAX_LEN     32
+
+struct flow_wc_field {
+    uint32_t  header;                  /* unmasked OXM header. */
+    uint8_t   mask[FLOW_WC_MAX_LEN];
+};
+
+struct flow_wildcards {
+    size_t                n_fields;
+    bool                  overflow;    /* true if a field did not fit; the
+                                          wildcards are then unusable. */
+    struct flow_wc_field  fields[FLOW_WC_MAX_FIELDS];
+};
+
+/* Initializes empty wildcards. */
+void
+flow_wildcards_init(struct flow_wildcards *wc);
+
+/* Adds the masked field to the wildcards. 'header' is the unmasked OXM header
+ * of the field; a NULL 'mask' stands for a mask of all ones. */
+void
+flow_wildcards_add(struct flow_wildcards *wc, uint32_t header, const uint8_t *mask);
+
+struct flow_classifier {
+    struct hmap   subtables;      /* subtables, hashed by their mask. */
+    struct list   subtables_prio; /* subtables, ordered by max priority. */
+    struct list   fallback;       /* entries matched one by one, in
+                                     priority and then insertion order. */
+    size_t        n_entries;      /* number of entries in the classifier. */
+};
+
+/* Initializes an empty classifier. */
+void
+flow_classifier_init(struct flow_classifier *cls);
+
+/* Frees the classifier's internal structures. The entries are not freed. */
+void
+flow_classifier_destroy(struct flow_classifier *cls);
+
+/* Inserts the entry into the classifier. The entry's priority, match and
+ * serial must not change while it is in the classifier. */
+void
+flow_classifier_insert(struct flow_classifier *cls, struct flow_entry *entry);
+
+/* Removes the entry from the classifier. Does nothing if the entry is not
+ * in the classifier. */
+void
+flow_classifier_remove(struct flow_classifier *cls, struct flow_entry *entry);
+
+/* Returns the highest priority entry matching the packet's key, or
+ * NULL if there is none. Among entries with equal priority the one with the
+ * lowest serial is returned. If 'wc' is not NULL, the fields the result
+ * depends on are added to it. */
+struct flow_entry *
+flow_classifier_lookup(struct flow_classifier *cls, const struct packet_key *pkt_key,
+                       struct flow_wildcards *wc);
+
+#endif /* FLOW_CLASSIFIER_H */
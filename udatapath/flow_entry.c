@@ -38,6 +38,7 @@
 #include "group_entry.h"
 #include "meter_table.h"
 #include "meter_entry.h"
+#include "match_std.h"
 #include "oflib/ofl-messages.h"
 #include "oflib/ofl-structs.h"
 #include "oflib/ofl-actions.h"
@@ -194,6 +195,27 @@ flow_entry_update(struct flow_entry *entry) {
     entry->stats->duration_nsec = ((time_msec() - entry->created) % 1000) * 1000000;
 }
 
+struct ofl_flow_stats *
+flow_entry_stats_snapshot(struct flow_entry *entry) {
+    struct ofl_flow_stats *src = entry->stats;
+    struct ofl_flow_stats *stats = xmalloc(sizeof(struct ofl_flow_stats));
+
+    stats->table_id         = src->table_id;
+    stats->duration_sec     = src->duration_sec;
+    stats->duration_nsec    = src->duration_nsec;
+    stats->priority         = src->priority;
+    stats->idle_timeout     = src->idle_timeout;
+    stats->hard_timeout     = src->hard_timeout;
+    stats->flags            = src->flags;
+    stats->cookie           = src->cookie;
+    stats->packet_count     = __atomic_load_n(&src->packet_count, __ATOMIC_RELAXED);
+    stats->byte_count       = __atomic_load_n(&src->byte_count, __ATOMIC_RELAXED);
+    stats->match            = src->match;
+    stats->instructions_num = src->instructions_num;
+    stats->instructions     = src->instructions;
+    return stats;
+}
+
 /* Returns true if the flow entry has a reference to the given group. */
 static bool
 has_group_ref(struct flow_entry *entry, uint32_t group_id) {
@@ -362,6 +384,12 @@ flow_entry_create(struct datapath *dp, struct flow_table *table, struct ofl_msg_
     entry->stats->instructions     = mod->instructions;
 
     entry->match = mod->match; /* TODO: MOD MATCH? */
+    entry->matcher = xmalloc_aligned(CACHE_LINE_SIZE, sizeof(struct flow_matcher));
+    if (entry->match->type == OFPMT_OXM) {
+        flow_matcher_compile(entry->matcher, (struct ofl_match *)entry->match);
+    } else {
+        entry->matcher->fallback = true;
+    }
 
     entry->created      = now;
     entry->remove_at    = mod->hard_timeout == 0 ? 0
@@ -369,8 +397,11 @@ flow_entry_create(struct datapath *dp, struct flow_table *table, struct ofl_msg_
     entry->last_used    = now;
     entry->send_removed = ((mod->flags & OFPFF_SEND_FLOW_REM) != 0);
     list_init(&entry->match_node);
-    list_init(&entry->idle_node);
-    list_init(&entry->hard_node);
+    wheel_timer_init(&entry->idle_timer);
+    wheel_timer_init(&entry->hard_timer);
+    list_init(&entry->cls_node);
+    entry->cls_bucket = NULL;
+    entry->serial = 0;
 
     list_init(&entry->group_refs);
     init_group_refs(entry);
@@ -385,11 +416,13 @@ void
 flow_entry_destroy(struct flow_entry *entry) {
     // NOTE: This will be called when the group entry itself destroys the
     //       flow; but it won't be a problem.
+    flow_cache_invalidate(&entry->dp->pipeline->cache);
     del_group_refs(entry);
     del_meter_refs(entry);
     ofl_structs_free_flow_stats(entry->stats, entry->dp->exp);
     // assumes it is a standard match
     //free(entry->match);
+    free(entry->matcher);
     free(entry);
 }
 
@@ -408,8 +441,9 @@ flow_entry_remove(struct flow_entry *entry, uint8_t reason) {
     }
 
     list_remove(&entry->match_node);
-    list_remove(&entry->hard_node);
-    list_remove(&entry->idle_node);
+    timer_wheel_cancel(&entry->table->hard_timers, &entry->hard_timer);
+    timer_wheel_cancel(&entry->table->idle_timers, &entry->idle_timer);
+    flow_classifier_remove(&entry->table->classifier, entry);
     entry->table->stats->active_count--;
     flow_entry_destroy(entry);
 }
@@ -36,6 +36,7 @@
 #include <sys/types.h>
 #include "datapath.h"
 #include "list.h"
+#include "timer-wheel.h"
 #include "oflib/ofl-structs.h"
 #include "oflib/ofl-messages.h"
 #include "timeval.h"
@@ -46,8 +47,13 @@
 
 struct flow_entry {
     struct list              match_node;  /* list nodes in flow table lists. */
-    struct list              hard_node;
-    struct list              idle_node;
+    struct wheel_timer       hard_timer;  /* timers in the flow table's wheels. */
+    struct wheel_timer       idle_timer;
+    struct list              cls_node;    /* node in the table classifier. */
+    struct cls_bucket       *cls_bucket;  /* classifier bucket holding the entry,
+                                             NULL if not hashed. */
+    uint64_t                 serial;      /* insertion order in the table, breaks
+                                             ties between equal priorities. */
 
     struct datapath         *dp;
     struct flow_table       *table;
@@ -55,6 +61,7 @@ struct flow_entry {
     struct ofl_match_header *match; /* Original match structure is stored in stats;
                                        this one is a modified version, which reflects
                                        1.2 matching rules. */
+    struct flow_matcher     *matcher; /* match compiled for packet lookups. */
     uint64_t                 created;  /* time the entry was created at. */
     uint64_t                 remove_at; /* time the entry should be removed at
                                            due to its hard timeout. */
@@ -69,6 +76,8 @@ struct flow_entry {
 };
 
 struct packet;
+struct cls_bucket;
+struct flow_matcher;
 
 /* Returns true if the flow entry matches the match in the flow mod message. */
 bool
@@ -110,6 +119,12 @@ flow_entry_has_out_group(struct flow_entry *entry, uint32_t group);
 void
 flow_entry_update(struct flow_entry *entry);
 
+/* Returns a copy of the flow entry statistics, with the counters the worker
+ * threads update read atomically. The copy shares the match and instructions
+ * of the entry, so it must be released with free() alone. */
+struct ofl_flow_stats *
+flow_entry_stats_snapshot(struct flow_entry *entry);
+
 /* Creates a flow entry. */
 struct flow_entry *
 flow_entry_create(struct datapath *dp, struct flow_table *table, struct ofl_msg_flow_mod *mod);
@@ -43,8 +43,6 @@
 #include "vlog.h"
 #define LOG_MODULE VLM_flow_t
 
-static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
-
 uint32_t oxm_ids[] = {OXM_OF_IN_PORT, OXM_OF_IN_PHY_PORT, OXM_OF_METADATA, OXM_OF_ETH_DST,
                       OXM_OF_ETH_SRC, OXM_OF_ETH_TYPE, OXM_OF_VLAN_VID, OXM_OF_VLAN_PCP, OXM_OF_IP_DSCP,
                       OXM_OF_IP_ECN, OXM_OF_IP_PROTO, OXM_OF_IPV4_SRC, OXM_OF_IPV4_DST, OXM_OF_TCP_SRC,
@@ -82,25 +80,25 @@ struct ofl_action_header actions[] = { {OFPAT_OUTPUT, 4},
 
 #define N_ACTIONS       (sizeof(actions) / sizeof(struct ofl_action_header))
 
-/* When inserting an entry, this function adds the flow entry to the list of
- * hard and idle timeout entries, if appropriate. */
+/* Returns the time the entry's idle timeout expires at, if it is not used
+ * before. */
+static inline long long int
+idle_expires(struct flow_entry *entry) {
+    return entry->last_used + entry->stats->idle_timeout * 1000 + 1;
+}
+
+/* When inserting an entry, this function sets the hard and idle timeout
+ * timers of the flow entry, if appropriate. */
 static void
-add_to_timeout_lists(struct flow_table *table, struct flow_entry *entry) {
+add_timeouts(struct flow_table *table, struct flow_entry *entry) {
     if (entry->stats->idle_timeout > 0) {
-        list_insert(&table->idle_entries, &entry->idle_node);
+        timer_wheel_add(&table->idle_timers, &entry->idle_timer,
+                        idle_expires(entry));
     }
 
     if (entry->remove_at > 0) {
-        struct flow_entry *e;
-
-        /* hard timeout entries are ordered by the time they should be removed at. */
-        LIST_FOR_EACH (e, struct flow_entry, hard_node, &table->hard_entries) {
-            if (e->remove_at > entry->remove_at) {
-                list_insert(&e->hard_node, &entry->hard_node);
-                return;
-            }
-        }
-        list_insert(&e->hard_node, &entry->hard_node);
+        timer_wheel_add(&table->hard_timers, &entry->hard_timer,
+                        entry->remove_at + 1);
     }
 }
 
@@ -123,10 +121,13 @@ flow_table_add(struct flow_table *table, struct ofl_msg_flow_mod *mod, bool chec
 
             /* NOTE: no flow removed message should be generated according to spec. */
             list_replace(&new_entry->match_node, &entry->match_node);
-            list_remove(&entry->hard_node);
-            list_remove(&entry->idle_node);
+            timer_wheel_cancel(&table->hard_timers, &entry->hard_timer);
+            timer_wheel_cancel(&table->idle_timers, &entry->idle_timer);
+            flow_classifier_remove(&table->classifier, entry);
+            new_entry->serial = entry->serial;
+            flow_classifier_insert(&table->classifier, new_entry);
             flow_entry_destroy(entry);
-            add_to_timeout_lists(table, new_entry);
+            add_timeouts(table, new_entry);
             return 0;
         }
 
@@ -145,7 +146,9 @@ flow_table_add(struct flow_table *table, struct ofl_msg_flow_mod *mod, bool chec
     *insts_kept = true;
 
     list_insert(&entry->match_node, &new_entry->match_node);
-    add_to_timeout_lists(table, new_entry);
+    new_entry->serial = table->next_serial++;
+    flow_classifier_insert(&table->classifier, new_entry);
+    add_timeouts(table, new_entry);
 
     return 0;
 }
@@ -211,60 +214,59 @@ flow_table_flow_mod(struct flow_table *table, struct ofl_msg_flow_mod *mod, bool
 
 
 struct flow_entry *
-flow_table_lookup(struct flow_table *table, struct packet *pkt) {
+flow_table_lookup(struct flow_table *table, struct packet *pkt,
+                  struct flow_wildcards *wc) {
     struct flow_entry *entry;
 
-    table->stats->lookup_count++;
-
-    LIST_FOR_EACH(entry, struct flow_entry, match_node, &table->match_entries) {
-        struct ofl_match_header *m;
-
-        m = entry->match == NULL ? entry->stats->match : entry->match;
-
-        /* select appropriate handler, based on match type of flow entry. */
-        switch (m->type) {
-            case (OFPMT_OXM): {
-               if (packet_handle_std_match(pkt->handle_std,
-                                            (struct ofl_match *)m)) {
-                    if (!entry->no_byt_count)                                            
-                        entry->stats->byte_count += pkt->buffer->size;
-                    if (!entry->no_pkt_count)
-                        entry->stats->packet_count++;
-                    entry->last_used = time_msec();
-
-                    table->stats->matched_count++;
+    packet_handle_std_validate(pkt->handle_std);
+    entry = flow_classifier_lookup(&table->classifier, &pkt->handle_std->key, wc);
+    flow_table_count_lookup(table, entry, pkt);
 
-                    return entry;
-                }
-                break;
+    return entry;
+}
 
-                break;
-            }
-            default: {
-                VLOG_WARN_RL(LOG_MODULE, &rl, "Trying to process flow entry with unknown match type (%u).", m->type);
-            }
-        }
+void
+flow_table_count_lookup(struct flow_table *table, struct flow_entry *entry,
+                        struct packet *pkt) {
+    /* Worker threads may count lookups on the same table concurrently. */
+    __atomic_fetch_add(&table->stats->lookup_count, 1, __ATOMIC_RELAXED);
+
+    if (entry != NULL) {
+        if (!entry->no_byt_count)
+            __atomic_fetch_add(&entry->stats->byte_count, pkt->buffer->size,
+                               __ATOMIC_RELAXED);
+        if (!entry->no_pkt_count)
+            __atomic_fetch_add(&entry->stats->packet_count, 1,
+                               __ATOMIC_RELAXED);
+        __atomic_store_n(&entry->last_used, time_msec(), __ATOMIC_RELAXED);
+
+        __atomic_fetch_add(&table->stats->matched_count, 1, __ATOMIC_RELAXED);
     }
-
-    return NULL;
 }
 
 
 
 void
 flow_table_timeout(struct flow_table *table) {
-    struct flow_entry *entry, *next;
+    long long int now = time_msec();
+    struct wheel_timer *timer;
+
+    /* Only the timers which are due are visited. */
+    while ((timer = timer_wheel_expire(&table->hard_timers, now)) != NULL) {
+        struct flow_entry *entry = CONTAINER_OF(timer, struct flow_entry, hard_timer);
 
-    /* NOTE: hard timeout entries are ordered by the time they should be removed at,
-     * so if one is not removed, the rest will not be either. */
-    LIST_FOR_EACH_SAFE (entry, next, struct flow_entry, hard_node, &table->hard_entries) {
         if (!flow_entry_hard_timeout(entry)) {
-            break;
+            timer_wheel_add(&table->hard_timers, timer, entry->remove_at + 1);
         }
     }
 
-    LIST_FOR_EACH_SAFE (entry, next, struct flow_entry, idle_node, &table->idle_entries) {
-        flow_entry_idle_timeout(entry);
+    while ((timer = timer_wheel_expire(&table->idle_timers, now)) != NULL) {
+        struct flow_entry *entry = CONTAINER_OF(timer, struct flow_entry, idle_timer);
+
+        /* The entry may have been used since the timer was set. */
+        if (!flow_entry_idle_timeout(entry)) {
+            timer_wheel_add(&table->idle_timers, timer, idle_expires(entry));
+        }
     }
 }
 
@@ -405,8 +407,10 @@ flow_table_create(struct datapath *dp, uint8_t table_id) {
     table->features->properties_num = flow_table_features(table->features);
 
     list_init(&table->match_entries);
-    list_init(&table->hard_entries);
-    list_init(&table->idle_entries);
+    timer_wheel_init(&table->hard_timers, time_msec());
+    timer_wheel_init(&table->idle_timers, time_msec());
+    flow_classifier_init(&table->classifier);
+    table->next_serial = 0;
 
     return table;
 }
@@ -415,9 +419,12 @@ void
 flow_table_destroy(struct flow_table *table) {
     struct flow_entry *entry, *next;
 
+    flow_classifier_destroy(&table->classifier);
     LIST_FOR_EACH_SAFE (entry, next, struct flow_entry, match_node, &table->match_entries) {
         flow_entry_destroy(entry);
     }
+    timer_wheel_destroy(&table->hard_timers);
+    timer_wheel_destroy(&table->idle_timers);
     free(table->features);
     free(table->stats);
     free(table);
@@ -439,7 +446,7 @@ flow_table_stats(struct flow_table *table, struct ofl_msg_multipart_request_flow
                 (*stats) = xrealloc(*stats, (sizeof(struct ofl_flow_stats *)) * (*stats_size) * 2);
                 *stats_size *= 2;
             }
-            (*stats)[(*stats_num)] = entry->stats;
+            (*stats)[(*stats_num)] = flow_entry_stats_snapshot(entry);
             (*stats_num)++;
         }
     }
@@ -455,9 +462,11 @@ flow_table_aggregate_stats(struct flow_table *table, struct ofl_msg_multipart_re
             (msg->out_group == OFPG_ANY || flow_entry_has_out_group(entry, msg->out_group))) {
 			
 			if (!entry->no_pkt_count)
-            	(*packet_count) += entry->stats->packet_count;
+            	(*packet_count) += __atomic_load_n(&entry->stats->packet_count,
+            	                                   __ATOMIC_RELAXED);
 			if (!entry->no_byt_count)            
-				(*byte_count)   += entry->stats->byte_count;
+				(*byte_count)   += __atomic_load_n(&entry->stats->byte_count,
+				                                   __ATOMIC_RELAXED);
             (*flow_count)++;
         }
     }
@@ -33,7 +33,9 @@
 #include "oflib/ofl.h"
 #include "oflib/ofl-messages.h"
 #include "oflib/ofl-structs.h"
+#include "flow_classifier.h"
 #include "pipeline.h"
+#include "timer-wheel.h"
 #include "timeval.h"
 
 
@@ -42,7 +44,8 @@
 
 /****************************************************************************
  * Implementation of a flow table. The current implementation stores flow
- * entries in priority and then insertion order.
+ * entries in priority and then insertion order, and indexes them in a tuple
+ * space search classifier for packet lookups.
  ****************************************************************************/
 
 
@@ -53,10 +56,12 @@ struct flow_table {
     struct ofl_table_stats    *stats;         /* structure storing table statistics. */
     
     struct list               match_entries;  /* list of entries in order. */
-    struct list               hard_entries;   /* list of entries with hard timeout;
-                                                ordered by their timeout times. */
-    struct list               idle_entries;   /* unordered list of entries with
-                                                idle timeout. */
+    struct timer_wheel        hard_timers;    /* hard timeouts of the entries. */
+    struct timer_wheel        idle_timers;    /* idle timeouts of the entries;
+                                                an entry used since its timer
+                                                was set is re-armed on expiry. */
+    struct flow_classifier    classifier;     /* index of entries for lookups. */
+    uint64_t                  next_serial;    /* serial of the next new entry. */
 };
 
 extern uint32_t oxm_ids[];
@@ -70,9 +75,18 @@ extern struct ofl_action_header actions[];
 ofl_err
 flow_table_flow_mod(struct flow_table *table, struct ofl_msg_flow_mod *mod, bool *match_kept, bool *insts_kept);
 
-/* Finds the flow entry with the highest priority, which matches the packet. */
+/* Finds the flow entry with the highest priority, which matches the packet.
+ * If 'wc' is not NULL, the match fields the result depends on are added to it. */
 struct flow_entry *
-flow_table_lookup(struct flow_table *table, struct packet *pkt);
+flow_table_lookup(struct flow_table *table, struct packet *pkt,
+                  struct flow_wildcards *wc);
+
+/* Updates the table and entry statistics for a lookup of the packet which
+ * resulted in the given entry (NULL on a miss). Used when the result of the
+ * lookup is already known, e.g. from the flow cache. */
+void
+flow_table_count_lookup(struct flow_table *table, struct flow_entry *entry,
+                        struct packet *pkt);
 
 /* Orders the flow table to check the timeout its flows. */
 void
@@ -86,7 +100,8 @@ flow_table_create(struct datapath *dp, uint8_t table_id);
 void
 flow_table_destroy(struct flow_table *table);
 
-/* Collects statistics of the flow entries of the table. */
+/* Collects snapshots of the statistics of the flow entries of the table. The
+ * caller frees each snapshot with free(). */
 void
 flow_table_stats(struct flow_table *table, struct ofl_msg_multipart_request_flow *msg,
                  struct ofl_flow_stats ***stats, size_t *stats_size, size_t *stats_num);
@@ -28,6 +28,7 @@
  *
  */
 
+#include <pthread.h>
 #include <stdbool.h>
 #include "flow_entry.h"
 #include "group_entry.h"
@@ -57,6 +58,7 @@ struct flow_ref_entry {
 
 /* Private data for select groups; for implementing weighted round-robin. */
 struct group_entry_wrr_data {
+    pthread_mutex_t mutex; /* serializes the selection of the workers. */
     uint16_t max_weight;  /* maximum weight of the buckets. */
     uint16_t gcd_weight;  /* g.c.d. of bucket weights. */
     uint16_t curr_weight; /* current weight in w.r.r. algorithm. */
@@ -66,6 +68,9 @@ struct group_entry_wrr_data {
 static uint16_t
 gcd(uint16_t a, uint16_t b);
 
+static void
+count_bucket(struct group_entry *entry, size_t bucket, size_t size);
+
 static bool
 bucket_is_alive(struct ofl_bucket *bucket, struct datapath *dp);
 
@@ -133,6 +138,11 @@ group_entry_destroy(struct group_entry *entry) {
 
     }
 
+    if (entry->desc->type == OFPGT_SELECT) {
+        struct group_entry_wrr_data *data = entry->data;
+
+        pthread_mutex_destroy(&data->mutex);
+    }
     ofl_structs_free_group_desc_stats(entry->desc, entry->dp->exp);
     ofl_structs_free_group_stats(entry->stats);
     free(entry->data);
@@ -144,11 +154,11 @@ static void
 execute_all(struct group_entry *entry, struct packet *pkt) {
     size_t i;
 
-    /* TODO Zoltan: Currently packets are always cloned. However it should
-     * be possible to see if cloning is necessary, or not, based on bucket actions. */
+    /* The clones share the buffer of the packet, which is only copied for
+     * the buckets that modify it. */
     for (i=0; i<entry->desc->buckets_num; i++) {
         struct ofl_bucket *bucket = entry->desc->buckets[i];
-        struct packet *p = packet_clone(pkt);
+        struct packet *p = packet_clone_shared(pkt);
 
         if (VLOG_IS_DBG_ENABLED(LOG_MODULE)) {
             char *b = ofl_structs_bucket_to_string(bucket, entry->dp->exp);
@@ -158,10 +168,7 @@ execute_all(struct group_entry *entry, struct packet *pkt) {
 
         action_set_write_actions(p->action_set, bucket->actions_num, bucket->actions);
 
-        entry->stats->byte_count += p->buffer->size;
-        entry->stats->packet_count++;
-        entry->stats->counters[i]->byte_count += p->buffer->size;
-        entry->stats->counters[i]->packet_count++;
+        count_bucket(entry, i, p->buffer->size);
 
         /* Cookie field is set 0xffffffffffffffff
            because we cannot associate to any
@@ -188,10 +195,7 @@ execute_select(struct group_entry *entry, struct packet *pkt) {
 
         action_set_write_actions(pkt->action_set, bucket->actions_num, bucket->actions);
 
-        entry->stats->byte_count += pkt->buffer->size;
-        entry->stats->packet_count++;
-        entry->stats->counters[b]->byte_count += pkt->buffer->size;
-        entry->stats->counters[b]->packet_count++;
+        count_bucket(entry, b, pkt->buffer->size);
         /* Cookie field is set 0xffffffffffffffff
            because we cannot associate to any
            particular flow */
@@ -217,10 +221,7 @@ execute_indirect(struct group_entry *entry, struct packet *pkt) {
 
         action_set_write_actions(pkt->action_set, bucket->actions_num, bucket->actions);
 
-        entry->stats->byte_count += pkt->buffer->size;
-        entry->stats->packet_count++;
-        entry->stats->counters[0]->byte_count += pkt->buffer->size;
-        entry->stats->counters[0]->packet_count++;
+        count_bucket(entry, 0, pkt->buffer->size);
         /* Cookie field is set 0xffffffffffffffff
            because we cannot associate to any
            particular flow */
@@ -247,10 +248,7 @@ execute_ff(struct group_entry *entry, struct packet *pkt) {
 
         action_set_write_actions(pkt->action_set, bucket->actions_num, bucket->actions);
 
-        entry->stats->byte_count += pkt->buffer->size;
-        entry->stats->packet_count++;
-        entry->stats->counters[b]->byte_count += pkt->buffer->size;
-        entry->stats->counters[b]->packet_count++;
+        count_bucket(entry, b, pkt->buffer->size);
         /* Cookie field is set 0xffffffffffffffff
            because we cannot associate to any
            particular flow */
@@ -312,6 +310,31 @@ group_entry_update(struct group_entry *entry){
     entry->stats->duration_nsec = ((time_msec() - entry->created) % 1000) * 1000000;
 }
 
+struct ofl_group_stats *
+group_entry_stats_snapshot(struct group_entry *entry) {
+    struct ofl_group_stats *src = entry->stats;
+    struct ofl_group_stats *stats = xmalloc(sizeof(struct ofl_group_stats));
+    size_t i;
+
+    stats->group_id      = src->group_id;
+    stats->ref_count     = src->ref_count;
+    stats->packet_count  = __atomic_load_n(&src->packet_count, __ATOMIC_RELAXED);
+    stats->byte_count    = __atomic_load_n(&src->byte_count, __ATOMIC_RELAXED);
+    stats->duration_sec  = src->duration_sec;
+    stats->duration_nsec = src->duration_nsec;
+    stats->counters_num  = src->counters_num;
+    stats->counters      = xmalloc(sizeof(struct ofl_bucket_counter *) * src->counters_num);
+
+    for (i = 0; i < src->counters_num; i++) {
+        stats->counters[i] = xmalloc(sizeof(struct ofl_bucket_counter));
+        stats->counters[i]->packet_count =
+                __atomic_load_n(&src->counters[i]->packet_count, __ATOMIC_RELAXED);
+        stats->counters[i]->byte_count =
+                __atomic_load_n(&src->counters[i]->byte_count, __ATOMIC_RELAXED);
+    }
+    return stats;
+}
+
 /* Returns true if the group entry has  reference to the flow entry. */
 static bool
 has_flow_ref(struct group_entry *entry, struct flow_entry *fe) {
@@ -385,6 +408,7 @@ init_select_group(struct group_entry *entry, struct ofl_msg_group_mod *mod) {
     entry->data = xmalloc(sizeof(struct group_entry_wrr_data));
     data = (struct group_entry_wrr_data *)entry->data;
 
+    pthread_mutex_init(&data->mutex, NULL);
     data->curr_weight = 0;
     data->curr_bucket = -1;
 
@@ -416,6 +440,7 @@ select_from_select_group(struct group_entry *entry) {
     data = (struct group_entry_wrr_data *)entry->data;
     guard = 0;
 
+    pthread_mutex_lock(&data->mutex);
     while (guard < entry->desc->buckets_num) {
         data->curr_bucket = (data->curr_bucket + 1) % entry->desc->buckets_num;
 
@@ -428,10 +453,14 @@ select_from_select_group(struct group_entry *entry) {
         }
 
         if (entry->desc->buckets[data->curr_bucket]->weight >= data->curr_weight) {
-            return data->curr_bucket;
+            size_t selected = data->curr_bucket;
+
+            pthread_mutex_unlock(&data->mutex);
+            return selected;
         }
         guard++;
     }
+    pthread_mutex_unlock(&data->mutex);
     VLOG_WARN_RL(LOG_MODULE, &rl, "Could not select from select group.");
     return -1;
 }
@@ -449,6 +478,18 @@ select_from_ff_group(struct group_entry *entry) {
     return -1;
 }
 
+/* Counts a packet of 'size' bytes executed by the given bucket of the group.
+ * Worker threads execute groups concurrently. */
+static void
+count_bucket(struct group_entry *entry, size_t bucket, size_t size) {
+    __atomic_fetch_add(&entry->stats->byte_count, size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->stats->packet_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->stats->counters[bucket]->byte_count, size,
+                       __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->stats->counters[bucket]->packet_count, 1,
+                       __ATOMIC_RELAXED);
+}
+
 /* Returns the g.c.d. of the two numbers. */
 static uint16_t
 gcd(uint16_t a, uint16_t b) {
@@ -95,4 +95,9 @@ group_entry_del_flow_ref(struct group_entry *entry, struct flow_entry *fe);
 void
 group_entry_update(struct group_entry *entry);
 
+/* Returns a copy of the group entry statistics, with the counters the worker
+ * threads update read atomically. Released with ofl_structs_free_group_stats. */
+struct ofl_group_stats *
+group_entry_stats_snapshot(struct group_entry *entry);
+
 #endif /* GROUP_entry_H */
@@ -38,10 +38,13 @@
 #include "hmap.h"
 #include "list.h"
 #include "packet.h"
+#include "pipeline.h"
 #include "util.h"
 #include "openflow/openflow.h"
 #include "oflib/ofl.h"
 #include "oflib/ofl-messages.h"
+#include "oflib/ofl-structs.h"
+#include "oflib/ofl-utils.h"
 
 #include "vlog.h"
 #define LOG_MODULE VLM_group_t
@@ -191,6 +194,8 @@ group_table_handle_group_mod(struct group_table *table, struct ofl_msg_group_mod
     if(sender->remote->role == OFPCR_ROLE_SLAVE)
         return ofl_error(OFPET_BAD_REQUEST, OFPBRC_IS_SLAVE);
 
+    flow_cache_invalidate(&table->dp->pipeline->cache);
+
     for (i=0; i< mod->buckets_num; i++) {
         error = dp_actions_validate(table->dp, mod->buckets[i]->actions_num, mod->buckets[i]->actions);
         if (error) {
@@ -244,18 +249,19 @@ group_table_handle_stats_request_group(struct group_table *table,
 
             HMAP_FOR_EACH(e, struct group_entry, node, &table->entries) {
                  group_entry_update(e);
-                 reply.stats[i] = e->stats;
+                 reply.stats[i] = group_entry_stats_snapshot(e);
                  i++;
              }
 
         } else {
             group_entry_update(entry);
-            reply.stats[0] = entry->stats;
+            reply.stats[0] = group_entry_stats_snapshot(entry);
         }
 
         dp_send_message(table->dp, (struct ofl_msg_header *)&reply, sender);
 
-        free(reply.stats);
+        OFL_UTILS_FREE_ARR_FUN(reply.stats, reply.stats_num,
+                               ofl_structs_free_group_stats);
         ofl_msg_free((struct ofl_msg_header *)msg, table->dp->exp);
         return 0;
     }
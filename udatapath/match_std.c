@@ -31,9 +31,15 @@
 
 #include <stdbool.h>
 #include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "lib/hash.h"
 #include "oflib/oxm-match.h"
 #include "match_std.h"
+#include "util.h"
 
 
 #include "vlog.h"
@@ -180,10 +186,9 @@ match_amaru(uint8_t *a, uint8_t *b)
 
 /* Returns true if the fields in *packet matches the flow entry in *flow_match */
 bool
-packet_match(struct ofl_match *flow_match, struct ofl_match *packet){
+packet_match(struct ofl_match *flow_match, const struct packet_key *packet){
 
     struct ofl_match_tlv *f;
-    struct ofl_match_tlv *packet_f;
     bool has_mask;
     int field_len;
     int packet_header;
@@ -225,8 +230,8 @@ packet_match(struct ofl_match *flow_match, struct ofl_match *packet){
             flow_mask = f->value + field_len;
         }
         /* Lookup the packet header */
-        packet_f = oxm_match_lookup(packet_header, packet);
-        if (!packet_f) {
+        packet_val = packet_key_get(packet, packet_header);
+        if (!packet_val) {
         	if (f->header==OXM_OF_VLAN_VID &&
         			*((uint16_t *) f->value)==OFPVID_NONE) {
         		/* There is no VLAN tag, as required */
@@ -236,7 +241,6 @@ packet_match(struct ofl_match *flow_match, struct ofl_match *packet){
         }
 
         /* Compare the flow and packet field values, considering the mask, if any */
-        packet_val = packet_f->value;
         switch (field_len) {
             case 1:
                 if (has_mask) {
@@ -355,6 +359,130 @@ packet_match(struct ofl_match *flow_match, struct ofl_match *packet){
     return true;
 }
 
+/* Adds a field to the compiled match. 'value' and 'mask' hold the field's
+ * length of bytes; 'mask' is NULL if the field is not masked. */
+static void
+flow_matcher_put(struct flow_matcher *matcher, int field, const uint8_t *value,
+                 const uint8_t *mask) {
+    const struct packet_key_field *kf = &packet_key_fields[field];
+    uint8_t *v = (uint8_t *)&matcher->value + kf->ofs;
+    uint8_t *m = (uint8_t *)&matcher->mask + kf->ofs;
+    size_t end = kf->ofs + kf->len;
+    size_t i;
+
+    for (i = 0; i < kf->len; i++) {
+        m[i] = mask != NULL ? mask[i] : 0xff;
+        v[i] = value[i] & m[i];
+    }
+    matcher->value.present |= UINT64_C(1) << field;
+    matcher->mask.present |= UINT64_C(1) << field;
+    end = ROUND_UP(end, FLOW_MATCHER_ALIGN);
+    if (end > matcher->len) {
+        matcher->len = end;
+    }
+}
+
+void
+flow_matcher_compile(struct flow_matcher *matcher, struct ofl_match *match) {
+    struct ofl_match_tlv *f;
+
+    packet_key_init(&matcher->value);
+    packet_key_init(&matcher->mask);
+    matcher->len = FLOW_MATCHER_ALIGN;   /* the presence bitmap. */
+    matcher->fallback = false;
+
+    if (match->header.length == 0) {
+        return;
+    }
+
+    HMAP_FOR_EACH(f, struct ofl_match_tlv, hmap_node, &match->match_fields)
+    {
+        bool has_mask = OXM_HASMASK(f->header);
+        int field_len = OXM_LENGTH(f->header);
+        uint32_t header = f->header;
+        uint8_t *mask = NULL;
+        int field;
+
+        if (has_mask) {
+            field_len /= 2;
+            header &= 0xfffffe00;
+            header |= field_len;
+            mask = f->value + field_len;
+        }
+        field = packet_key_field(header);
+
+        /* packet_match() has special rules for these, and fails fields the
+         * key cannot hold. */
+        if (field < 0 || header == OXM_OF_IPV6_EXTHDR ||
+            header == OXM_OF_AMARU_LEVEL || header == OXM_OF_AMARU_AMAC) {
+            matcher->fallback = true;
+            return;
+        }
+
+        if (header == OXM_OF_VLAN_VID) {
+            uint16_t vid = *((uint16_t *) f->value);
+
+            if (vid == OFPVID_NONE) {
+                if (has_mask) {
+                    matcher->fallback = true;
+                    return;
+                }
+                /* The packet must not have a VLAN tag. */
+                matcher->mask.present |= UINT64_C(1) << field;
+            } else if (vid == OFPVID_PRESENT) {
+                /* Any VLAN ID is acceptable. */
+                uint8_t zero[2] = {0, 0};
+                flow_matcher_put(matcher, field, zero, zero);
+            } else {
+                vid &= VLAN_VID_MASK;
+                flow_matcher_put(matcher, field, (uint8_t *) &vid, mask);
+            }
+            continue;
+        }
+
+        flow_matcher_put(matcher, field, f->value, mask);
+    }
+}
+
+bool
+flow_matcher_match(const struct flow_matcher *matcher,
+                   const struct packet_key *key) {
+    const uint8_t *k = (const uint8_t *) key;
+    const uint8_t *v = (const uint8_t *) &matcher->value;
+    const uint8_t *m = (const uint8_t *) &matcher->mask;
+    size_t i;
+#if defined(__AVX2__)
+    __m256i diff = _mm256_setzero_si256();
+
+    for (i = 0; i < matcher->len; i += 32) {
+        __m256i x = _mm256_xor_si256(_mm256_load_si256((const void *) (k + i)),
+                                     _mm256_load_si256((const void *) (v + i)));
+        diff = _mm256_or_si256(diff, _mm256_and_si256(x,
+                               _mm256_load_si256((const void *) (m + i))));
+    }
+    return _mm256_testz_si256(diff, diff);
+#elif defined(__SSE2__)
+    __m128i diff = _mm_setzero_si128();
+
+    for (i = 0; i < matcher->len; i += 16) {
+        __m128i x = _mm_xor_si128(_mm_load_si128((const void *) (k + i)),
+                                  _mm_load_si128((const void *) (v + i)));
+        diff = _mm_or_si128(diff, _mm_and_si128(x,
+                            _mm_load_si128((const void *) (m + i))));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) == 0xffff;
+#else
+    uint64_t diff = 0;
+
+    for (i = 0; i < matcher->len; i += 8) {
+        diff |= (*(const uint64_t *) (const void *) (k + i) ^
+                 *(const uint64_t *) (const void *) (v + i)) &
+                *(const uint64_t *) (const void *) (m + i);
+    }
+    return diff == 0;
+#endif
+}
+
 
 static inline bool
 strict_mask8(uint8_t *a, uint8_t *b, uint8_t *am, uint8_t *bm) {
@@ -34,6 +34,7 @@
 
 #include <stdbool.h>
 #include "oflib/ofl-structs.h"
+#include "packet_key.h"
 
 /****************************************************************************
  * Functions for comparing two extended match structures.
@@ -42,8 +43,34 @@
 bool
 match_std_overlap(struct ofl_match *a, struct ofl_match *b);
 
+/* Returns true if the packet key matches the flow match. */
 bool 
-packet_match(struct ofl_match *a, struct ofl_match *b);
+packet_match(struct ofl_match *a, const struct packet_key *b);
+
+/* A flow match compiled to the layout of the packet key. A packet matches if
+ * ((key ^ value) & mask) is zero over the whole key; the presence bitmap is
+ * compared the same way, so that required fields have their bit set in both
+ * 'value' and 'mask', and fields that must be absent only in 'mask'. */
+struct flow_matcher {
+    struct packet_key  value;
+    struct packet_key  mask;
+    size_t             len;      /* bytes of the key with mask bits set,
+                                    rounded up to FLOW_MATCHER_ALIGN. */
+    bool               fallback; /* true if the match has fields only
+                                    packet_match() handles. */
+};
+
+#define FLOW_MATCHER_ALIGN 32
+
+/* Compiles the flow match. */
+void
+flow_matcher_compile(struct flow_matcher *matcher, struct ofl_match *match);
+
+/* Returns true if the packet key matches the compiled flow match. Matchers
+ * with 'fallback' set must be checked with packet_match() instead. */
+bool
+flow_matcher_match(const struct flow_matcher *matcher,
+                   const struct packet_key *key);
 
 /* Returns true if match a matches match b, in a strict manner. */
 bool
@@ -240,10 +240,18 @@ meter_entry_apply(struct meter_entry *entry, struct packet **pkt){
                                        drop precedence is low (tos 0x***010**)
                                        or medium (tos 0x***100**). Jean II */
                     if (((old_drop == 0x8) && (band_header->prec_level <= 2)) || ((old_drop == 0x10) && (band_header->prec_level <= 1))) {
-                        uint8_t new_drop = old_drop + (band_header->prec_level << 3);
-                        uint8_t new_tos = new_drop | (ipv4->ip_tos & 0xE3);
-                        uint16_t old_val = htons((ipv4->ip_ihl_ver << 8) + ipv4->ip_tos);
-                        uint16_t new_val = htons((ipv4->ip_ihl_ver << 8) + new_tos);
+                        uint8_t new_drop;
+                        uint8_t new_tos;
+                        uint16_t old_val;
+                        uint16_t new_val;
+
+                        /* The buffer may be shared with group clones. */
+                        packet_make_writable(*pkt);
+                        ipv4 = (*pkt)->handle_std->proto->ipv4;
+                        new_drop = old_drop + (band_header->prec_level << 3);
+                        new_tos = new_drop | (ipv4->ip_tos & 0xE3);
+                        old_val = htons((ipv4->ip_ihl_ver << 8) + ipv4->ip_tos);
+                        new_val = htons((ipv4->ip_ihl_ver << 8) + new_tos);
                         ipv4->ip_csum = recalc_csum16(ipv4->ip_csum, old_val, new_val);
                         ipv4->ip_tos = new_tos;
                     }
@@ -255,10 +263,14 @@ meter_entry_apply(struct meter_entry *entry, struct packet **pkt){
                     if (((old_drop == 0x800000) && (band_header->prec_level <= 2)) || ((old_drop == 0x1000000) && (band_header->prec_level <= 1))){
                         uint32_t prec_level = band_header->prec_level << 23;
                         uint32_t new_drop = old_drop + prec_level;
+
+                        packet_make_writable(*pkt);
+                        ipv6 = (*pkt)->handle_std->proto->ipv6;
                         ipv6->ipv6_ver_tc_fl = htonl(new_drop | (ipv6_ver_tc_fl & 0xFE3FFFFF));
                     }
                 }
-                (*pkt)->handle_std->valid = false;
+                packet_handle_std_field_changed((*pkt)->handle_std,
+                                                OXM_OF_IP_DSCP);
 		}
                 break;
             }
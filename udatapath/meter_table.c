@@ -37,6 +37,7 @@
 #include "hmap.h"
 #include "list.h"
 #include "packet.h"
+#include "pipeline.h"
 #include "util.h"
 #include "openflow/openflow.h"
 #include "oflib/ofl.h"
@@ -56,6 +57,7 @@ meter_table_create(struct datapath *dp) {
     table->dp = dp;
     table->entries_num = 0;
     hmap_init(&table->meter_entries);
+    pthread_mutex_init(&table->mutex, NULL);
  
 	table->features = xmalloc(sizeof(struct ofl_meter_features));
 	table->features->max_meter = DEFAULT_MAX_METER;
@@ -76,6 +78,7 @@ meter_table_destroy(struct meter_table *table) {
         meter_entry_destroy(entry);
     }
     ///////////////////////////free features
+    pthread_mutex_destroy(&table->mutex);
     free(table);
 }
 
@@ -106,7 +109,9 @@ meter_table_apply(struct meter_table *table, struct packet **packet, uint32_t me
         return;
     }
 
-   meter_entry_apply(entry, packet);
+    pthread_mutex_lock(&table->mutex);
+    meter_entry_apply(entry, packet);
+    pthread_mutex_unlock(&table->mutex);
 }
 
 
@@ -215,6 +220,8 @@ meter_table_handle_meter_mod(struct meter_table *table, struct ofl_msg_meter_mod
     if(sender->remote->role == OFPCR_ROLE_SLAVE)
         return ofl_error(OFPET_BAD_REQUEST, OFPBRC_IS_SLAVE);
 
+    flow_cache_invalidate(&table->dp->pipeline->cache);
+
     switch (mod->command) {
         case (OFPMC_ADD): {
             return meter_table_add(table, mod);
@@ -255,6 +262,9 @@ meter_table_handle_stats_request_meter(struct meter_table *table,
                  .stats     = xmalloc(sizeof(struct ofl_meter_stats *) * (msg->meter_id == OFPM_ALL ? table->entries_num : 1))
                 };
 
+        /* Worker threads update the counters under the mutex; hold it until
+         * the reply is packed. */
+        pthread_mutex_lock(&table->mutex);
         if (msg->meter_id == OFPM_ALL) {
             struct meter_entry *e;
             size_t i = 0;
@@ -271,6 +281,7 @@ meter_table_handle_stats_request_meter(struct meter_table *table,
         }
 
         dp_send_message(table->dp, (struct ofl_msg_header *)&reply, sender);
+        pthread_mutex_unlock(&table->mutex);
 
         free(reply.stats);
         ofl_msg_free((struct ofl_msg_header *)msg, table->dp->exp);
@@ -342,9 +353,12 @@ void
 meter_table_add_tokens(struct meter_table *table){
 
     struct meter_entry *entry;
+
+    pthread_mutex_lock(&table->mutex);
     HMAP_FOR_EACH(entry, struct meter_entry, node, &table->meter_entries){
         refill_bucket(entry);
     }
+    pthread_mutex_unlock(&table->mutex);
 
 }
 
@@ -32,6 +32,7 @@
 #ifndef METER_TABLE_H
 #define METER_TABLE_H 1
 
+#include <pthread.h>
 #include <stdbool.h>
 #include "hmap.h"
 #include "list.h"
@@ -57,7 +58,9 @@ struct meter_table {
 	size_t				 entries_num;		/* The number of meters */
   struct hmap			meter_entries;	    /* Meter entries */
 	size_t              bands_num;
-
+	pthread_mutex_t     mutex;              /* Protects the buckets and
+	                                           counters of the meters from
+	                                           the worker threads */
 };
 
 
@@ -0,0 +1,1154 @@
+# Compiles the protocol descriptions of a NetPDL file into a C packet
+# parser, so that the datapath does not need the NetBee interpreter.
+#
+# Usage: netpdl2c.pl [--openflow=openflow.h] [--packets=packets.h]
+#                    [--start=ethernet] netpdl.xml
+#
+# Every protocol reachable from the start protocol that the datapath keeps
+# a header pointer for (see %headers), or that carries a "{0x8000 N}" OXM
+# field, becomes one C function.  The format section is compiled into
+# straight-line code, and the encapsulation section into direct calls of
+# the next protocol's function.  Fields are added to the key the way
+# nbee_link does it: only for the first instance of each protocol, with the
+# ethertype taken from the first non-VLAN type field, and with the values
+# nbee_link computes for them (see %nbee_fields and below).  Blocks tagged
+# "{0x8000 39 bit ...}" are IPv6 extension headers and feed the
+# OXM_OF_IPV6_EXTHDR pseudo-field.
+
+use strict;
+use warnings;
+use Getopt::Long;
+
+my $openflow_h = 'include/openflow/openflow.h';
+my $packets_h = 'lib/packets.h';
+my $start = 'ethernet';
+GetOptions("openflow=s" => \$openflow_h, "packets=s" => \$packets_h,
+           "start=s" => \$start) or exit(1);
+@ARGV == 1
+    or die "usage: $0 [--openflow=FILE] [--packets=FILE] [--start=PROTO] NETPDL\n";
+my $netpdl = $ARGV[0];
+
+# The protocols_std members of the protocols the datapath knows about.
+my %headers = (
+    ethernet => ['eth', 'struct eth_header', 'ETH_HEADER_LEN'],
+    vlan     => ['vlan', 'struct vlan_header', 'VLAN_HEADER_LEN', 'vlan_last'],
+    mpls     => ['mpls', 'struct mpls_header', 'MPLS_HEADER_LEN'],
+    pbb      => ['pbb', 'struct pbb_header', 'PBB_HEADER_LEN'],
+    arp      => ['arp', 'struct arp_eth_header', 'ARP_ETH_HEADER_LEN'],
+    ip       => ['ipv4', 'struct ip_header', 'IP_HEADER_LEN'],
+    ipv6     => ['ipv6', 'struct ipv6_header', 'IPV6_HEADER_LEN'],
+    tcp      => ['tcp', 'struct tcp_header', 'TCP_HEADER_LEN'],
+    udp      => ['udp', 'struct udp_header', 'UDP_HEADER_LEN'],
+    sctp     => ['sctp', 'struct sctp_header', 'SCTP_HEADER_LEN'],
+    icmp     => ['icmp', 'struct icmp_header', 'ICMP_HEADER_LEN'],
+    icmp6    => ['icmp', 'struct icmp_header', 'ICMP_HEADER_LEN'],
+    amaru    => ['amaru', 'struct Amaru_header', 'AMARU_HEADER_LEN'],
+);
+
+# Fields nbee_link looks up by name although they have no OXM tag.
+my %nbee_fields = (
+    'ipv6 flabel' => 'OXM_OF_IPV6_FLABEL',
+    'sctp sport'  => 'OXM_OF_SCTP_SRC',
+    'sctp dport'  => 'OXM_OF_SCTP_DST',
+);
+
+# nbee_link ignores the mask of the bit fields it matches on, and masks the
+# whole value itself, by field and field size.
+my %nbee_bits = (
+    OXM_OF_VLAN_VID    => {2 => '((%1$s & VLAN_VID_MASK) >> VLAN_VID_SHIFT)'},
+    OXM_OF_VLAN_PCP    => {2 => '((%1$s & VLAN_PCP_MASK) >> VLAN_PCP_SHIFT)'},
+    OXM_OF_IP_DSCP     => {1 => '((%1$s & IP_DSCP_MASK) >> 2)',
+                           4 => '((%1$s & IPV6_DSCP_MASK) >> IPV6_DSCP_SHIFT)'},
+    OXM_OF_IP_ECN      => {1 => '(%1$s & IP_ECN_MASK)',
+                           4 => '((%1$s >> IPV6_ECN_SHIFT) & IPV6_ECN_MASK)'},
+    OXM_OF_MPLS_LABEL  => {4 => '((%1$s & MPLS_LABEL_MASK) >> MPLS_LABEL_SHIFT)'},
+    OXM_OF_MPLS_TC     => {4 => '((%1$s & MPLS_TC_MASK) >> MPLS_TC_SHIFT)'},
+    OXM_OF_MPLS_BOS    => {4 => '((%1$s & MPLS_S_MASK) >> MPLS_S_SHIFT)'},
+    OXM_OF_IPV6_FLABEL => {4 => '(%1$s & IPV6_FLABEL_MASK)'},
+    OXM_OF_PBB_ISID    => {4 => '(%1$s & PBB_ISID_MASK)'},
+);
+
+# OXM field numbers and lengths, and IPv6 extension header flags.
+my (%oxm_name, %oxm_len, %ieh_name);
+open(my $of, '<', $openflow_h) or die "$openflow_h: $!\n";
+while (<$of>) {
+    $oxm_name{$2} = "OXM_OF_$1" if /^\s*OFPXMT_OFB_(\w+)\s*=\s*(\d+)/;
+    $oxm_len{"OXM_OF_$1"} = $2
+        if /^#define\s+OXM_OF_(\w+)\s+OXM_HEADER\s*\(\s*0x8000,\s*OFPXMT_OFB_\w+,\s*(\d+)\)/;
+    $ieh_name{$2} = "OFPIEH_$1" if /^\s*OFPIEH_(\w+)\s*=\s*1\s*<<\s*(\d+)/;
+}
+close($of);
+
+# Header lengths.
+my %header_len;
+open(my $ph, '<', $packets_h) or die "$packets_h: $!\n";
+while (<$ph>) {
+    $header_len{$1} = $2 if /^#define\s+(\w+_LEN)\s+(\d+)\s*$/;
+}
+close($ph);
+
+# A minimal XML reader: elements, attributes and nothing else.
+sub parse_xml {
+    my ($text) = @_;
+    my $root = {name => '#root', attrs => {}, kids => []};
+    my @stack = ($root);
+
+    $text =~ s/<!--.*?-->//gs;
+    $text =~ s/<\?.*?\?>//gs;
+    while ($text =~ /<(\/?)([\w:.-]+)((?:\s+[\w:.-]+\s*=\s*"[^"]*")*)\s*(\/?)>/g) {
+        my ($close, $name, $attrs, $empty) = ($1, $2, $3, $4);
+        if ($close) {
+            $stack[-1]{name} eq $name
+                or die "$netpdl: </$name> closes <$stack[-1]{name}>\n";
+            pop(@stack);
+            next;
+        }
+        my %a;
+        while ($attrs =~ /([\w:.-]+)\s*=\s*"([^"]*)"/g) {
+            my ($k, $v) = ($1, $2);
+            $v =~ s/&lt;/</g;
+            $v =~ s/&gt;/>/g;
+            $v =~ s/&quot;/"/g;
+            $v =~ s/&amp;/&/g;
+            $a{$k} = $v;
+        }
+        my $node = {name => $name, attrs => \%a, kids => []};
+        push(@{$stack[-1]{kids}}, $node);
+        push(@stack, $node) if !$empty;
+    }
+    @stack == 1 or die "$netpdl: <$stack[-1]{name}> is not closed\n";
+    return $root;
+}
+
+sub kids {
+    my ($node, $name) = @_;
+    return grep { $_->{name} eq $name } @{$node->{kids}};
+}
+
+open(my $in, '<', $netpdl) or die "$netpdl: $!\n";
+my $xml = parse_xml(do { local $/; <$in> });
+close($in);
+
+my ($db) = kids($xml, 'netpdl') or die "$netpdl: no <netpdl> element\n";
+my %protocols = map { $_->{attrs}{name} => $_ } kids($db, 'protocol');
+exists $protocols{$start} or die "$netpdl: no protocol $start\n";
+
+# Per-protocol facts.
+my %formats;       # protocol -> <format>
+my %blocks;        # protocol -> {block name -> <block>}
+my %compiled;      # protocols that get a C function
+
+for my $name (keys %protocols) {
+    my ($format) = kids($protocols{$name}, 'format');
+    $formats{$name} = $format;
+    $blocks{$name} = {map { $_->{attrs}{name} => $_ } kids($format, 'block')}
+        if $format;
+}
+
+my $proto;         # the protocol being compiled.
+
+sub field_oxm {
+    my ($node, $p) = @_;
+    my $longname = $node->{attrs}{longname} // '';
+    my $name = $node->{attrs}{name} // '';
+    $p //= $proto;
+    return $nbee_fields{"$p $name"}
+        if $node->{name} eq 'field' && $nbee_fields{"$p $name"};
+    return undef if $longname !~ /^\s*\{\s*0x8000\s+(\d+)\s*\}/;
+    return $oxm_name{$1} // die "$netpdl: unknown OXM field $1\n";
+}
+
+sub block_exthdr {
+    my ($node) = @_;
+    my $longname = $node->{attrs}{longname} // '';
+    return undef if $longname !~ /^\s*\{\s*0x8000\s+39\s+(\d+)/;
+    return $ieh_name{$1} // die "$netpdl: unknown extension header bit $1\n";
+}
+
+# Calls $fn on every node of the format of $proto reachable from $items,
+# following includeblk.
+sub walk {
+    my ($proto, $items, $fn, $seen) = @_;
+    $seen //= {};
+    for my $node (@$items) {
+        $fn->($node);
+        if ($node->{name} eq 'includeblk') {
+            my $block = $blocks{$proto}{$node->{attrs}{name}}
+                or die "$netpdl: $proto: no block $node->{attrs}{name}\n";
+            next if $seen->{$block}++;
+            $fn->($block);
+            walk($proto, $block->{kids}, $fn, $seen);
+            delete $seen->{$block};
+        } elsif ($node->{name} ne 'field') {
+            walk($proto, $node->{kids}, $fn, $seen);
+        }
+    }
+}
+
+sub format_items {
+    my ($proto) = @_;
+    my $format = $formats{$proto} or return [];
+    my ($fields) = kids($format, 'fields');
+    return $fields ? $fields->{kids} : [];
+}
+
+# The protocols compiled: reachable from the start protocol, and either
+# known to the datapath or carrying match fields.
+sub has_oxm {
+    my ($proto) = @_;
+    my $found = 0;
+    walk($proto, format_items($proto),
+         sub { $found = 1 if field_oxm($_[0], $proto)
+                             || block_exthdr($_[0]) });
+    return $found;
+}
+
+sub next_protos {
+    my ($proto) = @_;
+    my @next;
+    my ($encap) = kids($protocols{$proto}, 'encapsulation');
+    return () if !$encap;
+    my $collect;
+    $collect = sub {
+        for my $node (@{$_[0]{kids}}) {
+            if ($node->{name} eq 'nextproto') {
+                (my $n = $node->{attrs}{proto}) =~ s/^#//;
+                push(@next, $n);
+            }
+            $collect->($node);
+        }
+    };
+    $collect->($encap);
+    return @next;
+}
+
+my @order;
+my @queue = ($start);
+while (@queue) {
+    my $proto = shift(@queue);
+    next if $compiled{$proto};
+    next if !$protocols{$proto};
+    next if !$headers{$proto} && !has_oxm($proto);
+    $compiled{$proto} = 1;
+    push(@order, $proto);
+    push(@queue, next_protos($proto));
+}
+
+# Expressions.
+our ($expr_text, @tokens, $expr_refs);
+
+sub tokenize {
+    my ($text) = @_;
+    my @t;
+    while ($text =~ /\G\s*(0x[0-9a-fA-F]+|0b[01]+|\d+|\$\w+|\w+|==|!=|<=|>=|[-+*\/()<>!:\[\]])/gc) {
+        push(@t, $1);
+    }
+    $text =~ /\G\s*$/gc or die "$netpdl: cannot parse expression '$text'\n";
+    return @t;
+}
+
+sub peek { return $tokens[0] // ''; }
+sub take {
+    my ($want) = @_;
+    my $t = shift(@tokens);
+    die "$netpdl: expected '$want' in '$expr_text'\n"
+        if defined $want && (!defined $t || $t ne $want);
+    return $t;
+}
+
+sub expr_binary {
+    my ($level) = @_;
+    my @levels = (
+        {or => '||'},
+        {and => '&&'},
+        {'==' => '==', '!=' => '!=', eq => '==', ne => '!=',
+         lt => '<', gt => '>', le => '<=', ge => '>=',
+         '<' => '<', '>' => '>', '<=' => '<=', '>=' => '>='},
+        {bitwor => '|'},
+        {bitwand => '&'},
+        {'+' => '+', '-' => '-'},
+        {'*' => '*', div => '/', '/' => '/', mod => '%'},
+    );
+    return expr_unary() if $level == @levels;
+    my $left = expr_binary($level + 1);
+    while (exists $levels[$level]{peek()}) {
+        my $op = $levels[$level]{take()};
+        my $right = expr_binary($level + 1);
+        $left = "($left $op $right)";
+    }
+    return $left;
+}
+
+sub expr_unary {
+    if (peek() eq 'not' || peek() eq '!') {
+        take();
+        return '(!' . expr_unary() . ')';
+    }
+    if (peek() eq '-') {
+        take();
+        return '(-' . expr_unary() . ')';
+    }
+    return expr_primary();
+}
+
+sub expr_primary {
+    my $t = take();
+    die "$netpdl: truncated expression '$expr_text'\n" if !defined $t;
+    if ($t eq '(') {
+        my $e = expr_binary(0);
+        take(')');
+        return $e;
+    }
+    return "INT64_C($t)" if $t =~ /^(0x[0-9a-fA-F]+|\d+)$/;
+    return 'INT64_C(' . oct($t) . ')' if $t =~ /^0b/;
+    return '(int64_t)cur' if $t eq '$currentoffset';
+    return '(int64_t)ctx->length' if $t eq '$packetlength';
+    return '(int64_t)ctx->size' if $t eq '$framelength';
+    return 'INT64_C(1)' if $t eq '$linklayer';
+    if ($t eq 'buf2int') {
+        my $e;
+        take('(');
+        if (peek() eq '$packet') {
+            take();
+            take('[');
+            my $off = expr_binary(0);
+            take(':');
+            my $len = take();
+            $len =~ /^[1248]$/
+                or die "$netpdl: unsupported \$packet length in '$expr_text'\n";
+            take(']');
+            $e = "netpdl_peek(ctx, $off, $len)";
+        } else {
+            my @name;
+            push(@name, take()) while peek() ne ')' && peek() ne '';
+            my $name = join(' ', @name);
+            $expr_refs->{$name}++;
+            $e = '(int64_t)' . local_name($name);
+        }
+        take(')');
+        return $e;
+    }
+    die "$netpdl: unsupported '$t' in expression '$expr_text'\n";
+}
+
+# Returns the C translation of a NetPDL expression, counting the fields it
+# refers to in %$refs.
+sub expr {
+    my ($text, $refs) = @_;
+    local $expr_text = $text;
+    local @tokens = tokenize($text);
+    local $expr_refs = $refs // {};
+    my $e = expr_binary(0);
+    die "$netpdl: trailing '$tokens[0]' in '$text'\n" if @tokens;
+    return $e;
+}
+
+sub local_name {
+    my ($name) = @_;
+    (my $c = $name) =~ s/\W/_/g;
+    return "f_$c";
+}
+
+sub number {
+    my ($v) = @_;
+    return $v =~ /^0[xb]/i ? oct($v) : $v =~ /^[0-9a-fA-F]+$/ && $v =~ /[a-fA-F]/
+        ? hex($v) : $v;
+}
+
+# Counts the field references of every expression under $items.
+sub refs_of {
+    my ($proto, $items) = @_;
+    my %refs;
+    walk($proto, $items, sub {
+        my ($node) = @_;
+        for my $attr (qw(expr value)) {
+            next if !defined $node->{attrs}{$attr};
+            next if $node->{name} eq 'case';
+            next if $node->{name} eq 'assign-variable'
+                && $node->{attrs}{name} ne '$packetlength';
+            expr($node->{attrs}{$attr}, \%refs);
+        }
+    });
+    return \%refs;
+}
+
+# Code generation.
+our $out = '';
+our $fail = 'goto done;';   # leaves the item that runs out of packet
+my ($refs, $oxm_deferred, $label_id, $uses_start, $exthdr);
+my %oxm_kind;       # deferred field -> 'int' or 'bytes'
+my $avail;          # bytes known to be in the packet from the cursor on
+
+sub emit {
+    my ($depth, $line) = @_;
+    $out .= ($line eq '' ? '' : '    ' x $depth) . $line . "\n";
+}
+
+# True if $items adds match fields or sets fields read outside $items.
+sub needed {
+    my ($items) = @_;
+    my $inner = refs_of($proto, $items);
+    my $need = 0;
+    walk($proto, $items, sub {
+        my ($node) = @_;
+        $need = 1 if field_oxm($node) || block_exthdr($node);
+        $need = 1 if $node->{name} eq 'loopctrl';
+        $need = 1 if $node->{name} eq 'field' && defined $node->{attrs}{name}
+            && ($refs->{$node->{attrs}{name}} // 0)
+               > ($inner->{$node->{attrs}{name}} // 0);
+    });
+    return $need;
+}
+
+# The number of bytes $items always takes, or undef.
+sub static_size {
+    my ($items) = @_;
+    my $size = 0;
+    my $pending = 0;
+    for my $node (@$items) {
+        my $name = $node->{name};
+        if ($name eq 'field') {
+            my $type = $node->{attrs}{type};
+            if ($type eq 'fixed') {
+                $size += $node->{attrs}{size};
+            } elsif ($type eq 'bit') {
+                if (number($node->{attrs}{mask}) & 1) {
+                    $size += $node->{attrs}{size};
+                }
+            } else {
+                return undef;
+            }
+        } elsif ($name eq 'block') {
+            my $s = static_size($node->{kids});
+            return undef if !defined $s;
+            $size += $s;
+        } elsif ($name eq 'includeblk') {
+            my $s = static_size($blocks{$proto}{$node->{attrs}{name}}{kids});
+            return undef if !defined $s;
+            $size += $s;
+        } else {
+            return undef;
+        }
+    }
+    return $size;
+}
+
+sub read_int {
+    my ($size) = @_;
+    return {1 => 'p[cur]', 2 => 'netpdl_get16(p + cur)',
+            4 => 'netpdl_get32(p + cur)', 8 => 'netpdl_get64(p + cur)'}->{$size}
+        // die "$netpdl: $proto: cannot read a $size byte integer\n";
+}
+
+sub emit_check {
+    my ($d, $size) = @_;
+    return if $size <= $avail;
+    emit($d, "if (ctx->size - cur < $size) {");
+    emit($d + 1, $fail);
+    emit($d, '}');
+    $avail = $size;
+}
+
+sub emit_advance {
+    my ($d, $size) = @_;
+    my $indent = '    ' x $d;
+
+    $avail = $avail > $size ? $avail - $size : 0;
+    if ($out =~ s/^${indent}cur \+= (\d+);\n\z//m) {
+        $size += $1;
+    }
+    emit($d, "cur += $size;");
+}
+
+sub emit_skip {
+    my ($d, $len) = @_;
+    if ($len =~ /^INT64_C\((\d+)\)$/ && $1 <= $avail) {
+        emit_advance($d, $1);
+        return;
+    }
+    emit($d, "if (!netpdl_skip(ctx, &cur, $len)) {");
+    emit($d + 1, $fail);
+    emit($d, '}');
+    $avail = 0;
+}
+
+# Adds an integer value to the key.
+sub emit_put_int {
+    my ($d, $oxm, $value) = @_;
+    my $len = $oxm_len{$oxm};
+    if ($oxm eq 'OXM_OF_ETH_TYPE') {
+        emit($d, "packet_parse_eth_type(ctx->key, $value);");
+        return;
+    }
+    if ($oxm_deferred->{$oxm}) {
+        emit($d, "if (first) {");
+        emit($d + 1, "v_$oxm = $value;");
+        emit($d + 1, "has_$oxm = true;");
+        emit($d, '}');
+        return;
+    }
+    emit($d, "if (first) {");
+    emit($d + 1, put_int($oxm, $value) . ';');
+    emit($d, '}');
+}
+
+sub put_int {
+    my ($oxm, $value) = @_;
+    my $len = $oxm_len{$oxm};
+    return "netpdl_put24(ctx->key, $oxm, $value)" if $len == 3;
+    return "packet_key_put${\($len * 8)}(ctx->key, $oxm, $value)"
+        if $len =~ /^(1|2|4|8)$/;
+    die "$netpdl: $proto: $oxm is not an integer field\n";
+}
+
+sub put_bytes {
+    my ($oxm, $ptr) = @_;
+    return "packet_key_put(ctx->key, $oxm, $ptr)";
+}
+
+sub emit_field {
+    my ($d, $node) = @_;
+    my $a = $node->{attrs};
+    my $oxm = field_oxm($node);
+    my $ref = defined $a->{name} && $refs->{$a->{name}};
+    my $type = $a->{type};
+
+    if ($type eq 'fixed' || $type eq 'bit') {
+        my $size = $a->{size};
+        my ($value, $put);
+        my $bytes = $type eq 'fixed' && $oxm
+            && (($a->{showtemplate} // '') =~ /addr|MAC/i
+                || $size !~ /^(1|2|4|8)$/);
+
+        emit_check($d, $size);
+        if ($type eq 'bit') {
+            my $mask = number($a->{mask});
+            my $shift = 0;
+            $shift++ while $mask && !(($mask >> $shift) & 1);
+            $value = sprintf('((%s & 0x%x) >> %d)', read_int($size), $mask,
+                             $shift);
+            $value = sprintf('(%s & 0x%x)', read_int($size), $mask)
+                if $shift == 0;
+        } elsif (!$bytes) {
+            $value = read_int($size);
+        }
+        if ($ref) {
+            die "$netpdl: $proto: $a->{name} is not an integer\n"
+                if !defined $value;
+            emit($d, local_name($a->{name}) . " = $value;");
+            $value = local_name($a->{name});
+        }
+        $put = $value;
+        if ($oxm && $type eq 'bit') {
+            my $fmt = $nbee_bits{$oxm}{$size}
+                // die "$netpdl: $proto: nbee_link does not decode a "
+                       . "$size byte $oxm\n";
+            $put = sprintf($fmt, read_int($size));
+        }
+        if ($oxm) {
+            $oxm_len{$oxm} <= $size || $type eq 'bit'
+                or die "$netpdl: $proto: $a->{name} is shorter than $oxm\n";
+            $oxm_kind{$oxm} = $bytes ? 'bytes' : 'int';
+            if ($bytes) {
+                if ($oxm_deferred->{$oxm}) {
+                    emit($d, "if (first) {");
+                    emit($d + 1, "v_$oxm = p + cur;");
+                    emit($d, '}');
+                } else {
+                    emit($d, "if (first) {");
+                    emit($d + 1, put_bytes($oxm, 'p + cur') . ';');
+                    emit($d, '}');
+                }
+            } else {
+                emit_put_int($d, $oxm, $put);
+            }
+        }
+        emit_advance($d, $size)
+            if $type eq 'fixed' || (number($a->{mask}) & 1);
+    } elsif ($type eq 'variable') {
+        die "$netpdl: $proto: variable field $a->{name} has an OXM\n" if $oxm;
+        emit_skip($d, expr($a->{expr}));
+    } elsif ($type eq 'padding') {
+        $uses_start = 1;
+        emit_skip($d, "(INT64_C($a->{align}) - (int64_t)(cur - start) % "
+                      . "INT64_C($a->{align})) % INT64_C($a->{align})");
+        $avail = 0;
+    } else {
+        die "$netpdl: $proto: unsupported field type $type\n";
+    }
+}
+
+sub emit_items {
+    my ($d, $items, $trim) = @_;
+    my @items = @$items;
+
+    if ($trim) {
+        pop(@items) while @items && !needed([$items[-1]]);
+    }
+    # Runs of fields nobody reads are skipped in one step.
+    my $skip = 0;
+    for my $i (0 .. $#items) {
+        my $n = skipped_size($items[$i]);
+        if (defined $n) {
+            $skip += $n;
+            next;
+        }
+        emit_skip($d, "INT64_C($skip)") if $skip;
+        $skip = 0;
+        emit_item($d, $items[$i], $trim && $i == $#items);
+    }
+    emit_skip($d, "INT64_C($skip)") if $skip;
+}
+
+# The size of a field that is neither matched on nor read, or undef.
+sub skipped_size {
+    my ($node) = @_;
+    my $a = $node->{attrs};
+    if ($node->{name} eq 'block' || $node->{name} eq 'includeblk') {
+        my $block = $node->{name} eq 'block'
+            ? $node : $blocks{$proto}{$node->{attrs}{name}};
+        my $size = 0;
+        return undef if !$block || block_exthdr($block);
+        for my $kid (@{$block->{kids}}) {
+            my $n = skipped_size($kid);
+            return undef if !defined $n;
+            $size += $n;
+        }
+        return $size;
+    }
+    return undef if $node->{name} ne 'field' || field_oxm($node);
+    return undef if defined $a->{name} && $refs->{$a->{name}};
+    return $a->{size} if $a->{type} eq 'fixed';
+    return number($a->{mask}) & 1 ? $a->{size} : 0 if $a->{type} eq 'bit';
+    return undef;
+}
+
+sub emit_item {
+    my ($d, $node, $trim) = @_;
+    my $name = $node->{name};
+
+    if ($name eq 'field') {
+        emit_field($d, $node);
+    } elsif ($name eq 'block' || $name eq 'includeblk') {
+        my $block = $node;
+        if ($name eq 'includeblk') {
+            $block = $blocks{$proto}{$node->{attrs}{name}}
+                or die "$netpdl: $proto: no block $node->{attrs}{name}\n";
+        }
+        my $flag = block_exthdr($block);
+        if ($flag) {
+            $exthdr = 1;
+            emit($d, "packet_parse_ipv6_exthdr(&exthdr, $flag);");
+        }
+        emit_items($d, $block->{kids}, $trim);
+    } elsif ($name eq 'switch') {
+        my $id = ++$label_id;
+        my $first = 1;
+        my @cases = grep { $_->{name} eq 'case' || $_->{name} eq 'default' }
+                    @{$node->{kids}};
+        my $saved = $avail;
+        emit($d, '{');
+        emit($d + 1, "int64_t sw$id = " . expr($node->{attrs}{expr}) . ';');
+        emit($d + 1, '');
+        for my $case (@cases) {
+            my $cond;
+            if ($case->{name} eq 'default') {
+                $cond = undef;
+            } elsif (defined $case->{attrs}{maxvalue}) {
+                $cond = sprintf('sw%d >= %s && sw%d <= %s', $id,
+                                $case->{attrs}{value}, $id,
+                                $case->{attrs}{maxvalue});
+            } else {
+                $cond = "sw$id == $case->{attrs}{value}";
+            }
+            if (defined $cond) {
+                emit($d + 1, ($first ? '' : '} else ') . "if ($cond) {");
+            } else {
+                emit($d + 1, $first ? '{' : '} else {');
+            }
+            $avail = $saved;
+            emit_items($d + 2, $case->{kids}, $trim);
+            $first = 0;
+        }
+        emit($d + 1, '}') if !$first;
+        emit($d, '}');
+        $avail = 0;
+    } elsif ($name eq 'if') {
+        my ($true) = kids($node, 'if-true');
+        my ($false) = kids($node, 'if-false');
+        my $saved = $avail;
+        emit($d, 'if (' . expr($node->{attrs}{expr}) . ') {');
+        emit_items($d + 1, $true ? $true->{kids} : [], $trim);
+        if ($false && @{$false->{kids}}) {
+            emit($d, '} else {');
+            $avail = $saved;
+            emit_items($d + 1, $false->{kids}, $trim);
+        }
+        emit($d, '}');
+        $avail = 0;
+    } elsif ($name eq 'loop') {
+        my $type = $node->{attrs}{type};
+        my $e = expr($node->{attrs}{expr});
+        my $id = ++$label_id;
+        my $body = $node->{kids};
+
+        $avail = 0;
+
+        if ($type eq 'size') {
+            return emit_skip($d, $e) if !needed($body);
+            emit($d, '{');
+            emit($d + 1, "int64_t len$id = $e;");
+            emit($d + 1, "size_t end$id;");
+            emit($d + 1, '');
+            emit($d + 1, "if (len$id < 0 || (uint64_t)len$id > ctx->size - cur) {");
+            emit($d + 2, $fail);
+            emit($d + 1, '}');
+            emit($d + 1, "end$id = cur + len$id;");
+            emit($d + 1, "while (cur < end$id) {");
+            emit($d + 2, "size_t prev$id = cur;");
+            emit($d + 2, '');
+            {
+                # A malformed item only ends the loop, which has its size.
+                local $fail = "goto out$id;";
+                emit_items($d + 2, $body);
+            }
+            emit($d + 2, "if (cur == prev$id) {");
+            emit($d + 3, 'break;');
+            emit($d + 2, '}');
+            emit($d + 1, '}');
+            emit(0, "out$id:") if $out =~ /goto out$id;/;
+            emit($d + 1, "cur = end$id;");
+            emit($d, '}');
+            $avail = 0;
+        } elsif ($type eq 'times2repeat') {
+            my $size = static_size($body);
+            return emit_skip($d, "($e) * INT64_C($size)")
+                if defined $size && !needed($body);
+            emit($d, '{');
+            emit($d + 1, "int64_t n$id = $e;");
+            emit($d + 1, '');
+            emit($d + 1, "while (n$id-- > 0) {");
+            emit_items($d + 2, $body);
+            emit($d + 1, '}');
+            emit($d, '}');
+            $avail = 0;
+        } elsif ($type eq 'while' || $type eq 'do-while') {
+            my $cond = $e eq 'INT64_C(1)' ? ';;' : undef;
+            if ($type eq 'while') {
+                emit($d, defined $cond ? 'for (;;) {' : "while ($e) {");
+            } else {
+                emit($d, 'do {');
+            }
+            emit($d + 1, "size_t prev$id = cur;");
+            emit($d + 1, '');
+            emit_items($d + 1, $body);
+            emit($d + 1, "if (cur == prev$id) {");
+            emit($d + 2, 'break;');
+            emit($d + 1, '}');
+            emit($d, $type eq 'while' ? '}' : "} while ($e);");
+            $avail = 0;
+        } else {
+            die "$netpdl: $proto: unsupported loop type $type\n";
+        }
+    } elsif ($name eq 'loopctrl') {
+        my $type = $node->{attrs}{type};
+        $type eq 'break' || $type eq 'continue'
+            or die "$netpdl: $proto: unsupported loopctrl $type\n";
+        emit($d, "$type;");
+    } else {
+        die "$netpdl: $proto: unsupported element <$name>\n";
+    }
+}
+
+# The $packetlength assignments of the execute-code "after" sections.
+sub emit_after {
+    my ($d, $items) = @_;
+    for my $node (@$items) {
+        if ($node->{name} eq 'assign-variable') {
+            next if $node->{attrs}{name} ne '$packetlength';
+            emit($d, 'netpdl_set_length(ctx, '
+                     . expr($node->{attrs}{value}, $refs) . ');');
+        } elsif ($node->{name} eq 'if') {
+            my $assigns = 0;
+            walk($proto, [$node], sub {
+                $assigns = 1 if $_[0]{name} eq 'assign-variable'
+                    && $_[0]{attrs}{name} eq '$packetlength';
+            });
+            next if !$assigns;
+            my ($true) = kids($node, 'if-true');
+            my ($false) = kids($node, 'if-false');
+            emit($d, 'if (' . expr($node->{attrs}{expr}, $refs) . ') {');
+            emit_after($d + 1, $true ? $true->{kids} : []);
+            if ($false) {
+                emit($d, '} else {');
+                emit_after($d + 1, $false->{kids});
+            }
+            emit($d, '}');
+        }
+    }
+}
+
+sub emit_encap {
+    my ($d, $items) = @_;
+    for my $node (@$items) {
+        my $name = $node->{name};
+        if ($name eq 'nextproto') {
+            (my $next = $node->{attrs}{proto}) =~ s/^#//;
+            if ($compiled{$next}) {
+                emit($d, "netpdl_$next(ctx, cur);");
+            }
+            emit($d, 'return;');
+        } elsif ($name eq 'switch') {
+            my $id = ++$label_id;
+            my $first = 1;
+            emit($d, '{');
+            emit($d + 1, "int64_t sw$id = " . expr($node->{attrs}{expr}) . ';');
+            emit($d + 1, '');
+            for my $case (@{$node->{kids}}) {
+                next if $case->{name} ne 'case' && $case->{name} ne 'default';
+                if ($case->{name} eq 'default') {
+                    emit($d + 1, $first ? '{' : '} else {');
+                } elsif (defined $case->{attrs}{maxvalue}) {
+                    emit($d + 1, ($first ? '' : '} else ')
+                         . "if (sw$id >= $case->{attrs}{value} && "
+                         . "sw$id <= $case->{attrs}{maxvalue}) {");
+                } else {
+                    emit($d + 1, ($first ? '' : '} else ')
+                         . "if (sw$id == $case->{attrs}{value}) {");
+                }
+                emit_encap($d + 2, $case->{kids});
+                $first = 0;
+            }
+            emit($d + 1, '}') if !$first;
+            emit($d, '}');
+        } elsif ($name eq 'if') {
+            my ($true) = kids($node, 'if-true');
+            my ($false) = kids($node, 'if-false');
+            emit($d, 'if (' . expr($node->{attrs}{expr}) . ') {');
+            emit_encap($d + 1, $true ? $true->{kids} : []);
+            if ($false) {
+                emit($d, '} else {');
+                emit_encap($d + 1, $false->{kids});
+            }
+            emit($d, '}');
+        } else {
+            die "$netpdl: $proto: unsupported encapsulation <$name>\n";
+        }
+    }
+}
+
+# The maximum number of times $oxm can be set along one path of $items.
+sub occurrences {
+    my ($items, $oxm) = @_;
+    my $n = 0;
+    for my $node (@$items) {
+        my $name = $node->{name};
+        if ($name eq 'field') {
+            $n++ if (field_oxm($node) // '') eq $oxm;
+        } elsif ($name eq 'block') {
+            $n += occurrences($node->{kids}, $oxm);
+        } elsif ($name eq 'includeblk') {
+            $n += occurrences($blocks{$proto}{$node->{attrs}{name}}{kids}, $oxm);
+        } elsif ($name eq 'switch') {
+            my $max = 0;
+            for my $case (@{$node->{kids}}) {
+                my $c = occurrences($case->{kids}, $oxm);
+                $max = $c if $c > $max;
+            }
+            $n += $max;
+        } elsif ($name eq 'if') {
+            my $max = 0;
+            for my $branch (@{$node->{kids}}) {
+                my $c = occurrences($branch->{kids}, $oxm);
+                $max = $c if $c > $max;
+            }
+            $n += $max;
+        } elsif ($name eq 'loop') {
+            $n += 2 * occurrences($node->{kids}, $oxm);
+        }
+    }
+    return $n;
+}
+
+sub emit_protocol {
+    ($proto) = @_;
+    my $items = format_items($proto);
+    my ($encap) = kids($protocols{$proto}, 'encapsulation');
+    my ($code) = kids($protocols{$proto}, 'execute-code');
+    my @after = $code ? kids($code, 'after') : ();
+    my $leaf = !grep { $compiled{$_} } next_protos($proto);
+    my $h = $headers{$proto};
+    my (%oxms, $body);
+
+    # Fields read by expressions.
+    $refs = refs_of($proto, $items);
+    for my $node (@after) {
+        my $when = $node->{attrs}{when};
+        expr($when, $refs) if defined $when;
+        my $saved = $out;
+        emit_after(0, $node->{kids});
+        $out = $saved;
+    }
+    if ($encap) {
+        walk($proto, [$encap], sub {
+            expr($_[0]{attrs}{expr}, $refs) if defined $_[0]{attrs}{expr};
+        });
+    }
+
+    # Fields set more than once in a header are added once, at the end.
+    walk($proto, $items, sub {
+        my $oxm = field_oxm($_[0]);
+        $oxms{$oxm} = 1 if $oxm;
+    });
+    $oxm_deferred = {};
+    for my $oxm (keys %oxms) {
+        $oxm_deferred->{$oxm} = 1
+            if $oxm ne 'OXM_OF_ETH_TYPE' && occurrences($items, $oxm) > 1;
+    }
+
+    # The code first, to learn what it needs declared.
+    ($label_id, $uses_start, $exthdr) = (0, 0, 0);
+    $avail = $h ? $header_len{$h->[2]} // die "$packets_h: no $h->[2]\n" : 0;
+    $body = capture(sub { emit_items(1, $items, $leaf && !@after) });
+
+    $exthdr && exists $oxms{OXM_OF_IP_PROTO}
+        or !$exthdr or die "$netpdl: $proto: extension headers without a "
+                           . "next header field\n";
+    $oxm_deferred->{OXM_OF_IP_PROTO} = 1 if $exthdr;
+
+    $body .= capture(sub {
+        for my $node (@after) {
+            my $when = $node->{attrs}{when};
+            my $cond = defined $when ? constant(expr($when)) : 1;
+            if (!defined $cond) {
+                emit(1, 'if (' . expr($when) . ') {');
+                emit_after(2, $node->{kids});
+                emit(1, '}');
+            } elsif ($cond) {
+                emit_after(1, $node->{kids});
+            }
+        }
+        emit_done($leaf || !$encap);
+        emit_encap(1, $encap->{kids}) if !$leaf && $encap;
+    });
+    if ($body =~ /^done:\n\z/m) {
+        $body =~ s/goto done;/return;/g;
+        $body =~ s/^done:\n//m;
+    } elsif ($body !~ /goto done;/) {
+        $body =~ s/^done:\n//m;
+    }
+    my $first = $h || $body =~ /\bfirst\b/;
+
+    emit(0, 'static void');
+    emit(0, "netpdl_$proto(struct netpdl_ctx *ctx, size_t cur) {");
+    emit(1, 'uint8_t *p = ctx->data;') if $body =~ /\bp\b/;
+    emit(1, 'size_t start = cur;') if $uses_start;
+    emit(1, 'bool first;') if $first;
+    emit(1, 'bool parsed = false;') if $body =~ /\bparsed\b/;
+    emit(1, 'struct ipv6_exthdr_walk exthdr = {0, 0, 0};') if $exthdr;
+    for my $name (sort keys %$refs) {
+        my $local = local_name($name);
+        emit(1, "uint64_t $local = 0;") if $body =~ /\b$local\b/;
+    }
+    for my $oxm (sort keys %$oxm_deferred) {
+        if ($oxm_kind{$oxm} eq 'int') {
+            emit(1, "uint64_t v_$oxm = 0;");
+            emit(1, "bool has_$oxm = false;");
+        } else {
+            emit(1, "uint8_t *v_$oxm = NULL;");
+        }
+    }
+    emit(0, '');
+    emit(1, 'if (++ctx->headers > NETPDL_MAX_HEADERS) {');
+    emit(2, 'return;');
+    emit(1, '}');
+    if ($h) {
+        my ($member, $type, $len, $last) = @$h;
+        emit(1, "if (ctx->size - cur < $len) {");
+        emit(2, 'return;');
+        emit(1, '}');
+        emit(1, "first = ctx->proto->$member == NULL;");
+        emit(1, 'if (first) {');
+        emit(2, "ctx->proto->$member = ($type *)netpdl_at(ctx, cur);");
+        emit(1, '}');
+        emit(1, "ctx->proto->$last = ($type *)netpdl_at(ctx, cur);")
+            if $last;
+    } else {
+        my $bit = (grep { $order[$_] eq $proto } 0 .. $#order)[0];
+        $bit < 64 or die "$netpdl: too many protocols\n";
+        emit(1, "first = !(ctx->seen & (UINT64_C(1) << $bit));") if $first;
+        emit(1, "ctx->seen |= UINT64_C(1) << $bit;");
+    }
+    $out .= $body;
+    emit(0, '}');
+    emit(0, '');
+}
+
+# Returns what $fn emits.
+sub capture {
+    my ($fn) = @_;
+    local $out = '';
+    $fn->();
+    return $out;
+}
+
+# Returns the value of a C expression made of constants only, or undef.
+sub constant {
+    my ($e) = @_;
+    (my $p = $e) =~ s/INT64_C\(([^()]*)\)/$1/g;
+    return undef if $p !~ /^[\s\d()x+*\/%<>=!&|-]+$/i;
+    my $v = eval $p;
+    return $@ ? undef : $v ? 1 : 0;
+}
+
+# The fields collected while parsing, added once the header is parsed.  The
+# encapsulation is only followed if the whole header was there.
+sub emit_done {
+    my ($last) = @_;
+    my @deferred = sort keys %$oxm_deferred;
+
+    if (!$last) {
+        emit(1, 'parsed = true;');
+    }
+    emit(0, 'done:');
+    if (@deferred || $exthdr) {
+        emit(1, 'if (first) {');
+        for my $oxm (@deferred) {
+            if ($oxm_kind{$oxm} eq 'int') {
+                emit(2, "if (has_$oxm) {");
+                emit(3, put_int($oxm, "v_$oxm") . ';');
+                emit(2, '}');
+            } else {
+                emit(2, "if (v_$oxm != NULL) {");
+                emit(3, put_bytes($oxm, "v_$oxm") . ';');
+                emit(2, '}');
+            }
+        }
+        if ($exthdr) {
+            emit(2, 'packet_key_put16(ctx->key, OXM_OF_IPV6_EXTHDR,');
+            emit(2, '        packet_parse_ipv6_exthdr_done(&exthdr, '
+                    . 'v_OXM_OF_IP_PROTO));');
+        }
+        emit(1, '}');
+    }
+    emit(1, 'if (!parsed) {') if !$last;
+    emit(2, 'return;') if !$last;
+    emit(1, '}') if !$last;
+}
+
+my $protos = join(', ', @order);
+$out .= <<EOF;
+/* Generated by netpdl2c.pl from $netpdl.  Do not edit.
+ *
+ * Protocols: $protos.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "packet_parse.h"
+#include "ofpbuf.h"
+#include "packets.h"
+#include "openflow/openflow.h"
+
+/* Bounds the number of headers parsed in a packet. */
+#define NETPDL_MAX_HEADERS 32
+
+struct netpdl_ctx {
+    uint8_t               *data;
+    size_t                 size;     /* bytes in the buffer. */
+    size_t                 length;   /* \$packetlength. */
+    struct packet_key     *key;
+    struct protocols_std  *proto;
+    uint64_t               seen;     /* protocols without a header pointer. */
+    int                    headers;  /* headers parsed so far. */
+};
+
+static inline void *
+netpdl_at(struct netpdl_ctx *ctx, size_t off) {
+    return ctx->data + off;
+}
+
+static inline uint16_t
+netpdl_get16(const uint8_t *p) {
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t
+netpdl_get32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline uint64_t
+netpdl_get64(const uint8_t *p) {
+    return ((uint64_t)netpdl_get32(p) << 32) | netpdl_get32(p + 4);
+}
+
+/* Reads an integer at an offset, or 0 past the end of the packet. */
+static inline int64_t
+netpdl_peek(const struct netpdl_ctx *ctx, int64_t off, size_t len) {
+    uint64_t v = 0;
+    size_t i;
+
+    if (off < 0 || (uint64_t)off > ctx->size || ctx->size - off < len) {
+        return 0;
+    }
+    for (i = 0; i < len; i++) {
+        v = (v << 8) | ctx->data[off + i];
+    }
+    return v;
+}
+
+/* Advances the cursor, unless that leaves the packet. */
+static inline bool
+netpdl_skip(const struct netpdl_ctx *ctx, size_t *cur, int64_t len) {
+    if (len < 0 || (uint64_t)len > ctx->size - *cur) {
+        return false;
+    }
+    *cur += len;
+    return true;
+}
+
+static inline void
+netpdl_set_length(struct netpdl_ctx *ctx, int64_t len) {
+    ctx->length = len < 0 ? 0 : (uint64_t)len > ctx->size ? ctx->size : len;
+}
+
+static inline void
+netpdl_put24(struct packet_key *key, uint32_t header, uint64_t v) {
+    uint8_t b[3] = {v >> 16, v >> 8, v};
+    packet_key_put(key, header, b);
+}
+
+EOF
+
+for my $p (@order) {
+    emit(0, "static void netpdl_$p(struct netpdl_ctx *ctx, size_t cur);");
+}
+emit(0, '');
+emit_protocol($_) for @order;
+
+my $start_len = $headers{$start} ? $headers{$start}[2] : 1;
+$out .= <<EOF;
+int
+packet_parse_netpdl(struct ofpbuf *pktin, struct packet_key *pktout,
+                    struct protocols_std *proto) {
+    struct netpdl_ctx ctx;
+
+    protocol_reset(proto);
+    if (pktin->size < $start_len) {
+        return -1;
+    }
+    ctx.data = pktin->data;
+    ctx.size = pktin->size;
+    ctx.length = pktin->size;
+    ctx.key = pktout;
+    ctx.proto = proto;
+    ctx.seen = 0;
+    ctx.headers = 0;
+    netpdl_$start(&ctx, 0);
+    return 1;
+}
+EOF
+
+print $out;
@@ -34,6 +34,7 @@
 #include <sys/types.h>
 #include "datapath.h"
 #include "dp_buffers.h"
+#include "dp_pool.h"
 #include "packet.h"
 #include "packets.h"
 #include "action_set.h"
@@ -44,13 +45,142 @@
 /*Modificaciones Boby UAH*/
 // #include "inet.h"
 /*+++FIN+++*/
+
+static void buffer_destroy(void *buffer);
+
+static struct dp_pool packet_pool =
+    DP_POOL_INITIALIZER("packet", sizeof(struct packet), NULL);
+
+/* Buffers with data, and headers of buffers whose data were not allocated
+ * with them (received in a ring or shared). */
+static struct dp_pool buffer_pool =
+    DP_POOL_INITIALIZER("buffer", sizeof(struct ofpbuf), buffer_destroy);
+static struct dp_pool buffer_header_pool =
+    DP_POOL_INITIALIZER("buffer header", sizeof(struct ofpbuf), NULL);
+/* Reference counts of the data shared by the clones of a packet. */
+static struct dp_pool ref_cnt_pool =
+    DP_POOL_INITIALIZER("buffer ref_cnt", sizeof(unsigned int), NULL);
+
+static void
+buffer_destroy(void *buffer)
+{
+    ofpbuf_delete(buffer);
+}
+
+struct ofpbuf *
+packet_buffer_new(size_t size, size_t headroom)
+{
+    struct ofpbuf *buffer = dp_pool_get(&buffer_pool);
+
+    if (buffer == NULL)
+    {
+        return ofpbuf_new_with_headroom(size, headroom);
+    }
+    ofpbuf_use(buffer, buffer->base, buffer->allocated);
+    ofpbuf_prealloc_tailroom(buffer, headroom + size);
+    ofpbuf_reserve(buffer, headroom);
+    return buffer;
+}
+
+struct ofpbuf *
+packet_buffer_header(void)
+{
+    struct ofpbuf *buffer = dp_pool_alloc(&buffer_header_pool);
+
+    ofpbuf_use_foreign(buffer, NULL, 0);
+    return buffer;
+}
+
+/* Returns true if the data of 'buffer' are used by other buffers too. */
+static bool
+buffer_is_shared(const struct ofpbuf *buffer)
+{
+    return (buffer->ref_cnt != NULL
+            && __atomic_load_n(buffer->ref_cnt, __ATOMIC_ACQUIRE) > 1);
+}
+
+/* Initializes 'share' as a buffer that uses the data of 'buffer', as
+ * ofpbuf_use_shared() does.  The reference count comes from a pool, and data
+ * in a receive ring are shared in place rather than copied: a packet that
+ * outlives the batch it was received in gets a copy (see
+ * packet_own_buffer()). */
+static void
+buffer_share(struct ofpbuf *share, struct ofpbuf *buffer)
+{
+    if (buffer->ref_cnt == NULL)
+    {
+        buffer->ref_cnt = dp_pool_alloc(&ref_cnt_pool);
+        *buffer->ref_cnt = 1;
+        if (buffer->source == OFPBUF_MALLOC)
+        {
+            buffer->source = OFPBUF_SHARED;
+        }
+    }
+    __atomic_add_fetch(buffer->ref_cnt, 1, __ATOMIC_RELAXED);
+
+    *share = *buffer;
+    share->next = NULL;
+    share->private_p = NULL;
+}
+
+/* Gives back the reference count of 'buffer', whose data no other buffer
+ * uses anymore. */
+static void
+buffer_unshare(struct ofpbuf *buffer)
+{
+    dp_pool_free(&ref_cnt_pool, buffer->ref_cnt);
+    buffer->ref_cnt = NULL;
+    if (buffer->source == OFPBUF_SHARED)
+    {
+        buffer->source = OFPBUF_MALLOC;
+    }
+}
+
+void packet_buffer_delete(struct ofpbuf *buffer)
+{
+    if (buffer->ref_cnt != NULL)
+    {
+        if (__atomic_sub_fetch(buffer->ref_cnt, 1, __ATOMIC_ACQ_REL) != 0)
+        {
+            /* Another packet still uses the data. */
+            dp_pool_free(&buffer_header_pool, buffer);
+            return;
+        }
+        buffer_unshare(buffer);
+    }
+    if (buffer->source == OFPBUF_MALLOC && buffer->base != NULL)
+    {
+        dp_pool_free(&buffer_pool, buffer);
+    }
+    else
+    {
+        ofpbuf_uninit(buffer);
+        dp_pool_free(&buffer_header_pool, buffer);
+    }
+}
+
+/* Replaces the buffer of 'pkt' by a copy of its data, along with its headroom
+ * and tailroom, in a recycled buffer. */
+static void
+packet_copy_buffer(struct packet *pkt)
+{
+    struct ofpbuf *old = pkt->buffer;
+    void *data = old->data;
+
+    pkt->buffer = packet_buffer_new(old->size + ofpbuf_tailroom(old),
+                                    ofpbuf_headroom(old));
+    ofpbuf_put(pkt->buffer, data, old->size);
+    packet_buffer_delete(old);
+    packet_handle_std_rebase(pkt->handle_std, data);
+}
+
 struct packet *
 packet_create(struct datapath *dp, uint32_t in_port,
               struct ofpbuf *buf, bool packet_out)
 {
     struct packet *pkt;
 
-    pkt = xmalloc(sizeof(struct packet));
+    pkt = dp_pool_alloc(&packet_pool);
 
     pkt->dp = dp;
     pkt->buffer = buf;
@@ -74,7 +204,7 @@ packet_clone(struct packet *pkt)
 {
     struct packet *clone;
 
-    clone = xmalloc(sizeof(struct packet));
+    clone = dp_pool_alloc(&packet_pool);
     clone->dp = pkt->dp;
     clone->buffer = ofpbuf_clone(pkt->buffer);
     clone->in_port = pkt->in_port;
@@ -99,27 +229,72 @@ packet_clone(struct packet *pkt)
     return clone;
 }
 
+struct packet *
+packet_clone_shared(struct packet *pkt)
+{
+    struct packet *clone;
+
+    clone = dp_pool_alloc(&packet_pool);
+    clone->dp = pkt->dp;
+    clone->buffer = dp_pool_alloc(&buffer_header_pool);
+    buffer_share(clone->buffer, pkt->buffer);
+    clone->in_port = pkt->in_port;
+    clone->action_set = action_set_create(pkt->dp->exp);
+
+    clone->packet_out = pkt->packet_out;
+    clone->out_group = OFPG_ANY;
+    clone->out_port = OFPP_ANY;
+    clone->out_port_max_len = 0;
+    clone->out_queue = 0;
+    clone->buffer_id = NO_BUFFER;
+    clone->table_id = pkt->table_id;
+
+    clone->handle_std = packet_handle_std_clone(clone, pkt->handle_std);
+
+    return clone;
+}
+
+bool packet_is_shared(const struct packet *pkt)
+{
+    return buffer_is_shared(pkt->buffer);
+}
+
+void packet_make_writable(struct packet *pkt)
+{
+    if (buffer_is_shared(pkt->buffer))
+    {
+        packet_copy_buffer(pkt);
+    }
+    else if (pkt->buffer->ref_cnt != NULL)
+    {
+        /* The other packets are gone. */
+        buffer_unshare(pkt->buffer);
+    }
+}
+
+void packet_own_buffer(struct packet *pkt)
+{
+    if (pkt->buffer->source == OFPBUF_FOREIGN)
+    {
+        packet_copy_buffer(pkt);
+    }
+}
+
 void packet_destroy(struct packet *pkt)
 {
     /* If packet is saved in a buffer, do not destroy it,
      * if buffer is still valid */
 
-    if (pkt->buffer_id != NO_BUFFER)
+    if (pkt->buffer_id != NO_BUFFER &&
+        dp_buffers_release(pkt->dp->buffers, pkt->buffer_id))
     {
-        if (dp_buffers_is_alive(pkt->dp->buffers, pkt->buffer_id))
-        {
-            return;
-        }
-        else
-        {
-            dp_buffers_discard(pkt->dp->buffers, pkt->buffer_id, false);
-        }
+        return;
     }
 
     action_set_destroy(pkt->action_set);
-    ofpbuf_delete(pkt->buffer);
+    packet_buffer_delete(pkt->buffer);
     packet_handle_std_destroy(pkt->handle_std);
-    free(pkt);
+    dp_pool_free(&packet_pool, pkt);
 }
 
 char *
@@ -165,7 +340,7 @@ struct packet *packet_Amaru(struct datapath *dp, uint32_t in_port, bool packet_o
     //     Total[i] = 0x00;
 
     //Creamos el buffer del paquete
-    buf = ofpbuf_new(LEN_BASIC_PKT); //(sizeof(struct Amaru_header)+sizeof(struct eth_header)); //sizeof(struct eth_header));
+    buf = packet_buffer_new(LEN_BASIC_PKT, 0); //(sizeof(struct Amaru_header)+sizeof(struct eth_header)); //sizeof(struct eth_header));
     //lo rellenamos con la broadcast
     ofpbuf_put(buf, MAC_BC, ETH_ADDR_LEN);
     //lo rellenamos con la mac switch
@@ -186,20 +361,7 @@ struct packet *packet_Amaru(struct datapath *dp, uint32_t in_port, bool packet_o
     //Creamos el buffer del paquete
     pkt = packet_create(dp, in_port, buf, packet_out);
 
-    //creamos la cabeceras de eth y amaru
-    pkt->handle_std->proto->eth = xmalloc(sizeof(struct eth_header));
-    memcpy(pkt->handle_std->proto->eth->eth_dst, MAC_BC, ETH_ADDR_LEN);
-    memcpy(pkt->handle_std->proto->eth->eth_src, dp->ports[1].conf->hw_addr, ETH_ADDR_LEN);
-    pkt->handle_std->proto->eth->eth_type = ETH_TYPE_AMARU;
-
-    pkt->handle_std->proto->amaru = xmalloc(sizeof(struct Amaru_header));
-    pkt->handle_std->proto->amaru->level = level;
-    memcpy(pkt->handle_std->proto->amaru->amac, AMAC, AMAC_LEN);
-
-    pkt->handle_std->valid = false;
-
-    packet_handle_std_validate(pkt->handle_std); //perdemos la cabecera AMARU
-
+    /* packet_create() parsed the Ethernet and AMARU headers in 'buf'. */
     return pkt;
 }
 
@@ -235,7 +397,7 @@ struct packet *create_amaru_new_localport_packet_UAH(struct datapath *dp, uint32
     // uint8_t Total[LEN_BASIC_PKT] = {0};  /*, i = 0;*/
 
     //Creamos el buffer del paquete
-    buf = ofpbuf_new(LEN_AMARU_PORT_PKT); //(sizeof(struct Amaru_header)+sizeof(struct eth_header)); //sizeof(struct eth_header));
+    buf = packet_buffer_new(LEN_AMARU_PORT_PKT, 0); //(sizeof(struct Amaru_header)+sizeof(struct eth_header)); //sizeof(struct eth_header));
     //lo rellenamos con la broadcast
     ofpbuf_put(buf, MAC_BC, ETH_ADDR_LEN);
     //lo rellenamos con la mac broadcast //Puro trámite
@@ -281,14 +443,10 @@ void send_amaru_new_localport_packet_UAH(struct datapath *dp, uint32_t new_local
     msg.buffer_id = OFP_NO_BUFFER;
     msg.data_length = pkt->buffer->size;
 
-    if (!pkt->handle_std->valid)
-    {
-        packet_handle_std_validate(pkt->handle_std);
-    }
     /* In this implementation the fields in_port and in_phy_port
         always will be the same, because we are not considering logical
         ports*/
-    msg.match = (struct ofl_match_header *)&pkt->handle_std->match;
+    msg.match = (struct ofl_match_header *)packet_handle_std_ofl_match(pkt->handle_std);
     dp_send_message(pkt->dp, (struct ofl_msg_header *)&msg, NULL);
 }
 
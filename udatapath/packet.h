@@ -80,6 +80,39 @@ void packet_destroy(struct packet *pkt);
 struct packet *
 packet_clone(struct packet *pkt);
 
+/* Clones a packet, sharing its buffer instead of copying it.  Either packet
+ * must be made writable with packet_make_writable() before its buffer is
+ * modified. */
+struct packet *
+packet_clone_shared(struct packet *pkt);
+
+/* Returns true if the buffer of the packet is shared with other packets. */
+bool packet_is_shared(const struct packet *pkt);
+
+/* Makes sure that the buffer of the packet is not shared with other packets,
+ * copying it if needed. */
+void packet_make_writable(struct packet *pkt);
+
+/* Makes sure that the buffer of the packet is not in a port's receive ring,
+ * copying it if needed, for a packet kept after the batch it was received
+ * in. */
+void packet_own_buffer(struct packet *pkt);
+
+/* Returns an empty buffer with room for 'size' bytes of data after
+ * 'headroom' bytes of headroom, recycled from a destroyed packet if
+ * possible. */
+struct ofpbuf *
+packet_buffer_new(size_t size, size_t headroom);
+
+/* Returns an ofpbuf header without data, e.g. to be filled in by
+ * netdev_recv_ring(), recycled from a destroyed packet if possible. */
+struct ofpbuf *
+packet_buffer_header(void);
+
+/* Frees 'buffer', returned by one of the functions above or owned by a
+ * packet, keeping it for reuse. */
+void packet_buffer_delete(struct ofpbuf *buffer);
+
 /*UAH Modificacion */
 
 struct packet *packet_Amaru(struct datapath *dp, uint32_t in_port, bool packet_out, uint8_t level, uint32_t out_port, uint8_t AMAC[AMAC_LEN]);
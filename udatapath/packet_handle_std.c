@@ -29,70 +29,118 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 #include "packet_handle_std.h"
+#include "dp_pool.h"
 #include "packet.h"
 #include "packets.h"
 #include "oflib/ofl-structs.h"
 #include "openflow/openflow.h"
 #include "compiler.h"
 
-#include "lib/hash.h"
-#include "oflib/oxm-match.h"
+#include "util.h"
 
-#include "nbee_link/nbee_link.h"
+#include "packet_parse.h"
+
+static struct dp_pool handle_pool =
+    DP_POOL_INITIALIZER("packet handle", sizeof(struct packet_handle_std),
+                        NULL);
+static struct dp_pool proto_pool =
+    DP_POOL_INITIALIZER("packet headers", sizeof(struct protocols_std), NULL);
 
 /* Resets all protocol fields to NULL */
 
+/* Frees the match structure built from the key. */
+static void
+match_free_fields(struct packet_handle_std *handle) {
+    struct ofl_match_tlv * iter, *next;
+
+    HMAP_FOR_EACH_SAFE(iter, next, struct ofl_match_tlv, hmap_node, &handle->match.match_fields){
+        free(iter->value);
+        free(iter);
+    }
+    hmap_destroy(&handle->match.match_fields);
+    ofl_structs_match_init(&handle->match);
+    handle->match_valid = false;
+}
+
 void
 packet_handle_std_validate(struct packet_handle_std *handle) {
-    struct ofl_match_tlv * iter, *next, *f;
     uint64_t metadata = 0;
     uint64_t tunnel_id = 0;
+    uint8_t *value;
     if(handle->valid)
         return;
-    
-    HMAP_FOR_EACH_WITH_HASH(f, struct ofl_match_tlv,
-                    hmap_node, hash_int(OXM_OF_METADATA,0), &handle->match.match_fields){
-                    metadata = *((uint64_t*) f->value);
-    }
 
-    HMAP_FOR_EACH_WITH_HASH(f, struct ofl_match_tlv,
-                    hmap_node, hash_int(OXM_OF_TUNNEL_ID,0), &handle->match.match_fields){
-            tunnel_id = *((uint64_t*) f->value);
+    value = packet_key_get(&handle->key, OXM_OF_METADATA);
+    if (value != NULL) {
+        metadata = *((uint64_t*) value);
     }
-
-    HMAP_FOR_EACH_SAFE(iter, next, struct ofl_match_tlv, hmap_node, &handle->match.match_fields){
-        free(iter->value);
-        free(iter);
+    value = packet_key_get(&handle->key, OXM_OF_TUNNEL_ID);
+    if (value != NULL) {
+        tunnel_id = *((uint64_t*) value);
     }
-    ofl_structs_match_init(&handle->match);
 
-    if (nblink_packet_parse(handle->pkt->buffer,&handle->match,
+    match_free_fields(handle);
+    packet_key_init(&handle->key);
+
+    if (packet_parse(handle->pkt->buffer,&handle->key,
                             handle->proto) < 0)
         return;
 
     handle->valid = true;
 
-    /* Add in_port value to the hash_map */
-    ofl_structs_match_put32(&handle->match, OXM_OF_IN_PORT, handle->pkt->in_port);
-    /*Add metadata  and tunnel_id value to the hash_map */
-    ofl_structs_match_put64(&handle->match,  OXM_OF_METADATA, metadata);
-    ofl_structs_match_put64(&handle->match,  OXM_OF_TUNNEL_ID, tunnel_id);
+    /* Add in_port, metadata and tunnel_id to the key */
+    packet_key_put32(&handle->key, OXM_OF_IN_PORT, handle->pkt->in_port);
+    packet_key_put64(&handle->key, OXM_OF_METADATA, metadata);
+    packet_key_put64(&handle->key, OXM_OF_TUNNEL_ID, tunnel_id);
     return;
 }
 
+void
+packet_handle_std_field_changed(struct packet_handle_std *handle,
+                                uint32_t header) {
+    if (!handle->valid) {
+        return;
+    }
+    handle->match_valid = false;
+    /* The other parsers differ from the native one in places, and the whole
+     * packet must then be parsed by the selected parser again. */
+    if (!packet_parse_is_native() ||
+        !packet_parse_field(handle->pkt->buffer, &handle->key,
+                            handle->proto, header)) {
+        handle->valid = false;
+    }
+}
+
+void
+packet_handle_std_tags_changed(struct packet_handle_std *handle,
+                               bool network_changed) {
+    if (!handle->valid) {
+        return;
+    }
+    handle->match_valid = false;
+    if (!packet_parse_is_native() ||
+        packet_parse_link(handle->pkt->buffer, &handle->key, handle->proto,
+                          network_changed) < 0) {
+        handle->valid = false;
+    }
+}
 
 struct packet_handle_std *
 packet_handle_std_create(struct packet *pkt) {
-	struct packet_handle_std *handle = xmalloc(sizeof(struct packet_handle_std));
-	handle->proto = xmalloc(sizeof(struct protocols_std));
+	struct packet_handle_std *handle = dp_pool_alloc(&handle_pool);
+	handle->proto = dp_pool_alloc(&proto_pool);
 	handle->pkt = pkt;
 
-	hmap_init(&handle->match.match_fields);
+	packet_key_init(&handle->key);
+	ofl_structs_match_init(&handle->match);
+	handle->match_valid = false;
 
 	handle->valid = false;
 	packet_handle_std_validate(handle);
@@ -101,31 +149,88 @@ packet_handle_std_create(struct packet *pkt) {
 }
 
 struct packet_handle_std *
-packet_handle_std_clone(struct packet *pkt, struct packet_handle_std *handle UNUSED) {
-    struct packet_handle_std *clone = xmalloc(sizeof(struct packet_handle_std));
+packet_handle_std_clone(struct packet *pkt, struct packet_handle_std *handle) {
+    struct packet_handle_std *clone = dp_pool_alloc(&handle_pool);
 
     clone->pkt = pkt;
-    clone->proto = xmalloc(sizeof(struct protocols_std));
-    hmap_init(&clone->match.match_fields);
-    clone->valid = false;
-    // TODO Zoltan: if handle->valid, then match could be memcpy'd, and protocol
-    //              could be offset
+    ofl_structs_match_init(&clone->match);
+    clone->match_valid = false;
+    clone->table_miss = handle->table_miss;
+
+    if (handle->valid) {
+        /* The buffer of the clone holds the same data, so the parsed fields
+         * remain valid, and the headers are at the same offsets. */
+        clone->proto = dp_pool_alloc(&proto_pool);
+        memcpy(clone->proto, handle->proto, sizeof(struct protocols_std));
+        memcpy(&clone->key, &handle->key, sizeof clone->key);
+        clone->valid = true;
+        packet_handle_std_rebase(clone, handle->pkt->buffer->data);
+    } else {
+        clone->proto = dp_pool_alloc(&proto_pool);
+        packet_key_init(&clone->key);
+        clone->valid = false;
+    }
     packet_handle_std_validate(clone);
 
     return clone;
 }
 
+/* Moves the header pointer 'FIELD' of 'proto' from the 'size' bytes at 'old'
+ * to the same offset in 'new'.  Returns false from the calling function if
+ * the header is not in the old data. */
+#define REBASE_HEADER(FIELD)                                            \
+    if (proto->FIELD != NULL) {                                         \
+        uintptr_t ofs = (uintptr_t) proto->FIELD - (uintptr_t) old;     \
+        if (ofs >= size) {                                              \
+            return false;                                               \
+        }                                                               \
+        proto->FIELD = (void *) (new + ofs);                            \
+    }
+
+static bool
+rebase_protocols(struct protocols_std *proto, const uint8_t *old,
+                 uint8_t *new, size_t size) {
+    REBASE_HEADER(eth);
+    REBASE_HEADER(eth_snap);
+    REBASE_HEADER(vlan);
+    REBASE_HEADER(vlan_last);
+    REBASE_HEADER(mpls);
+    REBASE_HEADER(pbb);
+    REBASE_HEADER(ipv4);
+    REBASE_HEADER(ipv6);
+    REBASE_HEADER(arp);
+    REBASE_HEADER(tcp);
+    REBASE_HEADER(udp);
+    REBASE_HEADER(sctp);
+    REBASE_HEADER(icmp);
+    REBASE_HEADER(amaru);
+    return true;
+}
+
+#undef REBASE_HEADER
+
 void
-packet_handle_std_destroy(struct packet_handle_std *handle) {
+packet_handle_std_rebase(struct packet_handle_std *handle,
+                         const void *old_data) {
+    struct ofpbuf *buffer = handle->pkt->buffer;
 
-    struct ofl_match_tlv * iter, *next;
-    HMAP_FOR_EACH_SAFE(iter, next, struct ofl_match_tlv, hmap_node, &handle->match.match_fields){
-        free(iter->value);
-        free(iter);
+    if (!handle->valid || buffer->data == old_data) {
+        return;
+    }
+    /* Headers that were not parsed out of the buffer, e.g. those built for
+     * AMARU packets, cannot be moved; the packet is parsed again instead. */
+    if (!rebase_protocols(handle->proto, old_data, buffer->data,
+                          buffer->size)) {
+        handle->valid = false;
     }
-    free(handle->proto);
+}
+
+void
+packet_handle_std_destroy(struct packet_handle_std *handle) {
+    match_free_fields(handle);
+    dp_pool_free(&proto_pool, handle->proto);
     hmap_destroy(&handle->match.match_fields);
-    free(handle);
+    dp_pool_free(&handle_pool, handle);
 }
 
 bool
@@ -166,7 +271,19 @@ packet_handle_std_match(struct packet_handle_std *handle, struct ofl_match *matc
         }
     }
 
-    return packet_match(match ,&handle->match );
+    return packet_match(match ,&handle->key );
+}
+
+struct ofl_match *
+packet_handle_std_ofl_match(struct packet_handle_std *handle) {
+    packet_handle_std_validate(handle);
+
+    if (!handle->match_valid) {
+        match_free_fields(handle);
+        packet_key_to_match(&handle->key, &handle->match);
+        handle->match_valid = true;
+    }
+    return &handle->match;
 }
 
 
@@ -208,7 +325,9 @@ packet_handle_std_print(FILE *stream, struct packet_handle_std *handle) {
     proto_print(stream, handle->proto);
 
     fprintf(stream, ", match=");
-    ofl_structs_match_print(stream, (struct ofl_match_header *)(&handle->match), handle->pkt->dp->exp);
+    ofl_structs_match_print(stream,
+                            (struct ofl_match_header *)packet_handle_std_ofl_match(handle),
+                            handle->pkt->dp->exp);
     fprintf(stream, "\"}");
 }
 
@@ -36,6 +36,7 @@
 #include "packet.h"
 #include "packets.h"
 #include "match_std.h"
+#include "packet_key.h"
 #include "oflib/ofl-structs.h"
 #include "nbee_link/nbee_link.h"
 
@@ -45,11 +46,14 @@
 
 /* The data associated with the handler */
 struct packet_handle_std {
+   struct packet_key           key;   /* Fields extracted from the packet. */
    struct packet              *pkt;
    struct protocols_std       *proto;
-   struct ofl_match  match;  /* Match fields extracted from the packet
-                                           are also stored in a match structure
-                                           for convenience */
+   struct ofl_match  match;  /* The key as a match structure; only built
+                                           on demand, see
+                                           packet_handle_std_ofl_match. */
+   bool                        match_valid; /* Set to true if match reflects
+                                           the key. */
    bool                        valid; /* Set to true if the handler data is valid.
                                            if false, it is revalidated before
                                            executing any methods. */
@@ -77,6 +81,10 @@ packet_handle_std_is_fragment(struct packet_handle_std *handle);
 bool
 packet_handle_std_match(struct packet_handle_std *handle,  struct ofl_match *match);
 
+/* Returns the packet fields as a match structure, e.g. for a packet_in. */
+struct ofl_match *
+packet_handle_std_ofl_match(struct packet_handle_std *handle);
+
 /* Converts the packet to a string representation */
 char *
 packet_handle_std_to_string(struct packet_handle_std *handle);
@@ -84,10 +92,35 @@ packet_handle_std_to_string(struct packet_handle_std *handle);
 void
 packet_handle_std_print(FILE *stream, struct packet_handle_std *handle);
 
-/* Clones the handler, and associates it with the new packet. */
+/* Clones the handler, and associates it with the new packet, whose buffer
+ * must hold the same data.  If the handler is valid, the parsed fields are
+ * copied instead of parsing the buffer again. */
 struct packet_handle_std *
 packet_handle_std_clone(struct packet *pkt, struct packet_handle_std *handle);
 
+/* Updates the handler after the data of the packet moved, unchanged, from
+ * 'old_data' to a new place, e.g. when the buffer was copied out of a ring or
+ * unshared. */
+void
+packet_handle_std_rebase(struct packet_handle_std *handle,
+                         const void *old_data);
+
+/* Updates the handler after an action rewrote the given field of the packet
+ * in place, parsing only the header that holds it again when possible.  With
+ * a parser other than the native one, the packet is parsed again as a whole
+ * instead. */
+void
+packet_handle_std_field_changed(struct packet_handle_std *handle,
+                                uint32_t header);
+
+/* Updates the handler after an action pushed or popped a VLAN, PBB or MPLS
+ * header of the packet.  The network and transport headers are only located
+ * again, unless 'network_changed'.  With a parser other than the native one,
+ * the packet is parsed again as a whole instead. */
+void
+packet_handle_std_tags_changed(struct packet_handle_std *handle,
+                               bool network_changed);
+
 /* Revalidates the handler data */
 void
 packet_handle_std_validate(struct packet_handle_std *handle);
@@ -0,0 +1,124 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "packet_key.h"
+#include "hash.h"
+#include "hmap.h"
+#include "util.h"
+#include "oflib/ofl-structs.h"
+#include "openflow/openflow.h"
+
+#define KEY_FIELD(FIELD, MEMBER) \
+    [FIELD] = {offsetof(struct packet_key, MEMBER), \
+               sizeof(((struct packet_key *)0)->MEMBER)}
+
+const struct packet_key_field packet_key_fields[PACKET_KEY_N_FIELDS] = {
+    KEY_FIELD(OFPXMT_OFB_IN_PORT,        in_port),
+    KEY_FIELD(OFPXMT_OFB_IN_PHY_PORT,    in_phy_port),
+    KEY_FIELD(OFPXMT_OFB_METADATA,       metadata),
+    KEY_FIELD(OFPXMT_OFB_ETH_DST,        eth_dst),
+    KEY_FIELD(OFPXMT_OFB_ETH_SRC,        eth_src),
+    KEY_FIELD(OFPXMT_OFB_ETH_TYPE,       eth_type),
+    KEY_FIELD(OFPXMT_OFB_VLAN_VID,       vlan_vid),
+    KEY_FIELD(OFPXMT_OFB_VLAN_PCP,       vlan_pcp),
+    KEY_FIELD(OFPXMT_OFB_IP_DSCP,        ip_dscp),
+    KEY_FIELD(OFPXMT_OFB_IP_ECN,         ip_ecn),
+    KEY_FIELD(OFPXMT_OFB_IP_PROTO,       ip_proto),
+    KEY_FIELD(OFPXMT_OFB_IPV4_SRC,       ipv4_src),
+    KEY_FIELD(OFPXMT_OFB_IPV4_DST,       ipv4_dst),
+    KEY_FIELD(OFPXMT_OFB_TCP_SRC,        tcp_src),
+    KEY_FIELD(OFPXMT_OFB_TCP_DST,        tcp_dst),
+    KEY_FIELD(OFPXMT_OFB_UDP_SRC,        udp_src),
+    KEY_FIELD(OFPXMT_OFB_UDP_DST,        udp_dst),
+    KEY_FIELD(OFPXMT_OFB_SCTP_SRC,       sctp_src),
+    KEY_FIELD(OFPXMT_OFB_SCTP_DST,       sctp_dst),
+    KEY_FIELD(OFPXMT_OFB_ICMPV4_TYPE,    icmpv4_type),
+    KEY_FIELD(OFPXMT_OFB_ICMPV4_CODE,    icmpv4_code),
+    KEY_FIELD(OFPXMT_OFB_ARP_OP,         arp_op),
+    KEY_FIELD(OFPXMT_OFB_ARP_SPA,        arp_spa),
+    KEY_FIELD(OFPXMT_OFB_ARP_TPA,        arp_tpa),
+    KEY_FIELD(OFPXMT_OFB_ARP_SHA,        arp_sha),
+    KEY_FIELD(OFPXMT_OFB_ARP_THA,        arp_tha),
+    KEY_FIELD(OFPXMT_OFB_IPV6_SRC,       ipv6_src),
+    KEY_FIELD(OFPXMT_OFB_IPV6_DST,       ipv6_dst),
+    KEY_FIELD(OFPXMT_OFB_IPV6_FLABEL,    ipv6_flabel),
+    KEY_FIELD(OFPXMT_OFB_ICMPV6_TYPE,    icmpv6_type),
+    KEY_FIELD(OFPXMT_OFB_ICMPV6_CODE,    icmpv6_code),
+    KEY_FIELD(OFPXMT_OFB_IPV6_ND_TARGET, ipv6_nd_target),
+    KEY_FIELD(OFPXMT_OFB_IPV6_ND_SLL,    ipv6_nd_sll),
+    KEY_FIELD(OFPXMT_OFB_IPV6_ND_TLL,    ipv6_nd_tll),
+    KEY_FIELD(OFPXMT_OFB_MPLS_LABEL,     mpls_label),
+    KEY_FIELD(OFPXMT_OFB_MPLS_TC,        mpls_tc),
+    KEY_FIELD(OFPXMT_OFB_MPLS_BOS,       mpls_bos),
+    KEY_FIELD(OFPXMT_OFB_PBB_ISID,       pbb_isid),
+    KEY_FIELD(OFPXMT_OFB_TUNNEL_ID,      tunnel_id),
+    KEY_FIELD(OFPXMT_OFB_IPV6_EXTHDR,    ipv6_exthdr),
+    KEY_FIELD(OFPXMT_OFB_AMARU_LEVEL,    amaru_level),
+    KEY_FIELD(OFPXMT_OFB_AMARU_AMAC,     amaru_amac)
+};
+
+uint32_t
+packet_key_header(int field) {
+    return OXM_HEADER(OFPXMC_OPENFLOW_BASIC, field, packet_key_fields[field].len);
+}
+
+void
+packet_key_to_match(const struct packet_key *key, struct ofl_match *match) {
+    int field;
+
+    for (field = 0; field < PACKET_KEY_N_FIELDS; field++) {
+        const struct packet_key_field *kf = &packet_key_fields[field];
+        struct ofl_match_tlv *m;
+
+        if (!(key->present & (UINT64_C(1) << field))) {
+            continue;
+        }
+        m = xmalloc(sizeof *m);
+        m->header = packet_key_header(field);
+        m->value = xmalloc(kf->len);
+        memcpy(m->value, (const uint8_t *)key + kf->ofs, kf->len);
+        hmap_insert(&match->match_fields, &m->hmap_node, hash_int(m->header, 0));
+        match->header.length += kf->len + 4;
+    }
+}
+
+void
+packet_key_from_match(struct packet_key *key, const struct ofl_match *match) {
+    struct ofl_match_tlv *f;
+
+    HMAP_FOR_EACH (f, struct ofl_match_tlv, hmap_node, &match->match_fields) {
+        if (!OXM_HASMASK(f->header)) {
+            packet_key_put(key, f->header, f->value);
+        }
+    }
+}
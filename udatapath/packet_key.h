@@ -0,0 +1,191 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef PACKET_KEY_H
+#define PACKET_KEY_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "compiler.h"
+#include "oflib/ofl-structs.h"
+#include "openflow/openflow.h"
+
+/****************************************************************************
+ * Fixed layout packet key. Holds the match fields parsed from a packet in
+ * one flat structure, with a bitmap telling which fields are present, so
+ * that parsing and matching a packet do not allocate memory. The TLV form of
+ * the fields (struct ofl_match) is only built when a message needs it.
+ *
+ * Field values are kept in the same representation as in the TLVs of a
+ * struct ofl_match, so they can be compared with flow match values as is.
+ ****************************************************************************/
+
+/* Number of OXM basic fields the key can hold. */
+#define PACKET_KEY_N_FIELDS (OFPXMT_OFB_AMARU_AMAC + 1)
+
+struct packet_key {
+    uint64_t   present;         /* bit N set if field N is in the key. */
+
+    uint64_t   metadata;
+    uint64_t   tunnel_id;
+    uint32_t   in_port;
+    uint32_t   in_phy_port;
+    uint32_t   ipv4_src;
+    uint32_t   ipv4_dst;
+    uint32_t   arp_spa;
+    uint32_t   arp_tpa;
+    uint32_t   ipv6_flabel;
+    uint32_t   mpls_label;
+    uint8_t    ipv6_src[16];
+    uint8_t    ipv6_dst[16];
+    uint8_t    ipv6_nd_target[16];
+    uint16_t   eth_type;
+    uint16_t   vlan_vid;
+    uint16_t   tcp_src;
+    uint16_t   tcp_dst;
+    uint16_t   udp_src;
+    uint16_t   udp_dst;
+    uint16_t   sctp_src;
+    uint16_t   sctp_dst;
+    uint16_t   arp_op;
+    uint16_t   ipv6_exthdr;
+    uint8_t    eth_dst[6];
+    uint8_t    eth_src[6];
+    uint8_t    arp_sha[6];
+    uint8_t    arp_tha[6];
+    uint8_t    ipv6_nd_sll[6];
+    uint8_t    ipv6_nd_tll[6];
+    uint8_t    vlan_pcp;
+    uint8_t    ip_dscp;
+    uint8_t    ip_ecn;
+    uint8_t    ip_proto;
+    uint8_t    icmpv4_type;
+    uint8_t    icmpv4_code;
+    uint8_t    icmpv6_type;
+    uint8_t    icmpv6_code;
+    uint8_t    mpls_tc;
+    uint8_t    mpls_bos;
+    uint8_t    pbb_isid[3];
+    uint8_t    amaru_level;
+    uint8_t    amaru_amac[28];
+} CACHE_ALIGNED;
+
+/* Location of a field's value in the key. */
+struct packet_key_field {
+    uint16_t   ofs;
+    uint16_t   len;             /* 0 if the key cannot hold the field. */
+};
+
+extern const struct packet_key_field packet_key_fields[PACKET_KEY_N_FIELDS];
+
+/* Returns the index of the field with the given unmasked header, or -1 if
+ * the key cannot hold it. */
+static inline int
+packet_key_field(uint32_t header) {
+    uint32_t field = OXM_FIELD(header);
+
+    if (OXM_CLASS(header) != OFPXMC_OPENFLOW_BASIC ||
+        field >= PACKET_KEY_N_FIELDS ||
+        packet_key_fields[field].len != OXM_LENGTH(header)) {
+        return -1;
+    }
+    return field;
+}
+
+/* Empties the key. */
+static inline void
+packet_key_init(struct packet_key *key) {
+    memset(key, 0, sizeof *key);
+}
+
+/* Returns the value of the field, or NULL if it is not in the key. */
+static inline uint8_t *
+packet_key_get(const struct packet_key *key, uint32_t header) {
+    int field = packet_key_field(header);
+
+    if (field < 0 || !(key->present & (UINT64_C(1) << field))) {
+        return NULL;
+    }
+    return (uint8_t *)key + packet_key_fields[field].ofs;
+}
+
+/* Returns true if the field is in the key. */
+static inline bool
+packet_key_has(const struct packet_key *key, uint32_t header) {
+    return packet_key_get(key, header) != NULL;
+}
+
+/* Adds the field to the key, or overwrites its value. 'value' holds
+ * OXM_LENGTH(header) bytes. Fields the key cannot hold are ignored. */
+static inline void
+packet_key_put(struct packet_key *key, uint32_t header, const void *value) {
+    int field = packet_key_field(header);
+
+    if (field >= 0) {
+        memcpy((uint8_t *)key + packet_key_fields[field].ofs, value,
+               packet_key_fields[field].len);
+        key->present |= UINT64_C(1) << field;
+    }
+}
+
+static inline void
+packet_key_put8(struct packet_key *key, uint32_t header, uint8_t value) {
+    packet_key_put(key, header, &value);
+}
+
+static inline void
+packet_key_put16(struct packet_key *key, uint32_t header, uint16_t value) {
+    packet_key_put(key, header, &value);
+}
+
+static inline void
+packet_key_put32(struct packet_key *key, uint32_t header, uint32_t value) {
+    packet_key_put(key, header, &value);
+}
+
+static inline void
+packet_key_put64(struct packet_key *key, uint32_t header, uint64_t value) {
+    packet_key_put(key, header, &value);
+}
+
+/* Returns the unmasked OXM header of the field with the given index. */
+uint32_t
+packet_key_header(int field);
+
+/* Adds the fields of the key to the match, in field order. */
+void
+packet_key_to_match(const struct packet_key *key, struct ofl_match *match);
+
+/* Adds the fields of the match the key can hold to the key. */
+void
+packet_key_from_match(struct packet_key *key, const struct ofl_match *match);
+
+#endif /* PACKET_KEY_H */
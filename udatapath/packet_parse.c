@@ -0,0 +1,984 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <config.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include "packet_parse.h"
+#include "hmap.h"
+#include "util.h"
+#include "oflib/ofl-structs.h"
+#include "openflow/openflow.h"
+#include "vlog.h"
+#ifdef HAVE_NBEE
+#include "nbee_link/nbee_link.h"
+#endif
+
+#define LOG_MODULE VLM_packet_parse
+
+#ifdef HAVE_NBEE
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+#endif
+
+static enum packet_parser parser = PACKET_PARSER_NATIVE;
+
+/* IPv6 extension headers, with the ones RFC 2460 recommends to follow. */
+struct ipv6_ext_hdr {
+    uint8_t    type;      /* next header value. */
+    uint16_t   flag;      /* OFPIEH_* flag. */
+    uint16_t   order;     /* ipv6_ext_hdr_order_T1 bit. */
+    uint16_t   allowed;   /* order bits of the headers allowed next. */
+};
+
+static const struct ipv6_ext_hdr ipv6_ext_hdrs[] = {
+    {IPV6_TYPE_HBH, OFPIEH_HOP,    HBH,
+     DESTINATION | ROUTING | FRAGMENT | AUTHENTICATION | ESP},
+    {IPV6_TYPE_DOH, OFPIEH_DEST,   DESTINATION,    ROUTING},
+    {IPV6_TYPE_RH,  OFPIEH_ROUTER, ROUTING,
+     FRAGMENT | AUTHENTICATION | ESP | DESTINATION},
+    {IPV6_TYPE_FH,  OFPIEH_FRAG,   FRAGMENT,
+     AUTHENTICATION | ESP | DESTINATION},
+    {IPV6_TYPE_AH,  OFPIEH_AUTH,   AUTHENTICATION, ESP | DESTINATION},
+    {IPV6_TYPE_ESP, OFPIEH_ESP,    ESP,            DESTINATION}
+};
+
+#define IPV6_EXT_HDR_MIN_LEN 8
+#define IPV6_FH_OFFSET_MASK 0xfff8
+
+static const struct ipv6_ext_hdr *
+ipv6_ext_hdr_find(uint8_t type) {
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(ipv6_ext_hdrs); i++) {
+        if (ipv6_ext_hdrs[i].type == type) {
+            return &ipv6_ext_hdrs[i];
+        }
+    }
+    return NULL;
+}
+
+static const struct ipv6_ext_hdr *
+ipv6_ext_hdr_find_flag(uint16_t flag) {
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(ipv6_ext_hdrs); i++) {
+        if (ipv6_ext_hdrs[i].flag == flag) {
+            return &ipv6_ext_hdrs[i];
+        }
+    }
+    return NULL;
+}
+
+void
+packet_parse_ipv6_exthdr(struct ipv6_exthdr_walk *walk, uint16_t flag) {
+    const struct ipv6_ext_hdr *eh = ipv6_ext_hdr_find_flag(flag);
+    const struct ipv6_ext_hdr *prev = ipv6_ext_hdr_find_flag(walk->last);
+
+    if (walk->flags & flag) {
+        if (flag != OFPIEH_DEST || walk->n_dest > 1) {
+            walk->flags |= OFPIEH_UNREP;
+        }
+    }
+    if (flag == OFPIEH_DEST) {
+        walk->n_dest++;
+    }
+    if (flag == OFPIEH_HOP && walk->last != 0) {
+        walk->flags |= OFPIEH_UNSEQ;
+    }
+    if (prev != NULL && eh != NULL && !(prev->allowed & eh->order)) {
+        walk->flags |= OFPIEH_UNSEQ;
+    }
+    walk->flags |= flag;
+    walk->last = flag;
+}
+
+uint16_t
+packet_parse_ipv6_exthdr_done(struct ipv6_exthdr_walk *walk, uint8_t next) {
+    if (next == IPV6_NO_NEXT_HEADER) {
+        walk->flags |= OFPIEH_NONEXT;
+    }
+    return walk->flags;
+}
+
+void
+packet_parse_eth_type(struct packet_key *pktout, uint16_t eth_type) {
+    if (packet_key_has(pktout, OXM_OF_ETH_TYPE)) {
+        return;
+    }
+    if (eth_type == ETH_TYPE_VLAN || eth_type == ETH_TYPE_SVLAN ||
+        eth_type == ETH_TYPE_VLAN_QinQ || eth_type == ETH_TYPE_VLAN_PBB_B) {
+        return;
+    }
+    packet_key_put16(pktout, OXM_OF_ETH_TYPE, eth_type);
+}
+
+static void
+parse_tcp(struct ofpbuf *pktin, size_t off, struct packet_key *pktout,
+          struct protocols_std *proto) {
+    struct tcp_header *tcp;
+
+    if (pktin->size < off + TCP_HEADER_LEN) {
+        return;
+    }
+    tcp = (struct tcp_header *)((uint8_t *)pktin->data + off);
+    proto->tcp = tcp;
+    packet_key_put16(pktout, OXM_OF_TCP_SRC, ntohs(tcp->tcp_src));
+    packet_key_put16(pktout, OXM_OF_TCP_DST, ntohs(tcp->tcp_dst));
+}
+
+static void
+parse_udp(struct ofpbuf *pktin, size_t off, struct packet_key *pktout,
+          struct protocols_std *proto) {
+    struct udp_header *udp;
+
+    if (pktin->size < off + UDP_HEADER_LEN) {
+        return;
+    }
+    udp = (struct udp_header *)((uint8_t *)pktin->data + off);
+    proto->udp = udp;
+    packet_key_put16(pktout, OXM_OF_UDP_SRC, ntohs(udp->udp_src));
+    packet_key_put16(pktout, OXM_OF_UDP_DST, ntohs(udp->udp_dst));
+}
+
+static void
+parse_sctp(struct ofpbuf *pktin, size_t off, struct packet_key *pktout,
+           struct protocols_std *proto) {
+    struct sctp_header *sctp;
+
+    if (pktin->size < off + SCTP_HEADER_LEN) {
+        return;
+    }
+    sctp = (struct sctp_header *)((uint8_t *)pktin->data + off);
+    proto->sctp = sctp;
+    packet_key_put16(pktout, OXM_OF_SCTP_SRC, ntohs(sctp->sctp_src));
+    packet_key_put16(pktout, OXM_OF_SCTP_DST, ntohs(sctp->sctp_dst));
+}
+
+static void
+parse_icmp(struct ofpbuf *pktin, size_t off, struct packet_key *pktout,
+           struct protocols_std *proto) {
+    struct icmp_header *icmp;
+
+    if (pktin->size < off + ICMP_HEADER_LEN) {
+        return;
+    }
+    icmp = (struct icmp_header *)((uint8_t *)pktin->data + off);
+    proto->icmp = icmp;
+    packet_key_put8(pktout, OXM_OF_ICMPV4_TYPE, icmp->icmp_type);
+    packet_key_put8(pktout, OXM_OF_ICMPV4_CODE, icmp->icmp_code);
+}
+
+static void
+parse_icmpv6(struct ofpbuf *pktin, size_t off, struct packet_key *pktout,
+             struct protocols_std *proto) {
+    struct icmp_header *icmp;
+    struct ipv6_nd_header *nd;
+    bool sll = false, tll = false;
+
+    if (pktin->size < off + ICMP_HEADER_LEN) {
+        return;
+    }
+    icmp = (struct icmp_header *)((uint8_t *)pktin->data + off);
+    proto->icmp = icmp;
+    packet_key_put8(pktout, OXM_OF_ICMPV6_TYPE, icmp->icmp_type);
+    packet_key_put8(pktout, OXM_OF_ICMPV6_CODE, icmp->icmp_code);
+
+    if (icmp->icmp_type != ICMPV6_NEIGHSOL &&
+        icmp->icmp_type != ICMPV6_NEIGHADV) {
+        return;
+    }
+    off += ICMP_HEADER_LEN;
+    if (pktin->size < off + IPV6_ND_HEADER_LEN) {
+        return;
+    }
+    nd = (struct ipv6_nd_header *)((uint8_t *)pktin->data + off);
+    packet_key_put(pktout, OXM_OF_IPV6_ND_TARGET,
+                               nd->target_addr.s6_addr);
+    off += IPV6_ND_HEADER_LEN;
+
+    /* Only the first link-layer address option of each kind is used. */
+    while (pktin->size >= off + IPV6_ND_OPT_HD_LEN) {
+        struct ipv6_nd_options_hd *opt;
+        size_t opt_len;
+
+        opt = (struct ipv6_nd_options_hd *)((uint8_t *)pktin->data + off);
+        opt_len = opt->length * 8;
+        if (opt_len == 0 || pktin->size < off + opt_len) {
+            break;
+        }
+        if (opt_len >= IPV6_ND_OPT_HD_LEN + ETH_ADDR_LEN) {
+            uint8_t *addr = (uint8_t *)opt + IPV6_ND_OPT_HD_LEN;
+
+            if (opt->type == ND_OPT_SLL && !sll) {
+                packet_key_put(pktout, OXM_OF_IPV6_ND_SLL, addr);
+                sll = true;
+            } else if (opt->type == ND_OPT_TLL && !tll) {
+                packet_key_put(pktout, OXM_OF_IPV6_ND_TLL, addr);
+                tll = true;
+            }
+        }
+        off += opt_len;
+    }
+}
+
+static void
+parse_ipv4(struct ofpbuf *pktin, size_t off, struct packet_key *pktout,
+           struct protocols_std *proto) {
+    struct ip_header *ipv4;
+    size_t ihl;
+
+    if (pktin->size < off + IP_HEADER_LEN) {
+        return;
+    }
+    ipv4 = (struct ip_header *)((uint8_t *)pktin->data + off);
+    ihl = IP_IHL(ipv4->ip_ihl_ver) * 4;
+    if (ihl < IP_HEADER_LEN || pktin->size < off + ihl) {
+        return;
+    }
+    proto->ipv4 = ipv4;
+    packet_key_put8(pktout, OXM_OF_IP_DSCP,
+                           (ipv4->ip_tos & IP_DSCP_MASK) >> 2);
+    packet_key_put8(pktout, OXM_OF_IP_ECN, ipv4->ip_tos & IP_ECN_MASK);
+    packet_key_put32(pktout, OXM_OF_IPV4_SRC, ipv4->ip_src);
+    packet_key_put32(pktout, OXM_OF_IPV4_DST, ipv4->ip_dst);
+    packet_key_put8(pktout, OXM_OF_IP_PROTO, ipv4->ip_proto);
+
+    /* Only the first fragment carries the transport header. */
+    if (ipv4->ip_frag_off & htons(IP_FRAG_OFF_MASK)) {
+        return;
+    }
+    off += ihl;
+    switch (ipv4->ip_proto) {
+        case IP_TYPE_ICMP: {
+            parse_icmp(pktin, off, pktout, proto);
+            break;
+        }
+        case IP_TYPE_TCP: {
+            parse_tcp(pktin, off, pktout, proto);
+            break;
+        }
+        case IP_TYPE_UDP: {
+            parse_udp(pktin, off, pktout, proto);
+            break;
+        }
+        case IP_TYPE_SCTP: {
+            parse_sctp(pktin, off, pktout, proto);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+static void
+parse_ipv6(struct ofpbuf *pktin, size_t off, struct packet_key *pktout,
+           struct protocols_std *proto) {
+    struct ipv6_exthdr_walk walk = {0, 0, 0};
+    const struct ipv6_ext_hdr *eh;
+    struct ipv6_header *ipv6;
+    uint32_t ver_tc_fl;
+    bool first_fragment = true;
+    uint8_t next;
+
+    if (pktin->size < off + IPV6_HEADER_LEN) {
+        return;
+    }
+    ipv6 = (struct ipv6_header *)((uint8_t *)pktin->data + off);
+    proto->ipv6 = ipv6;
+    ver_tc_fl = ntohl(ipv6->ipv6_ver_tc_fl);
+    packet_key_put8(pktout, OXM_OF_IP_DSCP,
+                           (ver_tc_fl & IPV6_DSCP_MASK) >> IPV6_DSCP_SHIFT);
+    packet_key_put8(pktout, OXM_OF_IP_ECN,
+                           (ver_tc_fl >> IPV6_ECN_SHIFT) & IPV6_ECN_MASK);
+    packet_key_put32(pktout, OXM_OF_IPV6_FLABEL,
+                            ver_tc_fl & IPV6_FLABEL_MASK);
+
+    /* Walk the extension headers, flagging repeats and unexpected order. */
+    off += IPV6_HEADER_LEN;
+    next = ipv6->ipv6_next_hd;
+    while ((eh = ipv6_ext_hdr_find(next)) != NULL) {
+        uint8_t *hdr;
+        size_t len;
+
+        packet_parse_ipv6_exthdr(&walk, eh->flag);
+
+        /* Nothing past an ESP header can be seen in clear. */
+        if (eh->flag == OFPIEH_ESP ||
+            pktin->size < off + IPV6_EXT_HDR_MIN_LEN) {
+            break;
+        }
+        hdr = (uint8_t *)pktin->data + off;
+        switch (eh->flag) {
+            case OFPIEH_FRAG: {
+                uint16_t frag_off = (hdr[2] << 8) | hdr[3];
+                if (frag_off & IPV6_FH_OFFSET_MASK) {
+                    first_fragment = false;
+                }
+                len = IPV6_EXT_HDR_MIN_LEN;
+                break;
+            }
+            case OFPIEH_AUTH: {
+                len = (hdr[1] + 2) * 4;
+                break;
+            }
+            case OFPIEH_ROUTER: {
+                len = IPV6_EXT_HDR_MIN_LEN +
+                      (hdr[2] == 0 ? hdr[1] / 2 * 16 : hdr[1] * 8);
+                break;
+            }
+            default: {
+                len = (hdr[1] + 1) * 8;
+                break;
+            }
+        }
+        if (pktin->size < off + len) {
+            break;
+        }
+        off += len;
+        next = hdr[0];
+        /* Only the first fragment carries the headers that follow. */
+        if (!first_fragment) {
+            break;
+        }
+    }
+    packet_key_put16(pktout, OXM_OF_IPV6_EXTHDR,
+                            packet_parse_ipv6_exthdr_done(&walk, next));
+    packet_key_put(pktout, OXM_OF_IPV6_SRC,
+                               ipv6->ipv6_src.s6_addr);
+    packet_key_put(pktout, OXM_OF_IPV6_DST,
+                               ipv6->ipv6_dst.s6_addr);
+    packet_key_put8(pktout, OXM_OF_IP_PROTO, next);
+
+    if (!first_fragment) {
+        return;
+    }
+    switch (next) {
+        case IP_TYPE_TCP: {
+            parse_tcp(pktin, off, pktout, proto);
+            break;
+        }
+        case IP_TYPE_UDP: {
+            parse_udp(pktin, off, pktout, proto);
+            break;
+        }
+        case IP_TYPE_SCTP: {
+            parse_sctp(pktin, off, pktout, proto);
+            break;
+        }
+        case IPV6_TYPE_ICMPV6: {
+            parse_icmpv6(pktin, off, pktout, proto);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+static void
+parse_arp(struct ofpbuf *pktin, size_t off, struct packet_key *pktout,
+          struct protocols_std *proto) {
+    struct arp_eth_header *arp;
+
+    if (pktin->size < off + ARP_ETH_HEADER_LEN) {
+        return;
+    }
+    arp = (struct arp_eth_header *)((uint8_t *)pktin->data + off);
+    proto->arp = arp;
+    packet_key_put16(pktout, OXM_OF_ARP_OP, ntohs(arp->ar_op));
+    packet_key_put(pktout, OXM_OF_ARP_SHA, arp->ar_sha);
+    packet_key_put32(pktout, OXM_OF_ARP_SPA, arp->ar_spa);
+    packet_key_put(pktout, OXM_OF_ARP_THA, arp->ar_tha);
+    packet_key_put32(pktout, OXM_OF_ARP_TPA, arp->ar_tpa);
+}
+
+static void
+parse_mpls(struct ofpbuf *pktin, size_t off, struct packet_key *pktout,
+           struct protocols_std *proto) {
+    struct mpls_header *mpls;
+    uint32_t fields;
+
+    if (pktin->size < off + MPLS_HEADER_LEN) {
+        return;
+    }
+    mpls = (struct mpls_header *)((uint8_t *)pktin->data + off);
+    proto->mpls = mpls;
+    fields = ntohl(mpls->fields);
+    packet_key_put32(pktout, OXM_OF_MPLS_LABEL,
+                            (fields & MPLS_LABEL_MASK) >> MPLS_LABEL_SHIFT);
+    packet_key_put8(pktout, OXM_OF_MPLS_TC,
+                           (fields & MPLS_TC_MASK) >> MPLS_TC_SHIFT);
+    packet_key_put8(pktout, OXM_OF_MPLS_BOS,
+                           (fields & MPLS_S_MASK) >> MPLS_S_SHIFT);
+}
+
+/* MPLS label that tells an IPv6 payload, the IPv6 explicit null label. */
+#define MPLS_LABEL_IPV6_NULL 2
+
+/* Parses the label stack at 'off', with the fields of its first entry, and
+ * the payload after its bottom, which is IPv6 if the bottom label says so
+ * and IPv4 otherwise. */
+static void
+parse_mpls_stack(struct ofpbuf *pktin, size_t off, struct packet_key *pktout,
+                 struct protocols_std *proto) {
+    struct mpls_header *mpls;
+    uint32_t fields;
+
+    parse_mpls(pktin, off, pktout, proto);
+    do {
+        if (pktin->size < off + MPLS_HEADER_LEN) {
+            return;
+        }
+        mpls = (struct mpls_header *)((uint8_t *)pktin->data + off);
+        fields = ntohl(mpls->fields);
+        off += MPLS_HEADER_LEN;
+    } while (!(fields & MPLS_S_MASK));
+
+    if ((fields & MPLS_LABEL_MASK) >> MPLS_LABEL_SHIFT ==
+        MPLS_LABEL_IPV6_NULL) {
+        parse_ipv6(pktin, off, pktout, proto);
+    } else {
+        parse_ipv4(pktin, off, pktout, proto);
+    }
+}
+
+static void
+parse_amaru(struct ofpbuf *pktin, size_t off, struct packet_key *pktout,
+            struct protocols_std *proto) {
+    struct Amaru_header *amaru;
+
+    if (pktin->size < off + AMARU_HEADER_LEN) {
+        return;
+    }
+    amaru = (struct Amaru_header *)((uint8_t *)pktin->data + off);
+    proto->amaru = amaru;
+    packet_key_put8(pktout, OXM_OF_AMARU_LEVEL, amaru->level);
+    packet_key_put(pktout, OXM_OF_AMARU_AMAC, amaru->amac);
+}
+
+/* Parses the Ethernet header and the VLAN and PBB tags that follow it.
+ * Stores the offset and the ethertype of the header after the tags in 'off'
+ * and 'eth_type'.  Returns false if the packet ends within the tags, or if
+ * the header after them is one customnetpdl.xml only decodes right after
+ * the Ethernet header. */
+static bool
+parse_link(struct ofpbuf *pktin, struct packet_key *pktout,
+           struct protocols_std *proto, size_t *off, uint16_t *eth_type) {
+    struct eth_header *eth;
+
+    eth = (struct eth_header *)pktin->data;
+    proto->eth = eth;
+    packet_key_put(pktout, OXM_OF_ETH_DST, eth->eth_dst);
+    packet_key_put(pktout, OXM_OF_ETH_SRC, eth->eth_src);
+    *eth_type = ntohs(eth->eth_type);
+    packet_parse_eth_type(pktout, *eth_type);
+    *off = ETH_HEADER_LEN;
+
+    /* Walk the tags until the network header. */
+    for (;;) {
+        switch (*eth_type) {
+            case ETH_TYPE_VLAN:
+            case ETH_TYPE_VLAN_QinQ:
+            case ETH_TYPE_VLAN_PBB_B: {
+                struct vlan_header *vlan;
+                uint16_t tci;
+
+                if (pktin->size < *off + VLAN_HEADER_LEN) {
+                    return false;
+                }
+                vlan = (struct vlan_header *)((uint8_t *)pktin->data + *off);
+                if (proto->vlan == NULL) {
+                    proto->vlan = vlan;
+                    tci = ntohs(vlan->vlan_tci);
+                    packet_key_put8(pktout, OXM_OF_VLAN_PCP,
+                                   (tci & VLAN_PCP_MASK) >> VLAN_PCP_SHIFT);
+                    packet_key_put16(pktout, OXM_OF_VLAN_VID,
+                                   (tci & VLAN_VID_MASK) >> VLAN_VID_SHIFT);
+                }
+                proto->vlan_last = vlan;
+                *eth_type = ntohs(vlan->vlan_next_type);
+                packet_parse_eth_type(pktout, *eth_type);
+                *off += VLAN_HEADER_LEN;
+                break;
+            }
+            case ETH_TYPE_VLAN_PBB_S: {
+                struct pbb_header *pbb;
+
+                if (pktin->size < *off + PBB_HEADER_LEN) {
+                    return false;
+                }
+                pbb = (struct pbb_header *)((uint8_t *)pktin->data + *off);
+                /* Only the fields of the first one are kept. */
+                if (proto->pbb == NULL) {
+                    proto->pbb = pbb;
+                    packet_key_put(pktout, OXM_OF_PBB_ISID,
+                                   (uint8_t *)&pbb->id + 1);
+                }
+                *eth_type = ntohs(pbb->pbb_next_type);
+                packet_parse_eth_type(pktout, *eth_type);
+                *off += PBB_HEADER_LEN;
+                break;
+            }
+            case ETH_TYPE_MPLS:
+            case ETH_TYPE_MPLS_MCAST:
+            case ETH_TYPE_AMARU: {
+                return *off == ETH_HEADER_LEN;
+            }
+            default: {
+                return true;
+            }
+        }
+    }
+}
+
+/* Parses the network header of the given ethertype at 'off', and the
+ * transport header after it. */
+static void
+parse_network(struct ofpbuf *pktin, size_t off, uint16_t eth_type,
+              struct packet_key *pktout, struct protocols_std *proto) {
+    switch (eth_type) {
+        case ETH_TYPE_MPLS:
+        case ETH_TYPE_MPLS_MCAST: {
+            parse_mpls_stack(pktin, off, pktout, proto);
+            break;
+        }
+        case ETH_TYPE_ARP: {
+            parse_arp(pktin, off, pktout, proto);
+            break;
+        }
+        case ETH_TYPE_IP: {
+            parse_ipv4(pktin, off, pktout, proto);
+            break;
+        }
+        case ETH_TYPE_IPV6: {
+            parse_ipv6(pktin, off, pktout, proto);
+            break;
+        }
+        case ETH_TYPE_AMARU: {
+            parse_amaru(pktin, off, pktout, proto);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+int
+packet_parse_native(struct ofpbuf *pktin, struct packet_key *pktout,
+                    struct protocols_std *proto) {
+    uint16_t eth_type;
+    size_t off;
+
+    protocol_reset(proto);
+    if (pktin->size < ETH_HEADER_LEN) {
+        return -1;
+    }
+    if (parse_link(pktin, pktout, proto, &off, &eth_type)) {
+        parse_network(pktin, off, eth_type, pktout, proto);
+    }
+    return 1;
+}
+
+/* Returns the offset of 'header' in the packet data. */
+static size_t
+header_offset(const struct ofpbuf *pktin, const void *header) {
+    return (const uint8_t *)header - (const uint8_t *)pktin->data;
+}
+
+bool
+packet_parse_field(struct ofpbuf *pktin, struct packet_key *pktout,
+                   struct protocols_std *proto, uint32_t header) {
+    switch (header) {
+        case OXM_OF_ETH_DST:
+        case OXM_OF_ETH_SRC: {
+            if (proto->eth != NULL) {
+                packet_key_put(pktout, OXM_OF_ETH_DST, proto->eth->eth_dst);
+                packet_key_put(pktout, OXM_OF_ETH_SRC, proto->eth->eth_src);
+            }
+            return true;
+        }
+        case OXM_OF_VLAN_VID:
+        case OXM_OF_VLAN_PCP: {
+            if (proto->vlan != NULL) {
+                uint16_t tci = ntohs(proto->vlan->vlan_tci);
+
+                packet_key_put8(pktout, OXM_OF_VLAN_PCP,
+                                (tci & VLAN_PCP_MASK) >> VLAN_PCP_SHIFT);
+                packet_key_put16(pktout, OXM_OF_VLAN_VID,
+                                 (tci & VLAN_VID_MASK) >> VLAN_VID_SHIFT);
+            }
+            return true;
+        }
+        case OXM_OF_PBB_ISID: {
+            if (proto->pbb != NULL) {
+                packet_key_put(pktout, OXM_OF_PBB_ISID,
+                               (uint8_t *)&proto->pbb->id + 1);
+            }
+            return true;
+        }
+        case OXM_OF_ARP_OP:
+        case OXM_OF_ARP_SHA:
+        case OXM_OF_ARP_SPA:
+        case OXM_OF_ARP_THA:
+        case OXM_OF_ARP_TPA: {
+            if (proto->arp != NULL) {
+                parse_arp(pktin, header_offset(pktin, proto->arp),
+                          pktout, proto);
+            }
+            return true;
+        }
+        /* The network header is parsed again with the transport header after
+         * it, which is found at the same place. */
+        case OXM_OF_IP_DSCP:
+        case OXM_OF_IP_ECN:
+        case OXM_OF_IPV4_SRC:
+        case OXM_OF_IPV4_DST:
+        case OXM_OF_IPV6_SRC:
+        case OXM_OF_IPV6_DST:
+        case OXM_OF_IPV6_FLABEL: {
+            if (proto->ipv4 != NULL) {
+                parse_ipv4(pktin, header_offset(pktin, proto->ipv4),
+                           pktout, proto);
+            } else if (proto->ipv6 != NULL) {
+                parse_ipv6(pktin, header_offset(pktin, proto->ipv6),
+                           pktout, proto);
+            }
+            return true;
+        }
+        case OXM_OF_TCP_SRC:
+        case OXM_OF_TCP_DST: {
+            if (proto->tcp != NULL) {
+                parse_tcp(pktin, header_offset(pktin, proto->tcp),
+                          pktout, proto);
+            }
+            return true;
+        }
+        case OXM_OF_UDP_SRC:
+        case OXM_OF_UDP_DST: {
+            if (proto->udp != NULL) {
+                parse_udp(pktin, header_offset(pktin, proto->udp),
+                          pktout, proto);
+            }
+            return true;
+        }
+        case OXM_OF_SCTP_SRC:
+        case OXM_OF_SCTP_DST: {
+            if (proto->sctp != NULL) {
+                parse_sctp(pktin, header_offset(pktin, proto->sctp),
+                           pktout, proto);
+            }
+            return true;
+        }
+        case OXM_OF_ICMPV4_TYPE:
+        case OXM_OF_ICMPV4_CODE: {
+            if (proto->icmp != NULL && proto->ipv4 != NULL) {
+                parse_icmp(pktin, header_offset(pktin, proto->icmp),
+                           pktout, proto);
+            }
+            return true;
+        }
+        /* The neighbor discovery fields do not depend on the code. */
+        case OXM_OF_ICMPV6_CODE:
+        case OXM_OF_IPV6_ND_TARGET:
+        case OXM_OF_IPV6_ND_SLL:
+        case OXM_OF_IPV6_ND_TLL: {
+            if (proto->icmp != NULL && proto->ipv6 != NULL) {
+                parse_icmpv6(pktin, header_offset(pktin, proto->icmp),
+                             pktout, proto);
+            }
+            return true;
+        }
+        case OXM_OF_AMARU_LEVEL:
+        case OXM_OF_AMARU_AMAC: {
+            if (proto->amaru != NULL) {
+                parse_amaru(pktin, header_offset(pktin, proto->amaru),
+                            pktout, proto);
+            }
+            return true;
+        }
+        /* Fields not in the packet headers. */
+        case OXM_OF_IN_PORT:
+        case OXM_OF_IN_PHY_PORT:
+        case OXM_OF_METADATA:
+        case OXM_OF_TUNNEL_ID: {
+            return true;
+        }
+        /* The ethertype, the MPLS labels, the IP protocol and the ICMPv6
+         * type decide which headers follow, so the packet is parsed again as
+         * a whole. */
+        default: {
+            return false;
+        }
+    }
+}
+
+#define KEY_BIT(HEADER) (UINT64_C(1) << OXM_FIELD(HEADER))
+
+/* Fields of the link layer headers. */
+#define LINK_FIELDS (KEY_BIT(OXM_OF_ETH_DST) | KEY_BIT(OXM_OF_ETH_SRC) |  \
+                     KEY_BIT(OXM_OF_ETH_TYPE) | KEY_BIT(OXM_OF_VLAN_VID) | \
+                     KEY_BIT(OXM_OF_VLAN_PCP) | KEY_BIT(OXM_OF_PBB_ISID))
+
+/* Fields that do not come from the packet headers. */
+#define META_FIELDS (KEY_BIT(OXM_OF_IN_PORT) | KEY_BIT(OXM_OF_IN_PHY_PORT) | \
+                     KEY_BIT(OXM_OF_METADATA) | KEY_BIT(OXM_OF_TUNNEL_ID))
+
+/* Returns the network header of the given ethertype in 'proto', or NULL. */
+static uint8_t *
+network_header(const struct protocols_std *proto, uint16_t eth_type) {
+    switch (eth_type) {
+        case ETH_TYPE_MPLS:
+        case ETH_TYPE_MPLS_MCAST: {
+            return (uint8_t *)proto->mpls;
+        }
+        case ETH_TYPE_ARP: {
+            return (uint8_t *)proto->arp;
+        }
+        case ETH_TYPE_IP: {
+            return (uint8_t *)proto->ipv4;
+        }
+        case ETH_TYPE_IPV6: {
+            return (uint8_t *)proto->ipv6;
+        }
+        case ETH_TYPE_AMARU: {
+            return (uint8_t *)proto->amaru;
+        }
+        default: {
+            return NULL;
+        }
+    }
+}
+
+/* Moves the header pointer 'FIELD' of 'proto' by 'delta' bytes. */
+#define MOVE_HEADER(FIELD)                                              \
+    if (old.FIELD != NULL) {                                            \
+        proto->FIELD = (void *)((uint8_t *)old.FIELD + delta);          \
+    }
+
+int
+packet_parse_link(struct ofpbuf *pktin, struct packet_key *pktout,
+                  struct protocols_std *proto, bool network_changed) {
+    struct protocols_std old = *proto;
+    uint64_t network_fields = pktout->present & ~(LINK_FIELDS | META_FIELDS);
+    uint8_t *network;
+    uint16_t eth_type;
+    ptrdiff_t delta;
+    size_t off;
+
+    pktout->present &= META_FIELDS;
+    protocol_reset(proto);
+    if (pktin->size < ETH_HEADER_LEN) {
+        return -1;
+    }
+    if (!parse_link(pktin, pktout, proto, &off, &eth_type)) {
+        return 1;
+    }
+
+    network = network_header(&old, eth_type);
+    if (network_changed || network == NULL) {
+        parse_network(pktin, off, eth_type, pktout, proto);
+        return 1;
+    }
+
+    /* The network header is the one parsed before, and so are the fields
+     * of the headers from there on, wherever they are now. */
+    delta = (uint8_t *)pktin->data + off - network;
+    MOVE_HEADER(mpls);
+    MOVE_HEADER(ipv4);
+    MOVE_HEADER(ipv6);
+    MOVE_HEADER(arp);
+    MOVE_HEADER(tcp);
+    MOVE_HEADER(udp);
+    MOVE_HEADER(sctp);
+    MOVE_HEADER(icmp);
+    MOVE_HEADER(amaru);
+    pktout->present |= network_fields;
+    return 1;
+}
+
+#undef MOVE_HEADER
+
+#ifdef HAVE_NBEE
+static void
+match_free_fields(struct ofl_match *match) {
+    struct ofl_match_tlv *iter, *next;
+
+    HMAP_FOR_EACH_SAFE(iter, next, struct ofl_match_tlv, hmap_node,
+                       &match->match_fields) {
+        free(iter->value);
+        free(iter);
+    }
+    hmap_destroy(&match->match_fields);
+}
+
+/* Parses the packet with NetBee, which fills in a match. */
+static int
+packet_parse_nbee(struct ofpbuf *pktin, struct packet_key *pktout,
+                  struct protocols_std *proto) {
+    struct ofl_match match;
+    int ret;
+
+    ofl_structs_match_init(&match);
+    ret = nblink_packet_parse(pktin, &match, proto);
+    packet_key_from_match(pktout, &match);
+    match_free_fields(&match);
+    return ret;
+}
+
+/* Returns the header of a field the two keys disagree on, or 0. */
+static uint32_t
+key_diff(const struct packet_key *a, const struct packet_key *b) {
+    int field;
+
+    for (field = 0; field < PACKET_KEY_N_FIELDS; field++) {
+        uint64_t bit = UINT64_C(1) << field;
+        const struct packet_key_field *kf = &packet_key_fields[field];
+
+        if ((a->present & bit) != (b->present & bit) ||
+            memcmp((const uint8_t *)a + kf->ofs,
+                   (const uint8_t *)b + kf->ofs, kf->len) != 0) {
+            return packet_key_header(field);
+        }
+    }
+    return 0;
+}
+
+/* Runs another parser on a packet NetBee parsed, and reports where it
+ * disagrees with NetBee. */
+static void
+packet_parse_compare(const char *name,
+                     int (*parse)(struct ofpbuf *, struct packet_key *,
+                                  struct protocols_std *),
+                     struct ofpbuf *pktin, const struct packet_key *nbee,
+                     const struct protocols_std *nbee_proto) {
+    struct protocols_std proto;
+    struct packet_key key;
+    uint32_t header;
+
+    packet_key_init(&key);
+    parse(pktin, &key, &proto);
+    header = key_diff(nbee, &key);
+    if (header != 0) {
+        VLOG_WARN_RL(LOG_MODULE, &rl, "NetBee and the %s parser disagree on "
+                     "field 0x%08"PRIx32" of a %zu byte packet.",
+                     name, header, pktin->size);
+    } else if (memcmp(nbee_proto, &proto, sizeof proto) != 0) {
+        VLOG_WARN_RL(LOG_MODULE, &rl, "NetBee and the %s parser disagree on "
+                     "the headers of a %zu byte packet.", name, pktin->size);
+    }
+}
+
+/* Parses the packet with NetBee, and reports where the native and the
+ * generated parsers disagree with it. */
+static int
+packet_parse_check(struct ofpbuf *pktin, struct packet_key *pktout,
+                   struct protocols_std *proto) {
+    int ret;
+
+    ret = packet_parse_nbee(pktin, pktout, proto);
+    if (ret >= 0) {
+        packet_parse_compare("native", packet_parse_native,
+                             pktin, pktout, proto);
+        packet_parse_compare("netpdl", packet_parse_netpdl,
+                             pktin, pktout, proto);
+    }
+    return ret;
+}
+#endif
+
+bool
+packet_parse_set_parser(const char *name) {
+    if (strcmp(name, "native") == 0) {
+        parser = PACKET_PARSER_NATIVE;
+        return true;
+    }
+    if (strcmp(name, "netpdl") == 0) {
+        parser = PACKET_PARSER_NETPDL;
+        return true;
+    }
+#ifdef HAVE_NBEE
+    if (strcmp(name, "nbee") == 0) {
+        parser = PACKET_PARSER_NBEE;
+        return true;
+    }
+    if (strcmp(name, "check") == 0) {
+        parser = PACKET_PARSER_CHECK;
+        return true;
+    }
+#endif
+    return false;
+}
+
+void
+packet_parse_init(void) {
+#ifdef HAVE_NBEE
+    if ((parser == PACKET_PARSER_NBEE || parser == PACKET_PARSER_CHECK) &&
+        nblink_initialize() != 0) {
+        VLOG_WARN(LOG_MODULE, "Cannot initialize NetBee, "
+                  "using the native packet parser.");
+        parser = PACKET_PARSER_NATIVE;
+    }
+#endif
+}
+
+bool
+packet_parse_is_native(void) {
+    return parser == PACKET_PARSER_NATIVE;
+}
+
+int
+packet_parse(struct ofpbuf *pktin, struct packet_key *pktout,
+             struct protocols_std *proto) {
+    switch (parser) {
+#ifdef HAVE_NBEE
+        case PACKET_PARSER_NBEE: {
+            return packet_parse_nbee(pktin, pktout, proto);
+        }
+        case PACKET_PARSER_CHECK: {
+            return packet_parse_check(pktin, pktout, proto);
+        }
+#else
+        case PACKET_PARSER_NBEE:
+        case PACKET_PARSER_CHECK:
+#endif
+        case PACKET_PARSER_NETPDL: {
+            return packet_parse_netpdl(pktin, pktout, proto);
+        }
+        case PACKET_PARSER_NATIVE:
+        default: {
+            return packet_parse_native(pktin, pktout, proto);
+        }
+    }
+}
@@ -0,0 +1,128 @@
+/* Copyright (c) 2011, TrafficLab, Ericsson Research, Hungary
+ * Copyright (c) 2012, CPqD, Brazil 
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Ericsson Research nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef PACKET_PARSE_H
+#define PACKET_PARSE_H 1
+
+#include <stdbool.h>
+#include "ofpbuf.h"
+#include "packets.h"
+#include "packet_key.h"
+
+/****************************************************************************
+ * Packet parsers. Locate the protocol headers of a packet and extract its
+ * match fields.
+ ****************************************************************************/
+
+/* The available parsers. */
+enum packet_parser {
+    PACKET_PARSER_NATIVE,   /* hand-written C parser. */
+    PACKET_PARSER_NETPDL,   /* C parser generated from customnetpdl.xml. */
+    PACKET_PARSER_NBEE,     /* NetBee decoder driven by customnetpdl.xml. */
+    PACKET_PARSER_CHECK     /* NetBee, cross-checked by the other parsers. */
+};
+
+/* Selects the parser by name. Returns false if it is not built in. */
+bool
+packet_parse_set_parser(const char *name);
+
+/* Initializes the selected parser. */
+void
+packet_parse_init(void);
+
+/* Parses the packet with the selected parser. Fills in the protocol headers
+ * and adds the packet fields to the key. Returns -1 on failure. */
+int
+packet_parse(struct ofpbuf *pktin, struct packet_key *pktout,
+             struct protocols_std *proto);
+
+/* Returns true if the selected parser is the native one, which the partial
+ * parses below agree with. */
+bool
+packet_parse_is_native(void);
+
+/* Parses the packet with the native parser. */
+int
+packet_parse_native(struct ofpbuf *pktin, struct packet_key *pktout,
+                    struct protocols_std *proto);
+
+/* Parses the packet with the parser generated from customnetpdl.xml. */
+int
+packet_parse_netpdl(struct ofpbuf *pktin, struct packet_key *pktout,
+                    struct protocols_std *proto);
+
+/* Parses the header that holds the given field of a parsed packet again,
+ * after an action rewrote the field in place, with the native parser.
+ * Returns false if the headers that follow may have changed as well, and the
+ * packet must be parsed again as a whole. */
+bool
+packet_parse_field(struct ofpbuf *pktin, struct packet_key *pktout,
+                   struct protocols_std *proto, uint32_t header);
+
+/* Parses the link layer headers of a parsed packet again, after an action
+ * pushed or popped a VLAN, PBB or MPLS header, with the native parser.  Unless
+ * 'network_changed', the fields of the network and transport headers are
+ * kept, and the headers are only located again.  Returns -1 on failure. */
+int
+packet_parse_link(struct ofpbuf *pktin, struct packet_key *pktout,
+                  struct protocols_std *proto, bool network_changed);
+
+/****************************************************************************
+ * Helpers shared by the native and the generated parsers.
+ ****************************************************************************/
+
+/* State of a walk over the IPv6 extension headers of a packet. */
+struct ipv6_exthdr_walk {
+    uint16_t   flags;     /* OFPIEH_* flags seen so far. */
+    uint16_t   last;      /* OFPIEH_* flag of the previous header, or 0. */
+    int        n_dest;    /* destination options headers seen. */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Records an extension header in the walk, flagging repeats and unexpected
+ * order. */
+void
+packet_parse_ipv6_exthdr(struct ipv6_exthdr_walk *walk, uint16_t flag);
+
+/* Ends the walk at the given next header value. Returns the value of the
+ * IPV6_EXTHDR field. */
+uint16_t
+packet_parse_ipv6_exthdr_done(struct ipv6_exthdr_walk *walk, uint8_t next);
+#ifdef __cplusplus
+}
+#endif
+
+/* Adds the ethertype, unless one was added already or it is a VLAN tag. */
+void
+packet_parse_eth_type(struct packet_key *pktout, uint16_t eth_type);
+
+#endif /* PACKET_PARSE_H */
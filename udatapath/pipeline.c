@@ -29,13 +29,19 @@
  */
 
 #include <sys/types.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
 
 #include "action_set.h"
+#include "amaru_log.h"
 #include "compiler.h"
 #include "dp_actions.h"
 #include "dp_buffers.h"
+#include "dp_workers.h"
+#include "dynamic-string.h"
 #include "dp_exp.h"
 #include "dp_ports.h"
 #include "datapath.h"
@@ -46,9 +52,11 @@
 #include "meter_table.h"
 #include "oflib/ofl.h"
 #include "oflib/ofl-structs.h"
+#include "oflib/ofl-utils.h"
 #include "util.h"
 #include "hash.h"
 #include "oflib/oxm-match.h"
+#include "trace.h"
 #include "vlog.h"
 //Modificaciones Boby UAH//
 #include "rconn.h"
@@ -58,6 +66,9 @@
 
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 
+/* Serializes the AMARU packets received by the worker threads. */
+static pthread_mutex_t amaru_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static void
 execute_entry(struct pipeline *pl, struct flow_entry *entry,
               struct flow_table **table, struct packet **pkt);
@@ -73,7 +84,7 @@ pipeline_create(struct datapath *dp)
         pl->tables[i] = flow_table_create(dp, i);
     }
     pl->dp = dp;
-    nblink_initialize();
+    flow_cache_init(&pl->cache);
     return pl;
 }
 
@@ -90,14 +101,9 @@ send_packet_to_controller(struct pipeline *pl, struct packet *pkt, uint8_t table
 
     struct ofl_msg_packet_in msg;
     struct ofl_match *m;
-    //**Modificaciones boby UAH**//
-    if (pkt->buffer->size == 60)
-    {
-        char *pkt_str = packet_to_string(pkt);
-        VLOG_WARN(LOG_MODULE, "[SEND PACKET TO CONTROLLER %lu]: Procesando paquete: %s", pl->dp->id, pkt_str);
-        free(pkt_str);
-    }
-    ////
+    TRACE(LOG_MODULE, "packet_in", "table %"PRIu64" reason %"PRIu64
+          " in_port %"PRIu64" size %"PRIu64, table_id, reason, pkt->in_port,
+          pkt->buffer->size);
     msg.header.type = OFPT_PACKET_IN;
     msg.total_len = pkt->buffer->size;
     msg.reason = reason;
@@ -119,7 +125,7 @@ send_packet_to_controller(struct pipeline *pl, struct packet *pkt, uint8_t table
         msg.data_length = pkt->buffer->size;
     }
 
-    m = &pkt->handle_std->match;
+    m = packet_handle_std_ofl_match(pkt->handle_std);
 
     /* In this implementation the fields in_port and in_phy_port
         always will be the same, because we are not considering logical
@@ -128,14 +134,106 @@ send_packet_to_controller(struct pipeline *pl, struct packet *pkt, uint8_t table
     dp_send_message(pl->dp, (struct ofl_msg_header *)&msg, NULL);
 }
 
-/* Pass the packet through the flow tables.
- * This function takes ownership of the packet and will destroy it. */
-void pipeline_process_packet(struct pipeline *pl, struct packet *pkt)
+/* Returns true if the table lookups following the entry in a traversal only
+ * depend on the packet as it entered the pipeline, so that they can be
+ * replayed from the cache.  Metadata written by the entry is accounted for by
+ * making the megaflow depend on the whole of the original metadata. */
+static bool
+cache_entry_ok(struct flow_entry *entry, struct flow_wildcards *wc)
 {
-    struct flow_table *table, *next_table;
-    /*Modificaciones Boby UAH*/
-    char *aux;
+    struct ofl_instruction_header *inst;
+    bool has_goto = false;
+    size_t i, j;
+
+    for (i = 0; i < entry->stats->instructions_num; i++)
+    {
+        if (entry->stats->instructions[i]->type == OFPIT_GOTO_TABLE)
+        {
+            has_goto = true;
+        }
+    }
+    if (!has_goto)
+    {
+        return true;
+    }
+
+    for (i = 0; i < entry->stats->instructions_num; i++)
+    {
+        inst = entry->stats->instructions[i];
+        if (inst->type == OFPIT_APPLY_ACTIONS)
+        {
+            struct ofl_instruction_actions *ia = (struct ofl_instruction_actions *)inst;
+
+            /* Actions modifying the packet would change what the next
+             * tables see. */
+            for (j = 0; j < ia->actions_num; j++)
+            {
+                if (ia->actions[j]->type != OFPAT_OUTPUT &&
+                    ia->actions[j]->type != OFPAT_GROUP &&
+                    ia->actions[j]->type != OFPAT_SET_QUEUE)
+                {
+                    return false;
+                }
+            }
+        }
+        else if (inst->type == OFPIT_WRITE_METADATA)
+        {
+            flow_wildcards_add(wc, OXM_OF_METADATA, NULL);
+        }
+        else if (inst->type == OFPIT_METER ||
+                 inst->type == OFPIT_EXPERIMENTER)
+        {
+            /* A meter band may remark the packet depending on the rate,
+             * and experimenter instructions are opaque. */
+            return false;
+        }
+    }
+    return true;
+}
+
+/* The state of a packet in its traversal of the flow tables. */
+struct pipeline_slot
+{
+    struct packet *pkt;         /* NULL once the packet was consumed. */
+    struct flow_table *table;   /* Next table to look up, NULL at the end. */
+    struct flow_entry *entry;   /* Entry found by the last lookup. */
+
+    /* The cached traversal of the packet, copied from the cache as later
+     * lookups in a batch may replace the cache slot. */
+    struct flow_cache_key key;
+    bool cached;
+    size_t n_cached;
+    struct flow_entry *cached_entries[FLOW_CACHE_MAX_CHAIN];
+
+    /* The traversal so far, recorded for the cache on a cache miss. */
+    bool record;
+    size_t chain_len;
+    struct flow_entry *chain[FLOW_CACHE_MAX_CHAIN];
+    struct flow_wildcards wc;
+};
+
+/* Results of pipeline_slot_execute(). */
+enum pipeline_slot_state
+{
+    SLOT_NEXT_TABLE, /* The packet goes on to 'slot->table'. */
+    SLOT_DONE,       /* Only the action set of the packet remains. */
+    SLOT_CONSUMED    /* The packet was dropped or destroyed. */
+};
+
+/* Returns the flow cache of the calling thread. */
+static struct flow_cache *
+pipeline_cache(struct pipeline *pl)
+{
+    struct flow_cache *cache = dp_workers_flow_cache(&pl->cache);
+
+    return cache != NULL ? cache : &pl->cache;
+}
 
+/* Runs the checks that come before the flow tables on the packet.  Returns
+ * false if the packet was consumed. */
+static bool
+pipeline_admit(struct pipeline *pl, struct packet *pkt)
+{
     // if (pkt->buffer->size == 60 || pkt->buffer->size == 42)
     // {
     //     char *pkt_str = packet_to_string(pkt);
@@ -155,100 +253,326 @@ void pipeline_process_packet(struct pipeline *pl, struct packet *pkt)
     {
         send_packet_to_controller(pl, pkt, 0 /*table_id*/, OFPR_INVALID_TTL);
         packet_destroy(pkt);
-        return;
+        return false;
     }
 
     /*Modificacion UAH*/
     if (pkt->handle_std->proto->eth->eth_type == 56710)
     { /*quitar ipv6*/
         packet_destroy(pkt);
-        return;
+        return false;
     }
     //Insertamos la logica necesaria para AMARU
-    VLOG_INFO(LOG_MODULE, "pkt->handle_std->proto->eth->eth_type=%d\n", pkt->handle_std->proto->eth->eth_type);
+    TRACE(LOG_MODULE, "admit", "in_port %"PRIu64" eth_type 0x%04"PRIx64,
+          pkt->in_port, ntohs(pkt->handle_std->proto->eth->eth_type));
     if (pkt->handle_std->proto->eth->eth_type == ETH_TYPE_AMARU)
     {
-        VLOG_INFO(LOG_MODULE, "Entramos en mecanismo de AMARU\n");
+        TRACE(LOG_MODULE, "amaru_rx", "in_port %"PRIu64" level %"PRIu64,
+              pkt->in_port, pkt->handle_std->proto->amaru->level);
+        pthread_mutex_lock(&amaru_mutex);
         //comprobamos si la mac es valida para el switch
         if (validate_AMAC_in_switch(&table_AMAC, pkt->handle_std->proto->amaru->amac, pkt->in_port) == 0)
         {
-            VLOG_INFO(LOG_MODULE, "AMAC no valida para este switch\n");
+            TRACE(LOG_MODULE, "amaru_invalid", "in_port %"PRIu64,
+                  pkt->in_port);
+            pthread_mutex_unlock(&amaru_mutex);
             packet_destroy(pkt);
-            return;
+            return false;
         }
         else
         {
             //guardamos la direccion
             table_AMACS_add_AMAC(&table_AMAC, pkt->handle_std->proto->amaru->amac, pkt->handle_std->proto->amaru->level, pkt->in_port, time_msec());
             //visualizar_mac(&table_AMAC, pkt->dp->id);
-            visualizar_tabla_AMAC(&table_AMAC, pkt->dp->id);
-            VLOG_INFO(LOG_MODULE, "table_AMACS_add_AMAC-> Correctamente realizado\n");
+            amaru_log_table(&table_AMAC, pkt->dp->id);
+            TRACE(LOG_MODULE, "amaru_learn", "in_port %"PRIu64" level %"PRIu64,
+                  pkt->in_port, pkt->handle_std->proto->amaru->level);
             //volvemos a propagar
             packet_Amaru_send(pkt, OFPP_RANDOM);
-            VLOG_INFO(LOG_MODULE, "packet_Amaru_send-> Correctamente realizado\n");
         }
+        pthread_mutex_unlock(&amaru_mutex);
     }
 
     /*FIN Modificacion UAH*/
+    return true;
+}
+
+/* Starts the traversal of the packet in 'slot': parses the packet and looks
+ * for a cached traversal of it.  If there is none, the entries hit in the
+ * tables are recorded for the cache. */
+static void
+pipeline_slot_start(struct pipeline *pl, struct flow_cache *cache,
+                    struct pipeline_slot *slot, struct packet *pkt)
+{
+    const struct flow_cache_entry *cached;
+
+    slot->pkt = pkt;
+    slot->table = pl->tables[0];
+    slot->entry = NULL;
+
+    packet_handle_std_validate(pkt->handle_std);
+    flow_cache_key_init(&slot->key, &pkt->handle_std->key);
+    cached = flow_cache_lookup(cache, &slot->key);
+    slot->cached = (cached != NULL);
+    if (slot->cached)
+    {
+        slot->n_cached = cached->n_entries;
+        memcpy(slot->cached_entries, cached->entries,
+               cached->n_entries * sizeof *cached->entries);
+    }
+
+    slot->record = !slot->cached;
+    slot->chain_len = 0;
+    flow_wildcards_init(&slot->wc);
+}
+
+/* Caches the traversal recorded in 'slot' so far, and stops recording. */
+static void
+pipeline_slot_cache(struct flow_cache *cache, struct pipeline_slot *slot)
+{
+    flow_cache_insert(cache, &slot->key, slot->chain, slot->chain_len,
+                      &slot->wc);
+    slot->record = false;
+}
+
+/* Looks up the packet of 'slot' in its next table, or takes the entry of its
+ * cached traversal. */
+static void
+pipeline_slot_lookup(struct pipeline_slot *slot)
+{
+    struct flow_table *table = slot->table;
+    struct packet *pkt = slot->pkt;
+    struct flow_entry *entry;
+
+    VLOG_DBG_RL(LOG_MODULE, &rl, "trying table %u.", table->stats->table_id);
+
+    pkt->table_id = table->stats->table_id;
 
-    next_table = pl->tables[0];
-    while (next_table != NULL)
+    // EEDBEH: additional printout to debug table lookup
+    if (VLOG_IS_DBG_ENABLED(LOG_MODULE))
+    {
+        char *m = ofl_structs_match_to_string((struct ofl_match_header *)packet_handle_std_ofl_match(pkt->handle_std), pkt->dp->exp);
+        VLOG_DBG_RL(LOG_MODULE, &rl, "searching table entry for packet match: %s.", m);
+        free(m);
+    }
+    if (slot->cached && slot->chain_len < slot->n_cached &&
+        (slot->cached_entries[slot->chain_len] == NULL ||
+         slot->cached_entries[slot->chain_len]->table == table))
     {
-        struct flow_entry *entry;
+        entry = slot->cached_entries[slot->chain_len];
+        flow_table_count_lookup(table, entry, pkt);
+    }
+    else
+    {
+        slot->cached = false;
+        entry = flow_table_lookup(table, pkt, slot->record ? &slot->wc : NULL);
+    }
 
-        VLOG_DBG_RL(LOG_MODULE, &rl, "trying table %u.", next_table->stats->table_id);
+    if (slot->record)
+    {
+        if (slot->chain_len < FLOW_CACHE_MAX_CHAIN)
+        {
+            slot->chain[slot->chain_len] = entry;
+        }
+        else
+        {
+            slot->record = false;
+        }
+    }
+    slot->chain_len++;
+    slot->entry = entry;
+}
 
-        pkt->table_id = next_table->stats->table_id;
-        table = next_table;
-        next_table = NULL;
+/* Executes the instructions of the entry found by pipeline_slot_lookup(), or
+ * drops the packet on a table miss. */
+static enum pipeline_slot_state
+pipeline_slot_execute(struct pipeline *pl, struct flow_cache *cache,
+                      struct pipeline_slot *slot)
+{
+    struct flow_entry *entry = slot->entry;
 
-        // EEDBEH: additional printout to debug table lookup
+    slot->table = NULL;
+    if (entry != NULL)
+    {
+        TRACE(LOG_MODULE, "table_hit", "table %"PRIu64" priority %"PRIu64
+              " cookie 0x%"PRIx64" in_port %"PRIu64, entry->stats->table_id,
+              entry->stats->priority, entry->stats->cookie, slot->pkt->in_port);
         if (VLOG_IS_DBG_ENABLED(LOG_MODULE))
         {
-            char *m = ofl_structs_match_to_string((struct ofl_match_header *)&(pkt->handle_std->match), pkt->dp->exp);
-            VLOG_DBG_RL(LOG_MODULE, &rl, "searching table entry for packet match: %s.", m);
+            struct ofl_flow_stats *s = flow_entry_stats_snapshot(entry);
+            char *m = ofl_structs_flow_stats_to_string(s, slot->pkt->dp->exp);
+            VLOG_DBG_RL(LOG_MODULE, &rl, "found matching entry: %s.", m);
             free(m);
+            free(s);
+        }
+        if (slot->record && !cache_entry_ok(entry, &slot->wc))
+        {
+            /* The next tables may see another packet for the same key, so
+             * only the traversal up to this entry is cached. */
+            pipeline_slot_cache(cache, slot);
+        }
+        slot->pkt->handle_std->table_miss = is_table_miss(entry);
+        execute_entry(pl, entry, &slot->table, &slot->pkt);
+        /* Packet could be destroyed by a meter instruction */
+        if (!slot->pkt)
+        {
+            return SLOT_CONSUMED;
+        }
+
+        if (slot->table != NULL)
+        {
+            return SLOT_NEXT_TABLE;
         }
-        entry = flow_table_lookup(table, pkt);
-        if (entry != NULL)
+        if (slot->record)
+        {
+            pipeline_slot_cache(cache, slot);
+        }
+        return SLOT_DONE;
+    }
+    else
+    {
+        /* OpenFlow 1.3 default behavior on a table miss */
+        VLOG_DBG_RL(LOG_MODULE, &rl, "No matching entry found. Dropping packet.");
+        if (slot->record)
         {
-            /*Modificaciones Boby UAH*/
-            aux = ofl_structs_match_to_string((struct ofl_match_header *)&(pkt->handle_std->match), pkt->dp->exp);
-            VLOG_WARN(LOG_MODULE, "[PIPELINE PROCESS PACKET]: Match del paquete: %s", aux);
-            aux = ofl_structs_flow_stats_to_string(entry->stats, pkt->dp->exp);
-            VLOG_WARN(LOG_MODULE, "[PIPELINE PROCESS PACKET]: Entrada encontrada: %s", aux);
+            pipeline_slot_cache(cache, slot);
+        }
+        packet_destroy(slot->pkt);
+        slot->pkt = NULL;
+        return SLOT_CONSUMED;
+    }
+}
 
-            /*+++FIN+++*/
-            if (VLOG_IS_DBG_ENABLED(LOG_MODULE))
+/* Executes the action set of a packet that went through its last table. */
+static void
+pipeline_slot_finish(struct pipeline_slot *slot)
+{
+    /* Cookie field is set 0xffffffffffffffff
+    because we cannot associate it to any
+    particular flow */
+    action_set_execute(slot->pkt->action_set, slot->pkt, 0xffffffffffffffff);
+}
+
+/* Pass the packet through the flow tables.
+ * This function takes ownership of the packet and will destroy it. */
+void pipeline_process_packet(struct pipeline *pl, struct packet *pkt)
+{
+    struct flow_cache *cache;
+    struct pipeline_slot slot;
+
+    if (!pipeline_admit(pl, pkt))
+    {
+        return;
+    }
+
+    cache = pipeline_cache(pl);
+    pipeline_slot_start(pl, cache, &slot, pkt);
+    for (;;)
+    {
+        pipeline_slot_lookup(&slot);
+        switch (pipeline_slot_execute(pl, cache, &slot))
+        {
+        case SLOT_NEXT_TABLE:
+            break;
+        case SLOT_DONE:
+            pipeline_slot_finish(&slot);
+            return;
+        case SLOT_CONSUMED:
+            return;
+        }
+    }
+}
+
+/* Returns the table with the lowest id that a packet in 'slots' goes to next,
+ * or NULL if all of them are through. */
+static struct flow_table *
+pipeline_batch_next_table(const struct pipeline_slot *slots, size_t n_slots)
+{
+    struct flow_table *next = NULL;
+    size_t i;
+
+    for (i = 0; i < n_slots; i++)
+    {
+        struct flow_table *table = slots[i].table;
+
+        if (table != NULL &&
+            (next == NULL || table->stats->table_id < next->stats->table_id))
+        {
+            next = table;
+        }
+    }
+    return next;
+}
+
+/* Processes up to PIPELINE_MAX_BATCH packets, using 'slots'. */
+static void
+pipeline_process_slots(struct pipeline *pl, struct pipeline_slot *slots,
+                       struct packet **pkts, size_t n_pkts)
+{
+    struct flow_cache *cache = pipeline_cache(pl);
+    struct flow_table *table;
+    size_t n_slots, i;
+
+    /* Parse the packets and look for their cached traversals. */
+    n_slots = 0;
+    for (i = 0; i < n_pkts; i++)
+    {
+        if (pipeline_admit(pl, pkts[i]))
+        {
+            pipeline_slot_start(pl, cache, &slots[n_slots++], pkts[i]);
+        }
+    }
+
+    /* Each round takes the packets that go to the same table, first
+     * looking all of them up, then executing the instructions of their
+     * entries. */
+    while ((table = pipeline_batch_next_table(slots, n_slots)) != NULL)
+    {
+        for (i = 0; i < n_slots; i++)
+        {
+            if (slots[i].table == table)
             {
-                char *m = ofl_structs_flow_stats_to_string(entry->stats, pkt->dp->exp);
-                VLOG_DBG_RL(LOG_MODULE, &rl, "found matching entry: %s.", m);
-                free(m);
+                pipeline_slot_lookup(&slots[i]);
             }
-            pkt->handle_std->table_miss = is_table_miss(entry);
-            execute_entry(pl, entry, &next_table, &pkt);
-            /* Packet could be destroyed by a meter instruction */
-            if (!pkt)
-                return;
-
-            if (next_table == NULL)
+        }
+        for (i = 0; i < n_slots; i++)
+        {
+            if (slots[i].table == table)
             {
-                /* Cookie field is set 0xffffffffffffffff
-                because we cannot associate it to any
-                particular flow */
-                action_set_execute(pkt->action_set, pkt, 0xffffffffffffffff);
-                return;
+                pipeline_slot_execute(pl, cache, &slots[i]);
             }
         }
-        else
+    }
+
+    /* Execute the action sets of the packets that went through. */
+    for (i = 0; i < n_slots; i++)
+    {
+        if (slots[i].pkt != NULL)
         {
-            /* OpenFlow 1.3 default behavior on a table miss */
-            VLOG_DBG_RL(LOG_MODULE, &rl, "No matching entry found. Dropping packet.");
-            packet_destroy(pkt);
-            return;
+            pipeline_slot_finish(&slots[i]);
         }
     }
-    VLOG_WARN_RL(LOG_MODULE, &rl, "Reached outside of pipeline processing cycle.");
+}
+
+void pipeline_process_batch(struct pipeline *pl, struct packet **pkts,
+                            size_t n_pkts)
+{
+    /* Too large for the stack, and only used by one batch of a thread at a
+     * time. */
+    static THREAD_LOCAL struct pipeline_slot *slots;
+
+    if (slots == NULL)
+    {
+        slots = xmalloc(PIPELINE_MAX_BATCH * sizeof *slots);
+    }
+    while (n_pkts > 0)
+    {
+        size_t n = MIN(n_pkts, PIPELINE_MAX_BATCH);
+
+        pipeline_process_slots(pl, slots, pkts, n);
+        pkts += n;
+        n_pkts -= n;
+    }
 }
 
 static int inst_compare(const void *inst1, const void *inst2)
@@ -289,6 +613,7 @@ pipeline_handle_flow_mod(struct pipeline *pl, struct ofl_msg_flow_mod *msg,
 
     match_kept = false;
     insts_kept = false;
+    flow_cache_invalidate(&pl->cache);
     /*Sort by execution oder*/
     qsort(msg->instructions, msg->instructions_num,
           sizeof(struct ofl_instruction_header *), inst_compare);
@@ -447,7 +772,7 @@ pipeline_handle_stats_request_flow(struct pipeline *pl,
         dp_send_message(pl->dp, (struct ofl_msg_header *)&reply, sender);
     }
 
-    free(stats);
+    OFL_UTILS_FREE_ARR(stats, stats_num);
     ofl_msg_free((struct ofl_msg_header *)msg, pl->dp->exp);
     return 0;
 }
@@ -464,7 +789,14 @@ pipeline_handle_stats_request_table(struct pipeline *pl,
 
     for (i = 0; i < PIPELINE_TABLES; i++)
     {
-        stats[i] = pl->tables[i]->stats;
+        struct ofl_table_stats *src = pl->tables[i]->stats;
+
+        /* Worker threads keep counting lookups while the reply is built. */
+        stats[i] = xmalloc(sizeof(struct ofl_table_stats));
+        stats[i]->table_id      = src->table_id;
+        stats[i]->active_count  = src->active_count;
+        stats[i]->lookup_count  = __atomic_load_n(&src->lookup_count, __ATOMIC_RELAXED);
+        stats[i]->matched_count = __atomic_load_n(&src->matched_count, __ATOMIC_RELAXED);
     }
 
     {
@@ -478,7 +810,7 @@ pipeline_handle_stats_request_table(struct pipeline *pl,
         dp_send_message(pl->dp, (struct ofl_msg_header *)&reply, sender);
     }
 
-    free(stats);
+    OFL_UTILS_FREE_ARR(stats, PIPELINE_TABLES);
     ofl_msg_free((struct ofl_msg_header *)msg, pl->dp->exp);
     return 0;
 }
@@ -723,6 +1055,7 @@ void pipeline_destroy(struct pipeline *pl)
             flow_table_destroy(table);
         }
     }
+    flow_cache_destroy(&pl->cache);
     free(pl);
 }
 
@@ -734,6 +1067,31 @@ void pipeline_timeout(struct pipeline *pl)
     {
         flow_table_timeout(pl->tables[i]);
     }
+
+    if (VLOG_IS_DBG_ENABLED(LOG_MODULE))
+    {
+        struct ds ds = DS_EMPTY_INITIALIZER;
+
+        pipeline_format_cache_stats(pl, &ds);
+        VLOG_DBG(LOG_MODULE, "%s", ds_cstr(&ds));
+        ds_destroy(&ds);
+    }
+}
+
+void
+pipeline_format_cache_stats(struct pipeline *pl, struct ds *ds)
+{
+    struct flow_cache_stats stats;
+
+    memset(&stats, 0, sizeof stats);
+    flow_cache_add_stats(&pl->cache, &stats);
+    dp_workers_add_cache_stats(pl->dp, &stats);
+
+    /* The workers' caches are invalidated along with the main one. */
+    ds_put_format(ds, "flow cache: %" PRIu64 " hits, %" PRIu64 " megaflow hits, "
+                  "%" PRIu64 " misses, %" PRIu64 " invalidations, %zu megaflows.",
+                  stats.n_hits, stats.n_megaflow_hits, stats.n_misses,
+                  pl->cache.n_invalidations, stats.n_megaflows);
 }
 
 /* Executes the instructions associated with a flow entry */
@@ -775,17 +1133,17 @@ execute_entry(struct pipeline *pl, struct flow_entry *entry,
         case OFPIT_WRITE_METADATA:
         {
             struct ofl_instruction_write_metadata *wi = (struct ofl_instruction_write_metadata *)inst;
-            struct ofl_match_tlv *f;
+            uint64_t *metadata;
 
             /* NOTE: Hackish solution. If packet had multiple handles, metadata
                  *       should be updated in all. */
             packet_handle_std_validate((*pkt)->handle_std);
             /* Search field on the description of the packet. */
-            HMAP_FOR_EACH_WITH_HASH(f, struct ofl_match_tlv,
-                                    hmap_node, hash_int(OXM_OF_METADATA, 0), &(*pkt)->handle_std->match.match_fields)
+            metadata = (uint64_t *)packet_key_get(&(*pkt)->handle_std->key, OXM_OF_METADATA);
+            if (metadata != NULL)
             {
-                uint64_t *metadata = (uint64_t *)f->value;
                 *metadata = (*metadata & ~wi->metadata_mask) | (wi->metadata & wi->metadata_mask);
+                (*pkt)->handle_std->match_valid = false;
                 VLOG_DBG_RL(LOG_MODULE, &rl, "Executing write metadata: 0x%" PRIx64 "", *metadata);
             }
             break;
@@ -799,7 +1157,14 @@ execute_entry(struct pipeline *pl, struct flow_entry *entry,
         case OFPIT_APPLY_ACTIONS:
         {
             struct ofl_instruction_actions *ia = (struct ofl_instruction_actions *)inst;
-            dp_execute_action_list((*pkt), ia->actions_num, ia->actions, entry->stats->cookie);
+            /* The packet is dropped after the last instruction if it has
+             * neither a next table nor an action set. */
+            bool last = (i == entry->stats->instructions_num - 1 &&
+                         *next_table == NULL &&
+                         action_set_is_empty((*pkt)->action_set));
+
+            dp_execute_action_list((*pkt), ia->actions_num, ia->actions, entry->stats->cookie,
+                                   last);
             break;
         }
         case OFPIT_CLEAR_ACTIONS:
@@ -34,10 +34,13 @@
 
 #include "datapath.h"
 #include "packet.h"
+#include "flow_cache.h"
 #include "flow_table.h"
 #include "oflib/ofl.h"
 #include "oflib/ofl-messages.h"
 
+struct ds;
+
 /*Modificacion UAH*/
 extern struct table_AMACS table_AMAC;
 /*Fin Modificacion UAH*/
@@ -53,6 +56,7 @@ struct sender;
 struct pipeline {
     struct datapath    *dp;
     struct flow_table  *tables[PIPELINE_TABLES];
+    struct flow_cache   cache;   /* cache of pipeline traversals. */
 };
 
 
@@ -60,10 +64,22 @@ struct pipeline {
 struct pipeline *
 pipeline_create(struct datapath *dp);
 
+/* Maximum number of packets processed together by pipeline_process_batch();
+ * larger vectors are processed in several batches. */
+#define PIPELINE_MAX_BATCH 64
+
 /* Processes a packet in the pipeline. */
 void
 pipeline_process_packet(struct pipeline *pl, struct packet *pkt);
 
+/* Processes 'n_pkts' packets in the pipeline, stage by stage: all the packets
+ * are parsed, then looked up in table 0, then have the instructions of their
+ * entries executed, and so on for the tables they go to next, and at last have
+ * their action sets executed.  Takes ownership of the packets. */
+void
+pipeline_process_batch(struct pipeline *pl, struct packet **pkts,
+                        size_t n_pkts);
+
 
 /* Handles a flow_mod message. */
 ofl_err
@@ -105,6 +121,11 @@ pipeline_handle_stats_request_aggregate(struct pipeline *pl,
 void
 pipeline_timeout(struct pipeline *pl);
 
+/* Appends the counters of the flow caches, summed over the main thread and
+ * the workers, to 'ds'. */
+void
+pipeline_format_cache_stats(struct pipeline *pl, struct ds *ds);
+
 /* Detroys the pipeline. */
 void
 pipeline_destroy(struct pipeline *pl);
@@ -46,11 +46,17 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "amaru_log.h"
 #include "command-line.h"
 #include "daemon.h"
 #include "datapath.h"
+#include "dp_pool.h"
+#include "dp_workers.h"
+#include "dynamic-string.h"
 #include "fault.h"
 #include "openflow/openflow.h"
+#include "packet_parse.h"
+#include "pipeline.h"
 #include "poll-loop.h"
 #include "queue.h"
 #include "util.h"
@@ -79,6 +85,7 @@ static char *port_list;
 static char *local_port = "tap:";
 
 static void add_ports(struct datapath *dp, char *port_list);
+static char *format_stats(void *dp_);
 
 static bool use_multiple_connections = false;
 
@@ -139,6 +146,7 @@ int udatapath_cmd(int argc, char *argv[])
     //fin modificacion uah
 
     parse_options(dp, argc, argv);
+    packet_parse_init();
     signal(SIGPIPE, SIG_IGN);
 
     if (argc - optind < 1)
@@ -205,6 +213,7 @@ int udatapath_cmd(int argc, char *argv[])
     {
         OFP_FATAL(error, "could not listen for vlog connections");
     }
+    vlog_server_set_stats(format_stats, dp);
 
     die_if_already_running();
     daemonize();
@@ -224,7 +233,7 @@ int udatapath_cmd(int argc, char *argv[])
         table_AMACS_add_AMAC(&table_AMAC, AMAC, 1, ctrl_port, time_msec()); /*Modificacion Boby UAH*/ /*La AMAC inicial tiene nivel 1*/
 
         // visualizar_mac(&table_AMAC, dp->id);
-        visualizar_tabla_AMAC(&table_AMAC, dp->id);
+        amaru_log_table(&table_AMAC, dp->id);
         VLOG_INFO(THIS_MODULE, "table_AMACS_add_AMAC Correcto\n");
         //paquete amaru as root
         pkt_amaru_as_root = packet_Amaru_as_root(dp, ctrl_port, false); //He modificado el argumento de packet out a false
@@ -237,6 +246,10 @@ int udatapath_cmd(int argc, char *argv[])
     }
     /* FIN Modificacion UAH */
 
+    amaru_log_start();
+    /* The first run looks at the ports, before the workers use them. */
+    dp_run(dp);
+    dp_workers_start(dp);
     for (;;)
     {
         dp_run(dp);
@@ -279,6 +292,19 @@ add_ports(struct datapath *dp, char *port_list)
     }
 }
 
+/* Answers "vlogconf --stats". */
+static char *
+format_stats(void *dp_)
+{
+    struct datapath *dp = dp_;
+    struct ds ds = DS_EMPTY_INITIALIZER;
+
+    pipeline_format_cache_stats(dp->pipeline, &ds);
+    ds_put_char(&ds, '\n');
+    dp_pool_format_stats(&ds);
+    return ds_cstr(&ds);
+}
+
 static void
 parse_options(struct datapath *dp, int argc, char *argv[])
 {
@@ -291,7 +317,16 @@ parse_options(struct datapath *dp, int argc, char *argv[])
         OPT_SERIAL_NUM,
         OPT_BOOTSTRAP_CA_CERT,
         OPT_NO_LOCAL_PORT,
-        OPT_NO_SLICING
+        OPT_NO_SLICING,
+        OPT_PARSER,
+        OPT_RX_BURST,
+        OPT_MMAP,
+        OPT_XDP,
+        OPT_THREADS,
+        OPT_FANOUT,
+        OPT_AMARU_LOG,
+        OPT_AMARU_LOG_MODE,
+        OPT_AMARU_LOG_SIZE
     };
 
     static struct option long_options[] = {
@@ -304,6 +339,15 @@ parse_options(struct datapath *dp, int argc, char *argv[])
         {"help", no_argument, 0, 'h'},
         {"version", no_argument, 0, 'V'},
         {"no-slicing", no_argument, 0, OPT_NO_SLICING},
+        {"parser", required_argument, 0, OPT_PARSER},
+        {"rx-burst", required_argument, 0, OPT_RX_BURST},
+        {"mmap", required_argument, 0, OPT_MMAP},
+        {"xdp", required_argument, 0, OPT_XDP},
+        {"threads", required_argument, 0, OPT_THREADS},
+        {"fanout", required_argument, 0, OPT_FANOUT},
+        {"amaru-log", required_argument, 0, OPT_AMARU_LOG},
+        {"amaru-log-mode", required_argument, 0, OPT_AMARU_LOG_MODE},
+        {"amaru-log-size", required_argument, 0, OPT_AMARU_LOG_SIZE},
         {"mfr-desc", required_argument, 0, OPT_MFR_DESC},
         {"hw-desc", required_argument, 0, OPT_HW_DESC},
         {"sw-desc", required_argument, 0, OPT_SW_DESC},
@@ -316,6 +360,9 @@ parse_options(struct datapath *dp, int argc, char *argv[])
         {0, 0, 0, 0},
     };
     char *short_options = long_options_to_short_options(long_options);
+    const char *amaru_log_dir = NULL;
+    enum amaru_log_mode amaru_log_mode = AMARU_LOG_TEXT;
+    size_t amaru_log_size = AMARU_LOG_MAX_SIZE;
 
     for (;;)
     {
@@ -411,6 +458,106 @@ parse_options(struct datapath *dp, int argc, char *argv[])
             dp_set_max_queues(dp, 0);
             break;
 
+        case OPT_PARSER:
+            if (!packet_parse_set_parser(optarg))
+            {
+                ofp_fatal(0, "unknown or unavailable packet parser \"%s\"",
+                          optarg);
+            }
+            break;
+
+        case OPT_RX_BURST:
+        {
+            char *tail;
+            unsigned long int rx_burst = strtoul(optarg, &tail, 10);
+            if (*tail != '\0' || rx_burst < 1 || rx_burst > NETDEV_MAX_BATCH)
+            {
+                ofp_fatal(0, "--rx-burst argument must be between 1 and %d",
+                          NETDEV_MAX_BATCH);
+            }
+            dp_set_rx_burst(dp, rx_burst);
+            break;
+        }
+
+        case OPT_MMAP:
+        {
+            char *port, *save_ptr;
+            for (port = strtok_r(optarg, ",,", &save_ptr); port;
+                 port = strtok_r(NULL, ",,", &save_ptr))
+            {
+                dp_add_mmap_port(dp, port);
+            }
+            break;
+        }
+
+        case OPT_XDP:
+        {
+            char *port, *save_ptr;
+            for (port = strtok_r(optarg, ",,", &save_ptr); port;
+                 port = strtok_r(NULL, ",,", &save_ptr))
+            {
+                dp_add_xdp_port(dp, port);
+            }
+            break;
+        }
+
+        case OPT_THREADS:
+        {
+            char *tail;
+            unsigned long int n_workers = strtoul(optarg, &tail, 10);
+            if (*tail != '\0' || n_workers > DP_MAX_WORKERS)
+            {
+                ofp_fatal(0, "--threads argument must be between 0 and %d",
+                          DP_MAX_WORKERS);
+            }
+            dp_set_n_workers(dp, n_workers);
+            break;
+        }
+
+        case OPT_FANOUT:
+        {
+            char *port, *save_ptr;
+            for (port = strtok_r(optarg, ",,", &save_ptr); port;
+                 port = strtok_r(NULL, ",,", &save_ptr))
+            {
+                dp_add_fanout_port(dp, port);
+            }
+            break;
+        }
+
+        case OPT_AMARU_LOG:
+            amaru_log_dir = optarg;
+            break;
+
+        case OPT_AMARU_LOG_MODE:
+            if (!strcmp(optarg, "text"))
+            {
+                amaru_log_mode = AMARU_LOG_TEXT;
+            }
+            else if (!strcmp(optarg, "counters"))
+            {
+                amaru_log_mode = AMARU_LOG_COUNTERS;
+            }
+            else
+            {
+                ofp_fatal(0, "--amaru-log-mode argument must be \"text\" "
+                             "or \"counters\"");
+            }
+            break;
+
+        case OPT_AMARU_LOG_SIZE:
+        {
+            char *tail;
+            unsigned long int size = strtoul(optarg, &tail, 10);
+            if (*tail != '\0' || size < 1)
+            {
+                ofp_fatal(0, "--amaru-log-size argument must be a positive "
+                             "number of bytes");
+            }
+            amaru_log_size = size;
+            break;
+        }
+
             DAEMON_OPTION_HANDLERS
 
 #ifdef HAVE_OPENSSL
@@ -429,6 +576,11 @@ parse_options(struct datapath *dp, int argc, char *argv[])
         }
     }
     free(short_options);
+
+    if (amaru_log_dir != NULL)
+    {
+        amaru_log_init(amaru_log_dir, amaru_log_mode, amaru_log_size);
+    }
 }
 
 static void
@@ -450,6 +602,30 @@ usage(void)
            "  -m, --multiconn         enable multiple connections to the\n"
            "                          same controller.\n"
            "  --no-slicing            disable slicing\n"
+           "  --parser=PARSER         packet parser: native (default), netpdl,\n"
+           "                          nbee or check (nbee, verified by the\n"
+           "                          native and netpdl parsers)\n"
+           "  --rx-burst=N            receive up to N packets per port at a\n"
+           "                          time (default: %d)\n"
+           "  --mmap=NETDEV[,NETDEV]...\n"
+           "                          use PACKET_MMAP rings to receive and\n"
+           "                          send on the specified ports\n"
+           "  --xdp=NETDEV[,NETDEV]...\n"
+           "                          use AF_XDP sockets to receive and send\n"
+           "                          on the specified ports\n"
+           "  --threads=N             receive and process packets in N\n"
+           "                          worker threads (default: 0, in the\n"
+           "                          main thread)\n"
+           "  --fanout=NETDEV[,NETDEV]...\n"
+           "                          spread the packets received on the\n"
+           "                          specified ports over all the worker\n"
+           "                          threads\n"
+           "  --amaru-log=DIR         log the AMAC table and the AMARU packets\n"
+           "                          sent into files of DIR\n"
+           "  --amaru-log-mode=MODE   log events as text (default), or\n"
+           "                          counters as binary records\n"
+           "  --amaru-log-size=BYTES  rotate log files larger than BYTES\n"
+           "                          (default: %d)\n"
            "\nOther options:\n"
            "  -D, --detach            run in background as daemon\n"
            "  -P, --pidfile[=FILE]    create pidfile (default: %s/ofdatapath.pid)\n"
@@ -458,7 +634,7 @@ usage(void)
            "  -v, --verbose           set maximum verbosity level\n"
            "  -h, --help              display this help message\n"
            "  -V, --version           display version information\n",
-           ofp_rundir);
+           DP_RX_BURST, AMARU_LOG_MAX_SIZE, ofp_rundir);
     exit(EXIT_SUCCESS);
 }
 
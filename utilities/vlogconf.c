@@ -64,6 +64,11 @@ usage(char *prog_name, int exit_code)
            "        FACILITY may be 'syslog', 'console', 'file', or 'ANY' (default)\n"
            "        LEVEL may be 'emer', 'err', 'warn', 'info', or 'dbg' (default)\n"
            "  -r, --reopen       Make the program reopen its log file\n"
+           "  -T, --trace=MODULE[:on|:off]\n"
+           "        Turn the trace points of MODULE on (default) or off\n"
+           "        MODULE may be any valid module name or 'ANY'\n"
+           "  -d, --dump-trace   Print the latest records of the trace ring\n"
+           "  -S, --stats        Print the program's statistics\n"
            "  -h, --help         Print this helpful information\n",
            prog_name);
     exit(exit_code);
@@ -150,6 +155,9 @@ int main(int argc, char *argv[])
         {"list", no_argument, NULL, 'l'},
         {"set", required_argument, NULL, 's'},
         {"reopen", no_argument, NULL, 'r'},
+        {"trace", required_argument, NULL, 'T'},
+        {"dump-trace", no_argument, NULL, 'd'},
+        {"stats", no_argument, NULL, 'S'},
         {0, 0, 0, 0},
     };
     char *short_options;
@@ -216,6 +224,45 @@ int main(int argc, char *argv[])
             }
             break;
 
+        case 'T':
+            for (i = 0; i < n_clients; i++) {
+                struct vlog_client *client = clients[i];
+                char *request = xasprintf("trace %s", optarg);
+                transact_ack(client, request, &ok);
+                free(request);
+            }
+            break;
+
+        case 'd':
+            for (i = 0; i < n_clients; i++) {
+                struct vlog_client *client = clients[i];
+                char *reply;
+
+                printf("%s:\n", vlog_client_target(client));
+                reply = transact(client, "dump-trace", &ok);
+                fputs(reply, stdout);
+                free(reply);
+            }
+            break;
+
+        case 'S':
+            for (i = 0; i < n_clients; i++) {
+                struct vlog_client *client = clients[i];
+                char *reply;
+
+                printf("%s:\n", vlog_client_target(client));
+                reply = transact(client, "stats", &ok);
+                if (!strcmp(reply, "nak")) {
+                    fprintf(stderr, "%s: no statistics available\n",
+                            vlog_client_target(client));
+                    ok = false;
+                } else {
+                    fputs(reply, stdout);
+                }
+                free(reply);
+            }
+            break;
+
         case 'h':
             usage(argv[0], EXIT_SUCCESS);
             break;